@@ -1,6 +1,13 @@
 #ifndef __CLOUD_STORAGE_FILEDOWNLOAD_CONTEXT_HPP__
 #define __CLOUD_STORAGE_FILEDOWNLOAD_CONTEXT_HPP__
 
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
 namespace flkeeper {
 
 using namespace flkeeper;
@@ -10,78 +17,59 @@ namespace fs = std::experimental::filesystem;
 
 
 // 文件下载上下文
+// 只负责持有打开的文件描述符和请求的字节范围，真正的数据发送由
+// TcpConnection::sendFile通过sendfile(2)零拷贝完成
 class FileDownContext {
 public:
   FileDownContext(const std::string &filepath,
                   const std::string &originalFilename)
-      : filepath_(filepath), originalFilename_(originalFilename), fileSize_(0),
-        currentPosition_(0), isComplete_(false) {
-    // 获取文件大小
-    fileSize_ = fs::file_size(filepath_);
-
+      : filepath_(filepath), originalFilename_(originalFilename), fd_(-1),
+        fileSize_(0), rangeStart_(0), rangeLength_(0) {
     // 打开文件
-    file_.open(filepath_, std::ios::binary | std::ios::in);
-    if (!file_.is_open()) {
+    fd_ = ::open(filepath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
       LOG_ERROR << "Failed to open file: " << filepath_;
       throw std::runtime_error("Failed to open file: " + filepath_);
     }
+
+    // 获取文件大小, 以打开的描述符为准, 避免与路径上的文件不一致
+    struct stat st;
+    if (::fstat(fd_, &st) < 0) {
+      ::close(fd_);
+      LOG_ERROR << "Failed to stat file: " << filepath_;
+      throw std::runtime_error("Failed to stat file: " + filepath_);
+    }
+    fileSize_ = static_cast<uintmax_t>(st.st_size);
+    rangeLength_ = fileSize_;
     LOG_INFO << "Opening file for download: " << filepath_
              << ", size: " << fileSize_;
   }
 
   ~FileDownContext() {
-    if (file_.is_open()) {
-      file_.close();
-    }
-  }
-
-  void seekTo(uintmax_t position) {
-    if (!file_.is_open()) {
-      throw std::runtime_error("File is not open: " + filepath_);
+    if (fd_ >= 0) {
+      ::close(fd_);
     }
-    file_.seekg(position);
-    currentPosition_ = position;
-    isComplete_ = false;
   }
 
-  // @brief 从文件中读取下一个数据块,用于将文件分块传输给客户端
-  bool readNextChunk(std::string &chunk) {
-    if (!file_.is_open() || isComplete_) {
-      return false;
-    }
-
-    const uintmax_t chunkSize = 1024 * 1024; // 1MB
-    uintmax_t remainingBytes = fileSize_ - currentPosition_;
-    uintmax_t bytesToRead = std::min(chunkSize, remainingBytes);
-
-    if (bytesToRead == 0) {
-      isComplete_ = true;
-      return false;
-    }
-
-    std::vector<char> buffer(bytesToRead);
-    file_.read(buffer.data(), bytesToRead);
-    chunk.assign(buffer.data(), bytesToRead);
-    currentPosition_ += bytesToRead;
-
-    LOG_INFO << "Read chunk of " << bytesToRead
-             << " bytes, current position: " << currentPosition_ << "/"
-             << fileSize_;
-    return true;
+  // @brief 设置要发送的字节范围[start, end], 调用者需保证start <= end < fileSize
+  void setRange(uintmax_t start, uintmax_t end) {
+    rangeStart_ = start;
+    rangeLength_ = end - start + 1;
   }
 
-  bool isComplete() const { return isComplete_; }
-  uintmax_t getCurrentPosition() const { return currentPosition_; }
+  int fd() const { return fd_; }
+  uintmax_t rangeStart() const { return rangeStart_; }
+  uintmax_t rangeLength() const { return rangeLength_; }
   uintmax_t getFileSize() const { return fileSize_; }
   const std::string &getOriginalFilename() const { return originalFilename_; }
 
 private:
   std::string filepath_;         // 文件路径
   std::string originalFilename_; // 原始文件名
-  std::ifstream file_;           // 文件流
+  int fd_;                       // 文件描述符
   uintmax_t fileSize_;           // 文件总大小，使用 uintmax_t 替代 size_t
-  uintmax_t currentPosition_;    // 当前读取位置，使用 uintmax_t 替代 size_t
-  bool isComplete_;              // 是否完成
+  uintmax_t rangeStart_;         // 发送范围的起始偏移
+  uintmax_t rangeLength_;        // 发送范围的长度
 };
 
 }   // namespace flkeeper
@@ -7,13 +7,18 @@
 #ifndef __CLOUD_STORAGE_FILEUPLOAD_CONTEXT_HPP__
 #define __CLOUD_STORAGE_FILEUPLOAD_CONTEXT_HPP__
 
+#include "network/EventLoop.hpp"
 #include "utils/log/Logging.hpp"
 #include <nlohmann/json.hpp>
 
 #include <cstdio>
+#include <cstring>
+#include <errno.h>
 #include <experimental/filesystem>
-#include <fstream>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <mysql/mysql.h>
 #include <string>
 #include <unistd.h>
@@ -25,19 +30,15 @@ using namespace flkeeper::log;
 using json = nlohmann::json;
 namespace fs = std::experimental::filesystem;
 
-class FileUploadContext {
+class FileUploadContext
+    : public std::enable_shared_from_this<FileUploadContext> {
 public:
-  enum class State {
-    kExpectHeaders,  // 等待头部
-    kExpectContent,  // 等待文件内容
-    kExpectBoundary, // 等待边界
-    kComplete        // 上传完成
-  };
-
   FileUploadContext(const std::string &filename,
                     const std::string &originalFilename)
-      : filename_(filename), originalFilename_(originalFilename),
-        totalBytes_(0), state_(State::kExpectHeaders), boundary_("") {
+      : filename_(filename), originalFilename_(originalFilename), fd_(-1),
+        totalBytes_(0), loop_(nullptr), nextOffset_(0), pendingWrites_(0),
+        pendingBytes_(0), highWaterMark_(0), lowWaterMark_(0),
+        writePaused_(false), writeFailed_(false) {
     // 确保目录存在
     fs::path filePath(filename_);
     fs::path dir = filePath.parent_path();
@@ -46,8 +47,9 @@ public:
     }
 
     // 打开文件
-    file_.open(filename_, std::ios::binary | std::ios::out);
-    if (!file_.is_open()) {
+    fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644);
+    if (fd_ < 0) {
       LOG_ERROR << "Failed to open file: " << filename;
       throw std::runtime_error("Failed to open file: " + filename);
     }
@@ -56,41 +58,148 @@ public:
   }
 
   ~FileUploadContext() {
-    if (file_.is_open()) {
-      file_.close();
+    if (fd_ >= 0) {
+      ::close(fd_);
     }
   }
 
   void writeData(const char *data, size_t len) {
-    if (!file_.is_open()) {
+    if (fd_ < 0) {
       throw std::runtime_error("File is not open: " + filename_);
     }
-
-    if (!file_.write(data, len)) {
-      throw std::runtime_error("Failed to write to file: " + filename_);
+    if (loop_) {
+      writeDataAsync(data, len);
+      return;
     }
 
-    file_.flush(); // 确保数据写入磁盘
+    // 直接写入内核, 不再经过ofstream的用户态缓冲
+    size_t written = 0;
+    while (written < len) {
+      ssize_t n = ::write(fd_, data + written, len - written);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("Failed to write to file: " + filename_);
+      }
+      written += n;
+    }
     totalBytes_ += len;
     // LOG_INFO << "Wrote " << len << " bytes, total: " << totalBytes_;
   }
 
+  /**
+   * @brief 设置执行异步写的EventLoop, 之后的writeData不再阻塞loop线程
+   * 数据被复制一份后通过EventLoop::asyncWrite按显式偏移提交, 多个写可以同时
+   * 进行; 使用io_uring时由内核完成写入, 否则退化为同步pwrite
+   * @note 上下文必须由std::shared_ptr管理
+   */
+  void setLoop(network::EventLoop *loop) { loop_ = loop; }
+
+  // @brief 尚未完成的异步写数量
+  size_t pendingWrites() const { return pendingWrites_; }
+  // @brief 尚未落盘的异步写字节数
+  size_t pendingBytes() const { return pendingBytes_; }
+
+  /**
+   * @brief 设置异步写的背压水位
+   * 未落盘的字节数达到highWaterMark时调用cb(true), 之后降到lowWaterMark
+   * 以下时调用cb(false); 调用者据此暂停/恢复读取对端数据, 磁盘跟不上时
+   * 上传数据不会在内存中无限堆积
+   */
+  void setWatermarks(size_t highWaterMark, size_t lowWaterMark,
+                     std::function<void(bool)> cb) {
+    highWaterMark_ = highWaterMark;
+    lowWaterMark_ = lowWaterMark;
+    watermarkCallback_ = std::move(cb);
+  }
+  // @brief 是否有异步写失败
+  bool writeFailed() const { return writeFailed_; }
+
+  // @brief 所有异步写完成后调用一次cb, 没有未完成的写时立即调用
+  void whenDrained(std::function<void()> cb) {
+    if (pendingWrites_ == 0) {
+      cb();
+    } else {
+      drainedCallback_ = std::move(cb);
+    }
+  }
+
+  // @brief 记录绕过writeData直接写入文件的字节数(例如splice)
+  void addWrittenBytes(uintmax_t len) { totalBytes_ += len; }
+
+  int fd() const { return fd_; }
+
   uintmax_t getTotalBytes() const { return totalBytes_; }
   const std::string &getFilename() const { return filename_; }
   const std::string &getOriginalFilename() const { return originalFilename_; }
 
-  void setBoundary(const std::string &boundary) { boundary_ = boundary; }
-  State getState() const { return state_; }
-  void setState(State state) { state_ = state; }
-  const std::string &getBoundary() const { return boundary_; }
-
 private:
+  void writeDataAsync(const char *data, size_t len) {
+    auto holder = std::make_shared<std::string>(data, len);
+    off_t offset = static_cast<off_t>(nextOffset_);
+    nextOffset_ += len;
+    totalBytes_ += len;
+    submitWrite(holder, 0, offset);
+  }
+
+  void submitWrite(const std::shared_ptr<std::string> &holder, size_t done,
+                   off_t offset) {
+    ++pendingWrites_;
+    pendingBytes_ += holder->size() - done;
+    if (highWaterMark_ > 0 && !writePaused_ &&
+        pendingBytes_ >= highWaterMark_ && watermarkCallback_) {
+      writePaused_ = true;
+      watermarkCallback_(true);
+    }
+    auto self = shared_from_this();
+    loop_->asyncWrite(
+        fd_, holder->data() + done, holder->size() - done, offset + done,
+        [self, holder, done, offset](ssize_t n) {
+          self->onWriteComplete(holder, done, offset, n);
+        });
+  }
+
+  void onWriteComplete(const std::shared_ptr<std::string> &holder,
+                       size_t done, off_t offset, ssize_t n) {
+    --pendingWrites_;
+    pendingBytes_ -= holder->size() - done;
+    if (n == -EINTR || n == -EAGAIN) {
+      n = 0;
+    } else if (n < 0 || (n == 0 && done < holder->size())) {
+      LOG_ERROR << "Failed to write to file: " << filename_ << ", "
+                << strerror(n < 0 ? static_cast<int>(-n) : EIO);
+      writeFailed_ = true;
+    }
+    if (!writeFailed_ && done + n < holder->size()) {
+      // 短写, 继续提交剩余部分
+      submitWrite(holder, done + n, offset);
+    }
+    if (writePaused_ && pendingBytes_ <= lowWaterMark_) {
+      writePaused_ = false;
+      watermarkCallback_(false);
+    }
+    if (pendingWrites_ == 0 && drainedCallback_) {
+      std::function<void()> cb;
+      cb.swap(drainedCallback_);
+      cb();
+    }
+  }
+
   std::string filename_;         // 保存在服务器上的文件名
   std::string originalFilename_; // 原始文件名
-  std::ofstream file_;
+  int fd_;                       // 文件描述符
   uintmax_t totalBytes_;
-  State state_;          // 当前状态
-  std::string boundary_; // multipart边界
+  network::EventLoop *loop_;        // 异步写所在的loop, nullptr表示同步写
+  uintmax_t nextOffset_;            // 下一次异步写的文件偏移
+  size_t pendingWrites_;            // 未完成的异步写数量
+  size_t pendingBytes_;             // 未完成的异步写字节数
+  size_t highWaterMark_;            // 暂停读取的水位, 0表示不限制
+  size_t lowWaterMark_;             // 恢复读取的水位
+  bool writePaused_;                // 是否已经通知暂停
+  std::function<void(bool)> watermarkCallback_; // 水位变化回调
+  bool writeFailed_;                // 是否有异步写失败
+  std::function<void()> drainedCallback_; // 异步写全部完成后的回调
 };
 
 }   // namespace flkeeper
@@ -10,12 +10,14 @@
 #include "network/http/HttpContext.hpp"
 #include "network/http/HttpRequest.hpp"
 #include "network/http/HttpResponse.hpp"
+#include "network/http/HttpResponseWriter.hpp"
 #include "network/http/HttpServer.hpp"
 #include "utils/log/Logging.hpp"
 #include "utils/thread/ThreadPool.hpp"
 #include <nlohmann/json.hpp>
 #include <atomic>
 #include <cstdio>
+#include <cstring>
 #include <experimental/filesystem>
 #include <fstream>
 #include <functional>
@@ -46,6 +48,10 @@ namespace fs = std::experimental::filesystem;
 
 class HttpUploadHandler {
 private:
+  // 上传数据尚未落盘的字节数超过高水位时暂停读取该连接, 降到低水位以下恢复
+  static const size_t kUploadHighWaterMark = 16 * 1024 * 1024;
+  static const size_t kUploadLowWaterMark = 4 * 1024 * 1024;
+
   ThreadPool threadPool_;           // 线程池
   std::string uploadDir_;           // 上传目录
   std::string mappingFile_;         // 文件名映射文件
@@ -54,8 +60,7 @@ private:
   std::map<std::string, std::string>
       filenameMapping_; // 文件名映射 <服务器文件名, 原始文件名>
 
-  // MySQL连接
-  MYSQL *mysql;
+  // MySQL连接参数, 连接本身每个线程各有一条, 见connection()
   std::string dbHost;
   std::string dbUser;
   std::string dbPassword;
@@ -83,12 +88,37 @@ private:
   // 路由表
   std::vector<RoutePattern> routes_;
 
-  // 初始化数据库连接
-  bool initDatabase() {
-    mysql = mysql_init(NULL);
+  // 一个线程的MySQL连接, 线程退出时关闭
+  struct ThreadConnection {
+    MYSQL *mysql = NULL;
+    ~ThreadConnection() {
+      if (mysql) {
+        mysql_close(mysql);
+        mysql_thread_end();
+      }
+    }
+  };
+
+  /**
+   * @brief 当前线程的MySQL连接, 第一次使用时建立, 失败时返回NULL并在下次
+   * 调用时重试
+   * @note 请求在多个IO线程中并发处理, 同一条连接上的mysql_query、
+   * mysql_store_result和mysql_insert_id不能交错, 所以每个线程各用一条连接
+   */
+  MYSQL *connection() {
+    static thread_local ThreadConnection t_connection;
+    if (!t_connection.mysql) {
+      t_connection.mysql = connectDatabase();
+    }
+    return t_connection.mysql;
+  }
+
+  // 建立一条数据库连接
+  MYSQL *connectDatabase() {
+    MYSQL *mysql = mysql_init(NULL);
     if (!mysql) {
       LOG_ERROR << "MySQL初始化失败";
-      return false;
+      return NULL;
     }
 
     if (!mysql_real_connect(mysql, dbHost.c_str(), dbUser.c_str(),
@@ -96,30 +126,26 @@ private:
                             0)) {
       LOG_ERROR << "连接到MySQL服务器失败: " << mysql_error(mysql);
       mysql_close(mysql);
-      mysql = NULL;
-      return false;
+      return NULL;
     }
 
     // 设置字符集为utf8
     if (mysql_set_character_set(mysql, "utf8") != 0) {
       LOG_ERROR << "设置字符集失败: " << mysql_error(mysql);
-      return false;
+      mysql_close(mysql);
+      return NULL;
     }
 
     LOG_INFO << "数据库连接成功";
-    return true;
+    return mysql;
   }
 
-  // 关闭数据库连接
-  void closeDatabase() {
-    if (mysql) {
-      mysql_close(mysql);
-      mysql = NULL;
-    }
-  }
+  // 初始化数据库连接, 在构造线程上检查数据库是否可用
+  bool initDatabase() { return connection() != NULL; }
 
   // 执行SQL查询
   bool executeQuery(const std::string &query) {
+    MYSQL *mysql = connection();
     if (!mysql) {
       LOG_ERROR << "数据库未连接";
       return false;
@@ -137,7 +163,7 @@ private:
     if (!executeQuery(query)) {
       return NULL;
     }
-    return mysql_store_result(mysql);
+    return mysql_store_result(connection());
   }
 
 public:
@@ -149,7 +175,7 @@ public:
       : threadPool_("UploadHandler"), uploadDir_("uploads"),
         mappingFile_("uploads/filename_mapping.json"), activeRequests_(0),
         dbHost(dbHost), dbUser(dbUser), dbPassword(dbPassword), dbName(dbName),
-        dbPort(dbPort), mysql(NULL) {
+        dbPort(dbPort) {
     threadPool_.start(numThreads);
 
     // 创建上传目录
@@ -169,20 +195,21 @@ public:
     initRoutes();
   }
 
+  // @brief 工作线程池, 可以在运行期间resize或绑定CPU
+  ThreadPool &workerPool() { return threadPool_; }
+
   ~HttpUploadHandler() {
     threadPool_.stop();
     // 保存文件名映射
     saveFilenameMapping();
-    closeDatabase();
   }
 
   void onConnection(const TcpConnectionPtr &conn) {
     if (conn->connected()) {
-      LOG_INFO << "New connection from " << conn->peerAddress().toIpPort();
-      // 为每个新连接创建一个 HttpContext
-      conn->setContext(std::make_shared<HttpContext>());
+      // HttpServer已经为新连接创建了HttpContext
+      LOG_DEBUG << "New connection from " << conn->peerAddress().toIpPort();
     } else {
-      LOG_INFO << "Connection closed from " << conn->peerAddress().toIpPort();
+      LOG_DEBUG << "Connection closed from " << conn->peerAddress().toIpPort();
       // 清理上下文
       if (auto context =
               std::static_pointer_cast<HttpContext>(conn->getContext())) {
@@ -241,13 +268,69 @@ public:
     } catch (const std::exception &e) {
       LOG_ERROR << "Error processing request: " << e.what();
       sendError(resp, "Internal Server Error",
-                HttpResponse::k500InternalServerError, conn);
+                HttpResponse::k500InternalServerError);
       return true;
     }
   }
 
+  /**
+   * @brief 请求头部解析完成、请求体尚未处理时调用
+   * @return 返回true表示请求体已经由处理器接管(PUT /upload/raw)
+   */
+  bool onHeaders(const TcpConnectionPtr &conn, HttpRequest &req) {
+    if (req.method() == HttpRequest::kPut && req.path() == "/upload/raw") {
+      return handleRawUpload(conn, req);
+    }
+    return false;
+  }
+
+  /**
+   * @brief 请求头部解析完成后, 为需要流式接收请求体的请求创建接收器
+   * @return POST /upload返回multipart接收器, chunked编码的PUT /upload/raw
+   * 返回原始上传的接收器(带Content-Length的已经由onHeaders通过splice接管),
+   * 其余请求返回空
+   */
+  std::shared_ptr<HttpBodySink> createBodySink(const TcpConnectionPtr &conn,
+                                               HttpRequest &req) {
+    bool multipart =
+        req.method() == HttpRequest::kPost && req.path() == "/upload";
+    bool raw = req.method() == HttpRequest::kPut && req.path() == "/upload/raw";
+    if (!multipart && !raw) {
+      return nullptr;
+    }
+    std::string sessionId = req.getHeader("X-Session-ID");
+    int userId;
+    std::string usernameFromSession;
+    if (!validateSession(sessionId, userId, usernameFromSession)) {
+      return std::make_shared<UploadBodySink>(
+          this, HttpResponse::k401Unauthorized, "未登录或会话已过期");
+    }
+    if (raw) {
+      LOG_INFO << "Chunked raw upload";
+      return std::make_shared<UploadBodySink>(this, conn, userId, "",
+                                              req.getHeader("X-File-Name"));
+    }
+
+    // 解析 multipart/form-data 边界
+    std::string contentType = req.getHeader("Content-Type");
+    if (contentType.empty()) {
+      return std::make_shared<UploadBodySink>(
+          this, HttpResponse::k400BadRequest, "Content-Type header is missing");
+    }
+    std::regex boundaryRegex("boundary=\"?([^\";]+)\"?");
+    std::smatch matches;
+    if (!std::regex_search(contentType, matches, boundaryRegex)) {
+      return std::make_shared<UploadBodySink>(
+          this, HttpResponse::k400BadRequest, "Invalid Content-Type");
+    }
+    std::string boundary = "--" + matches[1].str();
+    LOG_INFO << "Boundary: " << boundary;
+    return std::make_shared<UploadBodySink>(
+        this, conn, userId, boundary, req.getHeader("X-File-Name"));
+  }
+
 private:
-  bool handleIndex(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleIndex(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                    HttpResponse *resp) {
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
@@ -277,7 +360,7 @@ private:
     if (!file.is_open()) {
       LOG_ERROR << "Failed to open " << filePath;
       sendError(resp, "Failed to open " + filePath,
-                HttpResponse::k500InternalServerError, conn);
+                HttpResponse::k500InternalServerError);
       return true;
     }
 
@@ -285,309 +368,378 @@ private:
                      std::istreambuf_iterator<char>());
     file.close();
 
-    resp->addHeader("Connection", "close");
-    resp->setBody(html);
+    resp->setBody(std::move(html));
 
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
     return true;
   }
 
   /**
-   * @brief 处理HTTP POST请求中的文件上传操作, 需要验证用户的会话session
-   * conn 解析请求中的文件信息,创建或使用已有的上传上下文,将文件内容分块写入文件
-   * 并在文件上传完成之后进行相应的处理
-   * @param conn 客户端的TCP连接指针
-   * @param req 客户端的HTTP请求
-   * @note 传大文件时,客户端将文件分割成多数据块进行传入,服务器端也要相应的分块处理, 可以通过解析multipart/form-data的边界
-   * 来实现对文件的分块处理. 具体的, 在接收到上传请求的时,该函数会从请求的Content-Type头部中提取出边界字符串,根据边界字符串,函数
-   * 判断数据块的开始和结束位置,将文件数据分块写入到文件中
+   * @brief POST /upload没有请求体时的处理; 带请求体的上传在头部解析完成后
+   * 由createBodySink创建的UploadBodySink流式接收, 不会走到这里
    */
   bool handleFileUpload(const TcpConnectionPtr &conn, HttpRequest &req,
                         HttpResponse *resp) {
-    // 验证会话
-    std::string sessionId = req.getHeader("X-Session-ID");
-    int userId;
-    std::string usernameFromSession;
+    sendError(resp, "Request body is empty", HttpResponse::k400BadRequest);
+    return true;
+  }
 
-    // 验证Session会话是否过期,判断会话的有效性
-    if (!validateSession(sessionId, userId, usernameFromSession)) {
-      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized,
-                conn);
-      return true;
+  /**
+   * @brief 上传请求的请求体接收器, 请求体直接从连接的输入缓冲区写入文件,
+   * 不会在内存中累积
+   * 1. POST /upload: 边接收边解析multipart/form-data, 只保存第一个part;
+   *    跨越两次数据到达的边界通过保留末尾不足一个分隔符长度的数据来识别
+   * 2. PUT /upload/raw且请求体是chunked编码(没有Content-Length, 不能splice):
+   *    boundary为空, 解码后的请求体就是文件内容
+   * @note 会话或请求头无效时构造为拒绝请求的接收器, 收到第一段请求体时
+   * 放弃请求并返回错误, 不必读完整个请求体
+   */
+  class UploadBodySink : public HttpBodySink {
+  public:
+    UploadBodySink(HttpUploadHandler *handler,
+                   HttpResponse::HttpStatusCode code, const std::string &error)
+        : handler_(handler), userId_(0), state_(kExpectPartHeaders),
+          errorCode_(code), error_(error) {}
+
+    UploadBodySink(HttpUploadHandler *handler, const TcpConnectionPtr &conn,
+                   int userId, const std::string &boundary,
+                   const std::string &headerFilename)
+        : handler_(handler), conn_(conn), userId_(userId),
+          headerFilename_(headerFilename), state_(kExpectPartHeaders),
+          errorCode_(HttpResponse::kUnknown) {
+      if (boundary.empty()) {
+        std::string originalFilename =
+            headerFilename_.empty() ? "unknown_file"
+                                    : handler_->urlDecode(headerFilename_);
+        if (openFile(originalFilename)) {
+          state_ = kExpectContent;
+        }
+      } else {
+        delimiter_ = "\r\n" + boundary;
+      }
     }
 
-    // 获取 HttpContext
-    auto httpContext =
-        std::static_pointer_cast<HttpContext>(conn->getContext());
-    if (!httpContext) {
-      LOG_ERROR << "HttpContext is null";
-      sendError(resp, "Internal Server Error",
-                HttpResponse::k500InternalServerError, conn);
+    bool onBodyChunk(const char *data, size_t len) override {
+      if (!error_.empty()) {
+        return false;
+      }
+      try {
+        if (state_ == kExpectPartHeaders) {
+          return parsePartHeaders(data, len);
+        }
+        if (state_ == kExpectContent) {
+          feedContent(data, len);
+        }
+        // kComplete: 结束边界之后的内容忽略
+      } catch (const std::exception &e) {
+        LOG_ERROR << "Error processing data chunk: " << e.what();
+        fail(HttpResponse::k500InternalServerError, "Failed to process data");
+        return false;
+      }
       return true;
     }
-    LOG_INFO << "body.size() = " << req.body().size();
-    // 尝试获取已存在的上传上下文
-    std::shared_ptr<FileUploadContext> uploadContext =
-        httpContext->getContext<FileUploadContext>();
-
-    if (!uploadContext) {
-      // 解析 multipart/form-data 边界
-      std::string contentType = req.getHeader("Content-Type");
-      if (contentType.empty()) {
-        sendError(resp, "Content-Type header is missing",
-                  HttpResponse::k400BadRequest, conn);
+
+    bool onBodyEnd(const TcpConnectionPtr &conn, HttpRequest &req,
+                   HttpResponse *resp) override {
+      if (delimiter_.empty() && state_ == kExpectContent) {
+        // 原始上传的请求体收完就是文件结束
+        state_ = kComplete;
+      }
+      if (error_.empty() && state_ != kComplete) {
+        fail(HttpResponse::k400BadRequest, "Incomplete multipart body");
+      }
+      if (!error_.empty()) {
+        if (uploadContext_) {
+          ::unlink(uploadContext_->getFilename().c_str());
+        }
+        sendError(resp, error_, errorCode_);
         return true;
       }
+      if (uploadContext_->pendingWrites() > 0) {
+        // 还有写入在进行, 等全部落盘后再记录并响应
+        HttpUploadHandler *handler = handler_;
+        std::shared_ptr<FileUploadContext> uploadContext = uploadContext_;
+        int userId = userId_;
+        std::weak_ptr<TcpConnection> weakConn(conn);
+        uploadContext->whenDrained([handler, weakConn, uploadContext,
+                                    userId]() {
+          TcpConnectionPtr connection = weakConn.lock();
+          if (!connection) {
+            return;
+          }
+          auto context =
+              std::static_pointer_cast<HttpContext>(connection->getContext());
+          HttpResponse response(!context || context->closeAfterResponse());
+          handler->finishUpload(uploadContext, userId, &response);
+          if (context) {
+            context->reset();
+          }
+          sendResponseNow(connection, response);
+        });
+        return false;
+      }
+      handler_->finishUpload(uploadContext_, userId_, resp);
+      return true;
+    }
 
-      std::regex boundaryRegex("boundary=(.+)$");
-      std::smatch matches;
-      if (!std::regex_search(contentType, matches, boundaryRegex)) {
-        sendError(resp, "Invalid Content-Type", HttpResponse::k400BadRequest,
-                  conn);
+    void onAbort() override {
+      if (uploadContext_) {
+        LOG_INFO << "Upload aborted, removing "
+                 << uploadContext_->getFilename();
+        ::unlink(uploadContext_->getFilename().c_str());
+      }
+    }
+
+  private:
+    enum State {
+      kExpectPartHeaders, // 等待第一个part的头部
+      kExpectContent,     // 正在写入文件内容
+      kComplete           // 文件内容已经结束
+    };
+
+    // part头部的最大长度
+    static const size_t kMaxPartHeaders = 16 * 1024;
+
+    void fail(HttpResponse::HttpStatusCode code, const std::string &error) {
+      errorCode_ = code;
+      error_ = error;
+    }
+
+    // 积累第一个part的头部, 完整之后创建文件, 头部之后的数据作为文件内容
+    bool parsePartHeaders(const char *data, size_t len) {
+      size_t searchFrom = partHeaders_.size() < 3 ? 0 : partHeaders_.size() - 3;
+      partHeaders_.append(data, len);
+      size_t pos = partHeaders_.find("\r\n\r\n", searchFrom);
+      if (pos == std::string::npos) {
+        if (partHeaders_.size() > kMaxPartHeaders) {
+          fail(HttpResponse::k400BadRequest, "Multipart headers too large");
+          return false;
+        }
         return true;
       }
-      std::string boundary = "--" + matches[1].str();
-      LOG_INFO << "Boundary: " << boundary;
 
-      try {
-        // 获取原始文件名
-        std::string originalFilename;
-
-        // 首先尝试从X-File-Name头部获取文件名
-        std::string headerFilename = req.getHeader("X-File-Name");
-        if (!headerFilename.empty()) {
-          originalFilename = urlDecode(headerFilename);
-          LOG_INFO << "Got filename from X-File-Name header: "
+      std::string originalFilename;
+      if (!headerFilename_.empty()) {
+        originalFilename = handler_->urlDecode(headerFilename_);
+        LOG_INFO << "Got filename from X-File-Name header: "
+                 << originalFilename;
+      } else {
+        std::regex filenameRegex("Content-Disposition:.*filename=\"([^\"]+)\"");
+        std::smatch matches;
+        std::string headers = partHeaders_.substr(0, pos);
+        if (std::regex_search(headers, matches, filenameRegex)) {
+          originalFilename = matches[1].str();
+          LOG_INFO << "Got filename from Content-Disposition: "
                    << originalFilename;
         } else {
-          // 从Content-Disposition头中获取文件名
-          std::string body = req.body();
-          if (body.empty()) {
-            sendError(resp, "Request body is empty",
-                      HttpResponse::k400BadRequest, conn);
-            return true;
-          }
-
-          std::regex filenameRegex(
-              "Content-Disposition:.*filename=\"([^\"]+)\"");
-          if (std::regex_search(body, matches, filenameRegex) &&
-              matches[1].matched) {
-            originalFilename = matches[1].str();
-            LOG_INFO << "Got filename from Content-Disposition: "
-                     << originalFilename;
-          } else {
-            originalFilename = "unknown_file";
-            LOG_INFO << "Using default filename: " << originalFilename;
-          }
+          originalFilename = "unknown_file";
+          LOG_INFO << "Using default filename: " << originalFilename;
         }
+      }
 
-        // 生成服务器端文件名
-        std::string filename = generateUniqueFilename("upload");
-        std::string filepath = uploadDir_ + "/" + filename;
+      if (!openFile(originalFilename)) {
+        return false;
+      }
+      state_ = kExpectContent;
+      std::string rest = partHeaders_.substr(pos + 4);
+      std::string().swap(partHeaders_);
+      feedContent(rest.data(), rest.size());
+      return true;
+    }
 
-        // 创建上传上下文
-        uploadContext =
+    // 创建保存上传内容的文件
+    bool openFile(const std::string &originalFilename) {
+      std::string filepath = handler_->uploadDir_ + "/" +
+                             handler_->generateUniqueFilename("upload");
+      try {
+        uploadContext_ =
             std::make_shared<FileUploadContext>(filepath, originalFilename);
-        httpContext->setContext(uploadContext);
-
-        // 设置边界
-        uploadContext->setBoundary(boundary);
-
-        // 解析body中的文件内容
-        std::string body = req.body();
-        size_t pos = body.find("\r\n\r\n");
-        if (pos != std::string::npos) {
-          // 跳过头部信息，获取文件内容
-          pos += 4;
-
-          // 检查是否是结束边界
-          std::string endBoundary = boundary + "--";
-          size_t endPos = body.find(endBoundary);
-          if (endPos != std::string::npos) {
-            LOG_INFO << "Found end boundary";
-            // 先写入边界之前的内容
-            if (endPos > 0) {
-              uploadContext->writeData(body.data() + pos, endPos - pos);
-              LOG_INFO << "Wrote " << endPos - pos
-                       << " bytes before end boundary, total: "
-                       << uploadContext->getTotalBytes();
-            }
-            // 找到结束边界，上传完成
-            uploadContext->setState(FileUploadContext::State::kComplete);
-          } else {
-            // 直接写入从pos开始的所有内容
-            if (pos < body.size()) {
-              uploadContext->writeData(body.data() + pos, body.size() - pos);
-              LOG_INFO << "Wrote " << body.size() - pos
-                       << " bytes, total: " << uploadContext->getTotalBytes();
-            }
-            uploadContext->setState(FileUploadContext::State::kExpectBoundary);
-          }
-        }
-
-        req.setBody(""); // 清空请求体
-        LOG_INFO << "Created upload context for file: " << filepath;
       } catch (const std::exception &e) {
         LOG_ERROR << "Failed to create upload context: " << e.what();
-        sendError(resp, "Failed to create file",
-                  HttpResponse::k500InternalServerError, conn);
-        return true;
+        fail(HttpResponse::k500InternalServerError, "Failed to create file");
+        return false;
       }
-    } else {
-      try {
-        // 处理后续的数据块
-        std::string body = req.body();
-        if (!body.empty()) {
-          LOG_INFO << "uploadContext->getState() = "
-                   << static_cast<int>(uploadContext->getState());
-          switch (uploadContext->getState()) {
-          case FileUploadContext::State::kExpectBoundary: {
-            // 检查是否是结束边界 格式为：--boundary--
-            std::string endBoundary = uploadContext->getBoundary() + "--";
-            size_t endPos = body.find(endBoundary);
-            if (endPos != std::string::npos) {
-              // 在这里添加写入边界之前的内容
-              if (endPos > 0) {
-                uploadContext->writeData(body.data(), endPos);
-                LOG_INFO << "Wrote " << endPos
-                         << " bytes before end boundary, total: "
-                         << uploadContext->getTotalBytes();
-              }
-              LOG_INFO << "Found end boundary";
-              // 找到结束边界，上传完成
-              uploadContext->setState(FileUploadContext::State::kComplete);
-              break;
-            }
-            // 检查是否是普通边界 格式为：--boundary
-            size_t boundaryPos = body.find(uploadContext->getBoundary());
-            LOG_INFO << "检查是否是普通边界 boundaryPos:" << boundaryPos;
-            if (boundaryPos != std::string::npos) {
-              // 找到新边界的开始，跳过边界和头部
-              size_t contentStart = body.find("\r\n\r\n", boundaryPos);
-              if (contentStart != std::string::npos) {
-                contentStart += 4;
-                // 写入边界之前的内容
-                if (boundaryPos > 0) {
-                  uploadContext->writeData(body.data(), boundaryPos);
-                  LOG_INFO << "Wrote " << boundaryPos << " bytes, total: "
-                           << uploadContext->getTotalBytes();
+      if (TcpConnectionPtr conn = conn_.lock()) {
+        // 文件写入通过loop异步提交, 不阻塞其它连接
+        uploadContext_->setLoop(conn->getLoop());
+        // 磁盘跟不上时暂停读取该连接, 积压的写入降下来后再恢复
+        std::weak_ptr<TcpConnection> weakConn(conn_);
+        uploadContext_->setWatermarks(
+            kUploadHighWaterMark, kUploadLowWaterMark, [weakConn](bool pause) {
+              if (TcpConnectionPtr c = weakConn.lock()) {
+                if (pause) {
+                  c->stopRead(TcpConnection::kPauseFlowControl);
+                } else {
+                  c->startRead(TcpConnection::kPauseFlowControl);
                 }
-                // 更新状态
-                uploadContext->setState(
-                    FileUploadContext::State::kExpectContent);
               }
-            } else {
-              // 没有找到边界，写入所有内容
-              uploadContext->writeData(body.data(), body.size());
-
-              LOG_INFO << "Wrote " << body.size()
-                       << " bytes, total: " << uploadContext->getTotalBytes();
-            }
-            break;
-          }
-
-          case FileUploadContext::State::kExpectContent: {
-            // 检查是否包含下一个边界
-            size_t boundaryPos = body.find(uploadContext->getBoundary());
-            if (boundaryPos != std::string::npos) {
-              // 写入边界之前的内容
-              uploadContext->writeData(body.data(), boundaryPos);
-              LOG_INFO << "Wrote " << boundaryPos
-                       << " bytes, total: " << uploadContext->getTotalBytes();
-              // 更新状态
-              uploadContext->setState(
-                  FileUploadContext::State::kExpectBoundary);
-            } else {
-              // 没有找到边界，写入所有内容
-              uploadContext->writeData(body.data(), body.size());
-              LOG_INFO << "Wrote " << body.size()
-                       << " bytes, total: " << uploadContext->getTotalBytes();
-            }
-            break;
-          }
-
-          case FileUploadContext::State::kComplete:
-            // 上传已完成，忽略后续数据
-            break;
-
-          default:
-            LOG_INFO << "Unknown state: "
-                     << static_cast<int>(uploadContext->getState());
-            break;
-          }
-
-          // 更新总处理字节数
-          // uploadContext->addProcessedBytes(body.size());
-        }
-      } catch (const std::exception &e) {
-        LOG_ERROR << "Error processing data chunk: " << e.what();
-        sendError(resp, "Failed to process data",
-                  HttpResponse::k500InternalServerError, conn);
-        return true;
+            });
       }
+      LOG_INFO << "Created upload context for file: " << filepath;
+      return true;
     }
-    req.setBody(""); // 清空请求体
-
-    // 检查是否完成
-    if (uploadContext->getState() == FileUploadContext::State::kComplete ||
-        httpContext->gotAll()) {
-      // 上传完成，准备响应
-      std::string serverFilename =
-          fs::path(uploadContext->getFilename()).filename().string();
-      std::string originalFilename = uploadContext->getOriginalFilename();
-      uintmax_t fileSize = uploadContext->getTotalBytes();
-
-      // 检测文件类型
-      std::string fileType = getFileType(originalFilename);
 
-      // 保存文件信息到数据库
-      std::string query =
-          "INSERT INTO files (filename, original_filename, file_size, "
-          "file_type, user_id) VALUES ('" +
-          escapeString(serverFilename) + "', '" +
-          escapeString(originalFilename) + "', " + std::to_string(fileSize) +
-          ", '" + escapeString(fileType) + "', " + std::to_string(userId) + ")";
-
-      if (!executeQuery(query)) {
-        LOG_ERROR << "保存文件信息到数据库失败";
+    // 写入文件内容, 直到遇到"\r\n--boundary"
+    void feedContent(const char *data, size_t len) {
+      if (delimiter_.empty()) {
+        uploadContext_->writeData(data, len);
+        return;
+      }
+      size_t keep = delimiter_.size() - 1;
+      if (!carry_.empty()) {
+        // 上一段末尾保留的数据加上这一段的开头, 足以包含所有从保留数据中
+        // 开始的分隔符
+        size_t take = std::min(len, keep);
+        std::string joined = carry_;
+        joined.append(data, take);
+        carry_.clear();
+        size_t pos = joined.find(delimiter_);
+        if (pos != std::string::npos) {
+          finishContent(joined.data(), pos);
+          return;
+        }
+        if (take == len) {
+          size_t tail = std::min(joined.size(), keep);
+          uploadContext_->writeData(joined.data(), joined.size() - tail);
+          carry_.assign(joined, joined.size() - tail, tail);
+          return;
+        }
+        uploadContext_->writeData(joined.data(), joined.size() - take);
       }
 
-      int fileId = static_cast<int>(mysql_insert_id(mysql));
-
-      json response = {{"code", 0},
-                       {"message", "上传成功"},
-                       {"fileId", fileId},
-                       {"filename", serverFilename},
-                       {"originalFilename", originalFilename},
-                       {"size", fileSize}};
+      const char *found = static_cast<const char *>(
+          ::memmem(data, len, delimiter_.data(), delimiter_.size()));
+      if (found != nullptr) {
+        finishContent(data, found - data);
+        return;
+      }
+      size_t tail = std::min(len, keep);
+      uploadContext_->writeData(data, len - tail);
+      carry_.assign(data + len - tail, tail);
+    }
+
+    void finishContent(const char *data, size_t len) {
+      uploadContext_->writeData(data, len);
+      state_ = kComplete;
+      LOG_INFO << "Found end boundary, total: "
+               << uploadContext_->getTotalBytes();
+    }
+
+    HttpUploadHandler *handler_;
+    std::weak_ptr<TcpConnection> conn_;
+    int userId_;
+    std::string delimiter_;      // "\r\n--boundary", 原始上传时为空
+    std::string headerFilename_; // X-File-Name头部, 优先作为原始文件名
+    State state_;
+    std::string partHeaders_;    // 尚未完整的part头部
+    std::string carry_;          // 可能是分隔符开头的末尾数据, 暂不写入
+    std::shared_ptr<FileUploadContext> uploadContext_;
+    HttpResponse::HttpStatusCode errorCode_;
+    std::string error_;          // 非空表示请求已被拒绝
+  };
 
-      resp->setStatusCode(HttpResponse::k200Ok);
-      resp->setStatusMessage("OK");
-      resp->setContentType("application/json");
-      resp->addHeader("Connection", "close");
-      resp->setBody(response.dump());
+  /**
+   * @brief 处理原始二进制上传(PUT /upload/raw), 请求体就是文件内容
+   * 请求体不经过Buffer和HttpRequest, 而是由TcpConnection::spliceToFile
+   * 通过socket -> pipe -> file的splice直接写入文件
+   * @return 返回true表示已经接管请求体, false表示交给常规流程处理
+   */
+  bool handleRawUpload(const TcpConnectionPtr &conn, HttpRequest &req) {
+    auto httpContext =
+        std::static_pointer_cast<HttpContext>(conn->getContext());
+    if (!httpContext || httpContext->isChunked() ||
+        httpContext->contentLength() == 0) {
+      // splice只能接收带Content-Length的请求体, chunked请求体交给createBodySink
+      return false;
+    }
 
-      // 清理上下文
-      httpContext->setContext(nullptr);
+    // 这里的错误响应在请求体读取之前发出, 之后必须关闭连接
+    HttpResponse resp(true);
+    std::string sessionId = req.getHeader("X-Session-ID");
+    int userId;
+    std::string usernameFromSession;
+    if (!validateSession(sessionId, userId, usernameFromSession)) {
+      sendError(&resp, "未登录或会话已过期", HttpResponse::k401Unauthorized);
+      sendResponseNow(conn, resp);
+      return true;
+    }
 
-      conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-        LOG_INFO << "Upload complete, closing connection";
-        connection->shutdown();
-        return true;
-      });
+    std::string originalFilename = "unknown_file";
+    std::string headerFilename = req.getHeader("X-File-Name");
+    if (!headerFilename.empty()) {
+      originalFilename = urlDecode(headerFilename);
+    }
 
+    std::shared_ptr<FileUploadContext> uploadContext;
+    try {
+      std::string filepath =
+          uploadDir_ + "/" + generateUniqueFilename("upload");
+      uploadContext =
+          std::make_shared<FileUploadContext>(filepath, originalFilename);
+    } catch (const std::exception &e) {
+      LOG_ERROR << "Failed to create upload context: " << e.what();
+      sendError(&resp, "Failed to create file",
+                HttpResponse::k500InternalServerError);
+      sendResponseNow(conn, resp);
       return true;
-    } else {
-      LOG_INFO << "Waiting for more data, current state: "
-               << static_cast<int>(uploadContext->getState());
-      return false;
     }
+    httpContext->setContext(uploadContext);
+    LOG_INFO << "Raw upload of " << httpContext->contentLength()
+             << " bytes to " << uploadContext->getFilename();
+
+    conn->spliceToFile(
+        uploadContext->fd(), httpContext->contentLength(),
+        [this, userId, uploadContext](const TcpConnectionPtr &connection,
+                                      bool ok, size_t written) {
+          uploadContext->addWrittenBytes(written);
+          auto context =
+              std::static_pointer_cast<HttpContext>(connection->getContext());
+          // 请求体没有完整读完时连接上的数据已经不可用, 只能关闭连接
+          HttpResponse response(!ok || !context ||
+                                context->closeAfterResponse());
+          if (ok) {
+            completeUpload(uploadContext, userId, &response);
+          } else {
+            LOG_ERROR << "Raw upload failed after " << written
+                      << " bytes: " << uploadContext->getFilename();
+            ::unlink(uploadContext->getFilename().c_str());
+            sendError(&response, "Upload failed",
+                      HttpResponse::k500InternalServerError);
+          }
+          if (context) {
+            context->reset();
+          }
+          sendResponseNow(connection, response);
+        });
+    return true;
+  }
+
+  // @brief 文件全部写完之后记录上传结果, 写入失败时删除文件并返回500
+  void finishUpload(const std::shared_ptr<FileUploadContext> &uploadContext,
+                    int userId, HttpResponse *resp) {
+    if (uploadContext->writeFailed()) {
+      ::unlink(uploadContext->getFilename().c_str());
+      sendError(resp, "Failed to write file",
+                HttpResponse::k500InternalServerError);
+      return;
+    }
+    completeUpload(uploadContext, userId, resp);
+  }
+
+  // @brief 在HttpServer的常规流程之外直接发送响应
+  static void sendResponseNow(const TcpConnectionPtr &conn,
+                              HttpResponse &resp) {
+    HttpResponseWriter::send(conn, resp);
   }
 
-  bool handleListFiles(const TcpConnectionPtr &conn, HttpRequest &req,
+  // @brief PUT /upload/raw 没有请求体时的处理; 带Content-Length的请求体由
+  // onHeaders通过splice接管, chunked请求体由UploadBodySink接收
+  bool handleRawUploadFallback(const TcpConnectionPtr &conn, HttpRequest &req,
+                               HttpResponse *resp) {
+    sendError(resp, "Request body is empty", HttpResponse::k400BadRequest);
+    return true;
+  }
+
+  bool handleListFiles(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                        HttpResponse *resp) {
     // 验证会话
     std::string sessionId = req.getHeader("X-Session-ID");
@@ -595,8 +747,7 @@ private:
     std::string usernameFromSession;
 
     if (!validateSession(sessionId, userId, usernameFromSession)) {
-      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized,
-                conn);
+      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized);
       return true;
     }
 
@@ -720,16 +871,8 @@ private:
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
 
-    // 设置写完成回调以关闭连接
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      LOG_INFO << "List files complete, closing connection";
-      connection->shutdown();
-      return true;
-    });
-
     return true;
   }
 
@@ -737,7 +880,7 @@ private:
                       HttpResponse *resp) {
     std::string filename = req.getPathParam("filename");
     if (filename.empty()) {
-      sendError(resp, "Missing filename", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "Missing filename", HttpResponse::k400BadRequest);
       return true;
     }
 
@@ -778,7 +921,7 @@ private:
     } else {
       // 直接访问(需要登录)
       if (!isAuthenticated) {
-        sendError(resp, "请先登录", HttpResponse::k401Unauthorized, conn);
+        sendError(resp, "请先登录", HttpResponse::k401Unauthorized);
         return true;
       }
       query =
@@ -794,7 +937,7 @@ private:
     if (!result || mysql_num_rows(result) == 0) {
       if (result)
         mysql_free_result(result);
-      sendError(resp, "File not found", HttpResponse::k404NotFound, conn);
+      sendError(resp, "File not found", HttpResponse::k404NotFound);
       return true;
     }
 
@@ -842,12 +985,11 @@ private:
       if (shareType == "protected" &&
           (extractCode.empty() || extractCode != dbExtractCode)) {
         LOG_ERROR << "提取码错误或未提供";
-        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden, conn);
+        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden);
       } else {
         LOG_ERROR << "权限检查失败 - 用户ID: " << userId
                   << ", 文件ID: " << fileId;
-        sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden,
-                  conn);
+        sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden);
       }
       return true;
     }
@@ -857,7 +999,7 @@ private:
 
     try {
       if (!fs::exists(filepath) || !fs::is_regular_file(filepath)) {
-        sendError(resp, "File not found", HttpResponse::k404NotFound, conn);
+        sendError(resp, "File not found", HttpResponse::k404NotFound);
         return true;
       }
 
@@ -871,116 +1013,19 @@ private:
         resp->setContentType("application/octet-stream");
         resp->addHeader("Content-Length", std::to_string(fileSize));
         resp->addHeader("Accept-Ranges", "bytes");
-        resp->addHeader("Connection", "close");
-        conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-          connection->shutdown();
-          return true;
-        });
-        return true;
-      }
-
-      // 解析Range头部
-      std::string rangeHeader = req.getHeader("Range");
-      uintmax_t startPos = 0;
-      uintmax_t endPos = fileSize - 1;
-      bool isRangeRequest = false;
-
-      if (!rangeHeader.empty()) {
-        // 解析Range头部，格式为 "bytes=start-end"
-        std::regex rangeRegex("bytes=(\\d+)-(\\d*)");
-        std::smatch matches;
-        if (std::regex_search(rangeHeader, matches, rangeRegex)) {
-          startPos = std::stoull(matches[1]);
-          if (!matches[2].str().empty()) {
-            endPos = std::stoull(matches[2]);
-          }
-          isRangeRequest = true;
-
-          // 验证范围
-          if (startPos >= fileSize) {
-            sendError(resp, "Range Not Satisfiable",
-                      HttpResponse::k416RangeNotSatisfiable, conn);
-            return true;
-          }
-
-          // 如果endPos未指定或超出文件大小，则使用文件大小-1
-          if (endPos >= fileSize) {
-            endPos = fileSize - 1;
-          }
-        }
-      }
-      // 打印 startPos ， endPos
-      LOG_INFO << "startPos: " << startPos << ", endPos: " << endPos;
-
-      // 获取 HttpContext
-      auto httpContext =
-          std::static_pointer_cast<HttpContext>(conn->getContext());
-      if (!httpContext) {
-        LOG_ERROR << "HttpContext is null";
-        sendError(resp, "Internal Server Error",
-                  HttpResponse::k500InternalServerError, conn);
         return true;
       }
 
-      // 尝试获取已存在的下载上下文
-      std::shared_ptr<FileDownContext> downContext =
-          httpContext->getContext<FileDownContext>();
-
-      if (!downContext) {
-        // 创建新的下载上下文
-        downContext =
-            std::make_shared<FileDownContext>(filepath, originalFilename);
-        httpContext->setContext(downContext);
-
-        // 设置初始响应头
-        if (isRangeRequest) {
-          resp->setStatusCode(HttpResponse::k206PartialContent);
-          resp->setStatusMessage("Partial Content");
-          resp->addHeader("Content-Range", "bytes " + std::to_string(startPos) +
-                                               "-" + std::to_string(endPos) +
-                                               "/" + std::to_string(fileSize));
-        } else {
-          resp->setStatusCode(HttpResponse::k200Ok);
-          resp->setStatusMessage("OK");
-        }
-
-        resp->setContentType("application/octet-stream");
-        resp->addHeader("Content-Disposition",
-                        "attachment; filename=\"" + originalFilename + "\"");
-        resp->addHeader("Accept-Ranges", "bytes");
-        resp->addHeader("Connection", "keep-alive");
-
-        // 设置文件指针到起始位置
-        downContext->seekTo(startPos);
-      }
-
-      // 设置写完成回调，继续发送下一个数据块
-      conn->setWriteCompleteCallback(
-          [this, downContext](const TcpConnectionPtr &connection) {
-            // 读取下一个数据块
-            std::string chunk;
-            if (downContext->readNextChunk(chunk)) {
-              // 直接发送数据块
-              connection->send(chunk);
-              return true;
-            } else {
-              // 下载完成，关闭连接
-              LOG_INFO << "Download complete, closing connection";
-              connection->shutdown();
-              return true;
-            }
-          });
-
-      return true;
+      return prepareFileDownload(conn, req, resp, filepath, originalFilename,
+                                 fileSize);
     } catch (const std::exception &e) {
       LOG_ERROR << "Error during file download: " << e.what();
-      sendError(resp, "Download failed", HttpResponse::k500InternalServerError,
-                conn);
+      sendError(resp, "Download failed", HttpResponse::k500InternalServerError);
       return true;
     }
   }
 
-  bool handleDelete(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleDelete(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                     HttpResponse *resp) {
     // 验证会话
     std::string sessionId = req.getHeader("X-Session-ID");
@@ -988,15 +1033,14 @@ private:
     std::string usernameFromSession;
 
     if (!validateSession(sessionId, userId, usernameFromSession)) {
-      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized,
-                conn);
+      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized);
       return true;
     }
 
     // 从路径参数中获取文件名
     std::string filename = req.getPathParam("filename");
     if (filename.empty()) {
-      sendError(resp, "Missing filename", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "Missing filename", HttpResponse::k400BadRequest);
       LOG_WARN << "Missing filename";
       return true;
     }
@@ -1015,7 +1059,7 @@ private:
       if (result)
         mysql_free_result(result);
       sendError(resp, "文件不存在或您没有权限删除此文件",
-                HttpResponse::k403Forbidden, conn);
+                HttpResponse::k403Forbidden);
       return true;
     }
 
@@ -1035,8 +1079,8 @@ private:
         "DELETE FROM files WHERE id = " + std::to_string(fileId);
     if (!executeQuery(deleteFileQuery)) {
       LOG_ERROR << "删除文件记录失败";
-      sendError(resp, "删除文件记录失败", HttpResponse::k500InternalServerError,
-                conn);
+      sendError(resp, "删除文件记录失败",
+                HttpResponse::k500InternalServerError);
       return true;
     }
 
@@ -1065,13 +1109,8 @@ private:
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
 
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
     return true;
   }
 
@@ -1080,33 +1119,131 @@ private:
     resp->setStatusCode(HttpResponse::k404NotFound);
     resp->setStatusMessage("Not Found");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
 
-    conn->setWriteCompleteCallback([conn](const TcpConnectionPtr &connection) {
-      connection->shutdown();
+    return true;
+  }
+
+  // @brief 上传完成后保存文件信息到数据库, 并构造上传成功的响应
+  void completeUpload(const std::shared_ptr<FileUploadContext> &uploadContext,
+                      int userId, HttpResponse *resp) {
+    std::string serverFilename =
+        fs::path(uploadContext->getFilename()).filename().string();
+    std::string originalFilename = uploadContext->getOriginalFilename();
+    uintmax_t fileSize = uploadContext->getTotalBytes();
+
+    // 检测文件类型
+    std::string fileType = getFileType(originalFilename);
+
+    // 保存文件信息到数据库
+    std::string query =
+        "INSERT INTO files (filename, original_filename, file_size, "
+        "file_type, user_id) VALUES ('" +
+        escapeString(serverFilename) + "', '" +
+        escapeString(originalFilename) + "', " + std::to_string(fileSize) +
+        ", '" + escapeString(fileType) + "', " + std::to_string(userId) + ")";
+
+    if (!executeQuery(query)) {
+      LOG_ERROR << "保存文件信息到数据库失败";
+    }
+
+    int fileId = static_cast<int>(mysql_insert_id(connection()));
+
+    json response = {{"code", 0},
+                     {"message", "上传成功"},
+                     {"fileId", fileId},
+                     {"filename", serverFilename},
+                     {"originalFilename", originalFilename},
+                     {"size", fileSize}};
+
+    resp->setStatusCode(HttpResponse::k200Ok);
+    resp->setStatusMessage("OK");
+    resp->setContentType("application/json");
+    resp->setBody(response.dump());
+  }
+
+  // @brief 解析Range头部并准备文件响应，文件主体由TcpConnection::sendFile发送
+  bool prepareFileDownload(const TcpConnectionPtr &conn, HttpRequest &req,
+                           HttpResponse *resp, const std::string &filepath,
+                           const std::string &originalFilename,
+                           uintmax_t fileSize) {
+    // 解析Range头部
+    std::string rangeHeader = req.getHeader("Range");
+    uintmax_t startPos = 0;
+    uintmax_t endPos = fileSize > 0 ? fileSize - 1 : 0;
+    bool isRangeRequest = false;
+
+    if (!rangeHeader.empty()) {
+      // 解析Range头部，格式为 "bytes=start-end"
+      std::regex rangeRegex("bytes=(\\d+)-(\\d*)");
+      std::smatch matches;
+      if (std::regex_search(rangeHeader, matches, rangeRegex)) {
+        startPos = std::stoull(matches[1]);
+        if (!matches[2].str().empty()) {
+          endPos = std::stoull(matches[2]);
+        }
+        isRangeRequest = true;
+
+        // 验证范围
+        if (startPos >= fileSize || endPos < startPos) {
+          resp->addHeader("Content-Range",
+                          "bytes */" + std::to_string(fileSize));
+          sendError(resp, "Range Not Satisfiable",
+                    HttpResponse::k416RangeNotSatisfiable);
+          return true;
+        }
+
+        // 如果endPos未指定或超出文件大小，则使用文件大小-1
+        if (endPos >= fileSize) {
+          endPos = fileSize - 1;
+        }
+      }
+    }
+    LOG_INFO << "startPos: " << startPos << ", endPos: " << endPos;
+
+    // 获取 HttpContext
+    auto httpContext =
+        std::static_pointer_cast<HttpContext>(conn->getContext());
+    if (!httpContext) {
+      LOG_ERROR << "HttpContext is null";
+      sendError(resp, "Internal Server Error",
+                HttpResponse::k500InternalServerError);
       return true;
-    });
+    }
+
+    // 下载上下文持有文件描述符，挂在HttpContext上直到本次请求结束
+    auto downContext =
+        std::make_shared<FileDownContext>(filepath, originalFilename);
+    httpContext->setContext(downContext);
+    if (isRangeRequest) {
+      downContext->setRange(startPos, endPos);
+      resp->setStatusCode(HttpResponse::k206PartialContent);
+      resp->setStatusMessage("Partial Content");
+      resp->addHeader("Content-Range", "bytes " + std::to_string(startPos) +
+                                           "-" + std::to_string(endPos) +
+                                           "/" + std::to_string(fileSize));
+    } else {
+      resp->setStatusCode(HttpResponse::k200Ok);
+      resp->setStatusMessage("OK");
+    }
+
+    resp->setContentType("application/octet-stream");
+    resp->addHeader("Content-Disposition",
+                    "attachment; filename=\"" + originalFilename + "\"");
+    resp->addHeader("Accept-Ranges", "bytes");
+    // 设置Content-Length, 文件内容在响应头之后通过sendfile零拷贝发送
+    resp->setFileBody(downContext->fd(), downContext->rangeStart(),
+                      downContext->rangeLength());
     return true;
   }
 
   static void sendError(HttpResponse *resp, const std::string &message,
-                        HttpResponse::HttpStatusCode code,
-                        const TcpConnectionPtr &conn) {
+                        HttpResponse::HttpStatusCode code) {
     json response = {{"code", static_cast<int>(code)}, {"message", message}};
     resp->setStatusCode(code);
     resp->setStatusMessage(message);
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
-
-    if (conn) {
-      conn->setWriteCompleteCallback(
-          [conn](const TcpConnectionPtr &connection) {
-            connection->shutdown();
-            return true;
-          });
-    }
   }
 
   std::string generateUniqueFilename(const std::string &prefix) {
@@ -1207,7 +1344,7 @@ private:
   }
 
   // 用户注册
-  bool handleRegister(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleRegister(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                       HttpResponse *resp) {
     LOG_INFO << "Handling register request";
     LOG_INFO << "Request body: " << req.body();
@@ -1221,8 +1358,7 @@ private:
       LOG_INFO << "Register attempt for username: " << username;
       // 简单验证
       if (username.empty() || password.empty()) {
-        sendError(resp, "用户名和密码不能为空", HttpResponse::k400BadRequest,
-                  conn);
+        sendError(resp, "用户名和密码不能为空", HttpResponse::k400BadRequest);
         return true;
       }
 
@@ -1237,7 +1373,7 @@ private:
 
       if (result && mysql_num_rows(result) > 0) {
         mysql_free_result(result);
-        sendError(resp, "用户名已存在", HttpResponse::k400BadRequest, conn);
+        sendError(resp, "用户名已存在", HttpResponse::k400BadRequest);
         return true;
       }
 
@@ -1254,12 +1390,12 @@ private:
 
       if (!executeQuery(insertQuery)) {
         sendError(resp, "注册失败，请稍后重试",
-                  HttpResponse::k500InternalServerError, conn);
+                  HttpResponse::k500InternalServerError);
         return true;
       }
 
       // 获取新用户ID
-      int userId = static_cast<int>(mysql_insert_id(mysql));
+      int userId = static_cast<int>(mysql_insert_id(connection()));
 
       json response = {
           {"code", 0}, {"message", "注册成功"}, {"userId", userId}};
@@ -1267,25 +1403,19 @@ private:
       resp->setStatusCode(HttpResponse::k200Ok);
       resp->setStatusMessage("OK");
       resp->setContentType("application/json");
-      resp->addHeader("Connection", "close");
       resp->setBody(response.dump());
 
-      conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-        connection->shutdown();
-        return true;
-      });
-
       return true;
     } catch (const std::exception &e) {
       LOG_ERROR << "用户注册错误: " << e.what();
       sendError(resp, "注册失败: " + std::string(e.what()),
-                HttpResponse::k500InternalServerError, conn);
+                HttpResponse::k500InternalServerError);
       return true;
     }
   }
 
   // 用户登录
-  bool handleLogin(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleLogin(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                    HttpResponse *resp) {
     try {
       json requestData = json::parse(req.body());
@@ -1294,8 +1424,7 @@ private:
 
       // 验证参数
       if (username.empty() || password.empty()) {
-        sendError(resp, "用户名和密码不能为空", HttpResponse::k400BadRequest,
-                  conn);
+        sendError(resp, "用户名和密码不能为空", HttpResponse::k400BadRequest);
         return true;
       }
 
@@ -1313,8 +1442,7 @@ private:
         if (result) {
           mysql_free_result(result);
         }
-        sendError(resp, "用户名或密码错误", HttpResponse::k401Unauthorized,
-                  conn);
+        sendError(resp, "用户名或密码错误", HttpResponse::k401Unauthorized);
         return true;
       }
 
@@ -1336,19 +1464,13 @@ private:
       resp->setStatusCode(HttpResponse::k200Ok);
       resp->setStatusMessage("OK");
       resp->setContentType("application/json");
-      resp->addHeader("Connection", "close");
       resp->setBody(response.dump());
 
-      conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-        connection->shutdown();
-        return true;
-      });
-
       return true;
     } catch (const std::exception &e) {
       LOG_ERROR << "用户登录错误: " << e.what();
       sendError(resp, "登录失败: " + std::string(e.what()),
-                HttpResponse::k500InternalServerError, conn);
+                HttpResponse::k500InternalServerError);
       return true;
     }
   }
@@ -1436,6 +1558,7 @@ private:
 
   // 转义SQL字符串
   std::string escapeString(const std::string &str) {
+    MYSQL *mysql = connection();
     if (!mysql) {
       return str;
     }
@@ -1502,6 +1625,8 @@ private:
     // 需要会话验证的路由
     addRoute("/upload", HttpRequest::kPost,
              &HttpUploadHandler::handleFileUpload);
+    addRoute("/upload/raw", HttpRequest::kPut,
+             &HttpUploadHandler::handleRawUploadFallback);
     addRoute("/files", HttpRequest::kGet, &HttpUploadHandler::handleListFiles);
     addRoute("/download/([^/]+)", HttpRequest::kHead,
              &HttpUploadHandler::handleDownload, {"filename"});
@@ -1557,7 +1682,7 @@ private:
 
   // 登出处理
   // FIXME TODO: 用户如果直接退出浏览器也需要进行会话session的删除
-  bool handleLogout(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleLogout(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                     HttpResponse *resp) {
     std::string sessionId = req.getHeader("X-Session-ID");
     if (!sessionId.empty()) {
@@ -1569,18 +1694,13 @@ private:
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
 
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
     return true;
   }
 
   // 搜索用户
-  bool handleSearchUsers(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleSearchUsers(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                          HttpResponse *resp) {
     // 验证会话
     std::string sessionId = req.getHeader("X-Session-ID");
@@ -1588,8 +1708,7 @@ private:
     std::string username;
 
     if (!validateSession(sessionId, userId, username)) {
-      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized,
-                conn);
+      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized);
       LOG_WARN << "validateSession failed";
       return true;
     }
@@ -1607,13 +1726,13 @@ private:
     if (query.find("keyword=") == 0) {
       keyword = urlDecode(query.substr(8));
     } else {
-      sendError(resp, "搜索关键词不能为空", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "搜索关键词不能为空", HttpResponse::k400BadRequest);
       LOG_WARN << "keyword is empty";
       return true;
     }
 
     if (keyword.empty()) {
-      sendError(resp, "搜索关键词不能为空", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "搜索关键词不能为空", HttpResponse::k400BadRequest);
       LOG_WARN << "keyword is empty";
       return true;
     }
@@ -1649,13 +1768,8 @@ private:
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
     LOG_INFO << "response = " << response.dump();
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
 
     return true;
   }
@@ -1695,7 +1809,7 @@ private:
   }
 
   // 文件分享处理函数
-  bool handleShareFile(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleShareFile(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                        HttpResponse *resp) {
     // 验证会话
     std::string sessionId = req.getHeader("X-Session-ID");
@@ -1703,8 +1817,7 @@ private:
     std::string usernameFromSession;
 
     if (!validateSession(sessionId, userId, usernameFromSession)) {
-      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized,
-                conn);
+      sendError(resp, "未登录或会话已过期", HttpResponse::k401Unauthorized);
       return true;
     }
 
@@ -1723,8 +1836,7 @@ private:
       if (!fileResult || mysql_num_rows(fileResult) == 0) {
         if (fileResult)
           mysql_free_result(fileResult);
-        sendError(resp, "您没有权限分享此文件", HttpResponse::k403Forbidden,
-                  conn);
+        sendError(resp, "您没有权限分享此文件", HttpResponse::k403Forbidden);
         return true;
       }
 
@@ -1742,14 +1854,8 @@ private:
         resp->setStatusCode(HttpResponse::k200Ok);
         resp->setStatusMessage("OK");
         resp->setContentType("application/json");
-        resp->addHeader("Connection", "close");
         resp->setBody(response.dump());
 
-        conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-          connection->shutdown();
-          return true;
-        });
-
         return true;
       }
 
@@ -1783,8 +1889,7 @@ private:
         if (checkResult && mysql_num_rows(checkResult) > 0) {
           if (checkResult)
             mysql_free_result(checkResult);
-          sendError(resp, "已经分享给该用户", HttpResponse::k400BadRequest,
-                    conn);
+          sendError(resp, "已经分享给该用户", HttpResponse::k400BadRequest);
           return true;
         }
         if (checkResult)
@@ -1804,13 +1909,12 @@ private:
           ")";
 
       if (!executeQuery(insertQuery)) {
-        sendError(resp, "创建分享失败", HttpResponse::k500InternalServerError,
-                  conn);
+        sendError(resp, "创建分享失败", HttpResponse::k500InternalServerError);
         return true;
       }
 
       // 获取新创建的分享记录ID
-      int shareId = static_cast<int>(mysql_insert_id(mysql));
+      int shareId = static_cast<int>(mysql_insert_id(connection()));
 
       json response = {{"code", 0},
                        {"message", "分享成功"},
@@ -1829,19 +1933,13 @@ private:
       resp->setStatusCode(HttpResponse::k200Ok);
       resp->setStatusMessage("OK");
       resp->setContentType("application/json");
-      resp->addHeader("Connection", "close");
       resp->setBody(response.dump());
 
-      conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-        connection->shutdown();
-        return true;
-      });
-
       return true;
     } catch (const std::exception &e) {
       LOG_ERROR << "分享文件错误: " << e.what();
       sendError(resp, "分享失败: " + std::string(e.what()),
-                HttpResponse::k500InternalServerError, conn);
+                HttpResponse::k500InternalServerError);
       return true;
     }
   }
@@ -1855,7 +1953,7 @@ private:
     LOG_INFO << "path = " << path;
 
     if (!std::regex_search(path, matches, codeRegex) || matches.size() < 2) {
-      sendError(resp, "无效的分享链接", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "无效的分享链接", HttpResponse::k400BadRequest);
       LOG_WARN << "invalid share link";
       return true;
     }
@@ -1876,7 +1974,7 @@ private:
 
       // 检查分享码格式
       if (shareCode.empty() || shareCode.length() != 32) {
-        sendError(resp, "无效的分享码格式", HttpResponse::k400BadRequest, conn);
+        sendError(resp, "无效的分享码格式", HttpResponse::k400BadRequest);
         return true;
       }
 
@@ -1884,8 +1982,7 @@ private:
       if (!std::all_of(shareCode.begin(), shareCode.end(), [](char c) {
             return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
           })) {
-        sendError(resp, "分享码包含非法字符", HttpResponse::k400BadRequest,
-                  conn);
+        sendError(resp, "分享码包含非法字符", HttpResponse::k400BadRequest);
         return true;
       }
 
@@ -1913,8 +2010,7 @@ private:
       if (!result || mysql_num_rows(result) == 0) {
         if (result)
           mysql_free_result(result);
-        sendError(resp, "分享链接已失效或不存在", HttpResponse::k404NotFound,
-                  conn);
+        sendError(resp, "分享链接已失效或不存在", HttpResponse::k404NotFound);
         return true;
       }
 
@@ -1950,11 +2046,9 @@ private:
         mysql_free_result(result);
         if (shareType == "protected" &&
             (extractCode.empty() || extractCode != dbExtractCode)) {
-          sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden,
-                    conn);
+          sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden);
         } else {
-          sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden,
-                    conn);
+          sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden);
         }
         return true;
       }
@@ -1997,12 +2091,6 @@ private:
       return result;
     }
 
-    resp->addHeader("Connection", "close");
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
-
     return true;
   }
 
@@ -2011,7 +2099,7 @@ private:
                            HttpResponse *resp) {
     std::string filename = req.getPathParam("filename");
     if (filename.empty()) {
-      sendError(resp, "Missing filename", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "Missing filename", HttpResponse::k400BadRequest);
       return true;
     }
 
@@ -2021,7 +2109,7 @@ private:
     LOG_INFO << "shareCode = " << shareCode
              << ", extractCode = " << extractCode;
     if (shareCode.empty()) {
-      sendError(resp, "Missing share code", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "Missing share code", HttpResponse::k400BadRequest);
       return true;
     }
 
@@ -2054,8 +2142,7 @@ private:
       if (result)
         mysql_free_result(result);
       LOG_ERROR << "分享不存在或已过期";
-      sendError(resp, "Share not found or expired", HttpResponse::k404NotFound,
-                conn);
+      sendError(resp, "Share not found or expired", HttpResponse::k404NotFound);
       return true;
     }
 
@@ -2095,10 +2182,9 @@ private:
     if (!hasPermission) {
       if (shareType == "protected" &&
           (extractCode.empty() || extractCode != dbExtractCode)) {
-        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden, conn);
+        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden);
       } else {
-        sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden,
-                  conn);
+        sendError(resp, "您没有权限访问此文件", HttpResponse::k403Forbidden);
       }
       return true;
     }
@@ -2108,7 +2194,7 @@ private:
 
     try {
       if (!fs::exists(filepath) || !fs::is_regular_file(filepath)) {
-        sendError(resp, "File not found", HttpResponse::k404NotFound, conn);
+        sendError(resp, "File not found", HttpResponse::k404NotFound);
         return true;
       }
 
@@ -2122,119 +2208,24 @@ private:
         resp->setContentType("application/octet-stream");
         resp->addHeader("Content-Length", std::to_string(fileSize));
         resp->addHeader("Accept-Ranges", "bytes");
-        resp->addHeader("Connection", "close");
-        conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-          connection->shutdown();
-          return true;
-        });
-        return true;
-      }
-
-      // 解析Range头部
-      std::string rangeHeader = req.getHeader("Range");
-      uintmax_t startPos = 0;
-      uintmax_t endPos = fileSize - 1;
-      bool isRangeRequest = false;
-
-      if (!rangeHeader.empty()) {
-        // 解析Range头部，格式为 "bytes=start-end"
-        std::regex rangeRegex("bytes=(\\d+)-(\\d*)");
-        std::smatch matches;
-        if (std::regex_search(rangeHeader, matches, rangeRegex)) {
-          startPos = std::stoull(matches[1]);
-          if (!matches[2].str().empty()) {
-            endPos = std::stoull(matches[2]);
-          }
-          isRangeRequest = true;
-
-          // 验证范围
-          if (startPos >= fileSize) {
-            sendError(resp, "Range Not Satisfiable",
-                      HttpResponse::k416RangeNotSatisfiable, conn);
-            return true;
-          }
-
-          // 如果endPos未指定或超出文件大小，则使用文件大小-1
-          if (endPos >= fileSize) {
-            endPos = fileSize - 1;
-          }
-        }
-      }
-
-      // 获取 HttpContext
-      auto httpContext =
-          std::static_pointer_cast<HttpContext>(conn->getContext());
-      if (!httpContext) {
-        LOG_ERROR << "HttpContext is null";
-        sendError(resp, "Internal Server Error",
-                  HttpResponse::k500InternalServerError, conn);
         return true;
       }
 
-      // 尝试获取已存在的下载上下文
-      std::shared_ptr<FileDownContext> downContext =
-          httpContext->getContext<FileDownContext>();
-
-      if (!downContext) {
-        // 创建新的下载上下文
-        downContext =
-            std::make_shared<FileDownContext>(filepath, originalFilename);
-        httpContext->setContext(downContext);
-
-        // 设置初始响应头
-        if (isRangeRequest) {
-          resp->setStatusCode(HttpResponse::k206PartialContent);
-          resp->setStatusMessage("Partial Content");
-          resp->addHeader("Content-Range", "bytes " + std::to_string(startPos) +
-                                               "-" + std::to_string(endPos) +
-                                               "/" + std::to_string(fileSize));
-        } else {
-          resp->setStatusCode(HttpResponse::k200Ok);
-          resp->setStatusMessage("OK");
-        }
-
-        resp->setContentType("application/octet-stream");
-        resp->addHeader("Content-Disposition",
-                        "attachment; filename=\"" + originalFilename + "\"");
-        resp->addHeader("Accept-Ranges", "bytes");
-        resp->addHeader("Connection", "keep-alive");
-
-        // 设置文件指针到起始位置
-        downContext->seekTo(startPos);
-      }
-
-      // 设置写完成回调，继续发送下一个数据块
-      conn->setWriteCompleteCallback(
-          [this, downContext](const TcpConnectionPtr &connection) {
-            // 读取下一个数据块
-            std::string chunk;
-            if (downContext->readNextChunk(chunk)) {
-              // 直接发送数据块
-              connection->send(chunk);
-              return true;
-            } else {
-              // 下载完成，关闭连接
-              LOG_INFO << "Download complete, closing connection";
-              connection->shutdown();
-              return true;
-            }
-          });
-
-      return true;
+      return prepareFileDownload(conn, req, resp, filepath, originalFilename,
+                                 fileSize);
     } catch (const std::exception &e) {
       LOG_ERROR << "Error during file download: " << e.what();
-      sendError(resp, "Download failed", HttpResponse::k500InternalServerError,
-                conn);
+      sendError(resp, "Download failed", HttpResponse::k500InternalServerError);
       return true;
     }
   }
 
   // 获取分享信息
-  bool handleShareInfo(const TcpConnectionPtr &conn, HttpRequest &req,
+  bool handleShareInfo(const TcpConnectionPtr & /*conn*/, HttpRequest &req,
                        HttpResponse *resp) {
     std::string shareCode = req.getPathParam("code");
     if (shareCode.empty()) {
-      sendError(resp, "Missing share code", HttpResponse::k400BadRequest, conn);
+      sendError(resp, "Missing share code", HttpResponse::k400BadRequest);
       return true;
     }
 
@@ -2262,8 +2253,7 @@ private:
       if (result)
         mysql_free_result(result);
       LOG_ERROR << "分享链接已失效或不存在, shareCode = " << shareCode;
-      sendError(resp, "分享链接已失效或不存在", HttpResponse::k404NotFound,
-                conn);
+      sendError(resp, "分享链接已失效或不存在", HttpResponse::k404NotFound);
       return true;
     }
 
@@ -2281,7 +2271,7 @@ private:
       if (extractCode.empty() || extractCode != dbExtractCode) {
         mysql_free_result(result);
         LOG_ERROR << "提取码错误或未提供, shareCode = " << shareCode;
-        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden, conn);
+        sendError(resp, "需要正确的提取码", HttpResponse::k403Forbidden);
         return true;
       }
     }
@@ -2303,14 +2293,8 @@ private:
     resp->setStatusCode(HttpResponse::k200Ok);
     resp->setStatusMessage("OK");
     resp->setContentType("application/json");
-    resp->addHeader("Connection", "close");
     resp->setBody(response.dump());
 
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
-
     return true;
   }
 
@@ -2330,7 +2314,6 @@ private:
       resp->setStatusCode(HttpResponse::k404NotFound);
       resp->setStatusMessage("Not Found");
       resp->setContentType("image/x-icon");
-      resp->addHeader("Connection", "close");
       resp->setBody("");
     } else {
       std::string iconData((std::istreambuf_iterator<char>(file)),
@@ -2340,14 +2323,9 @@ private:
       resp->setStatusCode(HttpResponse::k200Ok);
       resp->setStatusMessage("OK");
       resp->setContentType("image/x-icon");
-      resp->addHeader("Connection", "close");
-      resp->setBody(iconData);
+      resp->setBody(std::move(iconData));
     }
 
-    conn->setWriteCompleteCallback([](const TcpConnectionPtr &connection) {
-      connection->shutdown();
-      return true;
-    });
     return true;
   }
 };
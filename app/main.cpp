@@ -5,11 +5,14 @@
 #include "network/http/HttpRequest.hpp"
 #include "network/http/HttpResponse.hpp"
 #include "network/http/HttpServer.hpp"
+#include "utils/log/AsyncLogging.hpp"
 #include "utils/log/Logging.hpp"
+#include "utils/thread/CpuTopology.hpp"
 #include "utils/thread/ThreadPool.hpp"
 #include <nlohmann/json.hpp>
 #include <atomic>
 #include <cstdio>
+#include <cstdlib>
 #include <experimental/filesystem>
 #include <fstream>
 #include <functional>
@@ -36,13 +39,64 @@ using namespace flkeeper::log;
 using json = nlohmann::json;
 namespace fs = std::experimental::filesystem;
 
+// 设置MYMUDUO_LOG_FILE时日志由后端线程异步写入文件
+static std::unique_ptr<AsyncLogging> g_asyncLog;
+
+static void asyncOutput(const char *msg, int len) {
+  g_asyncLog->append(msg, len);
+}
+
 int main() {
   Logger::setLogLevel(Logger::INFO);
   EventLoop loop;
-  HttpServer server(&loop, InetAddress(8080), "http-upload-test");
+  // 设置MYMUDUO_REUSEPORT_PER_LOOP时每个IO线程各自监听并accept
+  TcpServer::Option option = ::getenv("MYMUDUO_REUSEPORT_PER_LOOP")
+                                 ? TcpServer::kReusePortPerLoop
+                                 : TcpServer::kNoReusePort;
+  // 设置MYMUDUO_UNIX_SOCKET时监听Unix域socket而不是8080端口,
+  // 以'@'开头的名字表示抽象名字空间
+  InetAddress listenAddr(8080);
+  if (const char *path = ::getenv("MYMUDUO_UNIX_SOCKET")) {
+    listenAddr = path[0] == '@' ? InetAddress::fromUnixPath(path + 1, true)
+                                : InetAddress::fromUnixPath(path);
+  }
+  HttpServer server(&loop, listenAddr, "http-upload-test", option);
+
+  // IO线程数和工作线程数默认按CPU拓扑确定, 可以分别用MYMUDUO_IO_THREADS和
+  // MYMUDUO_WORKER_THREADS覆盖
+  int ioThreads = EventLoopThreadPool::kAutoThreads;
+  int workerThreads = ThreadPool::kAutoThreads;
+  if (const char *n = ::getenv("MYMUDUO_IO_THREADS")) {
+    ioThreads = ::atoi(n);
+  }
+  if (const char *n = ::getenv("MYMUDUO_WORKER_THREADS")) {
+    workerThreads = ::atoi(n);
+  }
 
   // 创建HTTP处理器
-  auto handler = std::make_shared<HttpUploadHandler>(4);
+  auto handler = std::make_shared<HttpUploadHandler>(workerThreads);
+
+  // 设置MYMUDUO_PIN_THREADS时IO线程独占绑定到物理核, 工作线程绑定到NUMA节点
+  bool pinThreads = ::getenv("MYMUDUO_PIN_THREADS") != nullptr;
+  if (pinThreads) {
+    server.setCpuAffinity(true);
+    handler->workerPool().setCpuAffinity(true);
+  }
+
+  if (const char *logFile = ::getenv("MYMUDUO_LOG_FILE")) {
+    g_asyncLog.reset(new AsyncLogging(logFile, 500 * 1024 * 1024));
+    // 绑定时日志线程放在IO线程之后的下一个CPU上, CPU都分给了IO线程时
+    // 不绑定, 避免与某个IO线程抢同一个核
+    const CpuTopology &topology = CpuTopology::instance();
+    int usedCpus = ioThreads == EventLoopThreadPool::kAutoThreads
+                       ? topology.recommendedIoThreads()
+                       : ioThreads;
+    if (pinThreads && usedCpus < topology.numCpus()) {
+      g_asyncLog->setCpuAffinity({topology.cpuForThread(usedCpus)});
+    }
+    g_asyncLog->start();
+    Logger::setOutput(asyncOutput);
+  }
 
   // 设置连接回调
   server.setConnectionCallback(
@@ -54,10 +108,97 @@ int main() {
     return handler->onRequest(conn, req, resp);
   });
 
-  server.setThreadNum(0);
+  // 请求头部解析完成后, 原始上传由处理器直接接管请求体
+  server.setHeadersCallback(
+      [handler](const TcpConnectionPtr &conn, HttpRequest &req) {
+        return handler->onHeaders(conn, req);
+      });
+
+  // multipart上传的请求体边接收边写入文件, 不在内存中累积
+  server.setBodySinkCallback(
+      [handler](const TcpConnectionPtr &conn, HttpRequest &req) {
+        return handler->createBodySink(conn, req);
+      });
+
+  // 设置MYMUDUO_USE_ET时连接使用边沿触发, 每次可读事件读到EAGAIN或预算用完
+  if (::getenv("MYMUDUO_USE_ET")) {
+    server.setEdgeTriggered(true);
+  }
+
+  // MYMUDUO_BUSY_POLL_US开启IO线程的自适应忙轮询(微秒), 设置
+  // MYMUDUO_SO_BUSY_POLL时新连接同时使用SO_BUSY_POLL
+  if (const char *us = ::getenv("MYMUDUO_BUSY_POLL_US")) {
+    server.setBusyPoll(::atoi(us), ::getenv("MYMUDUO_SO_BUSY_POLL") != nullptr);
+  }
+
+  // MYMUDUO_DISPATCH选择新连接的分配策略: least-conn, least-bytes, p2c,
+  // 默认轮询
+  if (const char *policy = ::getenv("MYMUDUO_DISPATCH")) {
+    std::string name(policy);
+    if (name == "least-conn") {
+      server.setDispatchPolicy(EventLoopThreadPool::kLeastConnections);
+    } else if (name == "least-bytes") {
+      server.setDispatchPolicy(EventLoopThreadPool::kLeastOutstandingBytes);
+    } else if (name == "p2c") {
+      server.setDispatchPolicy(EventLoopThreadPool::kPowerOfTwoChoices);
+    }
+  }
+
+  // MYMUDUO_SOCKET_PROFILE选择socket选项: bulk(大文件传输), latency(小请求),
+  // MYMUDUO_TCP_CONGESTION额外指定拥塞控制算法; 默认使用系统设置
+  SocketProfile profile;
+  if (const char *name = ::getenv("MYMUDUO_SOCKET_PROFILE")) {
+    std::string value(name);
+    if (value == "bulk") {
+      profile = SocketProfile::bulkTransfer();
+    } else if (value == "latency") {
+      profile = SocketProfile::lowLatency();
+    }
+  }
+  if (const char *cc = ::getenv("MYMUDUO_TCP_CONGESTION")) {
+    profile.congestion = cc;
+  }
+  server.setSocketProfile(profile);
+
+  // MYMUDUO_TCP_INFO_MS开启TCP_INFO采样(毫秒), 据此调整sendfile的发送量;
+  // MYMUDUO_SLOW_CLIENT_BPS为慢速客户端的速率阈值(字节/秒)
+  if (const char *ms = ::getenv("MYMUDUO_TCP_INFO_MS")) {
+    const char *bps = ::getenv("MYMUDUO_SLOW_CLIENT_BPS");
+    server.setTcpInfoSampling(::atoi(ms) / 1000.0,
+                              bps ? ::strtoull(bps, nullptr, 10) : 0);
+    server.setSlowClientCallback([](const TcpConnectionPtr &conn, bool slow) {
+      const TcpInfoSample &info = conn->tcpInfo();
+      LOG_WARN << "connection " << conn->name() << " from "
+               << conn->peerAddress().toIpPort()
+               << (slow ? " is slow" : " recovered") << ": rtt "
+               << info.rttUs << "us, cwnd " << info.cwnd << ", retrans "
+               << info.totalRetransmits;
+    });
+  }
+
+  // 同时设置MYMUDUO_TLS_CERT和MYMUDUO_TLS_KEY时以HTTPS提供服务,
+  // 会话票据密钥每小时轮换一次
+  const char *cert = ::getenv("MYMUDUO_TLS_CERT");
+  const char *key = ::getenv("MYMUDUO_TLS_KEY");
+  if (cert && key) {
+    auto tls = std::make_shared<TlsContext>();
+    if (!tls->useCertificate(cert, key)) {
+      return 1;
+    }
+    tls->rotateTicketKey();
+    loop.runEvery(3600, [tls]() { tls->rotateTicketKey(); });
+    server.setTlsContext(tls);
+  }
+
+  server.setThreadNum(ioThreads);
   server.start();
-  std::cout << "HTTP upload server is running on port 8080..." << std::endl;
-  std::cout << "Please visit http://localhost:8080" << std::endl;
+  if (listenAddr.isUnix()) {
+    std::cout << "HTTP upload server is running on " << listenAddr.toIpPort()
+              << "..." << std::endl;
+  } else {
+    std::cout << "HTTP upload server is running on port 8080..." << std::endl;
+    std::cout << "Please visit http://localhost:8080" << std::endl;
+  }
   loop.loop();
   return 0;
 }
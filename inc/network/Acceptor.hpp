@@ -2,9 +2,11 @@
 #define __CLOUD_STORAGE_ACCEPTOR_HPP__
 
 #include <functional>
+#include <string>
 #include "utils/NonCopyable.hpp"
 #include "network/Channel.hpp"
 #include "network/Socket.hpp"
+#include "network/SocketProfile.hpp"
 
 namespace flkeeper {
 namespace network {
@@ -13,7 +15,7 @@ class EventLoop;
 class InetAddress;
 
 ///
-/// Acceptor类用于接受TCP新连接
+/// Acceptor类用于接受TCP新连接, 也可以监听Unix域socket(路径或抽象名字空间)
 /// 使用非阻塞socket + Channel实现
 /// 支持优雅关闭和防止文件描述符耗尽
 ///
@@ -28,7 +30,7 @@ public:
   // 构造函数
   // loop: 所属的事件循环
   // listenAddr: 监听地址
-  // reuseport: 是否启用端口复用
+  // reuseport: 是否启用端口复用, Unix域socket忽略
   Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
   ~Acceptor();
 
@@ -41,13 +43,24 @@ public:
   // 返回是否正在监听
   bool listening() const { return listening_; }
 
+  // 返回所属的事件循环
+  EventLoop *getLoop() const { return loop_; }
+
   // 开始监听
   // 此函数必须在设置回调函数之后调用
   void listen();
 
+  // 把profile中监听socket相关的选项(DEFER_ACCEPT、Fast Open、接收缓冲区)
+  // 设置到监听socket上, 新连接会继承; 必须在listen之前调用
+  void setSocketProfile(const SocketProfile &profile);
+
 private:
+  // 单次可读事件最多接受的连接数, 监听socket是水平触发的, 没接受完的连接
+  // 在下一轮循环继续处理, 避免连接风暴时饿死已建立连接的读写
+  static const int kMaxAcceptsPerRead = 256;
+
   // 处理新连接到达
-  // 由Channel回调
+  // 由Channel回调, 循环accept直到EAGAIN
   void handleRead();
 
   EventLoop *loop_;       // Acceptor所属的事件循环
@@ -55,7 +68,9 @@ private:
   Channel acceptChannel_; // 监听Channel,用于观察监听socket上的可读事件
   NewConnectionCallback newConnectionCallback_; // 新连接回调函数
   bool listening_;                              // 是否正在监听
+  bool isUnix_;                                 // 是否监听Unix域socket
   int idleFd_; // 空闲的文件描述符，用于防止文件描述符耗尽
+  std::string unixPath_; // 绑定的socket文件, 析构时删除; 抽象名字为空
 };
 
 } // namespace network
@@ -0,0 +1,102 @@
+#ifndef __CLOUD_STORAGE_BLOCK_POOL_HPP__
+#define __CLOUD_STORAGE_BLOCK_POOL_HPP__
+
+#include "utils/NonCopyable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 按尺寸分级的内存块池, 供Buffer和LinkedBuffer申请/归还数据块
+ *
+ * 每个线程(也就是每个EventLoop)拥有一个自己的池, 通过current()获取, 分配与
+ * 归还都不需要加锁. 块的尺寸按2的幂分为1KB ~ 256KB共9级, 超过256KB的块直接
+ * 向系统申请. 每个块前有一个很小的头部记录所属的池和尺寸级别, 因此块可以在
+ * 任意线程归还: 统计数据记在分配它的池上, 块本身进入归还线程的空闲链表.
+ *
+ * 开启大页(setUseHugePages或环境变量MYMUDUO_USE_HUGEPAGES)后, 块从2MB的
+ * 大页slab中切分, slab在进程生命周期内不会归还给系统. 每级缓存同样受上限
+ * 约束, 超出的块(以及线程退出时缓存的块)进入全局共享的溢出链表, 各线程
+ * 切分新的slab之前先从溢出链表取块, 因此块在线程之间单向流动时占用的
+ * 内存也不会无限增长.
+ */
+class BlockPool : NonCopyable {
+public:
+  static constexpr size_t kMinBlockSize = 1024;       // 最小的块
+  static constexpr size_t kMaxBlockSize = 256 * 1024;  // 池化的最大块
+  static constexpr int kNumSizeClasses = 9;           // 1KB ~ 256KB
+
+  struct Stats {
+    size_t blocksInUse;          // 正在使用的块数
+    size_t blocksInUseHighWater; // 正在使用块数的历史最大值
+    size_t bytesInUse;           // 正在使用的字节数
+    size_t bytesInUseHighWater;  // 正在使用字节数的历史最大值
+    size_t cachedBlocks;         // 空闲链表中缓存的块数
+    size_t hugePageBytes;        // 已映射的大页slab总字节数
+  };
+
+  /**
+   * @brief 获取当前线程的块池, 第一次调用时创建
+   * @note 线程退出后返回nullptr
+   */
+  static BlockPool *current();
+
+  /**
+   * @brief 申请一块至少size字节的内存
+   * @param size 需要的字节数
+   * @param capacity 返回实际可用的字节数(向上取整到所在尺寸级别)
+   */
+  static char *allocate(size_t size, size_t *capacity);
+
+  /**
+   * @brief 归还allocate()申请的内存, 可以在任意线程调用
+   */
+  static void deallocate(char *block);
+
+  /**
+   * @brief 设置是否使用大页, 必须在第一次分配之前调用
+   */
+  static void setUseHugePages(bool on);
+  static bool useHugePages();
+
+  Stats stats() const;
+
+private:
+  struct BlockHeader;
+
+  BlockPool();
+  ~BlockPool();
+
+  char *allocateInPool(size_t size, size_t *capacity);
+  void deallocateInPool(char *block, BlockHeader *header);
+  char *refill(int sizeClass);
+  void trim();
+  void addInUse(size_t bytes);
+
+  static int sizeClassOf(size_t size);
+  static size_t classSize(int sizeClass);
+
+  friend struct PoolHolder;
+
+  std::vector<char *> freeLists_[kNumSizeClasses]; // 各级别的空闲块
+  char *slabCur_;                                  // 当前大页slab的切分位置
+  char *slabEnd_;                                  // 当前大页slab的末尾
+  bool detached_;                                  // 所属线程是否已经退出
+
+  // 统计数据由所属线程更新, 其它线程归还块时也会更新, 因此使用原子变量
+  std::atomic<size_t> blocksInUse_;
+  std::atomic<size_t> bytesInUse_;
+  std::atomic<size_t> blocksHighWater_;
+  std::atomic<size_t> bytesHighWater_;
+  std::atomic<size_t> cachedBlocks_;
+  std::atomic<size_t> hugePageBytes_;
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
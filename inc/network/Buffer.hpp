@@ -3,7 +3,6 @@
 
 #include <cassert>
 #include <cstring>
-#include <vector>
 #include <string>
 
 #define BUFFER_LEN 65536
@@ -23,18 +22,20 @@ namespace network {
  * prependable: 用于在数据前添加额外信息(如信息长度),避免数据移动
  * readable: 存储可读数据
  * writeable: 用于写入新数据
+ * 底层内存从当前线程的BlockPool申请, 扩容时不会对新空间做零填充
  */
 class Buffer {
 static const size_t kCheapPrepend = 8U;
 static const size_t kInitialSize = 1024U;
 public:
-  explicit Buffer(size_t initialSize = kInitialSize)
-      : buffer_(kCheapPrepend + kInitialSize), readIndex_(kCheapPrepend),
-        writeIndex_(kCheapPrepend) {
-    assert(readableBytes() == 0);
-    assert(writableBytes() == initialSize);
-    assert(prependableBytes() == kCheapPrepend);
-  }
+  explicit Buffer(size_t initialSize = kInitialSize);
+  ~Buffer();
+
+  Buffer(const Buffer &rhs);
+  Buffer &operator=(const Buffer &rhs);
+  // 移动后rhs是一个新的空缓冲区
+  Buffer(Buffer &&rhs);
+  Buffer &operator=(Buffer &&rhs);
 
   const char *findCRLF() const;
   const char *findCRLF(const char *start) const;
@@ -140,7 +141,7 @@ public:
   }
 
   // @brief 缓冲区容量
-  size_t capacity() const { return buffer_.capacity(); }
+  size_t capacity() const { return capacity_; }
 
   /**
    * @brief 从fd文件描述符中读取数据
@@ -152,16 +153,15 @@ public:
 
 private:
   /**
-   * @brief 返回第一个字符
-   * @note buffer_.begin()得到迭代器，对其*操作可以得到第一个字符
-   * 最后返回第一个字符的地址(char *)
+   * @brief 返回第一个字符的地址
    */
-  char *begin() { return &(*buffer_.begin()); }
-  const char *begin() const { return &*buffer_.begin(); }
+  char *begin() { return buffer_; }
+  const char *begin() const { return buffer_; }
 
   void makeSpace(size_t len);
 
-  std::vector<char> buffer_;    // 缓冲区
+  char *buffer_;                // 缓冲区, 从BlockPool申请
+  size_t capacity_;             // 缓冲区容量
   size_t readIndex_;            // 读位置
   size_t writeIndex_;           // 写位置
 
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <memory>
+#include <sys/types.h>
 #include "utils/date/TimeStamp.hpp"
 #include "Buffer.hpp"
 
@@ -32,6 +33,13 @@ using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
+// splice完成回调: 是否成功, 已写入文件的字节数
+using SpliceCompleteCallback =
+    std::function<void(const TcpConnectionPtr&, bool, size_t)>;
+// 慢速客户端回调: 连接是否变为慢速(false表示恢复)
+using SlowClientCallback = std::function<void(const TcpConnectionPtr&, bool)>;
+// 异步文件读写完成回调: 读写的字节数, 失败时为-errno
+using FileIoCallback = std::function<void(ssize_t)>;
 typedef std::function<void (const TcpConnectionPtr&,
                             Buffer*,
                             date::TimeStamp)> MessageCallback;
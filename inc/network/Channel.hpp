@@ -56,6 +56,20 @@ public:
   /// @brief 设置index
   void set_index(int idx) { index_ = idx; }
 
+  /// @brief Poller实际注册到内核的事件, 由Poller维护
+  int polledEvents() const { return polledEvents_; }
+  void set_polledEvents(int ev) { polledEvents_ = ev; }
+
+  /**
+   * @brief 设置是否使用边沿触发
+   * 边沿触发时Poller一次性注册读写事件, enableWriting/disableWriting只修改
+   * 本地的关注事件, 不再触发epoll_ctl; 未关注的事件在分发前被过滤掉.
+   * 使用者必须在每次事件中把数据读/写到EAGAIN, 否则不会再收到通知
+   * @note 只有支持边沿触发的Poller(epoll)才生效, 见EventLoop::supportsEdgeTriggered
+   */
+  void setEdgeTriggered(bool on);
+  bool isEdgeTriggered() const { return edgeTriggered_; }
+
   /// @brief 使能读事件
   void enableReading() {
     events_ |= kReadEvent;
@@ -112,6 +126,8 @@ private:
   int events_;      // 注册的事件
   int revents_;     // 实际发生的事件
   int index_;       // 用于Poller
+  int polledEvents_; // Poller实际注册的事件
+  bool edgeTriggered_; // 是否使用边沿触发
 
   bool eventHandling_; // 是否正在处理事件
   bool addedToLoop_;   // 是否已添加到EventLoop
@@ -0,0 +1,67 @@
+#ifndef __CLOUD_STORAGE_CONNECTIONTABLE_HPP__
+#define __CLOUD_STORAGE_CONNECTIONTABLE_HPP__
+
+#include "network/Callback.hpp"
+#include "utils/NonCopyable.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief TcpServer的连接表, 以整数编号索引
+ * @note
+ * 1. 连接存放在连续的槽位中, 删除后槽位进入空闲链表被复用
+ * 2. 编号由槽位下标和槽位的代数组成, 槽位每次复用代数加一, 已经删除的连接的
+ *    旧编号不会误删复用该槽位的新连接
+ * 3. 插入、删除、查找都是O(1), 不是线程安全的, 由调用者加锁
+ */
+class ConnectionTable : NonCopyable {
+public:
+  using Id = uint64_t;
+
+  ConnectionTable() : size_(0) {}
+
+  // @brief 插入连接, 返回分配的编号(不为0)
+  Id insert(const TcpConnectionPtr &conn);
+
+  // @brief 删除编号对应的连接, 编号已经失效时返回false
+  bool erase(Id id);
+
+  // @brief 查找编号对应的连接, 不存在时返回空指针
+  TcpConnectionPtr find(Id id) const;
+
+  // @brief 依次访问所有连接
+  template <typename Func> void forEach(Func func) const {
+    for (const Slot &slot : slots_) {
+      if (slot.conn) {
+        func(slot.conn);
+      }
+    }
+  }
+
+  // @brief 删除所有连接
+  void clear();
+
+  size_t size() const { return size_; }
+
+private:
+  struct Slot {
+    TcpConnectionPtr conn;
+    uint32_t generation; // 槽位被占用的次数, 从1开始
+  };
+
+  static uint32_t slotOf(Id id) { return static_cast<uint32_t>(id); }
+  static uint32_t generationOf(Id id) { return static_cast<uint32_t>(id >> 32); }
+
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> freeSlots_; // 空闲的槽位下标
+  size_t size_;                     // 表中的连接数
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
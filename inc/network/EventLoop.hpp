@@ -5,13 +5,15 @@
 #include <functional>
 #include <vector>
 #include <memory>
-#include <mutex>
 #include <algorithm>
 
 #include "utils/thread/CurrentThread.hpp"
 #include "utils/date/TimeStamp.hpp"
 #include "utils/Types.hpp"
 #include "utils/NonCopyable.hpp"
+#include "utils/datastructures/InlineTask.hpp"
+#include "utils/datastructures/MpscQueue.hpp"
+#include "network/BlockPool.hpp"
 #include "network/Callback.hpp"
 
 namespace flkeeper {
@@ -27,7 +29,8 @@ class TimerQueue;
 /// 负责IO和定时器事件的分发
 class EventLoop : NonCopyable {
 public:
-    using Functor = std::function<void()>;
+    /// @brief 投递到loop中执行的任务, 只能移动, 小的可调用对象不分配内存
+    using Functor = InlineTask;
 
     EventLoop();
     ~EventLoop();
@@ -45,9 +48,13 @@ public:
     void runInLoop(Functor cb);
 
     /// @brief 把回调放入队列，唤醒loop所在线程执行回调
+    /// @note loop线程自己投递的回调放入本地队列; 其它线程通过无锁MPSC队列投递,
+    /// 不加锁, 除了队列节点之外不分配内存
     void queueInLoop(Functor cb);
 
     /// @brief 唤醒loop所在线程
+    /// @note 上一次唤醒还没有被loop处理时不会重复写eventfd,
+    /// 连续的跨线程投递只触发一次唤醒
     void wakeup();
 
     /// @brief 更新Channel
@@ -59,6 +66,23 @@ public:
     /// @brief 是否有Channel
     bool hasChannel(Channel* channel);
 
+    /// @brief 当前Poller是否支持Channel的边沿触发模式
+    bool supportsEdgeTriggered() const;
+
+    /// @brief 异步读文件, 完成后在本loop中调用cb(读取的字节数, 失败时为-errno)
+    /// @param offset 文件偏移, 为-1时使用文件当前位置
+    /// @note 必须在loop线程调用, buf在回调之前必须保持有效;
+    /// 当前Poller不支持异步文件IO时同步读写, 回调仍然延后到本轮事件处理之后执行
+    void asyncRead(int fd, void* buf, size_t len, off_t offset, FileIoCallback cb);
+
+    /// @brief 异步写文件, 语义同asyncRead
+    void asyncWrite(int fd, const void* buf, size_t len, off_t offset,
+                    FileIoCallback cb);
+
+    /// @brief 当前Poller的asyncRead/asyncWrite是否真正异步, 否则在loop线程
+    /// 中同步读写
+    bool supportsAsyncFileIo() const;
+
     /// @brief 断言在EventLoop线程中
     void assertInLoopThread() {
         if (!isInLoopThread()) {
@@ -72,6 +96,56 @@ public:
     /// @brief 获取当前线程的EventLoop对象
     static EventLoop* getEventLoopOfCurrentThread();
 
+    /// @brief 获取本loop线程缓冲区块池的统计数据(使用中的块数、字节数及其峰值)
+    BlockPool::Stats blockPoolStats() const { return blockPool_->stats(); }
+
+    /// @brief 负载统计, 由本loop中的TcpConnection维护, 可以在任意线程读取,
+    /// EventLoopThreadPool按此选择接收新连接的loop
+    void addConnections(int delta) {
+        numConnections_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int numConnections() const {
+        return numConnections_.load(std::memory_order_relaxed);
+    }
+    void addOutstandingBytes(int64_t delta) {
+        outstandingBytes_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    /// @brief 本loop所有连接已排队但还没有写入内核的字节数(包括待发送的文件)
+    int64_t outstandingBytes() const {
+        return outstandingBytes_.load(std::memory_order_relaxed);
+    }
+    /// @brief 本loop中被判定为慢速客户端的连接数, 见TcpConnection::setTcpInfoSampling
+    void addSlowConnections(int delta) {
+        numSlowConnections_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int numSlowConnections() const {
+        return numSlowConnections_.load(std::memory_order_relaxed);
+    }
+    /// @brief 最近每轮事件处理耗时(poll返回到处理完回调)的滑动平均, 单位微秒
+    int64_t recentLatencyUs() const {
+        return recentLatencyUs_.load(std::memory_order_relaxed);
+    }
+
+    /// @brief 轮询统计, 由loop线程维护, 可以在任意线程读取
+    struct PollStats {
+        int64_t iterations;  // 事件循环的轮数
+        int64_t wakeups;     // poll返回时有事件(包括唤醒和定时器)的次数
+        int64_t spins;       // 忙轮询模式下没有等到事件的非阻塞poll次数
+        int64_t pollTimeUs;  // 在poll中(阻塞或忙轮询)花费的总时间
+    };
+    PollStats pollStats() const;
+
+    /// @brief 开启/关闭自适应忙轮询, 可以在任意线程调用
+    /// @param spinUs 最长忙轮询时间(微秒), 0表示关闭(默认), poll一直阻塞到
+    /// 有IO事件、定时器到期或被唤醒
+    /// @note 开启后每轮处理完事件先以非阻塞方式反复poll, 预算内等到事件就继续
+    /// 处理, 否则阻塞等待. 实际预算在[spinUs/16, spinUs]之间自适应:
+    /// 忙轮询等到事件时加倍, 没有等到时减半, 空闲的loop很快就几乎不再空转
+    void setBusyPoll(int spinUs) {
+        busyPollUs_.store(spinUs, std::memory_order_relaxed);
+    }
+    int busyPollUs() const { return busyPollUs_.load(std::memory_order_relaxed); }
+
     // timers
     TimerId runAt(date::TimeStamp time, TimerCallback cb);
     TimerId runAfter(double delay, TimerCallback cb);
@@ -82,9 +156,25 @@ private:
     void abortNotInLoopThread();
     void handleRead();  // wakeup
     void doPendingFunctors();
+    // 忙轮询模式下的poll, 预算内没有事件时转为阻塞
+    void pollWithSpin(int maxSpinUs, date::TimeStamp start);
 
     using ChannelList = std::vector<Channel*>;
 
+    // 其它线程投递的回调. 执行完的节点回收到所属loop的空闲栈, 生产者把
+    // 整个空闲栈取到线程局部的缓存中复用, 稳定运行时跨线程投递不再分配内存
+    struct RemoteFunctor : MpscNode {
+        Functor functor;
+        RemoteFunctor* nextFree = nullptr;  // 空闲栈和线程局部缓存中的链接
+    };
+
+    // 从当前线程的缓存中取一个节点, 缓存为空时取走本loop的整个空闲栈,
+    // 仍然没有时才分配
+    RemoteFunctor* allocRemoteFunctor(Functor cb);
+
+    // 每轮最多执行的跨线程回调数, 剩余的留到下一轮, 避免饿死IO事件
+    static const int kMaxRemoteFunctorsPerRound = 1024;
+
     // 按照构造函数初始化顺序声明成员变量
     std::atomic<bool> looping_;                  // atomic flag
     std::atomic<bool> quit_;                     // atomic flag
@@ -98,8 +188,24 @@ private:
     std::unique_ptr<Channel> wakeupChannel_;    // 用于处理wakeupFd_上的事件
     Channel* currentActiveChannel_;             // 当前正在处理的活动通道
     ChannelList activeChannels_;                // Poller返回的活动通道
-    std::mutex mutex_;                          // 互斥锁，用于保护pendingFunctors_
-    std::vector<Functor> pendingFunctors_;      // 待处理的回调函数
+    std::vector<Functor> pendingFunctors_;      // loop线程自己投递的回调
+    std::vector<Functor> runningFunctors_;      // 正在执行的本地回调, 复用内存
+    MpscQueue<RemoteFunctor> remoteFunctors_;   // 其它线程投递的回调
+    // 执行完的节点, 只有loop线程压入, 生产者用exchange整个取走, 没有ABA;
+    // 节点数不超过同时在途的跨线程回调数的峰值
+    std::atomic<RemoteFunctor*> freeFunctors_;
+    std::atomic<bool> wakeupPending_;           // 已经写过eventfd且loop还没有处理
+    BlockPool* blockPool_;                      // 本loop线程的缓冲区块池
+    std::atomic<int> numConnections_;           // 本loop中的连接数
+    std::atomic<int64_t> outstandingBytes_;     // 本loop中待发送的字节数
+    std::atomic<int> numSlowConnections_;       // 本loop中的慢速客户端连接数
+    std::atomic<int64_t> recentLatencyUs_;      // 每轮事件处理耗时的滑动平均
+    std::atomic<int> busyPollUs_;               // 最长忙轮询时间, 0表示关闭
+    int64_t spinBudgetUs_;                      // 当前自适应的忙轮询预算
+    std::atomic<int64_t> iterations_;           // 轮询统计, 见PollStats
+    std::atomic<int64_t> wakeups_;
+    std::atomic<int64_t> spins_;
+    std::atomic<int64_t> pollTimeUs_;
 };
 
 } // namespace network
@@ -8,6 +8,7 @@
 #include <functional>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace flkeeper {
 namespace network {
@@ -47,6 +48,14 @@ public:
    */
   EventLoop *startLoop();
 
+  /**
+   * @brief 设置线程绑定的CPU, 为空表示不绑定
+   * @note 必须在startLoop之前调用
+   */
+  void setCpuAffinity(const std::vector<int> &cpus) {
+    thread_.setCpuAffinity(cpus);
+  }
+
 private:
   /**
    * @brief 线程函数
@@ -8,6 +8,8 @@
 #include <vector>
 #include <string>
 #include <atomic>
+#include <random>
+#include <stdint.h>
 
 namespace flkeeper {
 namespace network {
@@ -24,7 +26,7 @@ class EventLoopThread;
  *
  * 特点：
  * 1. 支持动态调整线程数量
- * 2. Round-robin方式分配连接
+ * 2. 可选的连接分配策略, 默认Round-robin
  * 3. 支持线程初始化回调
  * 4. 支持优雅关闭
  * 5. 线程安全的设计
@@ -33,6 +35,14 @@ class EventLoopThreadPool : NonCopyable {
 public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
 
+    /// @brief 新连接的分配策略, 负载数据来自各EventLoop的统计
+    enum DispatchPolicy {
+        kRoundRobin,            // 轮询(默认)
+        kLeastConnections,      // 连接数最少的loop
+        kLeastOutstandingBytes, // 待发送字节数最少的loop
+        kPowerOfTwoChoices,     // 随机取两个loop, 选综合负载较低的一个
+    };
+
     /**
      * @brief 构造函数
      * @param baseLoop 主事件循环（通常是acceptor所属的loop）
@@ -46,13 +56,31 @@ public:
      */
     ~EventLoopThreadPool();
 
+    // setThreadNum传入kAutoThreads时按物理核数启动IO线程
+    static const int kAutoThreads = -1;
+
     /**
      * @brief 设置线程数量
      * @param numThreads 线程数量
-     * 如果numThreads为0，所有IO都在baseLoop线程中进行
+     * 如果numThreads为0，所有IO都在baseLoop线程中进行;
+     * 为kAutoThreads时在start中按CpuTopology::recommendedIoThreads确定
      */
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    /**
+     * @brief IO线程是否绑定CPU
+     * 第i个IO线程独占绑定到CpuTopology::cpuForThread(i), 各节点轮流、
+     * 物理核优先; 应在start之前调用
+     */
+    void setCpuAffinity(bool on) { pinThreads_ = on; }
+
+    /**
+     * @brief 设置新连接的分配策略
+     * @note getNextLoop在baseLoop线程中调用, 策略应在start之前设置
+     */
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+    DispatchPolicy dispatchPolicy() const { return policy_; }
+
     /**
      * @brief 启动线程池
      * @param cb 线程初始化回调函数
@@ -67,7 +95,7 @@ public:
 
     /**
      * @brief 获取下一个事件循环
-     * 用于新连接的分发，采用round-robin方式分配
+     * 用于新连接的分发，按setDispatchPolicy设置的策略选择
      */
     EventLoop* getNextLoop();
 
@@ -97,11 +125,21 @@ public:
     size_t size() const { return loops_.size(); }
 
 private:
+    // 从start开始依次比较, 负载相同时轮流选择不同的loop
+    template <typename LoadFunc>
+    EventLoop* leastLoaded(LoadFunc load);
+
+    // power-of-two-choices使用的综合负载
+    static int64_t loadScore(const EventLoop* loop);
+
     EventLoop* baseLoop_;        // 主事件循环
     std::string name_;               // 线程池名称
     bool started_;             // 是否已启动
     int numThreads_;           // 线程数量
+    bool pinThreads_;          // IO线程是否绑定CPU
     std::atomic<int> next_;    // 下一个要被分配的线程索引
+    DispatchPolicy policy_;    // 新连接的分配策略
+    std::minstd_rand rng_;     // power-of-two-choices的随机数
     std::vector<std::unique_ptr<EventLoopThread>> threads_;  // IO线程列表
     std::vector<EventLoop*> loops_;                          // EventLoop列表
 };
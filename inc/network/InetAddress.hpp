@@ -7,6 +7,7 @@
 
 #include <netinet/in.h>
 #include <string>
+#include <sys/un.h>
 
 namespace flkeeper {
 
@@ -29,10 +30,41 @@ public:
   InetAddress(StringArg ip, DFLK_UINT16 port);
   InetAddress(StringArg ip, DFLK_UINT16 port, bool ipv6);
 
-  explicit InetAddress(const struct sockaddr_in &addr) : addr_(addr) {}
-  explicit InetAddress(const struct sockaddr_in6 &addr6) : addr6_(addr6) {}
+  explicit InetAddress(const struct sockaddr_in &addr)
+      : addr_(addr), unixLen_(0) {}
+  explicit InetAddress(const struct sockaddr_in6 &addr6)
+      : addr6_(addr6), unixLen_(0) {}
+
+  /**
+   * @brief 从accept/getsockname等得到的通用地址构造, 支持AF_INET、AF_INET6
+   * 和AF_UNIX
+   * @param len 地址的实际长度, AF_UNIX用它区分路径、抽象名字和未命名的地址
+   */
+  InetAddress(const struct sockaddr *addr, socklen_t len);
+
+  /**
+   * @brief 构造AF_UNIX流式socket地址
+   * @param path 文件系统路径; abstract为true时是抽象命名空间中的名字,
+   * 不在文件系统中创建文件, 所有引用关闭后自动消失
+   * @note 名字超过sun_path的长度时截断并记录日志
+   */
+  static InetAddress fromUnixPath(const std::string &path,
+                                  bool abstract = false);
 
   sa_family_t family() const { return addr_.sin_family; }
+  bool isUnix() const { return family() == AF_UNIX; }
+  bool isAbstractUnix() const {
+    return isUnix() && unixLen_ > sizeof(sa_family_t) &&
+           addrUn_.sun_path[0] == '\0';
+  }
+  /**
+   * @brief AF_UNIX地址的路径, 抽象名字以'@'开头, 未命名的地址(例如客户端
+   * 没有bind)为空串
+   */
+  std::string unixPath() const;
+
+  // @brief 地址的实际长度, 用于bind/connect
+  socklen_t sockAddrLen() const;
   DFLK_UINT16 port() const;
   std::string toIp() const;
   std::string toIpPort() const;
@@ -50,6 +82,7 @@ public:
     return reinterpret_cast<const struct sockaddr *>(&addr6_);
   }
   void setSockAddrInet6(const struct sockaddr_in6 &addr6) { addr6_ = addr6; }
+  void setSockAddr(const struct sockaddr *addr, socklen_t len);
 
   DFLK_UINT32 ipv4NetEndian() const;
   DFLK_UINT16 portNetEndian() const { return addr_.sin_port; }
@@ -60,7 +93,9 @@ private:
   union {
     struct sockaddr_in addr_;
     struct sockaddr_in6 addr6_;
+    struct sockaddr_un addrUn_;
   };
+  socklen_t unixLen_; // AF_UNIX地址的实际长度
 };
 
 }   // namespace net
@@ -6,14 +6,20 @@
 #include <vector>
 #include <string>
 #include <list>
+#include <memory>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <errno.h>
 #include <algorithm>
 
+#include "BlockPool.hpp"
+
 // 单块内存默认大小（可根据场景调整）
 #define LINKED_BLOCK_SIZE 4096
 // 每块内存前置空间大小（用于头部插入）
 #define LINKED_PREPEND_SIZE 8
+// 单次writev最多使用的iovec数量
+#define LINKED_MAX_IOVEC 64
 
 namespace flkeeper {
 namespace network {
@@ -24,7 +30,11 @@ namespace network {
  * +-----------------+--------------------+-----------------+
  * |   prependable   |      readable      |     writeable   |
  * +-----------------+--------------------+-----------------+
- * 功能与原Buffer一致，但通过链表实现离散内存管理
+ * 功能与原Buffer一致，但通过链表实现离散内存管理，块内存从BlockPool申请
+ *
+ * 除了自有内存块之外，还可以把外部数据以引用计数切片的形式挂到链表上
+ * (appendSlice / append(std::string&&))，数据本身不发生拷贝，切片在被
+ * 读取完之前一直持有外部数据的引用
  */
 class LinkedBuffer {
 private:
@@ -35,17 +45,28 @@ private:
         size_t readable;          // 可读区域大小（有效数据）
         size_t writable;          // 可写区域大小（空闲空间）
         size_t capacity;          // 总容量（prependable + readable + writable）
+        std::shared_ptr<const void> holder;  // 非空表示引用外部数据(不拥有data)
 
         Block(size_t cap = LINKED_BLOCK_SIZE)
-            : capacity(cap),
-              prependable(LINKED_PREPEND_SIZE),  // 预留前置空间
-              readable(0),
-              writable(cap - LINKED_PREPEND_SIZE) {  // 剩余空间为可写
-            data = new char[capacity];
+            : prependable(LINKED_PREPEND_SIZE),  // 预留前置空间
+              readable(0) {
+            data = BlockPool::allocate(cap, &capacity);
+            writable = capacity - LINKED_PREPEND_SIZE;  // 剩余空间为可写
         }
 
+        // 引用外部数据的只读切片，没有前置空间和可写空间
+        Block(std::shared_ptr<const void> h, const char* p, size_t len)
+            : data(const_cast<char*>(p)),
+              prependable(0),
+              readable(len),
+              writable(0),
+              capacity(len),
+              holder(std::move(h)) {}
+
         ~Block() {
-            delete[] data;
+            if (!holder) {
+                BlockPool::deallocate(data);
+            }
         }
 
         // 可读数据起始地址
@@ -60,11 +81,16 @@ private:
 
         // 收缩块空间（仅保留必要容量）
         void shrink() {
-            if (prependable + readable + writable != capacity) return;
-            size_t new_cap = prependable + readable + 1;  // 保留1字节可写
-            char* new_data = new char[new_cap];
+            if (holder || prependable + readable + writable != capacity) return;
+            size_t new_cap = 0;
+            // 保留1字节可写, 实际容量会向上取整到BlockPool的尺寸级别
+            char* new_data = BlockPool::allocate(prependable + readable + 1, &new_cap);
+            if (new_cap >= capacity) {
+                BlockPool::deallocate(new_data);  // 已经是最小的尺寸级别
+                return;
+            }
             memcpy(new_data + prependable, peek(), readable);  // 拷贝有效数据
-            delete[] data;
+            BlockPool::deallocate(data);
             data = new_data;
             capacity = new_cap;
             writable = capacity - prependable - readable;
@@ -185,6 +211,25 @@ public:
         }
     }
 
+    // 第一个块的可读数据, 缓冲区为空时返回false
+    bool front(const char** data, size_t* len) const {
+        if (blocks_.empty()) return false;
+        *data = blocks_.front()->peek();
+        *len = blocks_.front()->readable;
+        return true;
+    }
+
+    // 第一个块是引用外部数据的切片时取出它的可读数据和持有者, 否则返回false
+    bool frontSlice(const char** data, size_t* len,
+                    std::shared_ptr<const void>* holder) const {
+        if (blocks_.empty() || !blocks_.front()->holder) return false;
+        const Block* front = blocks_.front();
+        *data = front->peek();
+        *len = front->readable;
+        *holder = front->holder;
+        return true;
+    }
+
     // 读取到指定位置
     void retrieveUntil(const char* end) {
         // 先定位end所在的块
@@ -249,8 +294,12 @@ public:
         // 优先填充已有块的可写空间
         while (remaining > 0) {
             if (blocks_.empty() || blocks_.back()->writable == 0) {
+                // 切片块的writable恒为0, 因此不会向外部数据中写入
                 // 无块或最后一块已满，新建块
-                size_t new_block_size = std::max<size_t>(LINKED_BLOCK_SIZE, remaining);
+                // 块大小不超过BlockPool池化的上限, 更大的数据拆成多个块
+                size_t new_block_size = std::min<size_t>(
+                    std::max<size_t>(LINKED_BLOCK_SIZE, remaining + LINKED_PREPEND_SIZE),
+                    BlockPool::kMaxBlockSize);
                 blocks_.push_back(new Block(new_block_size));
             }
             Block* back = blocks_.back();
@@ -268,6 +317,25 @@ public:
         append(str.data(), str.size());
     }
 
+    // 追加一个引用计数切片，holder保证[data, data+len)在切片被读取完之前有效
+    void appendSlice(std::shared_ptr<const void> holder, const char* data, size_t len) {
+        if (len == 0) return;
+        blocks_.push_back(new Block(std::move(holder), data, len));
+        total_readable_ += len;
+    }
+
+    // 接管字符串，不拷贝数据；较小的字符串直接拷贝进块中更划算
+    void append(std::string&& str) {
+        if (str.size() < LINKED_BLOCK_SIZE) {
+            append(str.data(), str.size());
+            return;
+        }
+        auto holder = std::make_shared<std::string>(std::move(str));
+        const char* data = holder->data();
+        size_t len = holder->size();
+        appendSlice(std::move(holder), data, len);
+    }
+
     // 头部插入数据（仅使用第一个块的前置空间）
     void prepend(const void* data, size_t len) {
         if (len == 0) return;
@@ -292,16 +360,19 @@ public:
             }
         }
         // 若需预留空间，确保最后一块有足够可写空间
-        if (writableBytes() < reserve && !blocks_.empty()) {
+        if (writableBytes() < reserve && !blocks_.empty() && blocks_.back()->holder) {
+            blocks_.push_back(new Block(std::max<size_t>(LINKED_BLOCK_SIZE,
+                                                         reserve + LINKED_PREPEND_SIZE)));
+        } else if (writableBytes() < reserve && !blocks_.empty()) {
+            Block* back = blocks_.back();
             size_t need = reserve - writableBytes();
-            blocks_.back()->writable += need;
-            blocks_.back()->capacity += need;
-            char* new_data = new char[blocks_.back()->capacity];
-            memcpy(new_data + blocks_.back()->prependable,
-                   blocks_.back()->peek(),
-                   blocks_.back()->readable);
-            delete[] blocks_.back()->data;
-            blocks_.back()->data = new_data;
+            size_t new_cap = 0;
+            char* new_data = BlockPool::allocate(back->capacity + need, &new_cap);
+            memcpy(new_data + back->prependable, back->peek(), back->readable);
+            BlockPool::deallocate(back->data);
+            back->data = new_data;
+            back->writable += new_cap - back->capacity;
+            back->capacity = new_cap;
         }
     }
 
@@ -330,18 +401,17 @@ public:
             size_t bytes_read = static_cast<size_t>(n);
             total_readable_ += bytes_read;
             // 更新块的可写/可读状态
-            auto it = blocks_.begin();
-            for (size_t i = 0; i < iovs.size() && bytes_read > 0; ++i) {
-                std::advance(it, i);  // 将迭代器向前移动i个位置
-                Block* block = (i < blocks_.size() - 1) ? *it : new_block;
-                // Block* block = (i < blocks_.size() - 1) ? blocks_[i] : new_block;
+            // iovs与带可写空间的块一一对应（最后一个是新块）
+            for (auto it = blocks_.begin(); it != blocks_.end() && bytes_read > 0; ++it) {
+                Block* block = *it;
+                if (block->writable == 0) continue;
                 size_t write_len = std::min(bytes_read, block->writable);
                 block->readable += write_len;
                 block->writable -= write_len;
                 bytes_read -= write_len;
             }
             // 若新块未使用，回收
-            if (new_block->writable == LINKED_BLOCK_SIZE - LINKED_PREPEND_SIZE) {
+            if (new_block->readable == 0) {
                 blocks_.pop_back();
                 delete new_block;
             }
@@ -354,17 +424,35 @@ public:
     }
 
     // 写入文件描述符（使用writev集中写）
-    ssize_t writeFd(int fd, int* savedErrno) {
-        if (total_readable_ == 0) return 0;
-        std::vector<struct iovec> iovs;
-        // 收集所有块的可读数据
+    // @param maxBytes 本次最多写出的字节数，用于与其它输出(如sendfile)保持顺序
+    // @param flags 非0时改用sendmsg并带上这些标志(如MSG_MORE)，fd必须是socket
+    ssize_t writeFd(int fd, int* savedErrno, size_t maxBytes = static_cast<size_t>(-1),
+                    int flags = 0) {
+        if (total_readable_ == 0 || maxBytes == 0) return 0;
+        struct iovec iovs[LINKED_MAX_IOVEC];
+        int iovcnt = 0;
+        // 收集块的可读数据，最多LINKED_MAX_IOVEC个块
         for (const auto& block : blocks_) {
+            if (iovcnt == LINKED_MAX_IOVEC || maxBytes == 0) break;
             if (block->readable > 0) {
-                iovs.push_back({const_cast<char*>(block->peek()), block->readable});
+                size_t len = std::min(block->readable, maxBytes);
+                iovs[iovcnt].iov_base = const_cast<char*>(block->peek());
+                iovs[iovcnt].iov_len = len;
+                ++iovcnt;
+                maxBytes -= len;
             }
         }
         // 执行集中写
-        const ssize_t n = ::writev(fd, iovs.data(), iovs.size());
+        ssize_t n;
+        if (flags == 0) {
+            n = ::writev(fd, iovs, iovcnt);
+        } else {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof msg);
+            msg.msg_iov = iovs;
+            msg.msg_iovlen = static_cast<size_t>(iovcnt);
+            n = ::sendmsg(fd, &msg, flags);
+        }
         if (n < 0) {
             *savedErrno = errno;
         } else if (static_cast<size_t>(n) > 0) {
@@ -384,11 +472,9 @@ private:
 
     std::list<Block*> blocks_;  // 块链表（管理所有内存块）
     size_t total_readable_;     // 总可读字节数（缓存，避免每次遍历计算）
-    static const char kCRLF[];  // CRLF分隔符
+    static constexpr char kCRLF[] = "\r\n";  // CRLF分隔符
 };
 
-const char LinkedBuffer::kCRLF[] = "\r\n";
-
 } // namespace network
 } // namespace flkeeper
 
@@ -1,13 +1,58 @@
 #ifndef __CLOUD_STORAGE_POLLER_HPP__
 #define __CLOUD_STORAGE_POLLER_HPP__
 
+#include "network/Callback.hpp"
 #include "network/Channel.hpp"
-#include <map>
+#include <algorithm>
+#include <assert.h>
+#include <sys/types.h>
 #include <vector>
 
 namespace flkeeper {
 namespace network {
 
+/// @brief 以fd为下标的Channel表
+/// 内核总是分配最小的可用fd, 活跃的fd基本是连续的小整数, 用vector直接下标
+/// 访问代替树查找; 表只增长不收缩
+class ChannelTable {
+public:
+  ChannelTable() : size_(0) {}
+
+  /// @brief 查找fd对应的Channel, 不存在时返回nullptr
+  Channel *find(int fd) const {
+    return fd >= 0 && static_cast<size_t>(fd) < table_.size() ? table_[fd]
+                                                              : nullptr;
+  }
+
+  void add(int fd, Channel *channel) {
+    assert(fd >= 0 && channel);
+    if (static_cast<size_t>(fd) >= table_.size()) {
+      table_.resize(std::max(static_cast<size_t>(fd) + 1, table_.size() * 2),
+                    nullptr);
+    }
+    assert(!table_[fd]);
+    table_[fd] = channel;
+    ++size_;
+  }
+
+  /// @return 删除的个数
+  size_t erase(int fd) {
+    if (!find(fd)) {
+      return 0;
+    }
+    table_[fd] = nullptr;
+    --size_;
+    return 1;
+  }
+
+  /// @brief 表中的Channel个数
+  size_t size() const { return size_; }
+
+private:
+  std::vector<Channel *> table_;
+  size_t size_;
+};
+
 class Poller {
 public:
   using ChannelList = std::vector<Channel *>;
@@ -30,14 +75,33 @@ public:
   /// @brief 是否有Channel
   virtual bool hasChannel(Channel *channel) const;
 
+  /// @brief 提交异步文件读写, 完成后在所属loop中调用cb
+  /// @return false表示该Poller不支持异步文件IO, 由调用者同步执行
+  virtual bool submitFileRead(int /*fd*/, void * /*buf*/, size_t /*len*/,
+                              off_t /*offset*/, const FileIoCallback & /*cb*/) {
+    return false;
+  }
+  virtual bool submitFileWrite(int /*fd*/, const void * /*buf*/,
+                               size_t /*len*/, off_t /*offset*/,
+                               const FileIoCallback & /*cb*/) {
+    return false;
+  }
+
+  /// @brief 文件读写是否真正异步执行(不会阻塞loop线程)
+  virtual bool supportsAsyncFileIo() const { return false; }
+
+  /// @brief 是否支持Channel的边沿触发模式
+  virtual bool supportsEdgeTriggered() const { return false; }
+
   /// @brief 获取默认的Poller
   static Poller *newDefaultPoller(EventLoop *loop);
 
   void assertInLoopThread() const;
 
 protected:
-  using ChannelMap = std::map<int, Channel *>;
-  ChannelMap channels_; // fd到Channel的映射
+  EventLoop *ownerLoop() const { return ownerLoop_; }
+
+  ChannelTable channels_; // fd到Channel的映射
 
 private:
   EventLoop *ownerLoop_;
@@ -3,6 +3,8 @@
 
 #include "network/InetAddress.hpp"
 #include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
 
 namespace flkeeper {
 namespace network {
@@ -74,6 +76,68 @@ public:
    */
   void setKeepAlive(bool on);
 
+  /**
+   * @brief 设置SO_BUSY_POLL, 阻塞读取或poll时内核先忙轮询网卡队列
+   * @param usec 忙轮询时间(微秒), 0表示关闭
+   * @note 需要CAP_NET_ADMIN才能调大, 失败时只记录日志
+   */
+  void setBusyPoll(int usec);
+
+  /**
+   * @brief 设置TCP_DEFER_ACCEPT, 连接上有数据到达之后才唤醒accept
+   * @param seconds 等待数据的最长时间, 超时后内核仍会交付连接; 0表示关闭
+   * @note 只对监听socket有效
+   */
+  void setDeferAccept(int seconds);
+
+  /**
+   * @brief 设置TCP_FASTOPEN, 允许客户端在SYN中携带数据
+   * @param queueLen 等待中的TFO请求队列长度, 0表示关闭
+   * @note 只对监听socket有效, 需要sysctl net.ipv4.tcp_fastopen打开服务端支持
+   */
+  void setFastOpen(int queueLen);
+
+  // @brief 设置SO_SNDBUF/SO_RCVBUF, 显式设置后内核不再自动调节该缓冲区
+  void setSendBuffer(int bytes);
+  void setRecvBuffer(int bytes);
+
+  /**
+   * @brief 设置TCP_NOTSENT_LOWAT
+   * 内核中尚未发送的数据低于bytes时才报告可写, 数据留在用户态队列里,
+   * 减少内核发送缓冲区中的排队
+   */
+  void setNotSentLowat(int bytes);
+
+  /**
+   * @brief 设置TCP_CONGESTION拥塞控制算法
+   * @param name 算法名, 例如"cubic"、"bbr"; 内核没有加载时只记录日志
+   */
+  void setCongestion(const std::string &name);
+
+  /**
+   * @brief 设置TCP_CORK
+   * 开启期间只发送满长度的报文段, 关闭时立即发出剩余的数据
+   */
+  void setCork(bool on);
+
+  /**
+   * @brief 设置SO_ZEROCOPY, 之后才能使用MSG_ZEROCOPY发送
+   * @return 成功返回true, 内核不支持时返回false
+   */
+  bool setZeroCopy(bool on);
+
+  /**
+   * @brief 读取Unix域socket对端进程的pid/uid/gid(SO_PEERCRED)
+   * @return 成功返回true
+   */
+  bool getPeerCredentials(struct ucred *cred) const;
+
+  /**
+   * @brief 读取TCP_INFO
+   * @return 成功返回true
+   */
+  bool getTcpInfo(struct tcp_info *info) const;
+
 private:
   const int sockfd_; // socket文件描述符
 };
@@ -0,0 +1,77 @@
+#ifndef __CLOUD_STORAGE_SOCKETPROFILE_HPP__
+#define __CLOUD_STORAGE_SOCKETPROFILE_HPP__
+
+#include <string>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 一组声明式的socket选项, 由TcpServer应用到监听socket和新连接上
+ * 每个字段取默认值时不做任何设置, 保持系统(或sysctl)的默认行为, 因此
+ * 默认构造的profile与不设置profile完全相同. 同一进程中的不同监听端口可以
+ * 使用不同的profile, 例如大文件传输和小请求API分别调优
+ */
+struct SocketProfile {
+  // 响应头部与正文的合并方式
+  enum Coalesce {
+    kCoalesceNone,   // 每次send尽量立即写出
+    kCoalesceCork,   // 本轮事件循环的输出合并写出, 夹带文件时用TCP_CORK
+    kCoalesceMsgMore // 本轮事件循环的输出合并写出, 文件之前的数据带MSG_MORE
+  };
+
+  SocketProfile()
+      : deferAcceptSeconds(0), fastOpenQueue(0), sendBufferBytes(0),
+        recvBufferBytes(0), notSentLowat(0), tcpNoDelay(false),
+        keepAlive(true), coalesce(kCoalesceNone), zeroCopyThreshold(0) {}
+
+  // ---- 监听socket ----
+  int deferAcceptSeconds; // TCP_DEFER_ACCEPT, 对端发来数据后才唤醒accept
+  int fastOpenQueue;      // TCP_FASTOPEN, 等待中的TFO请求队列长度
+
+  // ---- 连接 ----
+  // SO_SNDBUF/SO_RCVBUF, 字节数; 显式设置会关闭内核的自动调节.
+  // 接收缓冲区同时设置在监听socket上, 这样握手时就能协商出合适的窗口扩大因子
+  int sendBufferBytes;
+  int recvBufferBytes;
+  int notSentLowat;       // TCP_NOTSENT_LOWAT, 限制内核中未发送的数据量
+  std::string congestion; // TCP_CONGESTION, 例如"bbr", 空表示系统默认
+  bool tcpNoDelay;        // TCP_NODELAY
+  bool keepAlive;         // SO_KEEPALIVE, TcpConnection默认开启
+  Coalesce coalesce;      // 输出合并方式, 见TcpConnection::setSocketProfile
+  // 不小于该长度的引用计数输出以MSG_ZEROCOPY发送, 0表示关闭,
+  // 见TcpConnection::setZeroCopy
+  size_t zeroCopyThreshold;
+
+  /**
+   * @brief 大文件传输: 大缓冲区, 头部和文件内容合并发送, 大块内存数据
+   * 零拷贝发送, 等到请求数据到达才唤醒accept
+   */
+  static SocketProfile bulkTransfer() {
+    SocketProfile profile;
+    profile.deferAcceptSeconds = 5;
+    profile.sendBufferBytes = 4 * 1024 * 1024;
+    profile.recvBufferBytes = 4 * 1024 * 1024;
+    profile.coalesce = kCoalesceCork;
+    profile.zeroCopyThreshold = 64 * 1024;
+    return profile;
+  }
+
+  /**
+   * @brief 小请求低延迟: 关闭Nagle, 开启Fast Open, 限制未发送数据让
+   * 应用层的数据尽快进入网卡, 一次响应的多次send合并成一个报文段
+   */
+  static SocketProfile lowLatency() {
+    SocketProfile profile;
+    profile.fastOpenQueue = 256;
+    profile.notSentLowat = 16 * 1024;
+    profile.tcpNoDelay = true;
+    profile.coalesce = kCoalesceMsgMore;
+    return profile;
+  }
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
@@ -7,19 +7,23 @@ namespace flkeeper {
 namespace network {
 
 ///
-/// 创建一个非阻塞的socket文件描述符
+/// 创建一个非阻塞的流式socket文件描述符, AF_UNIX时创建Unix域socket
 /// 如果发生错误，会终止程序
 int createNonblockingOrDie(sa_family_t family);
 
 ///
 /// 连接socket
+/// @param addrlen 地址长度, AF_UNIX地址必须给出实际长度
 /// @return 成功返回0，失败返回-1
-int connect(int sockfd, const struct sockaddr* addr);
+int connect(int sockfd, const struct sockaddr* addr,
+            socklen_t addrlen = sizeof(struct sockaddr_in6));
 
 ///
 /// 绑定socket地址
+/// @param addrlen 地址长度, AF_UNIX地址必须给出实际长度
 /// 如果发生错误，会终止程序
-void bindOrDie(int sockfd, const struct sockaddr* addr);
+void bindOrDie(int sockfd, const struct sockaddr* addr,
+               socklen_t addrlen = sizeof(struct sockaddr_in6));
 
 ///
 /// 监听socket
@@ -31,6 +35,11 @@ void listenOrDie(int sockfd);
 /// @return 成功返回非负的文件描述符，失败返回-1
 int accept(int sockfd, struct sockaddr_in6* addr);
 
+///
+/// 接受新连接, 对端地址可以是任意地址族
+/// @param addrlen 输入时为addr的容量, 返回时为对端地址的实际长度
+int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen);
+
 ///
 /// 从socket读取数据
 ssize_t read(int sockfd, void *buf, size_t count);
@@ -4,12 +4,21 @@
 #include "Buffer.hpp"
 #include "Callback.hpp"
 #include "InetAddress.hpp"
+#include "LinkedBuffer.hpp"
+#include "SocketProfile.hpp"
+#include "TcpInfo.hpp"
+#include "TimerId.hpp"
 #include "utils/NonCopyable.hpp"
 #include "utils/datastructures/FKString.hpp"
 
 #include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
 
 namespace flkeeper {
 namespace network {
@@ -17,6 +26,8 @@ namespace network {
 class Channel;
 class EventLoop;
 class Socket;
+class TlsContext;
+class TlsSession;
 
 using std::string;
 
@@ -40,6 +51,17 @@ public:
   TcpConnection(EventLoop *loop, const string &name, int sockfd,
                 const InetAddress &localAddr, const InetAddress &peerAddr);
 
+  /**
+   * @brief 构造函数, 连接名字在第一次调用name()时才拼接成namePrefix + seq
+   * @param namePrefix 由同一个服务器的所有连接共享的名字前缀
+   * @param seq 连接序号
+   * @note 服务器接收连接时使用, 不打印日志就不需要格式化名字
+   */
+  TcpConnection(EventLoop *loop,
+                const std::shared_ptr<const string> &namePrefix, int64_t seq,
+                int sockfd, const InetAddress &localAddr,
+                const InetAddress &peerAddr);
+
   /**
    * @brief 析构函数
    */
@@ -52,8 +74,15 @@ public:
 
   /**
    * @brief 获取连接名字
+   * @note 延迟构造, 可以在任意线程调用
    */
-  const string &name() const { return name_; }
+  const string &name() const;
+
+  /**
+   * @brief 在TcpServer连接表中的编号, 不属于任何连接表时为0
+   */
+  uint64_t id() const { return id_; }
+  void setId(uint64_t id) { id_ = id; }
 
   /**
    * @brief 获取本地地址
@@ -105,11 +134,166 @@ public:
   /**
    * @brief 发送数据
    * @param message 要发送的数据
+   * @note 在其它线程调用时数据会先拷贝一份再转交给所属的事件循环
    */
   void send(const void *message, int len);
   void send(const FKString &message);
+  void send(const char *message);
   void send(Buffer *message);
 
+  /**
+   * @brief 发送数据并接管其内存
+   * @param message 要发送的数据, 调用后为空
+   * @note 未能立即写出的部分以引用计数切片的形式挂到输出队列上,
+   * 不会再拷贝一次; 跨线程调用时同样不拷贝
+   */
+  void send(std::string &&message);
+  void send(Buffer &&message);
+
+  /**
+   * @brief 发送一段头部和紧跟其后的正文, 两者用一次writev写出
+   * @note 头部通常很短, 未能立即写出时拷贝进输出缓冲区; 正文与
+   * send(std::string&&)相同, 较大的剩余部分直接引用, 不再拷贝
+   */
+  void send(Buffer &&head, std::string &&body);
+
+  /**
+   * @brief 零拷贝发送文件内容
+   * @param fd 要发送的文件描述符(内部会dup一份，调用返回后调用者即可关闭自己的fd)
+   * @param offset 文件中的起始偏移
+   * @param length 要发送的字节数
+   * @note 数据通过sendfile(2)在EPOLLOUT时直接由内核发送，不经过用户态缓冲区;
+   * 所属loop支持异步文件IO(io_uring)时改为分块异步读出再写入socket, 磁盘
+   * 慢时不阻塞loop线程. 与send()发送的数据严格保持调用顺序
+   */
+  void sendFile(int fd, off_t offset, size_t length);
+
+  /**
+   * @brief 将接下来length字节的输入数据直接写入文件(socket -> pipe -> file)
+   * @param fd 目标文件描述符, 从其当前偏移处开始写(内部会dup一份)
+   * @param length 要接收的字节数
+   * @param cb 完成或失败时在所属事件循环中调用
+   * @note 输入缓冲区中已经读到的数据会先写入文件, 其余数据通过splice(2)
+   * 在内核中搬运; 所属loop支持异步文件IO时改为读入内存后异步写入文件,
+   * 在途的写入达到上限时暂停读取socket. 期间不会回调messageCallback.
+   * 完成后若输入缓冲区中还有剩余数据, 会重新交给messageCallback处理,
+   * 文件的当前偏移与同步写入时一致. 失败时调用者应当关闭连接
+   */
+  void spliceToFile(int fd, size_t length, const SpliceCompleteCallback &cb);
+
+  /**
+   * @brief 开启/关闭边沿触发模式
+   * @param on 是否使用边沿触发
+   * @param readBudget 每次可读事件最多读取的字节数, 读满预算仍未遇到EAGAIN时
+   * 把剩余的读取放到事件循环的下一轮, 避免单个连接饿死其它连接
+   * @note 当前Poller不支持边沿触发时(poll/io_uring)只启用按预算读取,
+   * 仍然使用水平触发
+   */
+  void setEdgeTriggered(bool on, size_t readBudget = kDefaultReadBudget);
+  bool isEdgeTriggered() const { return edgeTriggered_; }
+
+  static const size_t kDefaultReadBudget = 256 * 1024;
+
+  // @brief 设置socket的SO_BUSY_POLL, 见Socket::setBusyPoll
+  void setBusyPoll(int usec);
+
+  /**
+   * @brief Unix域socket连接的对端进程凭据(pid/uid/gid), 取自SO_PEERCRED,
+   * 是对端connect时的凭据; TCP连接返回false
+   */
+  bool getPeerCredentials(struct ucred *cred) const;
+
+  /**
+   * @brief 在连接上做服务端TLS握手, 握手完成后才调用连接回调, 之后的收发
+   * 对使用者透明; 握手失败或超时时直接关闭连接, 不调用连接回调
+   * OpenSSL开启了kTLS发送时sendFile仍然走sendfile, 否则退回到读出文件在
+   * 用户态加密. TLS连接不使用MSG_ZEROCOPY, spliceToFile改为解密后写文件
+   * @note 必须在connectEstablished之前调用
+   */
+  void startTls(const std::shared_ptr<TlsContext> &context);
+  // @brief TLS连接的会话, 明文连接为空
+  const TlsSession *tlsSession() const { return tls_.get(); }
+
+  /**
+   * @brief 把profile中连接相关的选项设置到socket上, 取默认值的字段不做设置
+   * 合并输出(coalesce不为kCoalesceNone)时send不再立即写socket, 同一轮事件
+   * 循环中的多次send和sendFile在本轮末尾一起写出, 响应头部和正文的开头落在
+   * 同一个报文段中; 后面跟着文件时用TCP_CORK或MSG_MORE让头部等待文件内容
+   * @note 必须在所属loop线程或连接建立之前调用
+   */
+  void setSocketProfile(const SocketProfile &profile);
+
+  /**
+   * @brief 大块内存数据使用MSG_ZEROCOPY发送, 内核直接从用户内存发送, 不再拷贝
+   * @param threshold 以send(std::string&&)/send(Buffer&&)交出、长度不小于
+   * threshold的数据走零拷贝, 0表示关闭; 更小的数据和拷贝进输出缓冲区的数据
+   * 仍然用普通的write/writev
+   * @note 数据的引用一直保留到内核通过错误队列通知发送完成; 内核报告退化
+   * 为拷贝(如回环地址)时自动关闭. 必须在所属loop线程或连接建立之前调用
+   */
+  void setZeroCopy(size_t threshold);
+
+  /**
+   * @brief 周期性采样TCP_INFO(RTT、拥塞窗口、重传、在途报文段)和发送队列
+   * 采样结果决定每次可写事件通过sendfile发送的字节数(约两倍的实际BDP, 见
+   * sendBatchBytes), 并用来判断慢速客户端: 相邻两次采样时都有数据积压在
+   * 用户态, 而期间对端确认的速率低于slowThroughput即视为慢速. 慢速期间输出
+   * 背压的高水位降到与发送量相称的大小, 不再为慢速的对端积压大量数据
+   * @param interval 采样间隔(秒), 小于等于0表示关闭
+   * @param slowThroughput 慢速客户端的速率阈值(字节/秒), 0表示不判断
+   * @note 必须在所属loop线程或连接建立之前调用
+   */
+  void setTcpInfoSampling(double interval, uint64_t slowThroughput = 0);
+  void setSlowClientCallback(const SlowClientCallback &cb) {
+    slowClientCallback_ = cb;
+  }
+
+  // @brief 立即读取一次TCP_INFO, 成功返回true; 必须在所属loop线程调用
+  bool sampleTcpInfo();
+  // @brief 最近一次的采样结果, 必须在所属loop线程读取
+  const TcpInfoSample &tcpInfo() const { return tcpInfo_; }
+  // @brief 最近一次采样是否判定为慢速客户端
+  bool isSlowClient() const { return slowClient_; }
+  // @brief 每次可写事件最多通过sendfile发送的字节数, 没有采样时为固定上限
+  size_t sendBatchBytes() const;
+
+  // 暂停读取的原因, 不同的使用者各用一位, 互不覆盖
+  enum ReadPauseReason {
+    kPauseUser = 1,        // 默认, 一般的使用者
+    kPauseProtocol = 2,    // 协议层, 如HttpServer的流水线限制
+    kPauseFlowControl = 4, // 应用层的流控, 如上传数据等待落盘
+    kPauseFileIo = 8       // 内部使用: spliceToFile等待异步写入文件
+  };
+
+  /**
+   * @brief 以reason暂停/恢复从socket读取数据, 可以在任意线程调用
+   * 暂停期间对端的数据留在内核接收缓冲区中, 由TCP流控让对端放慢发送.
+   * 所有原因的暂停都解除之后才恢复读取, 一个使用者恢复不会取消另一个
+   * 使用者的暂停. 边沿触发时恢复后会主动读一次, 暂停期间到达的数据不会
+   * 丢失通知
+   */
+  void startRead(int reason = kPauseUser);
+  void stopRead(int reason = kPauseUser);
+  // @brief 使用者是否允许读取(不包括输出背压造成的暂停)
+  bool isReading() const { return readPauses_ == 0; }
+
+  /**
+   * @brief 输出背压: 输出队列达到highWaterMark时自动暂停读取, 降到
+   * lowWaterMark以下时恢复, 避免慢速的对端让连接积压大量待发送数据
+   * @param highWaterMark 为0表示关闭(默认)
+   * @note 只统计内存中的输出队列, 不包括sendFile待发送的文件内容;
+   * 与stopRead互不影响, 两者都允许时才读取. 必须在所属loop线程调用
+   */
+  void setOutputWatermarks(size_t highWaterMark, size_t lowWaterMark);
+
+  // @brief 是否正在通过splice接收数据
+  bool isSplicing() const { return static_cast<bool>(splice_); }
+
+  // @brief 输出队列或待发送的文件片段中是否还有数据没有写入内核
+  bool hasPendingOutput() const {
+    return outputBuffer_.readableBytes() > 0 || !fileSegments_.empty();
+  }
+
   /**
    * @brief 关闭连接
    * 会调用shutdown(SHUT_WR)半关闭写端
@@ -129,7 +313,7 @@ public:
   /**
    * @brief 获取输出缓冲区
    */
-  Buffer *outputBuffer() { return &outputBuffer_; }
+  LinkedBuffer *outputBuffer() { return &outputBuffer_; }
 
   // 修改context相关方法
   void setContext(const std::shared_ptr<void> &context) { context_ = context; }
@@ -137,6 +321,70 @@ public:
 
 private:
   enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+
+  // flushOutput的结果
+  enum FlushResult {
+    kFlushDone,    // 输出全部写完
+    kFlushBlocked, // 内核发送缓冲区已满(EAGAIN), 等待可写事件
+    kFlushYield,   // 为了公平主动让出, 发送缓冲区可能仍然可写
+    kFlushPending, // 等待异步读出文件内容, 读完后继续发送
+    kFlushError    // 出错, 需要关闭连接
+  };
+
+  // 等待通过sendfile发送的文件片段
+  struct FileSegment {
+    int fd;             // dup出来的文件描述符，发送完毕后关闭
+    off_t offset;       // 下一次发送的文件偏移
+    size_t remaining;   // 剩余待发送的字节数
+    size_t bytesBefore; // 输出缓冲区中必须先于该片段发送的字节数(相对前一个片段)
+  };
+
+  // 异步读出、等待写入socket的一块文件内容. 读取在途时内存和文件描述符
+  // 都不能释放, 所以由连接和完成回调共同持有
+  struct FileChunk {
+    FileChunk();
+    ~FileChunk();
+    std::vector<char> data;
+    int fd;         // 连接关闭时仍在读取的文件, 由这里在读完后关闭
+    size_t length;  // 读到的字节数
+    size_t sent;    // 已经写入socket的字节数
+    bool reading;   // 是否有读请求在途
+  };
+
+  // 以MSG_ZEROCOPY发出、等待内核完成通知的数据
+  struct ZeroCopyBuffer {
+    uint32_t id;                         // 内核为每次零拷贝发送分配的序号
+    std::shared_ptr<const void> holder;  // 数据的引用, 完成后释放
+  };
+
+  // 连接关闭时仍在等待零拷贝完成通知的数据. 内核发完之前这些内存不能释放,
+  // 所以dup一份socket保持打开(dup失败时持有连接本身), 定期读取错误队列
+  // 直到全部完成或超时
+  struct ZeroCopyLinger {
+    int fd;                              // dup出来的socket或连接自己的socket
+    std::shared_ptr<TcpConnection> owner; // dup失败时持有连接, 否则为空
+    std::deque<ZeroCopyBuffer> pending;  // 等待完成通知的数据
+    int ticksLeft;                       // 剩余的检查次数, 用完时中止连接
+    bool aborted;                        // 是否已经以RST中止
+  };
+
+  // splice接收状态, 析构时关闭管道和文件描述符
+  struct SpliceContext {
+    SpliceContext();
+    ~SpliceContext();
+    int pipeFds[2];                 // 中转管道, [0]读端 [1]写端
+    int fileFd;                     // dup出来的目标文件描述符
+    size_t pipeSize;                // 管道容量, 决定单次splice的上限
+    size_t remaining;               // 还需要接收的字节数
+    size_t written;                 // 已写入文件的字节数
+    off_t fileOffset;   // 异步写入时下一块数据的文件偏移, -1表示同步写入
+    int writesInFlight; // 在途的异步写请求数
+    SpliceCompleteCallback callback;
+  };
+
+  // 握手没有完成的连接最长存活时间(秒)
+  static constexpr double kHandshakeTimeout = 10.0;
+
   void setState(StateE s) { state_ = s; }
   void handleRead(date::TimeStamp receiveTime);
   void handleWrite();
@@ -144,13 +392,90 @@ private:
   void handleError();
   void sendInLoop(const FKString &message);
   void sendInLoop(const void *message, size_t len);
+  void sendStringInLoop(const std::shared_ptr<std::string> &message);
+  void sendBufferInLoop(const std::shared_ptr<Buffer> &message);
+  void sendPairInLoop(const std::shared_ptr<Buffer> &head,
+                      const std::shared_ptr<std::string> &body);
+  size_t writeDirectly(const char *data, size_t len, bool *faultError);
+  size_t writevDirectly(const struct iovec *iov, int iovcnt, size_t len,
+                        bool *faultError);
+  void queueOutput(size_t len);
+  void sendFileInLoop(int fd, off_t offset, size_t length);
+  FlushResult flushOutput();
+  // 通过异步读出的FileChunk发送文件片段, 片段发完时返回kFlushDone
+  FlushResult flushFileChunk(FileSegment &seg);
+  void handleFileChunkRead(ssize_t n);
+  // 写出输出缓冲区开头最多limit字节, 大块切片走MSG_ZEROCOPY
+  ssize_t writeOutput(size_t limit, int flags, int *savedErrno);
+  bool wantZeroCopy(size_t len) const {
+    return zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_;
+  }
+  // 读取错误队列中的零拷贝完成通知, 读到通知时返回true
+  bool handleZeroCopyCompletions();
+  // 从fd的错误队列中读出完成通知, 释放pending中已经完成的数据; 内核报告
+  // 退化为拷贝时把*copied置为true
+  static bool drainZeroCopyCompletions(int fd,
+                                       std::deque<ZeroCopyBuffer> *pending,
+                                       bool *copied);
+  // 连接关闭时把还没有完成的零拷贝数据交给ZeroCopyLinger, 不在这里释放
+  void parkZeroCopyPending();
+  static void
+  checkZeroCopyLinger(EventLoop *loop,
+                      const std::shared_ptr<ZeroCopyLinger> &linger);
+  void clearFileSegments();
+  // 把待发送字节数的变化同步到所属loop的负载统计
+  void updateOutputLoad();
+  void spliceToFileInLoop(int fd, size_t length,
+                          const SpliceCompleteCallback &cb);
+  void setEdgeTriggeredInLoop(bool on, size_t readBudget);
+  void startReadInLoop(int reason);
+  void stopReadInLoop(int reason);
+  // 按readPauses_和outputPaused_开关Channel的读事件
+  void updateReading();
+  void continueRead();
+  void continueWrite();
+  void startTcpInfoTimer();
+  // 停止采样定时器, 连接关闭时也从所属loop的慢速连接数中移除
+  void stopTcpInfoTimer();
+  void onTcpInfoTimer();
+  // 输出背压实际使用的高水位, 慢速客户端按发送量缩小
+  size_t effectiveHighWaterMark() const;
+  // 合并输出时在本轮事件循环末尾写出, 每轮最多投递一次
+  void scheduleFlush();
+  void flushCoalesced();
+  void handleSpliceRead();
+  // TLS连接的spliceToFile: 解密后写入文件
+  void handleTlsFileRead();
+  // 异步写入时的spliceToFile: 读入内存后交给所属loop异步写文件
+  void handleAsyncFileRead();
+  // 把data中从done开始的部分写到文件的offset处
+  void submitFileWrite(const std::shared_ptr<SpliceContext> &ctx,
+                       const std::shared_ptr<std::string> &data, size_t done,
+                       off_t offset);
+  void handleFileWritten(const std::shared_ptr<SpliceContext> &ctx,
+                         const std::shared_ptr<std::string> &data, size_t done,
+                         off_t offset, ssize_t n);
+  void finishSplice(bool ok);
+  // 推进TLS握手, 完成时调用连接回调
+  void handleHandshake();
+  // TLS连接读一次, 解密后的数据追加到输入缓冲区
+  ssize_t readTls(int *savedErrno);
+  // 是否需要在用户态加密输出(TLS连接且发送方向没有交给kTLS)
+  bool userspaceTls() const;
+  // 明文连接或TLS握手已经完成, 之前的连接对使用者不可见
+  bool handshakeDone() const;
   void shutdownInLoop();
   void forceCloseInLoop();
 
   EventLoop *loop_;           // 所属的事件循环
-  const string name_;         // 连接名字
+  const std::shared_ptr<const string> namePrefix_; // 连接名字的前缀
+  const int64_t seq_;         // 连接序号, 大于0时拼接在名字前缀之后
+  mutable std::once_flag nameOnce_;
+  mutable string name_;       // 连接名字, 第一次使用时构造
+  uint64_t id_;               // 在TcpServer连接表中的编号
   std::atomic<StateE> state_; // 连接状态
-  bool reading_;              // 是否正在读取数据
+  int readPauses_;            // 使用者暂停读取的原因, 见startRead/stopRead
+  bool outputPaused_;         // 是否因为输出队列超过高水位而暂停读取
 
   std::unique_ptr<Socket> socket_;   // Socket对象
   std::unique_ptr<Channel> channel_; // Channel对象
@@ -163,9 +488,41 @@ private:
   HighWaterMarkCallback highWaterMarkCallback_; // 高水位回调
   CloseCallback closeCallback_;                 // 连接关闭回调
   size_t highWaterMark_;                        // 高水位标记
+  size_t outputHighWaterMark_; // 输出背压的高水位, 0表示关闭
+  size_t outputLowWaterMark_;  // 输出背压的低水位
 
   Buffer inputBuffer_;  // 输入缓冲区
-  Buffer outputBuffer_; // 输出缓冲区
+  LinkedBuffer outputBuffer_; // 输出队列, 由自有内存块和引用计数切片组成
+
+  std::deque<FileSegment> fileSegments_; // 待发送的文件片段
+  size_t bufferedBeforeFiles_; // 输出缓冲区中排在文件片段之前的字节总数
+  size_t pendingFileBytes_;    // 文件片段中剩余待发送的字节总数
+  size_t reportedOutputBytes_; // 已经计入所属loop负载的待发送字节数
+  std::shared_ptr<FileChunk> fileChunk_; // 异步发送文件时的读缓冲
+
+  // 非空表示正在splice接收数据; 异步写入在途时由完成回调共同持有
+  std::shared_ptr<SpliceContext> splice_;
+
+  SocketProfile::Coalesce coalesce_; // 输出合并方式
+  size_t zeroCopyThreshold_;         // 零拷贝发送的长度下限, 0表示关闭
+  uint32_t zeroCopyNextId_;          // 下一次零拷贝发送的序号
+  std::deque<ZeroCopyBuffer> zeroCopyPending_; // 等待完成通知的数据
+  bool flushQueued_;                 // 是否已经投递了合并输出的写出
+
+  double tcpInfoInterval_;    // TCP_INFO采样间隔(秒), 0表示关闭
+  uint64_t slowThroughput_;   // 慢速客户端的速率阈值(字节/秒)
+  TimerId tcpInfoTimer_;      // 采样定时器
+  bool tcpInfoTimerActive_;   // 采样定时器是否在运行
+  TcpInfoSample tcpInfo_;     // 最近一次采样结果
+  uint64_t bytesWritten_;     // 写入内核的总字节数, 用来计算确认速率
+  bool slowClient_;           // 是否被判定为慢速客户端
+  SlowClientCallback slowClientCallback_;
+
+  std::unique_ptr<TlsSession> tls_; // TLS会话, 明文连接为空
+  TimerId handshakeTimer_;          // TLS握手超时定时器
+
+  bool edgeTriggered_; // Channel是否实际使用边沿触发
+  size_t readBudget_;  // 每次可读事件最多读取的字节数, 0表示只读一次
 
   // 修改context成员变量类型
   std::shared_ptr<void> context_;
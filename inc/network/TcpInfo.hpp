@@ -0,0 +1,75 @@
+#ifndef __CLOUD_STORAGE_TCPINFO_HPP__
+#define __CLOUD_STORAGE_TCPINFO_HPP__
+
+#include "utils/date/TimeStamp.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 一次TCP_INFO采样中与发送相关的字段
+ * 由TcpConnection周期性地从内核读取, 用来估计连接当前能承受的发送速率
+ */
+struct TcpInfoSample {
+  TcpInfoSample()
+      : rttUs(0), rttVarUs(0), cwnd(0), mss(0), unacked(0), retransmits(0),
+        totalRetransmits(0), sendQueueBytes(0), bytesAcked(0),
+        deliveryRate(0), deliveryRateValid(false), backlogged(false) {}
+
+  date::TimeStamp when;      // 采样时间, 无效表示还没有采样过
+  uint32_t rttUs;            // 平滑后的RTT(微秒)
+  uint32_t rttVarUs;         // RTT的波动(微秒)
+  uint32_t cwnd;             // 拥塞窗口(报文段数)
+  uint32_t mss;              // 发送方向的MSS
+  uint32_t unacked;          // 已发送未确认的报文段数
+  uint32_t retransmits;      // 当前正在重传的报文段数
+  uint32_t totalRetransmits; // 连接建立以来累计重传的报文段数
+  size_t sendQueueBytes;     // 内核发送队列中未确认(含未发送)的字节数(SIOCOUTQ)
+  uint64_t bytesAcked;       // 连接建立以来对端确认的字节数
+  uint64_t deliveryRate;     // 与上一次采样之间实际被确认的速率(字节/秒)
+  // 两次采样时用户态都有积压, 确认速率反映的是对端和网络而不是应用
+  bool deliveryRateValid;
+  bool backlogged;           // 采样时用户态是否还有没能写入内核的数据
+
+  bool valid() const { return when.microSecondsSinceEpoch() > 0; }
+
+  // @brief 一个RTT内允许在途的字节数
+  size_t windowBytes() const { return static_cast<size_t>(cwnd) * mss; }
+
+  // @brief 在途未确认的字节数
+  size_t unackedBytes() const { return static_cast<size_t>(unacked) * mss; }
+
+  // @brief 按拥塞窗口和RTT估计的发送速率上限(字节/秒), 没有RTT时为0
+  uint64_t windowThroughput() const {
+    return rttUs == 0 ? 0
+                      : static_cast<uint64_t>(windowBytes()) *
+                            date::TimeStamp::kMicroSecondsPerSec / rttUs;
+  }
+
+  /**
+   * @brief 一个RTT内实际能送达的字节数
+   * 拥塞窗口只反映网络, 对端读得慢时由接收窗口限制, 因此再用实测的
+   * 确认速率约束一次
+   */
+  size_t bdpBytes() const {
+    size_t window = windowBytes();
+    if (!deliveryRateValid || rttUs == 0) {
+      return window;
+    }
+    // 速率异常大时乘法会溢出, 此时确认速率不构成约束
+    if (deliveryRate > UINT64_MAX / rttUs) {
+      return window;
+    }
+    uint64_t measured =
+        deliveryRate * rttUs / date::TimeStamp::kMicroSecondsPerSec;
+    return measured < window ? static_cast<size_t>(measured) : window;
+  }
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
@@ -8,12 +8,17 @@
 #include "network/EventLoopThreadPool.hpp"
 #include "network/Callback.hpp"
 #include "network/Buffer.hpp"
+#include "network/TcpConnection.hpp"
+#include "network/ConnectionTable.hpp"
+#include "network/SocketProfile.hpp"
+#include "network/TlsContext.hpp"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <atomic>
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 
 namespace flkeeper {
 namespace network {
@@ -26,6 +31,9 @@ public:
   enum Option {
     kNoReusePort,
     kReusePort,
+    // 每个IO线程各自持有一个SO_REUSEPORT监听socket, 由内核在这些socket之间
+    // 分配新连接, 连接在接受它的线程中直接建立, 不再经过baseLoop转发
+    kReusePortPerLoop,
   };
 
   /**
@@ -58,9 +66,73 @@ public:
     writeCompleteCallback_ = cb;
   }
 
-  // 设置线程数量
+  // 设置线程数量, EventLoopThreadPool::kAutoThreads表示按物理核数自动确定
   void setThreadNum(int numThreads);
 
+  // IO线程是否绑定CPU, 见EventLoopThreadPool::setCpuAffinity
+  void setCpuAffinity(bool on) { threadPool_->setCpuAffinity(on); }
+
+  /**
+   * @brief 设置新连接在IO线程之间的分配策略
+   * @note kReusePortPerLoop时连接由内核分配到各个监听socket, 不经过该策略
+   */
+  void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) {
+    threadPool_->setDispatchPolicy(policy);
+  }
+
+  /**
+   * @brief 新连接是否使用边沿触发, 见TcpConnection::setEdgeTriggered
+   * @note 必须在start()之前调用
+   */
+  void setEdgeTriggered(bool on,
+                        size_t readBudget = TcpConnection::kDefaultReadBudget) {
+    edgeTriggered_ = on;
+    readBudget_ = readBudget;
+  }
+
+  /**
+   * @brief 开启各IO线程的自适应忙轮询, 见EventLoop::setBusyPoll
+   * @param spinUs 最长忙轮询时间(微秒), 0表示关闭
+   * @param socketBusyPoll 是否同时给新连接设置SO_BUSY_POLL(同样的时间)
+   * @note 以CPU换延迟, 只适合对延迟敏感的部署; 必须在start()之前调用
+   */
+  void setBusyPoll(int spinUs, bool socketBusyPoll = false) {
+    busyPollUs_ = spinUs;
+    socketBusyPoll_ = socketBusyPoll;
+  }
+
+  /**
+   * @brief 设置监听socket和新连接的socket选项, 见SocketProfile
+   * @note 必须在start()之前调用; 单个连接可以在连接回调中再用
+   * TcpConnection::setSocketProfile覆盖
+   */
+  void setSocketProfile(const SocketProfile &profile) {
+    socketProfile_ = profile;
+  }
+  const SocketProfile &socketProfile() const { return socketProfile_; }
+
+  /**
+   * @brief 新连接周期性采样TCP_INFO, 见TcpConnection::setTcpInfoSampling
+   * 各IO线程中的慢速连接数见EventLoop::numSlowConnections
+   * @note 必须在start()之前调用
+   */
+  void setTcpInfoSampling(double interval, uint64_t slowThroughput = 0) {
+    tcpInfoInterval_ = interval;
+    slowThroughput_ = slowThroughput;
+  }
+  // 连接被判定为慢速或恢复时在其IO线程中调用
+  void setSlowClientCallback(const SlowClientCallback &cb) {
+    slowClientCallback_ = cb;
+  }
+
+  /**
+   * @brief 新连接先做TLS握手, 见TcpConnection::startTls; 为空表示明文
+   * @note 必须在start()之前调用
+   */
+  void setTlsContext(const std::shared_ptr<TlsContext> &context) {
+    tlsContext_ = context;
+  }
+
   // 启动服务器
   void start();
 
@@ -74,31 +146,47 @@ public:
   const std::string &ipPort() const { return ipPort_; }
 
 private:
-  // 新连接到来时的回调函数
+  // 新连接到来时的回调函数, 由baseLoop上的acceptor调用
   void newConnection(int sockfd, const InetAddress &peerAddr);
 
+  // 在ioLoop中为新连接创建TcpConnection
+  void newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                           const InetAddress &peerAddr);
+
   // 移除连接的回调函数
   void removeConnection(const TcpConnectionPtr &conn);
 
   // 在IO线程中移除连接
   void removeConnectionInLoop(const TcpConnectionPtr &conn);
 
-  using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
-
   EventLoop *loop_;                                 // 事件循环
   const std::string ipPort_;                        // 监听的IP和端口
   const std::string name_;                          // 服务器名称
-  std::unique_ptr<Acceptor> acceptor_;              // 接收器
+  const std::shared_ptr<const std::string> connNamePrefix_; // 连接名字的前缀
+  const InetAddress listenAddr_;                    // 监听地址
+  const Option option_;                             // 端口复用选项
+  std::unique_ptr<Acceptor> acceptor_;              // 接收器, kReusePortPerLoop时为空
+  std::vector<std::unique_ptr<Acceptor>> loopAcceptors_; // 每个IO线程的接收器
   std::shared_ptr<EventLoopThreadPool> threadPool_; // 线程池
 
   ConnectionCallback connectionCallback_;       // 连接回调
   MessageCallback messageCallback_;             // 消息回调
   WriteCompleteCallback writeCompleteCallback_; // 写完成回调
   ThreadInitCallback threadInitCallback_;       // 线程初始化回调
+  SlowClientCallback slowClientCallback_;       // 慢速客户端回调
 
   std::atomic_bool started_;  // 服务器是否已启动
-  int nextConnId_;            // 下一个连接ID
-  ConnectionMap connections_; // 连接表
+  std::atomic<int64_t> nextConnId_; // 下一个连接序号, 用于连接名字
+  bool edgeTriggered_;        // 新连接是否使用边沿触发
+  size_t readBudget_;         // 边沿触发时每次可读事件的读取预算
+  int busyPollUs_;            // IO线程的最长忙轮询时间, 0表示关闭
+  bool socketBusyPoll_;       // 新连接是否设置SO_BUSY_POLL
+  SocketProfile socketProfile_; // 监听socket和新连接的socket选项
+  double tcpInfoInterval_;      // 新连接的TCP_INFO采样间隔, 0表示关闭
+  uint64_t slowThroughput_;     // 慢速客户端的速率阈值(字节/秒)
+  std::shared_ptr<TlsContext> tlsContext_; // 新连接的TLS配置, 为空表示明文
+  std::mutex connectionsMutex_; // kReusePortPerLoop时多个IO线程同时访问连接表
+  ConnectionTable connections_; // 连接表
 };
 
 } // namespace network
@@ -15,9 +15,26 @@ class Timer : NonCopyable {
 public:
   using TimerCallback = std::function<void()>;
 
+  Timer()
+      : expiration_(), interval_(0.0), repeat_(false), sequence_(0),
+        prev_(nullptr), next_(nullptr), wheelSlot_(-1), wheelState_(0) {}
+
   Timer(TimerCallback cb, date::TimeStamp when, DFLK_FP interval)
       : callback_(std::move(cb)), expiration_(when), interval_(interval),
-        repeat_(interval > 0.0), sequence_(s_numCreated_.fetch_add(1)) {}
+        repeat_(interval > 0.0), sequence_(s_numCreated_.fetch_add(1)),
+        prev_(nullptr), next_(nullptr), wheelSlot_(-1), wheelState_(0) {}
+
+  // @brief 重新初始化定时器并分配新的序列号, 用于复用定时器对象
+  void reset(TimerCallback cb, date::TimeStamp when, DFLK_FP interval) {
+    callback_ = std::move(cb);
+    expiration_ = when;
+    interval_ = interval;
+    repeat_ = interval > 0.0;
+    sequence_ = s_numCreated_.fetch_add(1);
+  }
+
+  // @brief 释放回调持有的资源, 对象回到池中之前调用
+  void clear() { TimerCallback().swap(callback_); }
 
   // @brief 执行回调函数
   void run() { callback_(); }
@@ -37,11 +54,19 @@ public:
   void restart(date::TimeStamp now);
 
 private:
-  const TimerCallback callback_;    // 定时器回调函数
+  friend class TimingWheel;
+
+  TimerCallback callback_;    // 定时器回调函数
   date::TimeStamp expiration_;      // 定时器超时时间, 超时后触发回调函数
-  const double interval_;   // 超时时间间隔
-  const bool repeat_;       // 是否重复
-  const DFLK_INT64 sequence_;   // 定时器的序号
+  double interval_;   // 超时时间间隔
+  bool repeat_;       // 是否重复
+  DFLK_INT64 sequence_;   // 定时器的序号
+
+  // 以下成员只由TimingWheel使用: 所在槽位的侵入式双向链表与状态
+  Timer *prev_;
+  Timer *next_;
+  int wheelSlot_;   // 所在槽位, -1表示不在时间轮中
+  int wheelState_;  // 见TimingWheel::NodeState
 
   static std::atomic<DFLK_INT64> s_numCreated_;   // 定时器计数。用于生成sequence
 };
@@ -1,59 +1,60 @@
 #ifndef __CLOUD_STORAGE_TIMERQUEUE_HPP__
 #define __CLOUD_STORAGE_TIMERQUEUE_HPP__
 
-#include <set>
-#include <vector>
-
 #include "utils/NonCopyable.hpp"
-#include "utils/thread/PMutex.hpp"
 #include "utils/date/TimeStamp.hpp"
 #include "utils/Types.hpp"
 #include "Callback.hpp"
 #include "Channel.hpp"
+#include "TimerId.hpp"
 
 namespace flkeeper {
 namespace network {
 
 class EventLoop;
 class Timer;
-class TimerId;
 
+/**
+ * @brief 定时器队列的抽象基类
+ * 基类持有timerfd及其Channel, 子类负责组织定时器并在timerfd可读时处理到期的
+ * 定时器. 默认实现为基于std::set的TreeTimerQueue, 设置环境变量
+ * MYMUDUO_USE_TIMING_WHEEL时使用层级时间轮TimingWheel
+ */
 class TimerQueue : NonCopyable {
 public:
   explicit TimerQueue(EventLoop *loop);
-  ~TimerQueue();
+  virtual ~TimerQueue();
 
-  TimerId addTimer(TimerCallback cb, date::TimeStamp when, DFLK_FP interval);
+  /// @brief 添加定时器, 可以在任意线程调用
+  /// @param interval 大于0时表示重复定时器的间隔(秒)
+  virtual TimerId addTimer(TimerCallback cb, date::TimeStamp when,
+                           DFLK_FP interval) = 0;
 
-  void cancel(TimerId timerId);
-private:
-  using Entry = std::pair<date::TimeStamp, Timer*>;
+  /// @brief 取消定时器, 可以在任意线程调用
+  virtual void cancel(TimerId timerId) = 0;
 
-  // 定时器集合，按到期时间排序
-  using TimerList = std::set<Entry>;
+  /// @brief 获取默认的定时器队列
+  static TimerQueue *newDefaultTimerQueue(EventLoop *loop);
 
-  // 激活的定时器集合
-  using ActiveTimer = std::pair<Timer*, DFLK_INT64>;
-  using ActiveTimerSet = std::set<ActiveTimer>;
+protected:
+  /// @brief timerfd可读时在loop线程中调用
+  virtual void handleExpired(date::TimeStamp now) = 0;
 
-  void addTimerInLoop(Timer *timer);
-  void cancelInLoop(TimerId timerId);
+  /// @brief 让timerfd在expiration时刻触发
+  void resetTimerfd(date::TimeStamp expiration);
 
-  void handleRead();
+  static Timer *timerOf(const TimerId &timerId) { return timerId.timer_; }
+  static DFLK_INT64 sequenceOf(const TimerId &timerId) {
+    return timerId.sequence_;
+  }
 
-  std::vector<Entry> getExpired(date::TimeStamp now);
-  void reset(const std::vector<Entry>& expired, date::TimeStamp now);
+  EventLoop *loop_;     // 该定时器队列所属的事件循环器
 
-  bool insert(Timer* timer);
+private:
+  void handleRead();
 
-  EventLoop *loop_;     // 该定时器队列所属的事件循环器
   const int timerfd_;     // 定时器文件描述符
   Channel timerfdChannel_;    // 定时器通道
-  TimerList timers_;      // 按到期时间排序的定时器集合
-
-  ActiveTimerSet activeTimers_;   // 按对象地址排序的定时器集合
-  bool callingExpiredTimers_;     // 是否正在处理到期定时器
-  ActiveTimerSet cancelingTimers_;    // 保存被取消的定时器
 };
 
 }     // namespace network
@@ -0,0 +1,95 @@
+#ifndef __CLOUD_STORAGE_TLSCONTEXT_HPP__
+#define __CLOUD_STORAGE_TLSCONTEXT_HPP__
+
+#include "utils/NonCopyable.hpp"
+
+#include <deque>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 服务端TLS配置, 封装OpenSSL的SSL_CTX, 由TcpServer的所有连接共享
+ * @note
+ * 1. 默认开启kTLS(SSL_OP_ENABLE_KTLS): 握手完成后OpenSSL通过TCP_ULP "tls"
+ *    把记录层的加解密交给内核, 之后write/writev/sendfile直接发送明文, 由内核
+ *    加密; 内核或加密套件不支持时自动退回用户态加密, 见TlsSession
+ * 2. 会话恢复: 服务端会话缓存(TLS1.2的session id)和会话票据(TLS1.3和
+ *    TLS1.2的ticket)都默认开启. 不设置票据密钥时OpenSSL为每个进程生成随机
+ *    密钥, 多进程部署时用addTicketKey设置相同的密钥, 并定期rotateTicketKey
+ * 3. 配置函数必须在TcpServer::start之前调用, 票据密钥的轮换可以在任意线程
+ */
+class TlsContext : NonCopyable {
+public:
+  // 票据密钥的长度: 16字节名字 + 32字节HMAC密钥 + 32字节AES密钥,
+  // 与nginx的ssl_session_ticket_key文件格式相同
+  static constexpr size_t kTicketKeyLength = 80;
+
+  TlsContext();
+  ~TlsContext();
+
+  /**
+   * @brief 加载PEM格式的证书链和私钥
+   * @return 成功返回true, 失败时记录OpenSSL的错误并返回false
+   */
+  bool useCertificate(const std::string &certChainFile,
+                      const std::string &keyFile);
+
+  // @brief 开启/关闭kTLS, 默认开启
+  void setKtls(bool on);
+  bool ktlsEnabled() const { return ktls_; }
+
+  /**
+   * @brief 设置服务端会话缓存
+   * @param size 缓存的会话数, 0表示不限制
+   * @param timeoutSeconds 会话(以及票据)的有效期
+   */
+  void setSessionCache(long size, long timeoutSeconds);
+
+  /**
+   * @brief 添加一个会话票据密钥, 新添加的密钥用于加密新票据, 之前的密钥
+   * 只用来解密, 最多保留kMaxTicketKeys个
+   * @param key kTicketKeyLength字节的密钥
+   * @return 长度不对时返回false
+   */
+  bool addTicketKey(const std::string &key);
+
+  // @brief 随机生成一个新的票据密钥并切换过去, 旧密钥签发的票据仍然有效
+  void rotateTicketKey();
+
+  SSL_CTX *get() const { return ctx_; }
+
+  // @brief 取出并清空当前线程的OpenSSL错误队列, 用于日志
+  static std::string errorString();
+
+private:
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char hmacKey[32];
+    unsigned char aesKey[32];
+  };
+
+  // 同时保留的票据密钥数: 当前密钥加上两个旧密钥
+  static constexpr size_t kMaxTicketKeys = 3;
+
+  // OpenSSL签发/解密票据时的回调, 返回值的含义见
+  // SSL_CTX_set_tlsext_ticket_key_evp_cb
+  static int ticketKeyCallback(SSL *ssl, unsigned char *name,
+                               unsigned char *iv, EVP_CIPHER_CTX *cipherCtx,
+                               EVP_MAC_CTX *macCtx, int enc);
+
+  void addTicketKey(const TicketKey &key);
+
+  SSL_CTX *ctx_;
+  bool ktls_;
+  std::mutex ticketMutex_;
+  std::deque<TicketKey> ticketKeys_; // 第一个是当前用于加密的密钥
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __CLOUD_STORAGE_TLSSESSION_HPP__
+#define __CLOUD_STORAGE_TLSSESSION_HPP__
+
+#include "network/TlsContext.hpp"
+#include "utils/NonCopyable.hpp"
+
+#include <memory>
+#include <openssl/ssl.h>
+#include <sys/types.h>
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 一条TLS连接的状态, 由TcpConnection持有, 只在所属loop线程中使用
+ * 握手在非阻塞socket上进行, 完成后如果OpenSSL把发送方向交给了kTLS
+ * (ktlsSend()为true), 明文可以直接write/sendfile到socket上; 否则所有输出
+ * 都要经过write/sendFile在用户态加密. 读取总是经过read, 接收方向是否卸载
+ * 到内核由OpenSSL处理
+ * @note 读写接口的返回值与read(2)/write(2)一致: 失败返回-1并把错误码写入
+ * savedErrno, EAGAIN表示需要等待socket可读或可写
+ */
+class TlsSession : NonCopyable {
+public:
+  enum HandshakeResult {
+    kHandshakeDone,      // 握手完成
+    kHandshakeWantRead,  // 等待socket可读
+    kHandshakeWantWrite, // 等待socket可写
+    kHandshakeError      // 握手失败, 应当关闭连接
+  };
+
+  TlsSession(const std::shared_ptr<TlsContext> &context, int sockfd);
+  ~TlsSession();
+
+  // @brief 推进一次握手
+  HandshakeResult handshake();
+  bool established() const { return established_; }
+
+  // @brief 握手后发送/接收方向是否由内核kTLS处理
+  bool ktlsSend() const { return ktlsSend_; }
+  bool ktlsRecv() const { return ktlsRecv_; }
+
+  // @brief 本次握手是否恢复了之前的会话(会话缓存或票据)
+  bool sessionReused() const { return SSL_session_reused(ssl_) == 1; }
+  const char *version() const { return SSL_get_version(ssl_); }
+  const char *cipher() const { return SSL_get_cipher_name(ssl_); }
+
+  /**
+   * @brief 读取解密后的数据
+   * @return 对端关闭(close_notify或TCP FIN)时返回0
+   */
+  ssize_t read(char *buf, size_t len, int *savedErrno);
+  // @brief OpenSSL中还有已经解密而没有读出的数据, socket上不会再有可读事件
+  bool hasPending() const { return SSL_pending(ssl_) > 0; }
+
+  /**
+   * @brief 加密并写出数据
+   * @note EAGAIN之后必须用内容相同、长度不小于上一次的数据重试
+   */
+  ssize_t write(const char *data, size_t len, int *savedErrno);
+
+  /**
+   * @brief 用户态加密时代替sendfile: 从文件读出一段到内部缓冲区再加密写出,
+   * 语义与sendfile(2)相同, 成功时推进*offset
+   * @note 写出一部分时剩余的数据留在内部缓冲区, 下一次调用先写它们,
+   * 因此同一个文件片段发送完之前不能穿插其它输出
+   */
+  ssize_t sendFile(int fd, off_t *offset, size_t count, int *savedErrno);
+
+  // @brief 发送close_notify, 尽力而为, 不等待对端的回应
+  void shutdown();
+
+private:
+  // 用户态加密时每次从文件读出的字节数, 正好是4个满长度的TLS记录
+  static constexpr size_t kFileChunk = 64 * 1024;
+
+  // 把SSL_read/SSL_write的失败转换成errno
+  ssize_t failed(int ret, const char *what, int *savedErrno);
+
+  std::shared_ptr<TlsContext> context_;
+  SSL *ssl_;
+  bool established_;
+  bool ktlsSend_;
+  bool ktlsRecv_;
+  std::unique_ptr<char[]> fileBuffer_; // 从文件读出、还没有加密写出的数据
+  size_t fileBegin_;                   // fileBuffer_中下一个要写出的位置
+  size_t fileEnd_;                     // fileBuffer_中数据的结尾
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __CLOUD_STORAGE_HTTPBODYSINK_HPP__
+#define __CLOUD_STORAGE_HTTPBODYSINK_HPP__
+
+#include "network/Callback.hpp"
+
+#include <stddef.h>
+
+namespace flkeeper::network {
+
+class HttpRequest;
+class HttpResponse;
+
+/**
+ * @brief 流式接收一个请求的请求体, 由HttpServer::BodySinkCallback在头部解析
+ * 完成后创建, 之后请求体不再存入HttpRequest::body()
+ * 调用顺序: onBodyChunk若干次 -> onBodyEnd一次; 连接在此之前断开时只调用
+ * onAbort. 所有回调都在连接所属的loop线程中执行
+ */
+class HttpBodySink {
+public:
+  virtual ~HttpBodySink() = default;
+
+  /**
+   * @brief 收到一段请求体
+   * @param data 直接指向连接输入缓冲区的数据, 只在本次调用期间有效, 需要
+   * 保留时必须自行拷贝
+   * @return 返回false表示放弃这个请求: 剩余的请求体被丢弃, 随后调用
+   * onBodyEnd生成响应, 响应发送之后必须关闭连接
+   */
+  virtual bool onBodyChunk(const char *data, size_t len) = 0;
+
+  /**
+   * @brief 请求体接收完毕(或者onBodyChunk放弃了请求), 填写响应
+   * @return 与HttpServer::HttpCallback相同: true表示响应已经填好, 由
+   * HttpServer发送; false表示异步响应, 由接收器自行发送并重置HttpContext
+   */
+  virtual bool onBodyEnd(const TcpConnectionPtr &conn, HttpRequest &req,
+                         HttpResponse *resp) = 0;
+
+  // @brief 请求体接收完之前连接已经断开, 用于清理未完成的数据
+  virtual void onAbort() {}
+};
+
+} // namespace flkeeper::network
+
+#endif
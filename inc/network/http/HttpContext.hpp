@@ -2,11 +2,13 @@
 #define __CLOUD_STORAGE_HTTPCONTEXT_HPP__
 
 #include "network/Buffer.hpp"
+#include "HttpBodySink.hpp"
 #include "HttpRequest.hpp"
 #include "utils/log/Logging.hpp"
 #include "utils/Copyable.hpp"
 #include "utils/date/TimeStamp.hpp"
 
+#include <functional>
 #include <memory>
 #include <unordered_map>
 
@@ -24,18 +26,40 @@ class HttpContext : public NonCopyable
     kGotAll,            // 完成全部请求的解析
   };
 
+  // chunked请求体的解码状态
+  enum ChunkState
+  {
+    kChunkSize,     // 期望块大小行
+    kChunkData,     // 块数据
+    kChunkDataEnd,  // 块数据之后的CRLF
+    kChunkTrailers  // 最后一个块之后的trailer字段
+  };
+
   enum ParseResult
   {
     kError = -1,           // 解析出错
     kNeedMore = 0,         // 需要更多数据
     kHeadersComplete = 1, // 头部解析完成
-    kGotRequest = 2       // 整个请求解析完成
+    kGotRequest = 2,      // 整个请求解析完成
+    kGotHeaders = 3,      // 头部刚刚解析完成, 请求体尚未处理
+    kBodyRejected = 4     // 请求体接收器放弃了请求
   };
 
   HttpContext() :
       contentLength_(0),
       bodyReceived_(0),
-      isChunked_(false)
+      isChunked_(false),
+      chunkState_(kChunkSize),
+      chunkRemaining_(0),
+      trailerBytes_(0),
+      headerScanned_(0),
+      bodyRejected_(false),
+      requestStarted_(false),
+      closeAfterResponse_(false),
+      asyncPending_(false),
+      readPaused_(false),
+      requestCount_(0),
+      pipelinedResponses_(0)
   {
   }
 
@@ -59,13 +83,23 @@ class HttpContext : public NonCopyable
   bool headersComplete() const
   { return state_ == kExpectBody || state_ == kGotAll; }
 
+  // @brief Content-Length请求体还没有收到的字节数, chunked请求体无意义
   size_t remainingLength() const
   { return contentLength_ - bodyReceived_; }
 
+  // @brief 已经收到的请求体字节数, chunked时是解码之后的长度
+  size_t bodyReceived() const
+  { return bodyReceived_; }
+
+  size_t contentLength() const
+  { return contentLength_; }
+
   bool isChunked() const
   { return isChunked_; }
 
-  // @brief 重置
+  // @brief 重置, 准备解析同一连接上的下一个请求
+  // @note 只清理单个请求的状态, 连接级的请求计数和活跃时间保持不变;
+  // 异步请求在这里结束, 随后通过恢复回调继续处理已经到达的后续请求
   void reset()
   {
     state_ = kExpectRequestLine;
@@ -74,9 +108,87 @@ class HttpContext : public NonCopyable
     contentLength_ = 0;
     bodyReceived_ = 0;
     isChunked_ = false;
+    chunkState_ = kChunkSize;
+    chunkRemaining_ = 0;
+    trailerBytes_ = 0;
+    headerScanned_ = 0;
+    bodySink_.reset();
+    bodyRejected_ = false;
+    requestStarted_ = false;
+    closeAfterResponse_ = false;
     customContext_.reset();
+    if (asyncPending_) {
+      asyncPending_ = false;
+      if (resumeCallback_) {
+        resumeCallback_();
+      }
+    }
+  }
+
+  /**
+   * @brief 标记当前请求由回调异步完成(HttpCallback返回false或请求体被
+   * HeadersCallback接管), 之后的请求留在输入缓冲区, 直到reset
+   */
+  void markAsync()
+  { asyncPending_ = true; }
+  bool asyncPending() const
+  { return asyncPending_; }
+
+  // @brief 异步请求reset时调用, 由HttpServer设置, 用于继续处理流水线中
+  // 排在后面的请求
+  void setResumeCallback(std::function<void()> cb)
+  { resumeCallback_ = std::move(cb); }
+
+  // @brief 已经生成、还没有完全写入内核的流水线响应数, 输出清空时清零
+  int pipelinedResponses() const
+  { return pipelinedResponses_; }
+  void addPipelinedResponse()
+  { ++pipelinedResponses_; }
+  void clearPipelinedResponses()
+  { pipelinedResponses_ = 0; }
+
+  // @brief HttpServer是否因为流水线限制暂停了读取
+  bool readPaused() const
+  { return readPaused_; }
+  void setReadPaused(bool paused)
+  { readPaused_ = paused; }
+
+  /**
+   * @brief 设置当前请求的请求体接收器, 必须在parseRequest返回kGotHeaders
+   * 之后、继续解析请求体之前设置; 之后的请求体通过接收器交付, 不再存入
+   * request().body()
+   */
+  void setBodySink(const std::shared_ptr<HttpBodySink>& sink)
+  { bodySink_ = sink; }
+  const std::shared_ptr<HttpBodySink>& bodySink() const
+  { return bodySink_; }
+
+  // @brief 标记当前请求开始处理, 并决定响应之后是否关闭连接
+  void startRequest(bool closeAfterResponse)
+  {
+    requestStarted_ = true;
+    closeAfterResponse_ = closeAfterResponse;
+    ++requestCount_;
   }
 
+  // @brief 当前请求是否已经调用过startRequest
+  bool requestStarted() const
+  { return requestStarted_; }
+
+  // @brief 当前请求的响应发送之后是否关闭连接, 异步发送响应时以此构造HttpResponse
+  bool closeAfterResponse() const
+  { return closeAfterResponse_; }
+
+  // @brief 该连接上已经开始处理的请求数
+  int requestCount() const
+  { return requestCount_; }
+
+  // @brief 记录连接最近一次活跃的时间, 用于空闲超时
+  void touch(TimeStamp now)
+  { lastActive_ = now; }
+  TimeStamp lastActive() const
+  { return lastActive_; }
+
   // @brief 获取request
   const HttpRequest& request() const
   { return request_; }
@@ -99,17 +211,43 @@ class HttpContext : public NonCopyable
   // @brief 用于解析http请求行，提取请求方法、请求路径、查询数和HTTP版本信息
   bool processRequestLine(const char* begin, const char* end);
 
-  // @brief 解析HTTP请求头部，将头部字段和对应的值存储在headers_成员中
+  // @brief 等到整个头部块到达后一次解析, 存入request_, 并确定请求体的长度
+  // 和传输方式; 头部格式错误或超过kMaxHeaderBytes时返回false
   bool processHeaders(Buffer* buf);
 
-  // @brief 用于处理HTTP请求体
+  // @brief 用于处理HTTP请求体, 收完时把状态置为kGotAll, 出错返回false
   bool processBody(Buffer* buf);
 
+  // @brief 增量解码chunked请求体, 每块的数据到达多少交付多少; 大小行、
+  // 块结尾的CRLF和trailer都可以分在多次读取中到达
+  bool processChunkedBody(Buffer* buf);
+
+  // @brief 把一段请求体交给接收器, 没有接收器时追加到request_的body中
+  bool deliverBody(const char* data, size_t len);
+
+  static const size_t kMaxRequestLine = 8 * 1024;   // 请求行的最大长度
+  static const size_t kMaxHeaderBytes = 64 * 1024;  // 头部块的最大长度
+  static const size_t kMaxChunkLine = 4 * 1024;     // 块大小行的最大长度
+
   HttpRequestParseState state_ = kExpectRequestLine;
   HttpRequest request_;
   size_t contentLength_;  // 用于存储 Content-Length 的值
   size_t bodyReceived_;   // 已接收的 body 长度
   bool isChunked_;        // 是否为 chunked 传输
+  ChunkState chunkState_; // chunked请求体的解码状态
+  size_t chunkRemaining_; // 当前块还没有收到的字节数
+  size_t trailerBytes_;   // 已经跳过的trailer字节数
+  size_t headerScanned_;  // 头部块中已经查找过空行的字节数
+  std::shared_ptr<HttpBodySink> bodySink_;  // 请求体接收器, 可以为空
+  bool bodyRejected_;     // 接收器是否放弃了当前请求
+  bool requestStarted_;   // 当前请求是否已经开始处理
+  bool closeAfterResponse_;  // 当前请求的响应之后是否关闭连接
+  bool asyncPending_;     // 当前请求是否在等待异步完成
+  bool readPaused_;       // 是否因为流水线限制暂停了读取, reset时不清零
+  int requestCount_;      // 该连接上已经处理的请求数, reset时不清零
+  int pipelinedResponses_;  // 还没有写完的流水线响应数, reset时不清零
+  std::function<void()> resumeCallback_;  // 异步请求结束时的恢复回调
+  TimeStamp lastActive_;  // 最近一次活跃的时间, reset时不清零
   std::shared_ptr<void> customContext_;  // 自定义上下文存储
 };
 
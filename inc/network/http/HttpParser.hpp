@@ -0,0 +1,88 @@
+#ifndef __CLOUD_STORAGE_HTTPPARSER_HPP__
+#define __CLOUD_STORAGE_HTTPPARSER_HPP__
+
+#include "utils/datastructures/FKString.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace flkeeper::network {
+
+/**
+ * @brief HTTP/1.x请求头部的扫描和解析, 无状态, 所有函数都是静态的
+ * @note
+ * 1. 分隔符的查找按CPU能力选择实现: 支持AVX2时一次比较32字节, 支持SSE4.2
+ *    时用pcmpestri按字符区间查找, 否则逐字节查找. 选择在运行时进行一次,
+ *    不依赖编译参数
+ * 2. 解析结果只记录字段名和字段值在头部块中的偏移, 不拷贝数据; 常用的头部
+ *    在解析时就确定编号, 查找时不需要再比较字符串
+ */
+class HttpParser {
+public:
+  // 常用头部的编号, kOtherHeader表示其它头部
+  enum HeaderId {
+    kOtherHeader,
+    kHost,
+    kConnection,
+    kContentLength,
+    kContentType,
+    kTransferEncoding,
+    kExpect,
+    kRange,
+    kAccept,
+    kSessionId,     // X-Session-ID
+    kFileName,      // X-File-Name
+    kRequestedWith, // X-Requested-With
+    kNumHeaderIds
+  };
+
+  // 一个头部字段, 偏移相对于头部块的开头
+  struct Header {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t valueOffset;
+    uint32_t valueLength;
+    HeaderId id;
+  };
+
+  // 单个请求最多的头部字段数
+  static constexpr size_t kMaxHeaders = 100;
+
+  /**
+   * @brief 查找头部块结尾的空行
+   * @param begin 请求行之后的第一个字节
+   * @param scanned 输入时为上一次已经查找过的字节数, 避免数据分多次到达时
+   * 重复扫描; 没有找到时更新为本次查找过的字节数
+   * @return 指向空行之后的第一个字节, 没有找到返回NULL
+   */
+  static const char *findHeaderEnd(const char *begin, const char *end,
+                                   size_t *scanned);
+
+  /**
+   * @brief 解析头部块
+   * @param begin 第一个头部行的开头
+   * @param end 最后一个头部行的CRLF之后, 不包括结尾的空行
+   * @param headers 追加解析出的头部字段
+   * @return 格式错误(字段名含非token字符、冒号前有空白、折行、值中有控制
+   * 字符、换行不是CRLF或字段数超过kMaxHeaders)时返回false
+   */
+  static bool parseHeaders(const char *begin, const char *end,
+                           std::vector<Header> *headers);
+
+  // @brief 字段名对应的编号, 不区分大小写
+  static HeaderId headerId(const char *name, size_t len);
+  // @brief 编号对应的标准写法, kOtherHeader返回空串
+  static const char *headerName(HeaderId id);
+
+  // @brief 不区分大小写地比较两个ASCII字符串
+  static bool equalsIgnoreCase(const char *a, size_t alen, const char *b,
+                               size_t blen);
+  static bool equalsIgnoreCase(const FKString &a, const FKString &b) {
+    return equalsIgnoreCase(a.data(), a.size(), b.data(), b.size());
+  }
+};
+
+} // namespace flkeeper::network
+
+#endif
@@ -1,12 +1,14 @@
 #ifndef __CLOUD_STORAGE_HTTPREQUEST_HPP__
 #define __CLOUD_STORAGE_HTTPREQUEST_HPP__
 
-#include <map>
+#include <algorithm>
 #include <string>
 #include <assert.h>
+#include <string.h>
 #include <unordered_map>
 #include <vector>
 
+#include "HttpParser.hpp"
 #include "utils/Copyable.hpp"
 #include "utils/date/TimeStamp.hpp"
 #include "utils/log/Logging.hpp"
@@ -25,7 +27,9 @@ public:
   enum Version { kUnknown, kHttp10, kHttp11 };
 
   // @brief 构造函数
-  HttpRequest() : method_(kInvalid), version_(kUnknown) {}
+  HttpRequest() : method_(kInvalid), version_(kUnknown) {
+    std::fill(headerIndex_, headerIndex_ + HttpParser::kNumHeaderIds, -1);
+  }
 
   void setVersion(Version ver) { version_ = ver; }
 
@@ -37,16 +41,16 @@ public:
    */
   bool setMethod(const char *start, const char *end) {
     assert(method_ == kInvalid);
-    string m(start, end);
-    if (m == "GET") {
+    size_t len = end - start;
+    if (len == 3 && memcmp(start, "GET", 3) == 0) {
       method_ = kGet;
-    } else if (m == "POST") {
+    } else if (len == 4 && memcmp(start, "POST", 4) == 0) {
       method_ = kPost;
-    } else if (m == "HEAD") {
+    } else if (len == 4 && memcmp(start, "HEAD", 4) == 0) {
       method_ = kHead;
-    } else if (m == "PUT") {
+    } else if (len == 3 && memcmp(start, "PUT", 3) == 0) {
       method_ = kPut;
-    } else if (m == "DELETE") {
+    } else if (len == 6 && memcmp(start, "DELETE", 6) == 0) {
       method_ = kDelete;
     } else {
       method_ = kInvalid;
@@ -104,41 +108,85 @@ public:
 
   TimeStamp receiveTime() const { return receiveTime_; }
 
-  // @note 对于"Content-Type: application/json", field="Content-Type", value="application/json"
-  void addHeader(const char *start, const char *colon, const char *end) {
-    string field(start, colon);   // 提取头部字段名，从start到colon之前的部分
-    ++colon;    // 跳过冒号
-    while (colon < end && isspace(*colon)) {
-      // 跳过冒号之后的空格
-      ++colon;
+  /**
+   * @brief 保存并解析头部块
+   * @param start 第一个头部行的开头
+   * @param end 最后一个头部行的CRLF之后, 不包括结尾的空行
+   * @return 头部格式错误时返回false
+   * @note 头部块整体拷贝一次, 之后字段名和值都是指向这份拷贝的视图; 输入
+   * 缓冲区在接收请求体时会被消费, 不能直接引用
+   */
+  bool setHeaders(const char *start, const char *end) {
+    headerBlock_.assign(start, end);
+    headers_.clear();
+    std::fill(headerIndex_, headerIndex_ + HttpParser::kNumHeaderIds, -1);
+    const char *block = headerBlock_.data();
+    if (!HttpParser::parseHeaders(block, block + headerBlock_.size(),
+                                  &headers_)) {
+      return false;
     }
-    string value(colon, end);     // 提取头部字段的值
-    while (!value.empty() && isspace(value[value.size() - 1])) {
-      // 去除值末尾的空格
-      value.resize(value.size() - 1);
+    // 同名头部出现多次时以最后一个为准
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      if (headers_[i].id != HttpParser::kOtherHeader) {
+        headerIndex_[headers_[i].id] = static_cast<int>(i);
+      }
     }
-    headers_[field] = value;
+    return true;
   }
 
-  string getHeader(const string &field) const {
-    string result;
-    std::map<string, string>::const_iterator it = headers_.find(field);
-    if (it != headers_.end()) {
-      result = it->second;
+  // @brief 按编号查找常用头部, 不比较字符串, 没有该头部时返回空视图
+  FKString header(HttpParser::HeaderId id) const {
+    int index = headerIndex_[id];
+    return index < 0 ? FKString() : headerValue(index);
+  }
+
+  // @brief 按名字查找头部, 不区分大小写, 不分配内存
+  FKString header(const FKString &field) const {
+    HttpParser::HeaderId id = HttpParser::headerId(field.data(), field.size());
+    if (id != HttpParser::kOtherHeader) {
+      return header(id);
+    }
+    FKString result;
+    for (size_t i = 0; i < headers_.size(); ++i) {
+      if (HttpParser::equalsIgnoreCase(headerName(i), field)) {
+        result = headerValue(i);
+      }
     }
     return result;
   }
 
-  const std::map<string, string> &headers() const { return headers_; }
+  bool hasHeader(HttpParser::HeaderId id) const {
+    return headerIndex_[id] >= 0;
+  }
+
+  // @brief 返回头部的值的拷贝, 没有该头部时返回空串
+  string getHeader(const string &field) const {
+    return header(FKString(field)).as_string();
+  }
+
+  // @brief 按出现的顺序遍历头部
+  size_t headerCount() const { return headers_.size(); }
+  FKString headerName(size_t i) const {
+    const HttpParser::Header &h = headers_[i];
+    return FKString(headerBlock_.data() + h.nameOffset, h.nameLength);
+  }
+  FKString headerValue(size_t i) const {
+    const HttpParser::Header &h = headers_[i];
+    return FKString(headerBlock_.data() + h.valueOffset, h.valueLength);
+  }
+  HttpParser::HeaderId headerId(size_t i) const { return headers_[i].id; }
 
   void swap(HttpRequest &that) {
     std::swap(method_, that.method_);
     std::swap(version_, that.version_);
-    path_.swap(that.query_);
+    path_.swap(that.path_);
     query_.swap(that.query_);
     body_.swap(that.body_);
     receiveTime_.swap(that.receiveTime_);
+    headerBlock_.swap(that.headerBlock_);
     headers_.swap(that.headers_);
+    std::swap(headerIndex_, that.headerIndex_);
+    pathParams_.swap(that.pathParams_);
   }
 
   // 获取查询参数
@@ -225,7 +273,9 @@ private:
   string body_;         // 存储请求的主体内容
 
   TimeStamp receiveTime_;   // 存储请求的接收时间
-  std::map<string, string> headers_;    // 存储请求的头部信息
+  string headerBlock_;      // 头部块的拷贝, 头部字段都是指向它的偏移
+  std::vector<HttpParser::Header> headers_;   // 按出现顺序存储的头部字段
+  int headerIndex_[HttpParser::kNumHeaderIds];  // 常用头部在headers_中的下标
 
   std::unordered_map<string, string> pathParams_;   // 存储路径参数
 };
@@ -1,9 +1,11 @@
 #ifndef __CLOUD_STORAGE_HTTPRESPONSE_HPP__
 #define __CLOUD_STORAGE_HTTPRESPONSE_HPP__
 
-#include <map>
 #include <functional>
 #include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
 #include "network/Buffer.hpp"
 #include "utils/log/Logging.hpp"
 
@@ -28,8 +30,17 @@ public:
     k500InternalServerError = 500,
   };
 
+  // 正文的分帧方式
+  enum Framing {
+    kFramingLength,  // Content-Length, 没有显式设置时按正文或文件长度填写
+    kFramingChunked, // Transfer-Encoding: chunked, 用于长度未知的流式正文
+    kFramingClose    // 不标记长度, 以关闭连接结束正文(HTTP/1.0的流式正文)
+  };
+
   explicit HttpResponse(bool close)
-      : statusCode_(kUnknown), closeConnection_(close), async_(false) {}
+      : statusCode_(kUnknown), closeConnection_(close),
+        framing_(kFramingLength), async_(false), fileFd_(-1), fileOffset_(0),
+        fileLength_(0) {}
   ~HttpResponse() { LOG_INFO << "HttpResponse::~HttpResponse()"; }
 
   void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
@@ -42,10 +53,36 @@ public:
   void setContentType(const std::string &contentType) {
     addHeader("Content-Type", contentType);
   }
-  void addHeader(const std::string &key, const std::string &value) {
-    headers_[key] = value;
+  // @brief 设置头部字段, 同名(不区分大小写)的字段已经存在时替换它的值
+  void addHeader(const std::string &key, const std::string &value);
+  // @brief 同名的字段, 没有时返回NULL
+  const std::string *findHeader(const char *key) const;
+
+  // @brief 设置正文, 传入右值时不拷贝
+  void setBody(std::string body) { body_ = std::move(body); }
+  const std::string &body() const { return body_; }
+  // @brief 移走正文, 发送时交给TcpConnection而不再拷贝
+  std::string takeBody() { return std::move(body_); }
+
+  void setFraming(Framing framing) { framing_ = framing; }
+  Framing framing() const { return framing_; }
+
+  /**
+   * @brief 以文件内容作为响应主体，由TcpConnection::sendFile零拷贝发送
+   * @param fd 文件描述符(不接管所有权，发送时会dup一份)
+   * @param offset 起始偏移
+   * @param length 发送长度，同时作为Content-Length
+   */
+  void setFileBody(int fd, off_t offset, size_t length) {
+    fileFd_ = fd;
+    fileOffset_ = offset;
+    fileLength_ = length;
+    addHeader("Content-Length", std::to_string(length));
   }
-  void setBody(const std::string &body) { body_ = body; }
+  bool hasFileBody() const { return fileFd_ >= 0; }
+  int fileFd() const { return fileFd_; }
+  off_t fileOffset() const { return fileOffset_; }
+  size_t fileLength() const { return fileLength_; }
 
   // 设置为异步响应
   void setAsync(bool async) { async_ = async; }
@@ -59,38 +96,34 @@ public:
     return responseCallback_;
   }
 
+  /**
+   * @brief 把状态行和头部(包括Connection、Date和分帧字段)追加到output,
+   * 以空行结束; 追加之前按估算的长度一次预留好空间
+   */
+  void appendHeadersToBuffer(Buffer *output) const;
+
+  // @brief 头部之后紧跟内存中的正文, 文件正文需要另外发送
   void appendToBuffer(Buffer *output) const {
-    char buf[32];
-    snprintf(buf, sizeof(buf), "HTTP/1.1 %d ", statusCode_);
-    output->append(buf);
-    output->append(statusMessage_);
-    output->append("\r\n");
-
-    if (closeConnection_) {
-      output->append("Connection: close\r\n");
-    } else {
-      output->append("Connection: Keep-Alive\r\n");
-    }
-
-    for (const auto &header : headers_) {
-      output->append(header.first);
-      output->append(": ");
-      output->append(header.second);
-      output->append("\r\n");
-    }
-
-    output->append("\r\n");
+    appendHeadersToBuffer(output);
     output->append(body_);
   }
 
+  // @brief 头部序列化之后的大致长度, 用于预留缓冲区
+  size_t headersSizeHint() const;
+
 private:
-  std::map<std::string, std::string> headers_;
+  // 头部字段按添加的顺序保存, 字段很少, 线性查找比map更快
+  std::vector<std::pair<std::string, std::string>> headers_;
   HttpStatusCode statusCode_;
   std::string statusMessage_;
   bool closeConnection_;              // 是否关闭连接
+  Framing framing_;                   // 正文的分帧方式
   std::string body_;
   bool async_;                        // 是否为异步响应
   ResponseCallback responseCallback_; // 响应回调函数
+  int fileFd_;                        // 文件主体的描述符, -1表示没有
+  off_t fileOffset_;                  // 文件主体的起始偏移
+  size_t fileLength_;                 // 文件主体的长度
 }; // class HttpResponse
 
 } // namespace network
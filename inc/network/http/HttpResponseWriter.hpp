@@ -0,0 +1,70 @@
+#ifndef __CLOUD_STORAGE_HTTPRESPONSEWRITER_HPP__
+#define __CLOUD_STORAGE_HTTPRESPONSEWRITER_HPP__
+
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "network/Callback.hpp"
+#include "utils/NonCopyable.hpp"
+
+#include <memory>
+#include <string>
+
+namespace flkeeper::network {
+
+/**
+ * @brief 把HttpResponse写到连接上
+ * @note
+ * 1. 状态行和头部格式化到按估算长度预留好的Buffer中, 内存中的正文从
+ *    HttpResponse中移走, 作为第二个iovec与头部用一次writev写出; 文件正文
+ *    随后通过sendFile发送
+ * 2. 流式响应: begin发送头部, 之后每次write发送一段正文, finish结束.
+ *    没有显式设置Content-Length时使用chunked编码; 请求是HTTP/1.0时不能
+ *    使用chunked, 改为在正文结束后关闭连接
+ * 3. 异步完成的请求和其它异步响应一样, 在finish之前reset HttpContext
+ * 4. 所有函数都必须在连接所属的loop线程中调用
+ */
+class HttpResponseWriter : NonCopyable {
+public:
+  /**
+   * @brief 发送一个完整的响应, 正文从response中移走; 响应要求关闭连接时
+   * 发送之后shutdown
+   */
+  static void send(const TcpConnectionPtr &conn, HttpResponse &response);
+
+  // @param version 请求的HTTP版本, 决定能否使用chunked编码
+  HttpResponseWriter(const TcpConnectionPtr &conn,
+                     HttpRequest::Version version);
+  ~HttpResponseWriter();
+
+  /**
+   * @brief 发送状态行和头部, response中已有的正文作为第一段正文发送
+   * @note 之后对response的修改不再生效
+   */
+  void begin(HttpResponse &response);
+
+  // @brief 发送一段正文, 长度为0时忽略
+  void write(const char *data, size_t len);
+  void write(std::string &&data);
+
+  // @brief 结束正文, 响应要求关闭连接时随后shutdown; 析构时没有调用则
+  // 强制关闭连接, 因为客户端无法判断正文已经结束
+  void finish();
+
+  bool chunked() const { return framing_ == HttpResponse::kFramingChunked; }
+
+private:
+  // chunked编码时一段正文之前的分隔: 上一块结尾的CRLF和这一块的长度行
+  void appendChunkHead(Buffer *output, size_t len);
+
+  std::weak_ptr<TcpConnection> conn_;
+  bool http10_;
+  HttpResponse::Framing framing_;
+  bool close_;         // 正文结束后是否关闭连接
+  bool started_;       // 是否已经调用begin
+  bool finished_;      // 是否已经调用finish
+  bool wroteChunk_;    // chunked编码时是否已经发送过数据块
+};
+
+} // namespace flkeeper::network
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef __CLOUD_STORAGE_HTTPSERVER_HPP__
 #define __CLOUD_STORAGE_HTTPSERVER_HPP__
 
+#include "HttpContext.hpp"
 #include "HttpRequest.hpp"
 #include "HttpResponse.hpp"
 #include "network/TcpServer.hpp"
@@ -15,20 +16,112 @@ class HttpServer {
 public:
   using HttpCallback = std::function<bool(const TcpConnectionPtr &,
                                           HttpRequest &, HttpResponse *)>;
+  // 请求头部解析完成、请求体尚未处理时调用; 返回true表示请求体由回调自行接收
+  // (例如通过TcpConnection::spliceToFile直接写入文件), 此时回调负责在请求
+  // 结束后发送响应并重置HttpContext
+  using HeadersCallback =
+      std::function<bool(const TcpConnectionPtr &, HttpRequest &)>;
+  // 请求头部解析完成、请求体尚未处理时调用(在HeadersCallback没有接管之后);
+  // 返回非空时请求体流式交给该接收器, 请求结束时调用它的onBodyEnd代替
+  // HttpCallback; 返回空时请求体照常存入HttpRequest::body()
+  // @note 没有请求体的请求不调用
+  using BodySinkCallback = std::function<std::shared_ptr<HttpBodySink>(
+      const TcpConnectionPtr &, HttpRequest &)>;
 
   HttpServer(EventLoop *loop, const InetAddress &listenAddr,
-             const std::string &name);
+             const std::string &name,
+             TcpServer::Option option = TcpServer::kNoReusePort);
 
   void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+  void setHeadersCallback(const HeadersCallback &cb) { headersCallback_ = cb; }
+  void setBodySinkCallback(const BodySinkCallback &cb) {
+    bodySinkCallback_ = cb;
+  }
+  // HttpServer先为新连接创建HttpContext, 再调用用户的连接回调
   void setConnectionCallback(const ConnectionCallback &cb) {
-    server_.setConnectionCallback(cb);
+    connectionCallback_ = cb;
   }
   void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+  void setCpuAffinity(bool on) { server_.setCpuAffinity(on); }
+  void setBusyPoll(int spinUs, bool socketBusyPoll = false) {
+    server_.setBusyPoll(spinUs, socketBusyPoll);
+  }
+  void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) {
+    server_.setDispatchPolicy(policy);
+  }
+  void setEdgeTriggered(bool on,
+                        size_t readBudget = TcpConnection::kDefaultReadBudget) {
+    server_.setEdgeTriggered(on, readBudget);
+  }
+  // 见TcpServer::setSocketProfile, 需要在start之前调用
+  void setSocketProfile(const SocketProfile &profile) {
+    server_.setSocketProfile(profile);
+  }
+  // 见TcpServer::setTcpInfoSampling, 需要在start之前调用; 处理请求时可以
+  // 通过TcpConnection::tcpInfo读取最近的采样
+  void setTcpInfoSampling(double interval, uint64_t slowThroughput = 0) {
+    server_.setTcpInfoSampling(interval, slowThroughput);
+  }
+  void setSlowClientCallback(const SlowClientCallback &cb) {
+    server_.setSlowClientCallback(cb);
+  }
+  // 见TcpServer::setTlsContext, 需要在start之前调用
+  void setTlsContext(const std::shared_ptr<TlsContext> &context) {
+    server_.setTlsContext(context);
+  }
   void start() { server_.start(); }
 
+  /**
+   * @brief 设置长连接的空闲超时
+   * @param seconds 连接上没有请求在处理、也没有数据待发送的时间超过该值时
+   * 关闭连接, 小于等于0表示不限制
+   * @note 需要在start之前调用
+   */
+  void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+  /**
+   * @brief 设置单个连接上最多处理的请求数, 达到上限的那个请求的响应带上
+   * Connection: close并在发送完后关闭连接, 小于等于0表示不限制
+   */
+  void setMaxRequestsPerConnection(int n) { maxRequestsPerConnection_ = n; }
+
+  /**
+   * @brief 设置单个连接上最多积压的流水线响应数
+   * 一次读到多个请求时依次处理, 响应按请求的顺序发送; 已经生成但还没有
+   * 写入内核的响应达到n个时暂停读取和处理, 输出清空后恢复. 小于等于0表示
+   * 不限制(仍然受输出水位限制)
+   */
+  void setMaxPipelinedRequests(int n) { maxPipelinedRequests_ = n; }
+
+  /**
+   * @brief 设置连接的输出背压水位, 见TcpConnection::setOutputWatermarks
+   * 响应积压到highWaterMark时暂停读取该连接的后续请求, 降到lowWaterMark
+   * 以下时恢复; highWaterMark为0表示不限制
+   * @note 需要在start之前调用
+   */
+  void setOutputWatermarks(size_t highWaterMark, size_t lowWaterMark) {
+    outputHighWaterMark_ = highWaterMark;
+    outputLowWaterMark_ = lowWaterMark;
+  }
+
+  static const int kDefaultIdleTimeout = 60;
+  static const int kDefaultMaxRequestsPerConnection = 1000;
+  static const int kDefaultMaxPipelinedRequests = 16;
+  static const size_t kDefaultOutputHighWaterMark = 4 * 1024 * 1024;
+  static const size_t kDefaultOutputLowWaterMark = 1024 * 1024;
+
 private:
+  // 异步请求处理期间输入缓冲区中积压的后续请求超过该值时暂停读取
+  static const size_t kMaxPendingInput = 64 * 1024;
+
   void onConnection(const TcpConnectionPtr &conn);
 
+  // @brief 请求头部解析完成后调用一次, 计数并决定响应之后是否保持连接
+  void startRequest(HttpContext *context);
+
+  // @brief 空闲检查定时器到期, 连接空闲超时则关闭, 否则按剩余时间重新设置
+  void checkIdle(const std::weak_ptr<TcpConnection> &weakConn);
+
   /**
    * @brief 负责处理接收到的HTTP消息
    * @param conn 表示一个TCP连接的智能指针,用于与客户端进行通信
@@ -37,7 +130,25 @@ private:
    */
   void onMessage(const TcpConnectionPtr &conn, Buffer *buf,
                  TimeStamp receiveTime);
-  bool onRequest(const TcpConnectionPtr &, HttpRequest &);
+
+  // @brief 依次处理输入缓冲区中的完整请求, 遇到异步请求、数据不完整或
+  // 达到流水线上限时停止
+  void processRequests(const TcpConnectionPtr &conn, HttpContext *context,
+                       Buffer *buf, TimeStamp receiveTime);
+
+  // @brief 解析并处理一个请求, 同步完成并已重置HttpContext时返回true
+  bool processRequest(const TcpConnectionPtr &conn, HttpContext *context,
+                      Buffer *buf, TimeStamp receiveTime);
+
+  // @brief 异步请求结束或输出清空后, 恢复读取并处理缓冲区中剩余的请求
+  void resumeRequests(const std::weak_ptr<TcpConnection> &weakConn);
+
+  // @brief 输出全部写入内核, 积压的流水线响应清零
+  void onWriteComplete(const TcpConnectionPtr &conn);
+
+  bool onRequest(const TcpConnectionPtr &, HttpContext *context);
+  // @brief 见HttpResponseWriter::send, 正文从response中移走
+  void sendResponse(const TcpConnectionPtr &conn, HttpResponse &response);
 
   // 用于处理底层TCP连接和事件循环,HttpServer基于TcpServer实现，利用其
   // 提供的功能来监听和处理TCP连接
@@ -45,6 +156,21 @@ private:
 
   // 用于处理HTTP请求,用户可以通过`setHttpCallback`方法来设置该回调函数,以实现自定义的请求处理逻辑
   HttpCallback httpCallback_;
+
+  // 用于在请求体到达之前接管请求体的接收, 可以为空
+  HeadersCallback headersCallback_;
+
+  // 用于为请求创建流式的请求体接收器, 可以为空
+  BodySinkCallback bodySinkCallback_;
+
+  // 用户的连接回调, 可以为空
+  ConnectionCallback connectionCallback_;
+
+  double idleTimeout_;            // 长连接空闲超时(秒)
+  int maxRequestsPerConnection_;  // 单个连接最多处理的请求数
+  int maxPipelinedRequests_;      // 单个连接最多积压的流水线响应数
+  size_t outputHighWaterMark_;    // 输出背压的高水位
+  size_t outputLowWaterMark_;     // 输出背压的低水位
 }; // class HttpServer
 
 } // namespace flkeeper::network
@@ -18,6 +18,7 @@ public:
   date::TimeStamp poll(int timeoutMs, ChannelList *activeChannels) override;
   void updateChannel(Channel *channel) override;
   void removeChannel(Channel *channel) override;
+  bool supportsEdgeTriggered() const override { return true; }
 
 private:
   static const int kInitEventListSize = 16; ///< 初始事件列表大小
@@ -29,6 +30,9 @@ private:
   /// @param operation 操作类型：EPOLL_CTL_ADD, EPOLL_CTL_MOD, EPOLL_CTL_DEL
   void update(int operation, Channel *channel);
 
+  /// @brief channel应当注册到epoll中的事件
+  static int eventsToPoll(const Channel *channel);
+
   /// @brief 将epoll操作转换为字符串，用于日志
   static const char *operationToString(int op);
 
@@ -0,0 +1,90 @@
+#ifndef __CLOUD_STORAGE_IOURINGPOLLER_HPP__
+#define __CLOUD_STORAGE_IOURINGPOLLER_HPP__
+
+#include "network/Poller.hpp"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace flkeeper {
+namespace network {
+
+/// @brief io_uring(7)的封装
+/// socket的可读/可写通过一次性的IORING_OP_POLL_ADD实现, 事件分发之后在下一次
+/// poll时重新提交, 因此对Channel来说仍然是水平触发的语义;
+/// 文件读写通过IORING_OP_READ/IORING_OP_WRITE异步提交, 完成后把回调放入所属
+/// EventLoop的待处理队列中执行
+class IoUringPoller : public Poller {
+public:
+  IoUringPoller(EventLoop *loop);
+  ~IoUringPoller() override;
+
+  /// @brief io_uring是否初始化成功(内核不支持或被禁用时返回false)
+  bool valid() const { return ringFd_ >= 0; }
+
+  /// @brief 重写基类Poller的抽象方法
+  date::TimeStamp poll(int timeoutMs, ChannelList *activeChannels) override;
+  void updateChannel(Channel *channel) override;
+  void removeChannel(Channel *channel) override;
+
+  bool submitFileRead(int fd, void *buf, size_t len, off_t offset,
+                      const FileIoCallback &cb) override;
+  bool submitFileWrite(int fd, const void *buf, size_t len, off_t offset,
+                       const FileIoCallback &cb) override;
+  bool supportsAsyncFileIo() const override { return true; }
+
+private:
+  static const unsigned kRingEntries = 1024; ///< 提交队列大小
+
+  /// @brief 每个fd的poll状态
+  struct PollState {
+    Channel *channel;
+    uint32_t armedEvents; ///< 已提交的poll关注的事件, 0表示未提交
+    uint32_t generation;  ///< 提交时的代数, 用于识别过期的完成事件
+  };
+
+  bool setupRing();
+  io_uring_sqe *getSqe();
+  int enter(unsigned toSubmit, unsigned minComplete, int timeoutMs);
+  void arm(int fd, PollState *state);
+  void cancel(PollState *state, int fd);
+  void rearmPending();
+  void handleCompletion(const io_uring_cqe *cqe, ChannelList *activeChannels);
+  bool submitFileIo(uint8_t opcode, int fd, void *buf, size_t len,
+                    off_t offset, const FileIoCallback &cb);
+
+  int ringFd_;              ///< io_uring文件描述符
+  void *sqRing_;            ///< 提交队列环
+  size_t sqRingSize_;
+  void *cqRing_;            ///< 完成队列环(可能与sqRing_是同一块映射)
+  size_t cqRingSize_;
+  io_uring_sqe *sqes_;      ///< 提交队列项数组
+  size_t sqesSize_;
+  unsigned *sqHead_;
+  unsigned *sqTail_;
+  unsigned *sqMask_;
+  unsigned *sqArray_;
+  unsigned sqEntries_;
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  unsigned *cqMask_;
+  io_uring_cqe *cqes_;
+  unsigned sqeTail_;        ///< 本地的提交队列尾, enter之前同步到sqTail_
+  unsigned toSubmit_;       ///< 尚未提交给内核的sqe数量
+  uint32_t generation_;     ///< poll提交的代数计数
+
+  std::unordered_map<int, PollState> pollStates_; ///< fd到poll状态的映射
+  std::vector<int> rearmList_;                    ///< 需要重新提交poll的fd
+
+  std::vector<FileIoCallback> fileOps_; ///< 进行中的文件读写回调, 下标即槽位
+  std::vector<uint32_t> freeFileSlots_; ///< 空闲的槽位
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
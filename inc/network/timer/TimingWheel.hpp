@@ -0,0 +1,87 @@
+#ifndef __CLOUD_STORAGE_TIMINGWHEEL_HPP__
+#define __CLOUD_STORAGE_TIMINGWHEEL_HPP__
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "network/TimerQueue.hpp"
+
+namespace flkeeper {
+namespace network {
+
+/**
+ * @brief 层级哈希时间轮
+ * 精度为1ms, 第0层256个槽, 第1~4层各64个槽, 覆盖约49天, 更远的定时器先挂在
+ * 最高层, 随着级联逐步下放. 每个槽是Timer组成的侵入式双向链表, 插入和取消
+ * 都是O(1); 每层有一个占用位图, 用来快速找到下一次需要唤醒的时刻.
+ *
+ * Timer对象由时间轮持有并循环复用, 在时间轮析构之前不会释放, 因此过期的
+ * TimerId依然可以安全地通过序列号判断是否有效. 在loop线程中添加定时器时
+ * 直接插入, 不再经过runInLoop
+ */
+class TimingWheel : public TimerQueue {
+public:
+  explicit TimingWheel(EventLoop *loop);
+  ~TimingWheel() override;
+
+  TimerId addTimer(TimerCallback cb, date::TimeStamp when,
+                   DFLK_FP interval) override;
+
+  void cancel(TimerId timerId) override;
+
+  /// @brief 时间轮中等待到期的定时器个数
+  size_t size() const { return size_; }
+
+protected:
+  void handleExpired(date::TimeStamp now) override;
+
+private:
+  enum NodeState {
+    kFree,     // 在空闲链表中
+    kPending,  // 在时间轮中等待到期
+    kRunning,  // 已到期, 正在执行回调
+    kCanceled  // 执行回调期间被取消
+  };
+
+  static const int64_t kTickUs = 1000; // 一个刻度1ms
+  static const int kRootBits = 8;
+  static const int kLevelBits = 6;
+  static const int kRootSize = 1 << kRootBits;
+  static const int kLevelSize = 1 << kLevelBits;
+  static const int kNumLevels = 4; // 第0层之外的层数
+  static const int kNumSlots = kRootSize + kNumLevels * kLevelSize;
+
+  Timer *allocTimer(TimerCallback cb, date::TimeStamp when, DFLK_FP interval);
+  void freeTimer(Timer *timer);
+  void addTimerInLoop(Timer *timer);
+  void cancelInLoop(TimerId timerId);
+
+  uint64_t tickOf(date::TimeStamp when) const;
+  date::TimeStamp timeOfTick(uint64_t tick) const;
+  void insert(Timer *timer);
+  void link(Timer *timer, int slot);
+  void unlink(Timer *timer);
+  void cascade();
+  void advance(uint64_t nowTick);
+  uint64_t nextWakeupTick() const;
+  void rearm(uint64_t tick);
+
+  int64_t baseUs_;         // 第0个刻度对应的时间
+  uint64_t currentTick_;   // 下一个尚未处理的刻度
+  uint64_t armedTick_;     // timerfd当前设定的刻度, UINT64_MAX表示未设定
+  size_t size_;            // 时间轮中的定时器个数
+  bool handling_;          // 是否正在处理到期定时器
+
+  Timer *slots_[kNumSlots];              // 各槽位链表头
+  uint64_t occupied_[kNumSlots / 64];    // 槽位占用位图
+
+  std::vector<Timer *> expired_;                 // 本轮到期的定时器
+  std::vector<std::unique_ptr<Timer>> nodes_;    // 时间轮持有的全部定时器
+  std::vector<Timer *> freeList_;                // 可以复用的定时器
+};
+
+} // namespace network
+} // namespace flkeeper
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __CLOUD_STORAGE_TREETIMERQUEUE_HPP__
+#define __CLOUD_STORAGE_TREETIMERQUEUE_HPP__
+
+#include <set>
+#include <vector>
+
+#include "network/TimerQueue.hpp"
+
+namespace flkeeper {
+namespace network {
+
+/// @brief 基于std::set的定时器队列, 插入和取消都是O(log n)
+class TreeTimerQueue : public TimerQueue {
+public:
+  explicit TreeTimerQueue(EventLoop *loop);
+  ~TreeTimerQueue() override;
+
+  TimerId addTimer(TimerCallback cb, date::TimeStamp when,
+                   DFLK_FP interval) override;
+
+  void cancel(TimerId timerId) override;
+
+protected:
+  void handleExpired(date::TimeStamp now) override;
+
+private:
+  using Entry = std::pair<date::TimeStamp, Timer*>;
+
+  // 定时器集合，按到期时间排序
+  using TimerList = std::set<Entry>;
+
+  // 激活的定时器集合
+  using ActiveTimer = std::pair<Timer*, DFLK_INT64>;
+  using ActiveTimerSet = std::set<ActiveTimer>;
+
+  void addTimerInLoop(Timer *timer);
+  void cancelInLoop(TimerId timerId);
+
+  std::vector<Entry> getExpired(date::TimeStamp now);
+  void reset(const std::vector<Entry>& expired, date::TimeStamp now);
+
+  bool insert(Timer* timer);
+
+  TimerList timers_;      // 按到期时间排序的定时器集合
+
+  ActiveTimerSet activeTimers_;   // 按对象地址排序的定时器集合
+  bool callingExpiredTimers_;     // 是否正在处理到期定时器
+  ActiveTimerSet cancelingTimers_;    // 保存被取消的定时器
+};
+
+}     // namespace network
+}     // namespace flkeeper
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef __CLOUD_STORAGE_INLINETASK_HPP__
+#define __CLOUD_STORAGE_INLINETASK_HPP__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace flkeeper {
+
+/**
+ * @brief 只能移动的void()任务, 带小对象缓冲区
+ * @note
+ * 1. 不超过kInlineSize字节、移动不抛异常的可调用对象直接存放在对象内部,
+ *    构造和移动都不分配内存; 更大的对象退化为在堆上保存一份
+ * 2. 只要求可调用对象可以移动, 可以捕获unique_ptr等只能移动的类型
+ * 3. kInlineSize足够放下std::bind(&Class::method, shared_ptr, 两个指针大小的参数)
+ */
+class InlineTask {
+public:
+  static const size_t kInlineSize = 48;
+
+  InlineTask() noexcept : ops_(nullptr) {}
+  InlineTask(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, InlineTask>::value>::type>
+  InlineTask(F &&f) : ops_(nullptr) {
+    using Fn = typename std::decay<F>::type;
+    if constexpr (kFitsInline<Fn>) {
+      new (&storage_) Fn(std::forward<F>(f));
+      ops_ = &InlineOps<Fn>::kOps;
+    } else {
+      *reinterpret_cast<Fn **>(&storage_) = new Fn(std::forward<F>(f));
+      ops_ = &HeapOps<Fn>::kOps;
+    }
+  }
+
+  InlineTask(InlineTask &&that) noexcept : ops_(that.ops_) {
+    if (ops_) {
+      ops_->move(&storage_, &that.storage_);
+      that.ops_ = nullptr;
+    }
+  }
+
+  InlineTask &operator=(InlineTask &&that) noexcept {
+    if (this != &that) {
+      reset();
+      if (that.ops_) {
+        that.ops_->move(&storage_, &that.storage_);
+        ops_ = that.ops_;
+        that.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  InlineTask(const InlineTask &) = delete;
+  InlineTask &operator=(const InlineTask &) = delete;
+
+  ~InlineTask() { reset(); }
+
+  void operator()() { ops_->invoke(&storage_); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  // @brief 释放保存的可调用对象
+  void reset() {
+    if (ops_) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  // 按存放方式分别实现的调用、移动和析构
+  struct Ops {
+    void (*invoke)(void *);
+    void (*move)(void *dst, void *src);
+    void (*destroy)(void *);
+  };
+
+  using Storage =
+      std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type;
+
+  template <typename Fn>
+  static constexpr bool kFitsInline =
+      sizeof(Fn) <= kInlineSize &&
+      alignof(std::max_align_t) % alignof(Fn) == 0 &&
+      std::is_nothrow_move_constructible<Fn>::value;
+
+  template <typename Fn> struct InlineOps {
+    static void invoke(void *p) { (*static_cast<Fn *>(p))(); }
+    static void move(void *dst, void *src) {
+      new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+      static_cast<Fn *>(src)->~Fn();
+    }
+    static void destroy(void *p) { static_cast<Fn *>(p)->~Fn(); }
+    static constexpr Ops kOps = {&invoke, &move, &destroy};
+  };
+
+  template <typename Fn> struct HeapOps {
+    static void invoke(void *p) { (**static_cast<Fn **>(p))(); }
+    static void move(void *dst, void *src) {
+      *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+    }
+    static void destroy(void *p) { delete *static_cast<Fn **>(p); }
+    static constexpr Ops kOps = {&invoke, &move, &destroy};
+  };
+
+  Storage storage_;
+  const Ops *ops_; // 为空表示没有任务
+};
+
+} // namespace flkeeper
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __CLOUD_STORAGE_MPSCQUEUE_HPP__
+#define __CLOUD_STORAGE_MPSCQUEUE_HPP__
+
+#include "utils/NonCopyable.hpp"
+
+#include <atomic>
+
+namespace flkeeper {
+
+// @brief 侵入式MPSC队列的节点, 元素类型需要继承该类
+struct MpscNode {
+  std::atomic<MpscNode *> mpscNext_{nullptr};
+};
+
+/**
+ * @brief 侵入式无锁多生产者单消费者队列(Vyukov)
+ * @note
+ * 1. push可以在任意线程调用, 只有一次原子交换, 不会阻塞
+ * 2. pop只能由唯一的消费者线程调用
+ * 3. 生产者交换了队尾但还没有链接上节点时, pop暂时看不到之后的元素并返回
+ *    nullptr, 调用者需要依靠生产者随后的通知再次pop
+ * 4. 队列不持有节点, 节点的分配和释放由调用者负责
+ *
+ * @tparam T 元素类型, 必须继承MpscNode
+ */
+template <typename T> class MpscQueue : NonCopyable {
+public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {}
+
+  // @brief 入队, 任意线程调用
+  void push(T *node) { pushNode(node); }
+
+  // @brief 出队, 只能在消费者线程调用, 暂时没有元素时返回nullptr
+  T *pop() {
+    MpscNode *tail = tail_;
+    MpscNode *next = tail->mpscNext_.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (!next) {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->mpscNext_.load(std::memory_order_acquire);
+    }
+    if (next) {
+      tail_ = next;
+      return static_cast<T *>(tail);
+    }
+    if (tail != head_.load(std::memory_order_acquire)) {
+      // 有生产者正在入队
+      return nullptr;
+    }
+    // tail是最后一个元素, 放回stub后才能把它取出
+    pushNode(&stub_);
+    next = tail->mpscNext_.load(std::memory_order_acquire);
+    if (next) {
+      tail_ = next;
+      return static_cast<T *>(tail);
+    }
+    return nullptr;
+  }
+
+private:
+  void pushNode(MpscNode *node) {
+    node->mpscNext_.store(nullptr, std::memory_order_relaxed);
+    MpscNode *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->mpscNext_.store(node, std::memory_order_release);
+  }
+
+  alignas(64) std::atomic<MpscNode *> head_; // 生产者一侧的队尾
+  alignas(64) MpscNode *tail_;               // 消费者一侧的队头
+  MpscNode stub_;
+};
+
+} // namespace flkeeper
+
+#endif
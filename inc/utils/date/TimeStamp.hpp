@@ -17,7 +17,7 @@ public:
   static const DFLK_INT64 kMicroSecondsPerSec = 1000 * 1000;
   TimeStamp() : microSecondsSinceEpoch_(0) {}
 
-  explicit TimeStamp(DFLK_INT64 microSec) : microSecondsSinceEpoch_(0) {}
+  explicit TimeStamp(DFLK_INT64 microSec) : microSecondsSinceEpoch_(microSec) {}
 
   // @brief 交换两个时间戳
   void swap(TimeStamp &that) {
@@ -41,6 +41,14 @@ public:
      */
     void append(const char* logline, int len);
 
+    /**
+     * @brief 设置后端线程绑定的CPU, 必须在start之前调用
+     */
+    void setCpuAffinity(const std::vector<int>& cpus)
+    {
+        thread_.setCpuAffinity(cpus);
+    }
+
     /**
      * @brief 启动日志线程
      */
@@ -0,0 +1,78 @@
+#ifndef __CLOUD_STORAGE_CPUTOPOLOGY_HPP__
+#define __CLOUD_STORAGE_CPUTOPOLOGY_HPP__
+
+#include "utils/NonCopyable.hpp"
+
+#include <pthread.h>
+#include <vector>
+
+namespace flkeeper::thread {
+
+/**
+ * @brief 当前进程可用的CPU拓扑
+ * @note
+ * 1. 只统计sched_getaffinity允许的CPU, 容器或taskset限制后的结果也是准确的
+ * 2. 从/sys/devices/system读取物理核和NUMA节点, 读不到时视为单节点、
+ *    每个逻辑CPU一个物理核
+ * 3. 第一次调用instance()时检测, 之后只读, 可以在任意线程使用
+ */
+class CpuTopology : NonCopyable {
+public:
+  static const CpuTopology &instance();
+
+  // @brief 可用的逻辑CPU数
+  int numCpus() const { return static_cast<int>(cpus_.size()); }
+
+  // @brief 可用的全部逻辑CPU
+  const std::vector<int> &cpus() const { return cpus_; }
+
+  // @brief 可用CPU所在的物理核数
+  int numCores() const { return numCores_; }
+
+  // @brief 可用CPU所在的NUMA节点数
+  int numNodes() const { return static_cast<int>(nodes_.size()); }
+
+  // @brief 第node个节点上可用的CPU
+  const std::vector<int> &cpusOfNode(int node) const { return nodes_[node]; }
+
+  // @brief 推荐的IO线程数, 每个物理核一个, 超线程留给工作线程
+  int recommendedIoThreads() const { return numCores_; }
+
+  // @brief 推荐的工作线程数, 每个逻辑CPU一个
+  int recommendedWorkerThreads() const { return numCpus(); }
+
+  /**
+   * @brief 第index个线程应当绑定的CPU
+   * 放置顺序在各节点之间轮流, 每个节点先占满各物理核的第一个超线程,
+   * 再使用其余的超线程; 线程数超过CPU数时循环使用
+   */
+  int cpuForThread(int index) const {
+    return placement_[static_cast<size_t>(index) % placement_.size()];
+  }
+
+  // @brief 第index个线程应当绑定的节点上的全部CPU, 适合不需要独占核的线程
+  const std::vector<int> &nodeCpusForThread(int index) const {
+    return nodes_[static_cast<size_t>(index) % nodes_.size()];
+  }
+
+  /**
+   * @brief 把线程绑定到给定的CPU集合
+   * @return 成功返回true, 失败时记录日志并返回false
+   */
+  static bool pinThread(pthread_t thread, const std::vector<int> &cpus);
+  static bool pinCurrentThread(const std::vector<int> &cpus) {
+    return pinThread(::pthread_self(), cpus);
+  }
+
+private:
+  CpuTopology();
+
+  std::vector<int> cpus_;                // 可用的逻辑CPU
+  std::vector<std::vector<int>> nodes_;  // 每个节点上可用的CPU
+  std::vector<int> placement_;           // 线程放置顺序
+  int numCores_;                         // 物理核数
+};
+
+} // namespace flkeeper::thread
+
+#endif
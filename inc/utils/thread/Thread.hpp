@@ -7,6 +7,8 @@
 
 #include <functional>
 #include <pthread.h>
+#include <string>
+#include <vector>
 
 namespace flkeeper {
 
@@ -32,6 +34,13 @@ public:
   // @brief 启动线程
   void start();
 
+  /**
+   * @brief 设置线程绑定的CPU, 为空表示不绑定
+   * @note 在start之前调用时, 线程在执行线程函数之前完成绑定;
+   * 线程已经运行时立即生效
+   */
+  void setCpuAffinity(const std::vector<int> &cpus);
+
   // @brief 等待线程结束
   void join();
 
@@ -60,6 +69,7 @@ private:
   pid_t tid_;     // 线程真实id
   ThreadFunc func_;   // 线程函数
   std::string name_;    // 线程名称
+  std::vector<int> cpus_;   // 绑定的CPU, 为空表示不绑定
   CountDownLatch latch_;    // 用于确保线程安全启动
 
   static AtomicInt32 numCreated_;   // 已创建的线程数
@@ -21,7 +21,7 @@ using std::string;
 /**
  * @brief 线程池类
  * @note
- * 1. 固定数量的线程
+ * 1. 启动时指定线程数, 运行期间可以通过resize调整
  * 2. 任务队列
  * 3. 支持优雅的关闭
  * 4. 支持自定义任务类型
@@ -30,6 +30,9 @@ class ThreadPool : NonCopyable {
 public:
   using Task = std::function<void()>;
 
+  // start/resize传入kAutoThreads时按CPU拓扑推荐的工作线程数启动
+  static const int kAutoThreads = -1;
+
   explicit ThreadPool(const string &nameArg = string("ThreadPool"));
   ~ThreadPool();
 
@@ -39,9 +42,27 @@ public:
   // @brief 设置任务队列的大小
   void setMaxQueueSize(size_t maxSize) { maxQueueSize_ = maxSize; }
 
+  /**
+   * @brief 工作线程是否绑定CPU
+   * 第i个工作线程绑定到CpuTopology::nodeCpusForThread(i), 即按节点轮流绑定
+   * 到整个NUMA节点, 由调度器在节点内部均衡
+   * @note 已经在运行的线程立即重新绑定, 关闭时恢复为可以使用全部CPU
+   */
+  void setCpuAffinity(bool on);
+
   // @brief 启动线程池
   void start(int numThreads = 4);
 
+  /**
+   * @brief 运行期间调整工作线程数, 可以在任意线程调用
+   * 增加时立即创建新线程; 减少时通知多余的线程在完成手头任务后退出,
+   * 缩减到0时会先把队列中剩余的任务执行完
+   */
+  void resize(int numThreads);
+
+  // @brief 当前工作线程数(不含正在退出的线程)
+  int numThreads() const;
+
   // @brief 停止线程池
   void stop();
 
@@ -56,12 +77,19 @@ public:
 
 private:
   // @brief 获取一个带执行的任务
+  // @param retire 输出参数, 为true表示该线程应当退出
   // @return Task 任务函数
-  Task take();
+  Task take(bool *retire);
 
   // @brief 线程执行函数
   void runInThread();
 
+  // @brief 创建并启动一个工作线程, 调用时必须持有mutex_
+  void spawnThread();
+
+  // @brief 回收已经退出的线程, 调用时必须持有mutex_
+  void reapRetired();
+
   // @brief 检查任务队列是否已经满了
   bool isFull() const;
 
@@ -85,6 +113,18 @@ private:
   // @brief 线程池大小
   int threadSize_;
 
+  // @brief 等待退出的线程数, 由resize设置, 工作线程领取后退出
+  int retiring_;
+
+  // @brief 已经退出但还没有join的线程
+  std::vector<pid_t> retired_;
+
+  // @brief 工作线程是否绑定CPU
+  bool pinThreads_;
+
+  // @brief 已创建的线程个数, 用于命名
+  int spawned_;
+
   // @brief 任务队列
   std::deque<Task> queue_;
 
@@ -6,6 +6,7 @@
 #include "utils/log/Logging.hpp"
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace flkeeper {
@@ -22,15 +23,28 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr,
           listenAddr.family())),                // 创建非阻塞socket
       acceptChannel_(loop, acceptSocket_.fd()), // 创建接受通道
       listening_(false),                        // 初始状态为未监听
+      isUnix_(listenAddr.isUnix()),             // 是否是Unix域socket
       idleFd_(::open(
           "/dev/null",
           O_RDONLY | O_CLOEXEC)) // 打开空闲文件描述符,用于防止文件描述符耗尽
 {
   assert(idleFd_ >= 0);
 
-  // 设置socket选项
-  acceptSocket_.setReuseAddr(true); // 设置地址重用,防止服务器重启时bind失败
-  acceptSocket_.setReusePort(reuseport); // 设置端口重用,支持多进程监听同一端口
+  if (listenAddr.isUnix()) {
+    // Unix域socket没有端口复用; 路径socket的文件在进程退出后仍然存在,
+    // 重启时先删除残留的socket文件, 否则bind会返回EADDRINUSE
+    if (!listenAddr.isAbstractUnix()) {
+      unixPath_ = listenAddr.unixPath();
+      struct stat st;
+      if (::lstat(unixPath_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(unixPath_.c_str());
+      }
+    }
+  } else {
+    // 设置socket选项
+    acceptSocket_.setReuseAddr(true); // 设置地址重用,防止服务器重启时bind失败
+    acceptSocket_.setReusePort(reuseport); // 设置端口重用,支持多进程监听同一端口
+  }
   acceptSocket_.bindAddress(listenAddr); // 绑定监听地址
 
   // 设置Channel的可读回调函数
@@ -44,6 +58,9 @@ Acceptor::~Acceptor() {
   acceptChannel_.disableAll(); // 禁用所有事件
   acceptChannel_.remove();     // 从事件循环中移除
   ::close(idleFd_);            // 关闭空闲文件描述符
+  if (!unixPath_.empty()) {
+    ::unlink(unixPath_.c_str()); // 删除自己创建的socket文件
+  }
 }
 
 // 开始监听
@@ -55,29 +72,57 @@ void Acceptor::listen() {
   acceptChannel_.enableReading(); // 启用读事件,开始接受连接
 }
 
+void Acceptor::setSocketProfile(const SocketProfile &profile) {
+  assert(!listening_);
+  if (isUnix_) {
+    // DEFER_ACCEPT和Fast Open是TCP选项, 只有缓冲区对Unix域socket有意义
+    if (profile.recvBufferBytes > 0) {
+      acceptSocket_.setRecvBuffer(profile.recvBufferBytes);
+    }
+    return;
+  }
+  if (profile.deferAcceptSeconds > 0) {
+    acceptSocket_.setDeferAccept(profile.deferAcceptSeconds);
+  }
+  if (profile.fastOpenQueue > 0) {
+    acceptSocket_.setFastOpen(profile.fastOpenQueue);
+  }
+  // 窗口扩大因子在握手时确定, 接收缓冲区要在listen之前设置才能生效
+  if (profile.recvBufferBytes > 0) {
+    acceptSocket_.setRecvBuffer(profile.recvBufferBytes);
+  }
+}
+
 // 处理新连接到达
-// 在IO线程中调用
+// 在IO线程中调用, 一直accept到EAGAIN, 连接风暴时一次唤醒可以接受多个连接
 void Acceptor::handleRead() {
   loop_->assertInLoopThread(); // 确保在IO线程中调用
-  InetAddress peerAddr;        // 对端地址
 
-  int connfd = acceptSocket_.accept(&peerAddr); // 接受新连接
-  if (connfd >= 0) {                            // 接受成功
-    if (newConnectionCallback_) {               // 如果设置了回调函数
-      newConnectionCallback_(connfd, peerAddr); // 调用回调函数处理新连接
-    } else {
-      network::close(connfd); // 如果没有设置回调函数,直接关闭连接
+  for (int i = 0; i < kMaxAcceptsPerRead; ++i) {
+    InetAddress peerAddr;                         // 对端地址
+    int connfd = acceptSocket_.accept(&peerAddr); // 接受新连接
+    if (connfd >= 0) {                            // 接受成功
+      if (newConnectionCallback_) {               // 如果设置了回调函数
+        newConnectionCallback_(connfd, peerAddr); // 调用回调函数处理新连接
+      } else {
+        network::close(connfd); // 如果没有设置回调函数,直接关闭连接
+      }
+      continue;
+    }
+    // 接受失败, EAGAIN表示已经没有待接受的连接
+    int savedErrno = errno;
+    if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) {
+      LOG_SYSERR << "in Acceptor::handleRead";
     }
-  } else { // 接受失败
-    LOG_SYSERR << "in Acceptor::handleRead";
     // 如果是文件描述符耗尽(errno == EMFILE)
     // 则关闭空闲描述符,接受连接后立即关闭,这样可以优雅地处理文件描述符耗尽的情况
-    if (errno == EMFILE) {
+    if (savedErrno == EMFILE) {
       ::close(idleFd_);                                    // 关闭空闲描述符
       idleFd_ = ::accept(acceptSocket_.fd(), NULL, NULL);  // 接受连接
       ::close(idleFd_);                                    // 关闭连接
       idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC); // 重新打开空闲描述符
     }
+    break;
   }
 }
 
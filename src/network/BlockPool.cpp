@@ -0,0 +1,309 @@
+#include "network/BlockPool.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+namespace flkeeper {
+namespace network {
+
+namespace {
+const size_t kHugePageSize = 2 * 1024 * 1024;
+// 每个尺寸级别最多缓存的字节数, 超出的块直接释放; 大页模式下交给溢出链表
+const size_t kMaxCachedBytesPerClass = 4 * 1024 * 1024;
+
+// -1: 尚未确定, 第一次分配时根据环境变量决定
+std::atomic<int> g_useHugePages(-1);
+
+// 大页模式下超出缓存上限的空闲块, 所有线程共享. slab中的块不能单独还给
+// 系统, 块单向流动(一个线程分配、另一个线程归还)时多出来的块放到这里,
+// 分配线程先从这里取, 没有时才切分新的slab
+struct OverflowList {
+  std::mutex mutex;
+  std::vector<char *> blocks[BlockPool::kNumSizeClasses];
+  std::atomic<size_t> total{0}; // 所有级别的块数, 为0时不必加锁
+};
+
+// 线程退出阶段也会使用, 不析构
+OverflowList &overflowList() {
+  static OverflowList *list = new OverflowList;
+  return *list;
+}
+
+void pushOverflow(int sizeClass, char *const *blocks, size_t n) {
+  OverflowList &overflow = overflowList();
+  std::lock_guard<std::mutex> lock(overflow.mutex);
+  std::vector<char *> &shared = overflow.blocks[sizeClass];
+  shared.insert(shared.end(), blocks, blocks + n);
+  overflow.total.fetch_add(n, std::memory_order_relaxed);
+}
+
+// 从溢出链表取最多max块追加到out, 返回取到的块数
+size_t popOverflow(int sizeClass, size_t max, std::vector<char *> *out) {
+  OverflowList &overflow = overflowList();
+  if (overflow.total.load(std::memory_order_relaxed) == 0) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(overflow.mutex);
+  std::vector<char *> &shared = overflow.blocks[sizeClass];
+  size_t n = std::min(max, shared.size());
+  out->insert(out->end(), shared.end() - n, shared.end());
+  shared.resize(shared.size() - n);
+  overflow.total.fetch_sub(n, std::memory_order_relaxed);
+  return n;
+}
+} // namespace
+
+struct alignas(16) BlockPool::BlockHeader {
+  BlockPool *owner; // 分配该块的池, 用于统计; nullptr表示不属于任何池
+  size_t capacity;  // 块的可用字节数
+  int sizeClass;    // 尺寸级别, -1表示直接向系统申请的块
+};
+
+// 线程退出时清理缓存的空闲块; 池对象本身不释放, 因为其它线程可能还持有
+// 从它分配的块, 归还时需要更新它的统计数据
+struct PoolHolder {
+  BlockPool *pool = nullptr;
+  ~PoolHolder();
+};
+
+namespace {
+thread_local PoolHolder t_holder;
+thread_local bool t_holderDestroyed = false;
+} // namespace
+
+PoolHolder::~PoolHolder() {
+  if (pool) {
+    pool->trim();
+    pool->detached_ = true;
+  }
+  t_holderDestroyed = true;
+}
+
+BlockPool::BlockPool()
+    : slabCur_(nullptr), slabEnd_(nullptr), detached_(false),
+      blocksInUse_(0), bytesInUse_(0), blocksHighWater_(0),
+      bytesHighWater_(0), cachedBlocks_(0), hugePageBytes_(0) {}
+
+BlockPool::~BlockPool() { trim(); }
+
+BlockPool *BlockPool::current() {
+  if (t_holderDestroyed) {
+    return nullptr;
+  }
+  if (!t_holder.pool) {
+    t_holder.pool = new BlockPool;
+  }
+  return t_holder.pool;
+}
+
+void BlockPool::setUseHugePages(bool on) {
+  int expected = -1;
+  if (!g_useHugePages.compare_exchange_strong(expected, on ? 1 : 0) &&
+      expected != (on ? 1 : 0)) {
+    LOG_WARN << "BlockPool::setUseHugePages must be called before the first "
+                "allocation, ignored";
+  }
+}
+
+bool BlockPool::useHugePages() {
+  int v = g_useHugePages.load(std::memory_order_relaxed);
+  if (v < 0) {
+    const char *env = ::getenv("MYMUDUO_USE_HUGEPAGES");
+    int want = (env && *env && ::strcmp(env, "0") != 0) ? 1 : 0;
+    g_useHugePages.compare_exchange_strong(v, want);
+    v = g_useHugePages.load(std::memory_order_relaxed);
+  }
+  return v == 1;
+}
+
+int BlockPool::sizeClassOf(size_t size) {
+  if (size > kMaxBlockSize) {
+    return -1;
+  }
+  int sizeClass = 0;
+  size_t s = kMinBlockSize;
+  while (s < size) {
+    s <<= 1;
+    ++sizeClass;
+  }
+  return sizeClass;
+}
+
+size_t BlockPool::classSize(int sizeClass) { return kMinBlockSize << sizeClass; }
+
+char *BlockPool::allocate(size_t size, size_t *capacity) {
+  BlockPool *pool = current();
+  if (pool) {
+    return pool->allocateInPool(size, capacity);
+  }
+  // 线程退出阶段已经没有可用的池, 直接向系统申请
+  char *raw = static_cast<char *>(::operator new(sizeof(BlockHeader) + size));
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(raw);
+  header->owner = nullptr;
+  header->capacity = size;
+  header->sizeClass = -1;
+  *capacity = size;
+  return raw + sizeof(BlockHeader);
+}
+
+void BlockPool::deallocate(char *block) {
+  if (!block) {
+    return;
+  }
+  BlockHeader *header =
+      reinterpret_cast<BlockHeader *>(block - sizeof(BlockHeader));
+  if (header->owner) {
+    header->owner->blocksInUse_.fetch_sub(1, std::memory_order_relaxed);
+    header->owner->bytesInUse_.fetch_sub(header->capacity,
+                                         std::memory_order_relaxed);
+  }
+  if (header->sizeClass < 0) {
+    ::operator delete(header);
+    return;
+  }
+  BlockPool *pool = current();
+  if (pool && !pool->detached_) {
+    pool->deallocateInPool(reinterpret_cast<char *>(header), header);
+  } else if (!useHugePages()) {
+    ::operator delete(header);
+  } else {
+    // 线程退出阶段归还的大页块交给其它线程复用
+    char *raw = reinterpret_cast<char *>(header);
+    pushOverflow(header->sizeClass, &raw, 1);
+  }
+}
+
+char *BlockPool::allocateInPool(size_t size, size_t *capacity) {
+  int sizeClass = sizeClassOf(size);
+  char *raw = nullptr;
+  size_t cap = size;
+  if (sizeClass < 0) {
+    raw = static_cast<char *>(::operator new(sizeof(BlockHeader) + size));
+  } else {
+    cap = classSize(sizeClass);
+    std::vector<char *> &freeList = freeLists_[sizeClass];
+    if (freeList.empty()) {
+      raw = refill(sizeClass);
+    } else {
+      raw = freeList.back();
+      freeList.pop_back();
+      cachedBlocks_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  BlockHeader *header = reinterpret_cast<BlockHeader *>(raw);
+  header->owner = this;
+  header->capacity = cap;
+  header->sizeClass = sizeClass;
+  addInUse(cap);
+  *capacity = cap;
+  return raw + sizeof(BlockHeader);
+}
+
+void BlockPool::deallocateInPool(char *raw, BlockHeader *header) {
+  std::vector<char *> &freeList = freeLists_[header->sizeClass];
+  if ((freeList.size() + 1) * classSize(header->sizeClass) <=
+      kMaxCachedBytesPerClass) {
+    freeList.push_back(raw);
+    cachedBlocks_.fetch_add(1, std::memory_order_relaxed);
+  } else if (!useHugePages()) {
+    ::operator delete(raw);
+  } else {
+    // 大页块不能释放, 连同一半的缓存一起交给溢出链表, 分摊加锁的开销
+    size_t keep = freeList.size() / 2;
+    freeList.push_back(raw);
+    pushOverflow(header->sizeClass, freeList.data() + keep,
+                 freeList.size() - keep);
+    cachedBlocks_.fetch_sub(freeList.size() - keep - 1,
+                            std::memory_order_relaxed);
+    freeList.resize(keep);
+  }
+}
+
+char *BlockPool::refill(int sizeClass) {
+  size_t total = sizeof(BlockHeader) + classSize(sizeClass);
+  if (!useHugePages()) {
+    return static_cast<char *>(::operator new(total));
+  }
+
+  // 先复用其它线程交出来的块, 一次取半个缓存上限
+  std::vector<char *> &freeList = freeLists_[sizeClass];
+  size_t batch = std::max<size_t>(
+      1, kMaxCachedBytesPerClass / 2 / classSize(sizeClass));
+  if (popOverflow(sizeClass, batch, &freeList) > 0) {
+    char *raw = freeList.back();
+    freeList.pop_back();
+    cachedBlocks_.fetch_add(freeList.size(), std::memory_order_relaxed);
+    return raw;
+  }
+
+  if (static_cast<size_t>(slabEnd_ - slabCur_) < total) {
+    // 当前slab剩余空间不够, 映射一块新的大页slab
+    void *slab = ::mmap(nullptr, kHugePageSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (slab == MAP_FAILED) {
+      // 没有预留的hugetlbfs页时退回到透明大页
+      slab = ::mmap(nullptr, kHugePageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slab == MAP_FAILED) {
+        LOG_SYSERR << "BlockPool::refill mmap";
+        return static_cast<char *>(::operator new(total));
+      }
+      ::madvise(slab, kHugePageSize, MADV_HUGEPAGE);
+    }
+    slabCur_ = static_cast<char *>(slab);
+    slabEnd_ = slabCur_ + kHugePageSize;
+    hugePageBytes_.fetch_add(kHugePageSize, std::memory_order_relaxed);
+  }
+  char *raw = slabCur_;
+  slabCur_ += total;
+  return raw;
+}
+
+void BlockPool::trim() {
+  bool hugePages = useHugePages();
+  for (int sizeClass = 0; sizeClass < kNumSizeClasses; ++sizeClass) {
+    std::vector<char *> &freeList = freeLists_[sizeClass];
+    if (hugePages) {
+      // slab不归还给系统, 缓存的块留给其它线程
+      pushOverflow(sizeClass, freeList.data(), freeList.size());
+    } else {
+      for (char *raw : freeList) {
+        ::operator delete(raw);
+      }
+    }
+    freeList.clear();
+    freeList.shrink_to_fit();
+  }
+  cachedBlocks_.store(0, std::memory_order_relaxed);
+}
+
+void BlockPool::addInUse(size_t bytes) {
+  size_t blocks = blocksInUse_.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t inUse = bytesInUse_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  if (blocks > blocksHighWater_.load(std::memory_order_relaxed)) {
+    blocksHighWater_.store(blocks, std::memory_order_relaxed);
+  }
+  if (inUse > bytesHighWater_.load(std::memory_order_relaxed)) {
+    bytesHighWater_.store(inUse, std::memory_order_relaxed);
+  }
+}
+
+BlockPool::Stats BlockPool::stats() const {
+  Stats s;
+  s.blocksInUse = blocksInUse_.load(std::memory_order_relaxed);
+  s.blocksInUseHighWater = blocksHighWater_.load(std::memory_order_relaxed);
+  s.bytesInUse = bytesInUse_.load(std::memory_order_relaxed);
+  s.bytesInUseHighWater = bytesHighWater_.load(std::memory_order_relaxed);
+  s.cachedBlocks = cachedBlocks_.load(std::memory_order_relaxed);
+  s.hugePageBytes = hugePageBytes_.load(std::memory_order_relaxed);
+  return s;
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -1,4 +1,5 @@
 #include "network/Buffer.hpp"
+#include "network/BlockPool.hpp"
 #include <errno.h>
 #include <sys/uio.h>
 #include <algorithm>
@@ -8,6 +9,35 @@ namespace network {
 
 const char Buffer::kCRLF[] = "\r\n";
 
+Buffer::Buffer(size_t initialSize)
+    : buffer_(BlockPool::allocate(kCheapPrepend + initialSize, &capacity_)),
+      readIndex_(kCheapPrepend), writeIndex_(kCheapPrepend) {
+  assert(readableBytes() == 0);
+  assert(writableBytes() >= initialSize);
+  assert(prependableBytes() == kCheapPrepend);
+}
+
+Buffer::~Buffer() { BlockPool::deallocate(buffer_); }
+
+Buffer::Buffer(const Buffer &rhs) : Buffer(rhs.readableBytes()) {
+  append(rhs.peek(), rhs.readableBytes());
+}
+
+Buffer &Buffer::operator=(const Buffer &rhs) {
+  if (this != &rhs) {
+    Buffer tmp(rhs);
+    swap(tmp);
+  }
+  return *this;
+}
+
+Buffer::Buffer(Buffer &&rhs) : Buffer() { swap(rhs); }
+
+Buffer &Buffer::operator=(Buffer &&rhs) {
+  swap(rhs);
+  return *this;
+}
+
 const char *Buffer::findCRLF() const {
   const char *crlf = std::search(peek(), beginWrite(), kCRLF, kCRLF + 2);
   return crlf == beginWrite() ? nullptr : crlf;
@@ -37,7 +67,7 @@ size_t Buffer::readableBytes() const {
 }
 
 size_t Buffer::writableBytes() const {
-  return buffer_.size() - writeIndex_;
+  return capacity_ - writeIndex_;
 }
 
 size_t Buffer::prependableBytes() const {
@@ -53,7 +83,8 @@ void Buffer::checkWritableSpace(size_t len) {
 
 void Buffer::swap(Buffer& rhs)
 {
-  buffer_.swap(rhs.buffer_);
+  std::swap(buffer_, rhs.buffer_);
+  std::swap(capacity_, rhs.capacity_);
   std::swap(readIndex_, rhs.readIndex_);
   std::swap(writeIndex_, rhs.writeIndex_);
 }
@@ -80,8 +111,7 @@ void Buffer::prepend(const void* data, size_t len) {
 }
 
 void Buffer::shrink(size_t reserve) {
-  Buffer other;
-  other.checkWritableSpace(readableBytes() + reserve);
+  Buffer other(readableBytes() + reserve);
   other.append(peek(), readableBytes());
   swap(other);
 }
@@ -89,7 +119,18 @@ void Buffer::shrink(size_t reserve) {
 void Buffer::makeSpace(size_t len) {
   // or: if(writableBytes() < len)
   if(writableBytes() + prependableBytes() < len + kCheapPrepend) {
-    buffer_.resize(writeIndex_ + len);
+    // 换一块更大的内存, 只拷贝可读数据, 新空间不做零填充
+    size_t readable = readableBytes();
+    size_t newCapacity = 0;
+    char *newBuffer = BlockPool::allocate(
+        std::max(capacity_ * 2, kCheapPrepend + readable + len), &newCapacity);
+    std::copy(begin() + readIndex_, begin() + writeIndex_,
+              newBuffer + kCheapPrepend);
+    BlockPool::deallocate(buffer_);
+    buffer_ = newBuffer;
+    capacity_ = newCapacity;
+    readIndex_ = kCheapPrepend;
+    writeIndex_ = readIndex_ + readable;
   } else {
     assert(kCheapPrepend < readIndex_);
     auto readable = readableBytes();
@@ -128,7 +169,7 @@ ssize_t Buffer::readFd(int fd, int *savedErrno) {
     writeIndex_ += n;
   } else {
     // Buffer写满了，额外的数据写入了extrabuf，需要append
-    writeIndex_ = buffer_.size();
+    writeIndex_ = capacity_;
     append(extrabuf, n - writable);
   }
 
@@ -22,6 +22,8 @@ Channel::Channel(EventLoop* loop, int fd)
       events_(0),
       revents_(0),
       index_(-1),
+      polledEvents_(0),
+      edgeTriggered_(false),
       eventHandling_(false),
       addedToLoop_(false),
       logHup_(true),
@@ -41,6 +43,17 @@ void Channel::update() {
     loop_->updateChannel(this);
 }
 
+void Channel::setEdgeTriggered(bool on) {
+    if (edgeTriggered_ == on) {
+        return;
+    }
+    edgeTriggered_ = on;
+    // 已经注册过的Channel需要让Poller按新的触发方式重新注册
+    if (addedToLoop_ && !isNoneEvent()) {
+        update();
+    }
+}
+
 void Channel::remove() {
     assert(isNoneEvent());
     addedToLoop_ = false;
@@ -0,0 +1,63 @@
+#include "network/ConnectionTable.hpp"
+
+#include <assert.h>
+
+namespace flkeeper {
+namespace network {
+
+ConnectionTable::Id ConnectionTable::insert(const TcpConnectionPtr &conn) {
+  assert(conn);
+  uint32_t index;
+  if (freeSlots_.empty()) {
+    index = static_cast<uint32_t>(slots_.size());
+    slots_.push_back(Slot{TcpConnectionPtr(), 0});
+  } else {
+    index = freeSlots_.back();
+    freeSlots_.pop_back();
+  }
+  Slot &slot = slots_[index];
+  assert(!slot.conn);
+  slot.conn = conn;
+  // 代数为0的编号保留给无效值
+  if (++slot.generation == 0) {
+    slot.generation = 1;
+  }
+  ++size_;
+  return static_cast<Id>(slot.generation) << 32 | index;
+}
+
+bool ConnectionTable::erase(Id id) {
+  uint32_t index = slotOf(id);
+  if (index >= slots_.size()) {
+    return false;
+  }
+  Slot &slot = slots_[index];
+  if (!slot.conn || slot.generation != generationOf(id)) {
+    return false;
+  }
+  slot.conn.reset();
+  freeSlots_.push_back(index);
+  --size_;
+  return true;
+}
+
+TcpConnectionPtr ConnectionTable::find(Id id) const {
+  uint32_t index = slotOf(id);
+  if (index >= slots_.size() || slots_[index].generation != generationOf(id)) {
+    return TcpConnectionPtr();
+  }
+  return slots_[index].conn;
+}
+
+void ConnectionTable::clear() {
+  for (uint32_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].conn) {
+      slots_[i].conn.reset();
+      freeSlots_.push_back(i);
+    }
+  }
+  size_ = 0;
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -77,7 +77,8 @@ void Connector::connect() {
   int sockfd = network::createNonblockingOrDie(serverAddr_.family());
   // 连接服务器
   int ret = network::connect(
-      sockfd, reinterpret_cast<const sockaddr *>(serverAddr_.getSockAddr()));
+      sockfd, reinterpret_cast<const sockaddr *>(serverAddr_.getSockAddr()),
+      serverAddr_.sockAddrLen());
   int savedErrno = (ret == 0) ? 0 : errno;
   switch (savedErrno) {
   case 0:
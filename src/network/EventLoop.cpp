@@ -7,6 +7,7 @@
 #include "utils/log/Logging.hpp"
 
 #include <assert.h>
+#include <errno.h>
 #include <functional>
 #include <memory.h>
 #include <sys/eventfd.h>
@@ -17,7 +18,14 @@ namespace flkeeper {
 namespace network {
 thread_local EventLoop *t_loopInThisThread = nullptr;
 
-const int kPollTimeMs = 1; // 将超时时间从10ms改为1ms，以更快地响应写事件
+// poll一直阻塞到有IO事件: 定时器通过timerfd、跨线程投递通过eventfd唤醒
+const int kPollTimeMs = -1;
+
+// 单线程写入的统计计数, 不需要原子的读-改-写
+inline void addRelaxed(std::atomic<int64_t> &counter, int64_t delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
 
 int createEventfd() {
   int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -39,9 +47,15 @@ EventLoop::EventLoop()
     : looping_(false), quit_(false), eventHandling_(false),
       callingPendingFunctors_(false), threadId_(thread::tid()),
       poller_(Poller::newDefaultPoller(this)),
-      timerQueue_(new TimerQueue(this)), wakeupFd_(createEventfd()),
+      timerQueue_(TimerQueue::newDefaultTimerQueue(this)), wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      currentActiveChannel_(nullptr) {
+      currentActiveChannel_(nullptr), freeFunctors_(nullptr),
+      wakeupPending_(false),
+      blockPool_(BlockPool::current()),
+      numConnections_(0), outstandingBytes_(0), numSlowConnections_(0),
+      recentLatencyUs_(0),
+      busyPollUs_(0), spinBudgetUs_(0), iterations_(0), wakeups_(0), spins_(0),
+      pollTimeUs_(0) {
   LOG_DEBUG << "EventLoop created " << this << " in thread " << threadId_;
   if (t_loopInThisThread) {
     LOG_FATAL << "Another EventLoop " << t_loopInThisThread
@@ -59,6 +73,15 @@ EventLoop::~EventLoop() {
   wakeupChannel_->disableAll();
   wakeupChannel_->remove();
   ::close(wakeupFd_);
+  while (RemoteFunctor *node = remoteFunctors_.pop()) {
+    delete node;
+  }
+  RemoteFunctor *node = freeFunctors_.exchange(nullptr);
+  while (node) {
+    RemoteFunctor *next = node->nextFree;
+    delete node;
+    node = next;
+  }
   t_loopInThisThread = nullptr;
 }
 
@@ -69,9 +92,22 @@ void EventLoop::loop() {
   quit_ = false;
   LOG_TRACE << "EventLoop " << this << " start looping";
 
+  TimeStamp pollStart(TimeStamp::now());
   while (!quit_) {
     activeChannels_.clear();
-    pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+    int maxSpinUs = busyPollUs_.load(std::memory_order_relaxed);
+    if (maxSpinUs > 0) {
+      pollWithSpin(maxSpinUs, pollStart);
+    } else {
+      pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+    }
+    addRelaxed(iterations_, 1);
+    if (!activeChannels_.empty()) {
+      addRelaxed(wakeups_, 1);
+    }
+    addRelaxed(pollTimeUs_, pollReturnTime_.microSecondsSinceEpoch() -
+                                pollStart.microSecondsSinceEpoch());
+
     eventHandling_ = true;
     for (Channel *channel : activeChannels_) {
       currentActiveChannel_ = channel;
@@ -80,12 +116,49 @@ void EventLoop::loop() {
     currentActiveChannel_ = nullptr;
     eventHandling_ = false;
     doPendingFunctors();
+
+    // 按1/8的权重更新本轮处理耗时的滑动平均
+    pollStart = TimeStamp::now();
+    int64_t us = pollStart.microSecondsSinceEpoch() -
+                 pollReturnTime_.microSecondsSinceEpoch();
+    int64_t avg = recentLatencyUs_.load(std::memory_order_relaxed);
+    recentLatencyUs_.store(avg + (us - avg) / 8, std::memory_order_relaxed);
   }
 
   LOG_TRACE << "EventLoop " << this << " stop looping";
   looping_ = false;
 }
 
+void EventLoop::pollWithSpin(int maxSpinUs, TimeStamp start) {
+  int64_t minSpinUs = std::max(maxSpinUs / 16, 1);
+  spinBudgetUs_ = std::min(std::max(spinBudgetUs_, minSpinUs),
+                           static_cast<int64_t>(maxSpinUs));
+  int64_t deadline = start.microSecondsSinceEpoch() + spinBudgetUs_;
+  while (true) {
+    pollReturnTime_ = poller_->poll(0, &activeChannels_);
+    if (!activeChannels_.empty()) {
+      spinBudgetUs_ = std::min(spinBudgetUs_ * 2,
+                               static_cast<int64_t>(maxSpinUs));
+      return;
+    }
+    addRelaxed(spins_, 1);
+    if (quit_ || pollReturnTime_.microSecondsSinceEpoch() >= deadline) {
+      break;
+    }
+  }
+  spinBudgetUs_ = std::max(spinBudgetUs_ / 2, minSpinUs);
+  pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+}
+
+EventLoop::PollStats EventLoop::pollStats() const {
+  PollStats stats;
+  stats.iterations = iterations_.load(std::memory_order_relaxed);
+  stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+  stats.spins = spins_.load(std::memory_order_relaxed);
+  stats.pollTimeUs = pollTimeUs_.load(std::memory_order_relaxed);
+  return stats;
+}
+
 void EventLoop::quit() {
   quit_ = true;
   if (!isInLoopThread()) {
@@ -102,17 +175,50 @@ void EventLoop::runInLoop(Functor cb) {
 }
 
 void EventLoop::queueInLoop(Functor cb) {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
+  if (isInLoopThread()) {
     pendingFunctors_.push_back(std::move(cb));
+    // 正在执行回调时新投递的回调要等下一轮, 需要唤醒避免阻塞在poll中
+    if (callingPendingFunctors_) {
+      wakeup();
+    }
+  } else {
+    remoteFunctors_.push(allocRemoteFunctor(std::move(cb)));
+    wakeup();
   }
+}
 
-  if (!isInLoopThread() || callingPendingFunctors_) {
-    wakeup();
+EventLoop::RemoteFunctor *EventLoop::allocRemoteFunctor(Functor cb) {
+  // 线程退出时释放缓存中的节点
+  struct FunctorCache {
+    RemoteFunctor *head = nullptr;
+    ~FunctorCache() {
+      while (head) {
+        RemoteFunctor *next = head->nextFree;
+        delete head;
+        head = next;
+      }
+    }
+  };
+  static thread_local FunctorCache cache;
+
+  if (!cache.head) {
+    cache.head = freeFunctors_.exchange(nullptr, std::memory_order_acquire);
   }
+  RemoteFunctor *node = cache.head;
+  if (node) {
+    cache.head = node->nextFree;
+  } else {
+    node = new RemoteFunctor;
+  }
+  node->functor = std::move(cb);
+  return node;
 }
 
 void EventLoop::wakeup() {
+  // doPendingFunctors在取回调之前清除标志, 之后投递的回调一定会再写一次
+  if (wakeupPending_.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
   uint64_t one = 1;
   ssize_t n = ::write(wakeupFd_, &one, sizeof one);
   if (n != sizeof one) {
@@ -143,6 +249,41 @@ bool EventLoop::hasChannel(Channel *channel) {
   return poller_->hasChannel(channel);
 }
 
+bool EventLoop::supportsEdgeTriggered() const {
+  return poller_->supportsEdgeTriggered();
+}
+
+bool EventLoop::supportsAsyncFileIo() const {
+  return poller_->supportsAsyncFileIo();
+}
+
+void EventLoop::asyncRead(int fd, void *buf, size_t len, off_t offset,
+                          FileIoCallback cb) {
+  assertInLoopThread();
+  if (poller_->submitFileRead(fd, buf, len, offset, cb)) {
+    return;
+  }
+  ssize_t n = offset < 0 ? ::read(fd, buf, len) : ::pread(fd, buf, len, offset);
+  if (n < 0) {
+    n = -errno;
+  }
+  queueInLoop(std::bind(std::move(cb), n));
+}
+
+void EventLoop::asyncWrite(int fd, const void *buf, size_t len, off_t offset,
+                           FileIoCallback cb) {
+  assertInLoopThread();
+  if (poller_->submitFileWrite(fd, buf, len, offset, cb)) {
+    return;
+  }
+  ssize_t n =
+      offset < 0 ? ::write(fd, buf, len) : ::pwrite(fd, buf, len, offset);
+  if (n < 0) {
+    n = -errno;
+  }
+  queueInLoop(std::bind(std::move(cb), n));
+}
+
 void EventLoop::abortNotInLoopThread() {
   LOG_FATAL << "EventLoop::abortNotInLoopThread - EventLoop " << this
             << " was created in threadId_ = " << threadId_
@@ -158,16 +299,43 @@ void EventLoop::handleRead() {
 }
 
 void EventLoop::doPendingFunctors() {
-  std::vector<Functor> functors;
   callingPendingFunctors_ = true;
+  // 与生产者的exchange配对: 清除之前链接好的节点本轮一定能取到
+  wakeupPending_.exchange(false, std::memory_order_acq_rel);
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    functors.swap(pendingFunctors_);
+  runningFunctors_.swap(pendingFunctors_);
+  for (Functor &functor : runningFunctors_) {
+    functor();
   }
+  runningFunctors_.clear();
 
-  for (const Functor &functor : functors) {
-    functor();
+  int count = 0;
+  RemoteFunctor *recycled = nullptr; // 本轮执行完的节点, 最后一次压回空闲栈
+  RemoteFunctor *last = nullptr;
+  while (count < kMaxRemoteFunctorsPerRound) {
+    RemoteFunctor *node = remoteFunctors_.pop();
+    if (!node) {
+      break;
+    }
+    node->functor();
+    node->functor.reset(); // 尽早释放回调捕获的对象
+    node->nextFree = recycled;
+    recycled = node;
+    if (!last) {
+      last = node;
+    }
+    ++count;
+  }
+  if (recycled) {
+    RemoteFunctor *head = freeFunctors_.load(std::memory_order_relaxed);
+    do {
+      last->nextFree = head;
+    } while (!freeFunctors_.compare_exchange_weak(head, recycled,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+  }
+  if (count == kMaxRemoteFunctorsPerRound) {
+    wakeup();
   }
   callingPendingFunctors_ = false;
 }
@@ -1,6 +1,7 @@
 #include "network/EventLoopThreadPool.hpp"
 #include "network/EventLoop.hpp"
 #include "network/EventLoopThread.hpp"
+#include "utils/thread/CpuTopology.hpp"
 
 #include <assert.h>
 #include <stdio.h>
@@ -11,7 +12,8 @@ namespace network {
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop,
                                          const std::string &nameArg)
     : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0),
-      next_(0) {
+      pinThreads_(false), next_(0), policy_(kRoundRobin),
+      rng_(static_cast<unsigned>(reinterpret_cast<uintptr_t>(this))) {
   assert(baseLoop != nullptr);
 }
 
@@ -28,11 +30,19 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
 
   started_ = true;
 
+  const thread::CpuTopology &topology = thread::CpuTopology::instance();
+  if (numThreads_ == kAutoThreads) {
+    numThreads_ = topology.recommendedIoThreads();
+  }
+
   // 创建numThreads_个线程
   for (int i = 0; i < numThreads_; ++i) {
     char buf[name_.size() + 32];
     snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
     EventLoopThread *t = new EventLoopThread(cb, buf);
+    if (pinThreads_) {
+      t->setCpuAffinity({topology.cpuForThread(i)});
+    }
     threads_.push_back(std::unique_ptr<EventLoopThread>(t));
     loops_.push_back(
         t->startLoop()); // 启动EventLoopThread，返回其EventLoop指针
@@ -60,11 +70,40 @@ void EventLoopThreadPool::stop() {
   started_ = false;
 }
 
+namespace {
+// 综合负载中每个连接、每64KB待发送数据、每100us事件处理耗时各记1分
+const int64_t kScoreBytesUnit = 64 * 1024;
+const int64_t kScoreLatencyUnitUs = 100;
+} // namespace
+
 EventLoop *EventLoopThreadPool::getNextLoop() {
   assert(started_);
   EventLoop *loop = baseLoop_;
 
-  // 如果有其他线程，则采用round-robin方式分配
+  // 如果有其他线程，则按分配策略选择
+  if (loops_.size() > 1) {
+    switch (policy_) {
+    case kLeastConnections:
+      return leastLoaded(
+          [](const EventLoop *l) -> int64_t { return l->numConnections(); });
+    case kLeastOutstandingBytes:
+      return leastLoaded(
+          [](const EventLoop *l) { return l->outstandingBytes(); });
+    case kPowerOfTwoChoices: {
+      size_t n = loops_.size();
+      size_t a = rng_() % n;
+      size_t b = rng_() % (n - 1);
+      if (b >= a) {
+        ++b; // 保证两次选到不同的loop
+      }
+      return loadScore(loops_[b]) < loadScore(loops_[a]) ? loops_[b]
+                                                         : loops_[a];
+    }
+    case kRoundRobin:
+    default:
+      break;
+    }
+  }
   if (!loops_.empty()) {
     // round-robin
     loop = loops_[next_];
@@ -76,6 +115,29 @@ EventLoop *EventLoopThreadPool::getNextLoop() {
   return loop;
 }
 
+template <typename LoadFunc>
+EventLoop *EventLoopThreadPool::leastLoaded(LoadFunc load) {
+  size_t n = loops_.size();
+  size_t start = static_cast<size_t>(next_);
+  next_ = static_cast<int>((start + 1) % n);
+  EventLoop *best = loops_[start];
+  int64_t bestLoad = load(best);
+  for (size_t i = 1; i < n && bestLoad > 0; ++i) {
+    EventLoop *loop = loops_[(start + i) % n];
+    int64_t l = load(loop);
+    if (l < bestLoad) {
+      best = loop;
+      bestLoad = l;
+    }
+  }
+  return best;
+}
+
+int64_t EventLoopThreadPool::loadScore(const EventLoop *loop) {
+  return loop->numConnections() + loop->outstandingBytes() / kScoreBytesUnit +
+         loop->recentLatencyUs() / kScoreLatencyUnitUs;
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops() {
   assert(started_);
   if (loops_.empty()) {
@@ -4,7 +4,9 @@
 
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 #include <strings.h>
 
@@ -24,7 +26,7 @@ static bool isIpV6Address(const char *ip) {
   return false;
 }
 
-InetAddress::InetAddress(DFLK_UINT16 port, bool loopbackOnly) {
+InetAddress::InetAddress(DFLK_UINT16 port, bool loopbackOnly) : unixLen_(0) {
   ::bzero(&addr_, sizeof addr_);
   addr_.sin_family = AF_INET;
   in_addr_t ip = loopbackOnly ? kInaddrLoopback : kInaddrAny;
@@ -32,7 +34,7 @@ InetAddress::InetAddress(DFLK_UINT16 port, bool loopbackOnly) {
   addr_.sin_port = hostToNetwork16(port);
 }
 
-InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port) {
+InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port) : unixLen_(0) {
   if (isIpV6Address(ip.c_str())) {
     // 如果是ipv6地址
     ::bzero(&addr6_, sizeof addr6_);
@@ -51,7 +53,8 @@ InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port) {
   }
 }
 
-InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port, bool ipv6) {
+InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port, bool ipv6)
+    : unixLen_(0) {
   if (ipv6) {
     ::bzero(&addr6_, sizeof addr6_);
     addr6_.sin6_family = AF_INET6;
@@ -69,7 +72,68 @@ InetAddress::InetAddress(StringArg ip, DFLK_UINT16 port, bool ipv6) {
   }
 }
 
+InetAddress::InetAddress(const struct sockaddr *addr, socklen_t len)
+    : unixLen_(0) {
+  setSockAddr(addr, len);
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path, bool abstract) {
+  InetAddress result;
+  ::bzero(&result.addrUn_, sizeof result.addrUn_);
+  result.addrUn_.sun_family = AF_UNIX;
+  // 抽象名字以'\0'开头, 不需要结尾的'\0'; 路径需要留出结尾的'\0'
+  size_t offset = abstract ? 1 : 0;
+  size_t maxLen = sizeof result.addrUn_.sun_path - 1;
+  size_t len = path.size();
+  if (len > maxLen) {
+    LOG_ERROR << "InetAddress::fromUnixPath path too long: " << path;
+    len = maxLen;
+  }
+  ::memcpy(result.addrUn_.sun_path + offset, path.data(), len);
+  size_t terminator = abstract ? 0 : 1;
+  result.unixLen_ = static_cast<socklen_t>(
+      offsetof(struct sockaddr_un, sun_path) + offset + len + terminator);
+  return result;
+}
+
+void InetAddress::setSockAddr(const struct sockaddr *addr, socklen_t len) {
+  unixLen_ = 0;
+  if (addr->sa_family == AF_UNIX) {
+    ::bzero(&addrUn_, sizeof addrUn_);
+    unixLen_ = std::min(len, static_cast<socklen_t>(sizeof addrUn_));
+    ::memcpy(&addrUn_, addr, unixLen_);
+  } else if (addr->sa_family == AF_INET6) {
+    ::memcpy(&addr6_, addr, sizeof addr6_);
+  } else {
+    ::memcpy(&addr_, addr, sizeof addr_);
+  }
+}
+
+socklen_t InetAddress::sockAddrLen() const {
+  if (family() == AF_UNIX) {
+    return unixLen_;
+  }
+  return static_cast<socklen_t>(family() == AF_INET6 ? sizeof addr6_
+                                                     : sizeof addr_);
+}
+
+std::string InetAddress::unixPath() const {
+  size_t offset = offsetof(struct sockaddr_un, sun_path);
+  if (!isUnix() || unixLen_ <= offset) {
+    return std::string();
+  }
+  const char *path = addrUn_.sun_path;
+  size_t len = unixLen_ - offset;
+  if (path[0] == '\0') {
+    return "@" + std::string(path + 1, len - 1);
+  }
+  return std::string(path, ::strnlen(path, len));
+}
+
 std::string InetAddress::toIp() const {
+  if (isUnix()) {
+    return unixPath();
+  }
   char buf[64] = "";
   if (family() == AF_INET) {
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
@@ -80,6 +144,9 @@ std::string InetAddress::toIp() const {
 }
 
 std::string InetAddress::toIpPort() const {
+  if (isUnix()) {
+    return "unix:" + unixPath();
+  }
   char buf[64] = "";
   if (family() == AF_INET) {
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof buf);
@@ -97,6 +164,9 @@ std::string InetAddress::toIpPort() const {
 }
 
 uint16_t InetAddress::port() const {
+  if (isUnix()) {
+    return 0;
+  }
   return networkToHost16(portNetEndian());
 }
 
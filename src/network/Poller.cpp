@@ -10,8 +10,7 @@ Poller::~Poller() = default;
 
 bool Poller::hasChannel(Channel *channel) const {
   assertInLoopThread();
-  auto it = channels_.find(channel->fd());
-  return it != channels_.end() && it->second == channel;
+  return channels_.find(channel->fd()) == channel;
 }
 
 void Poller::assertInLoopThread() const { ownerLoop_->assertInLoopThread(); }
@@ -25,17 +25,21 @@ Socket::Socket(int sockfd) : sockfd_(sockfd) {
 Socket::~Socket() { close(sockfd_); }
 
 void Socket::bindAddress(const InetAddress &addr) {
-  bindOrDie(sockfd_, addr.getSockAddrInet6());
+  bindOrDie(sockfd_, addr.getSockAddr(), addr.sockAddrLen());
 }
 
 void Socket::listen() { listenOrDie(sockfd_); }
 
 int Socket::accept(InetAddress *peeraddr) {
-  struct sockaddr_in6 addr;
+  // 足够容纳IPv6和AF_UNIX地址
+  struct sockaddr_storage addr;
   memset(&addr, 0, sizeof addr);
-  int connfd = network::accept(sockfd_, &addr);
+  socklen_t addrlen = static_cast<socklen_t>(sizeof addr);
+  int connfd = network::accept(
+      sockfd_, reinterpret_cast<struct sockaddr *>(&addr), &addrlen);
   if (connfd >= 0) {
-    peeraddr->setSockAddrInet6(addr);
+    peeraddr->setSockAddr(reinterpret_cast<struct sockaddr *>(&addr),
+                          addrlen);
   }
   return connfd;
 }
@@ -84,5 +88,92 @@ void Socket::setKeepAlive(bool on) {
   }
 }
 
+void Socket::setBusyPoll(int usec) {
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec,
+                         static_cast<socklen_t>(sizeof usec));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setBusyPoll";
+  }
+}
+
+bool Socket::setZeroCopy(bool on) {
+  int optval = on ? 1 : 0;
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval,
+                         static_cast<socklen_t>(sizeof optval));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setZeroCopy";
+    return false;
+  }
+  return true;
+}
+
+bool Socket::getPeerCredentials(struct ucred *cred) const {
+  socklen_t len = sizeof(*cred);
+  return ::getsockopt(sockfd_, SOL_SOCKET, SO_PEERCRED, cred, &len) == 0;
+}
+
+bool Socket::getTcpInfo(struct tcp_info *info) const {
+  socklen_t len = sizeof(*info);
+  memset(info, 0, len);
+  return ::getsockopt(sockfd_, SOL_TCP, TCP_INFO, info, &len) == 0;
+}
+
+void Socket::setDeferAccept(int seconds) {
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds,
+                         static_cast<socklen_t>(sizeof seconds));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setDeferAccept";
+  }
+}
+
+void Socket::setFastOpen(int queueLen) {
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, &queueLen,
+                         static_cast<socklen_t>(sizeof queueLen));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setFastOpen";
+  }
+}
+
+void Socket::setSendBuffer(int bytes) {
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, &bytes,
+                         static_cast<socklen_t>(sizeof bytes));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setSendBuffer";
+  }
+}
+
+void Socket::setRecvBuffer(int bytes) {
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &bytes,
+                         static_cast<socklen_t>(sizeof bytes));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setRecvBuffer";
+  }
+}
+
+void Socket::setNotSentLowat(int bytes) {
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes,
+                         static_cast<socklen_t>(sizeof bytes));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setNotSentLowat";
+  }
+}
+
+void Socket::setCongestion(const std::string &name) {
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CONGESTION, name.data(),
+                         static_cast<socklen_t>(name.size()));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setCongestion " << name;
+  }
+}
+
+void Socket::setCork(bool on) {
+  int optval = on ? 1 : 0;
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval,
+                         static_cast<socklen_t>(sizeof optval));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setCork";
+  }
+}
+
 } // namespace network
 } // namespace flkeeper
@@ -66,7 +66,8 @@ const struct sockaddr_in6* sockaddr_in6_cast(const struct sockaddr* addr)
 int createNonblockingOrDie(sa_family_t family)
 {
 #if VALGRIND
-    int sockfd = ::socket(family, SOCK_STREAM, IPPROTO_TCP);
+    int sockfd = ::socket(family, SOCK_STREAM,
+                          family == AF_UNIX ? 0 : IPPROTO_TCP);
     if (sockfd < 0)
     {
         LOG_SYSFATAL << "sockets::createNonblockingOrDie";
@@ -74,7 +75,8 @@ int createNonblockingOrDie(sa_family_t family)
 
     setNonBlockAndCloseOnExec(sockfd);
 #else
-    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          family == AF_UNIX ? 0 : IPPROTO_TCP);
     if (sockfd < 0)
     {
         LOG_SYSFATAL << "sockets::createNonblockingOrDie";
@@ -85,9 +87,9 @@ int createNonblockingOrDie(sa_family_t family)
 
 ///
 /// 绑定socket地址
-void bindOrDie(int sockfd, const struct sockaddr* addr)
+void bindOrDie(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
 {
-    int ret = ::bind(sockfd, addr, static_cast<socklen_t>(sizeof(struct sockaddr_in6)));
+    int ret = ::bind(sockfd, addr, addrlen);
     if (ret < 0)
     {
         LOG_SYSFATAL << "sockets::bindOrDie";
@@ -110,17 +112,25 @@ void listenOrDie(int sockfd)
 int accept(int sockfd, struct sockaddr_in6* addr)
 {
     socklen_t addrlen = static_cast<socklen_t>(sizeof *addr);
+    return network::accept(sockfd, sockaddr_cast(addr), &addrlen);
+}
+
+int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen)
+{
 #if VALGRIND || defined (NO_ACCEPT4)
-    int connfd = ::accept(sockfd, sockaddr_cast(addr), &addrlen);
+    int connfd = ::accept(sockfd, addr, addrlen);
     setNonBlockAndCloseOnExec(connfd);
 #else
-    int connfd = ::accept4(sockfd, sockaddr_cast(addr),
-                          &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    int connfd = ::accept4(sockfd, addr, addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 #endif
     if (connfd < 0)
     {
         int savedErrno = errno;
-        LOG_SYSERR << "Socket::accept";
+        // 非阻塞监听socket一直accept到EAGAIN, 这是正常的结束条件
+        if (savedErrno != EAGAIN)
+        {
+            LOG_SYSERR << "Socket::accept";
+        }
         switch (savedErrno)
         {
             case EAGAIN:
@@ -153,9 +163,9 @@ int accept(int sockfd, struct sockaddr_in6* addr)
 
 ///
 /// 连接socket
-int connect(int sockfd, const struct sockaddr* addr)
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
 {
-    return ::connect(sockfd, addr, static_cast<socklen_t>(sizeof(struct sockaddr_in6)));
+    return ::connect(sockfd, addr, addrlen);
 }
 
 ///
@@ -3,11 +3,19 @@
 #include "network/Channel.hpp"
 #include "network/EventLoop.hpp"
 #include "network/Socket.hpp"
+#include "network/TlsSession.hpp"
 
+#include <algorithm>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
 #include <string.h>
 #include <strings.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -15,13 +23,73 @@
 namespace flkeeper {
 namespace network {
 
+namespace {
+// 单次sendfile调用最多发送的字节数，避免一个大文件长时间占用事件循环
+const size_t kMaxSendfileChunk = 4 * 1024 * 1024;
+// splice中转管道期望的容量, 设置失败时使用系统默认值
+const int kSplicePipeSize = 1024 * 1024;
+// 按TCP_INFO调整时单次sendfile的下限, 避免慢速连接上的系统调用过于频繁;
+// 不能小于TlsSession每次读文件的长度, 见flushOutput
+const size_t kMinSendBatch = 64 * 1024;
+// TLS记录的最大明文长度, SSL_read一次最多返回一个记录
+const size_t kTlsRecordSize = 16 * 1024;
+// 连接关闭后检查零拷贝完成通知的间隔(秒)和次数, 超时后以RST中止连接
+const double kZeroCopyLingerInterval = 0.1;
+const int kZeroCopyLingerTicks = 300;
+// 异步发送文件时每次读出的最大字节数
+const size_t kAsyncFileChunk = 256 * 1024;
+// spliceToFile异步写入时每块的最大字节数和在途写请求的上限, 达到上限时
+// 暂停读取socket
+const size_t kFileWriteChunk = 64 * 1024;
+const int kMaxFileWritesInFlight = 16;
+} // namespace
+
+TcpConnection::SpliceContext::SpliceContext()
+    : fileFd(-1), pipeSize(0), remaining(0), written(0), fileOffset(-1),
+      writesInFlight(0) {
+  pipeFds[0] = pipeFds[1] = -1;
+}
+
+TcpConnection::SpliceContext::~SpliceContext() {
+  for (int fd : {pipeFds[0], pipeFds[1], fileFd}) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+TcpConnection::FileChunk::FileChunk()
+    : fd(-1), length(0), sent(0), reading(false) {}
+
+TcpConnection::FileChunk::~FileChunk() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
 TcpConnection::TcpConnection(EventLoop *loop, const string &nameArg, int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
-    : loop_(loop), name_(nameArg), state_(kConnecting), reading_(true),
+    : TcpConnection(loop, std::make_shared<const string>(nameArg), 0, sockfd,
+                    localAddr, peerAddr) {}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::shared_ptr<const string> &namePrefix,
+                             int64_t seq, int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
+    : loop_(loop), namePrefix_(namePrefix), seq_(seq), id_(0),
+      state_(kConnecting), readPauses_(0), outputPaused_(false),
       socket_(new Socket(sockfd)), channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr), peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) // 64MB
+      highWaterMark_(64 * 1024 * 1024), // 64MB
+      outputHighWaterMark_(0), outputLowWaterMark_(0),
+      bufferedBeforeFiles_(0), pendingFileBytes_(0), reportedOutputBytes_(0),
+      coalesce_(SocketProfile::kCoalesceNone), zeroCopyThreshold_(0),
+      zeroCopyNextId_(0), flushQueued_(false),
+      tcpInfoInterval_(0), slowThroughput_(0), tcpInfoTimerActive_(false),
+      bytesWritten_(0), slowClient_(false),
+      edgeTriggered_(false), readBudget_(0)
 {
   // 设置通道的回调函数
   channel_->setReadCallback(
@@ -30,14 +98,23 @@ TcpConnection::TcpConnection(EventLoop *loop, const string &nameArg, int sockfd,
   channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
   channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
 
-  LOG_INFO << "TcpConnection::ctor[" << name_ << "] at " << this
-           << " fd=" << sockfd;
+  LOG_DEBUG << "TcpConnection::ctor[" << name() << "] at " << this
+            << " fd=" << sockfd;
   socket_->setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection() {
-  LOG_INFO << "TcpConnection::dtor[" << name_ << "] at " << this
-           << " fd=" << channel_->fd() << " state=" << static_cast<int>(state_);
+  LOG_DEBUG << "TcpConnection::dtor[" << name() << "] at " << this
+            << " fd=" << channel_->fd()
+            << " state=" << static_cast<int>(state_);
+  clearFileSegments();
+}
+
+const string &TcpConnection::name() const {
+  std::call_once(nameOnce_, [this]() {
+    name_ = seq_ > 0 ? *namePrefix_ + std::to_string(seq_) : *namePrefix_;
+  });
+  return name_;
 }
 
 void TcpConnection::send(const void *data, int len) {
@@ -45,10 +122,8 @@ void TcpConnection::send(const void *data, int len) {
     if (loop_->isInLoopThread()) {
       sendInLoop(data, len);
     } else {
-      void (TcpConnection::*fp)(const FKString &message) =
-          &TcpConnection::sendInLoop;
-      loop_->runInLoop(std::bind(
-          fp, this, FKString(static_cast<const char *>(data), len)));
+      // 调用者的数据在返回后可能失效, 先拷贝一份再转交给事件循环
+      send(std::string(static_cast<const char *>(data), len));
     }
   }
 }
@@ -58,23 +133,804 @@ void TcpConnection::send(const FKString &message) {
     if (loop_->isInLoopThread()) {
       sendInLoop(message);
     } else {
-      void (TcpConnection::*fp)(const FKString &message) =
-          &TcpConnection::sendInLoop;
-      loop_->runInLoop(std::bind(fp, this, message));
+      send(message.as_string());
     }
   }
 }
 
+void TcpConnection::send(const char *message) { send(FKString(message)); }
+
 void TcpConnection::send(Buffer *buf) {
   if (state_ == kConnected) {
     if (loop_->isInLoopThread()) {
       sendInLoop(buf->peek(), buf->readableBytes());
       buf->retrieveAll();
     } else {
-      void (TcpConnection::*fp)(const FKString &message) =
-          &TcpConnection::sendInLoop;
-      loop_->runInLoop(std::bind(fp, this, buf->retrieveAllAsString()));
+      send(buf->retrieveAllAsString());
+    }
+  }
+}
+
+void TcpConnection::send(std::string &&message) {
+  if (state_ == kConnected) {
+    auto msg = std::make_shared<std::string>(std::move(message));
+    if (loop_->isInLoopThread()) {
+      sendStringInLoop(msg);
+    } else {
+      loop_->runInLoop(std::bind(&TcpConnection::sendStringInLoop,
+                                 shared_from_this(), msg));
+    }
+  }
+}
+
+void TcpConnection::send(Buffer &&message) {
+  if (state_ == kConnected) {
+    auto buf = std::make_shared<Buffer>(std::move(message));
+    if (loop_->isInLoopThread()) {
+      sendBufferInLoop(buf);
+    } else {
+      loop_->runInLoop(std::bind(&TcpConnection::sendBufferInLoop,
+                                 shared_from_this(), buf));
+    }
+  }
+}
+
+void TcpConnection::send(Buffer &&head, std::string &&body) {
+  if (state_ == kConnected) {
+    auto headBuf = std::make_shared<Buffer>(std::move(head));
+    auto bodyStr = std::make_shared<std::string>(std::move(body));
+    if (loop_->isInLoopThread()) {
+      sendPairInLoop(headBuf, bodyStr);
+    } else {
+      loop_->runInLoop(std::bind(&TcpConnection::sendPairInLoop,
+                                 shared_from_this(), headBuf, bodyStr));
+    }
+  }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length) {
+  if (state_ != kConnected || length == 0) {
+    return;
+  }
+  // dup一份描述符，使文件的生命周期与发送过程绑定，调用者可以立即关闭自己的fd
+  int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dupfd < 0) {
+    LOG_SYSERR << "TcpConnection::sendFile dup fd = " << fd;
+    return;
+  }
+  if (loop_->isInLoopThread()) {
+    sendFileInLoop(dupfd, offset, length);
+  } else {
+    loop_->runInLoop(std::bind(&TcpConnection::sendFileInLoop,
+                               shared_from_this(), dupfd, offset, length));
+  }
+}
+
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_ERROR << "disconnected, give up sending file";
+    ::close(fd);
+    return;
+  }
+  // 记录在该文件之前已经进入输出缓冲区的字节数，保证与send()的数据按序发送
+  size_t bytesBefore = outputBuffer_.readableBytes() - bufferedBeforeFiles_;
+  bufferedBeforeFiles_ += bytesBefore;
+  fileSegments_.push_back(FileSegment{fd, offset, length, bytesBefore});
+  pendingFileBytes_ += length;
+  LOG_DEBUG << "sendFileInLoop: fd = " << fd << " offset = " << offset
+            << " length = " << length << " after " << bytesBefore
+            << " buffered bytes";
+
+  if (coalesce_ != SocketProfile::kCoalesceNone) {
+    // 与本轮之前send的数据(通常是响应头部)一起在本轮末尾写出
+    if (!channel_->isWriting()) {
+      channel_->enableWriting();
+    }
+    scheduleFlush();
+    updateOutputLoad();
+  } else if (!channel_->isWriting()) {
+    // 之前没有等待中的输出时立即开始发送, 否则等待EPOLLOUT
+    channel_->enableWriting();
+    handleWrite();
+  } else {
+    updateOutputLoad();
+  }
+}
+
+TcpConnection::FlushResult TcpConnection::flushOutput() {
+  while (true) {
+    // 先用writev写出排在下一个文件片段之前的缓冲数据, 直到内核发送缓冲区写满
+    size_t limit = fileSegments_.empty() ? outputBuffer_.readableBytes()
+                                         : fileSegments_.front().bytesBefore;
+    // 后面紧跟文件时用MSG_MORE告诉内核还有数据, 头部与文件开头合并成
+    // 满长度的报文段
+    int flags = coalesce_ == SocketProfile::kCoalesceMsgMore &&
+                        !fileSegments_.empty()
+                    ? MSG_MORE
+                    : 0;
+    while (limit > 0) {
+      int savedErrno = 0;
+      ssize_t n = writeOutput(limit, flags, &savedErrno);
+      if (n < 0) {
+        if (savedErrno == EINTR) {
+          continue;
+        }
+        if (savedErrno != EWOULDBLOCK && savedErrno != EAGAIN) {
+          errno = savedErrno;
+          LOG_SYSERR << "TcpConnection::flushOutput writev";
+          return kFlushError;
+        }
+        return kFlushBlocked;
+      }
+      LOG_DEBUG << "flushOutput: wrote " << n << " bytes";
+      bytesWritten_ += static_cast<uint64_t>(n);
+      limit -= n;
+      if (!fileSegments_.empty()) {
+        fileSegments_.front().bytesBefore -= n;
+        bufferedBeforeFiles_ -= n;
+      }
+    }
+    if (fileSegments_.empty()) {
+      return kFlushDone;
+    }
+
+    FileSegment &seg = fileSegments_.front();
+    if (loop_->supportsAsyncFileIo()) {
+      // 文件内容异步读出, 读盘期间loop线程继续处理其它连接
+      FlushResult result = flushFileChunk(seg);
+      if (result != kFlushDone) {
+        return result;
+      }
+      ::close(seg.fd);
+      fileSegments_.pop_front();
+      if (fileSegments_.empty()) {
+        fileChunk_.reset();
+      }
+      continue;
+    }
+    size_t chunk = std::min(seg.remaining, sendBatchBytes());
+    ssize_t n;
+    if (userspaceTls()) {
+      // 每次读出一块文件加密写出, 直到本批发完或发送缓冲区写满;
+      // 上一次没有写完的数据留在TlsSession中, 长度不会超过chunk
+      size_t sent = 0;
+      int savedErrno = 0;
+      do {
+        n = tls_->sendFile(seg.fd, &seg.offset, chunk - sent, &savedErrno);
+        if (n > 0) {
+          sent += static_cast<size_t>(n);
+        }
+      } while (n > 0 && sent < chunk);
+      if (sent > 0) {
+        n = static_cast<ssize_t>(sent);
+      } else if (n < 0) {
+        errno = savedErrno;
+      }
+    } else {
+      // 明文或kTLS, 内核负责加密
+      n = ::sendfile(channel_->fd(), seg.fd, &seg.offset, chunk);
+    }
+    if (n < 0) {
+      if (errno != EWOULDBLOCK && errno != EAGAIN) {
+        LOG_SYSERR << "TcpConnection::flushOutput sendfile";
+        return kFlushError;
+      }
+      return kFlushBlocked;
+    }
+    if (n == 0) {
+      // 文件在发送过程中被截断，已经无法发出约定长度的数据，只能断开连接
+      LOG_ERROR << "TcpConnection::flushOutput unexpected EOF, "
+                << seg.remaining << " bytes left";
+      return kFlushError;
+    }
+    LOG_DEBUG << "flushOutput: sendfile wrote " << n << " bytes";
+    bytesWritten_ += static_cast<uint64_t>(n);
+    seg.remaining -= n;
+    pendingFileBytes_ -= n;
+    if (seg.remaining > 0) {
+      // 每次可写事件最多发送一块, 避免大文件长时间占用事件循环
+      return kFlushYield;
+    }
+    ::close(seg.fd);
+    fileSegments_.pop_front();
+  }
+}
+
+TcpConnection::FlushResult TcpConnection::flushFileChunk(FileSegment &seg) {
+  if (!fileChunk_) {
+    fileChunk_ = std::make_shared<FileChunk>();
+  }
+  FileChunk *chunk = fileChunk_.get();
+  if (chunk->reading) {
+    return kFlushPending;
+  }
+  while (chunk->sent < chunk->length) {
+    const char *data = chunk->data.data() + chunk->sent;
+    size_t len = chunk->length - chunk->sent;
+    int savedErrno = 0;
+    ssize_t n;
+    if (userspaceTls()) {
+      // EAGAIN之后下一次仍然从同一位置写同样长度的数据, 满足重试的要求
+      n = tls_->write(data, len, &savedErrno);
+    } else {
+      n = ::write(channel_->fd(), data, len);
+      savedErrno = errno;
+    }
+    if (n < 0) {
+      if (savedErrno == EINTR) {
+        continue;
+      }
+      if (savedErrno != EWOULDBLOCK && savedErrno != EAGAIN) {
+        errno = savedErrno;
+        LOG_SYSERR << "TcpConnection::flushFileChunk write";
+        return kFlushError;
+      }
+      return kFlushBlocked;
+    }
+    LOG_DEBUG << "flushFileChunk: wrote " << n << " bytes";
+    bytesWritten_ += static_cast<uint64_t>(n);
+    chunk->sent += static_cast<size_t>(n);
+    seg.remaining -= static_cast<size_t>(n);
+    pendingFileBytes_ -= static_cast<size_t>(n);
+  }
+  if (seg.remaining == 0) {
+    return kFlushDone;
+  }
+
+  // 上一块已经全部写入内核, 读下一块; 读盘期间内核继续发送已有的数据
+  size_t len = std::min(seg.remaining, std::min(sendBatchBytes(),
+                                                kAsyncFileChunk));
+  chunk->data.resize(kAsyncFileChunk);
+  chunk->length = 0;
+  chunk->sent = 0;
+  chunk->reading = true;
+  std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+  std::shared_ptr<FileChunk> holder(fileChunk_);
+  loop_->asyncRead(seg.fd, chunk->data.data(), len, seg.offset,
+                   [weakThis, holder](ssize_t n) {
+                     holder->reading = false;
+                     TcpConnectionPtr conn = weakThis.lock();
+                     if (conn && conn->fileChunk_ == holder) {
+                       conn->handleFileChunkRead(n);
+                     }
+                   });
+  return kFlushPending;
+}
+
+void TcpConnection::handleFileChunkRead(ssize_t n) {
+  if (state_ == kDisconnected || fileSegments_.empty()) {
+    return;
+  }
+  FileSegment &seg = fileSegments_.front();
+  if (n <= 0) {
+    if (n < 0) {
+      errno = static_cast<int>(-n);
+      LOG_SYSERR << "TcpConnection::handleFileChunkRead";
+    } else {
+      // 与sendfile时一样, 文件被截断后无法发出约定长度的数据
+      LOG_ERROR << "TcpConnection::handleFileChunkRead unexpected EOF, "
+                << seg.remaining << " bytes left";
+    }
+    handleClose();
+    return;
+  }
+  fileChunk_->length = static_cast<size_t>(n);
+  seg.offset += n;
+  if (!channel_->isWriting()) {
+    channel_->enableWriting();
+  }
+  handleWrite();
+}
+
+ssize_t TcpConnection::writeOutput(size_t limit, int flags, int *savedErrno) {
+  const char *data;
+  size_t len;
+  if (userspaceTls()) {
+    // OpenSSL一次加密一段连续内存, EAGAIN之后输出缓冲区开头的数据不变,
+    // 满足重试时数据相同的要求
+    if (!outputBuffer_.front(&data, &len) || len == 0) {
+      return 0;
+    }
+    ssize_t n = tls_->write(data, std::min(len, limit), savedErrno);
+    if (n > 0) {
+      outputBuffer_.retrieve(static_cast<size_t>(n));
+    }
+    return n;
+  }
+  std::shared_ptr<const void> holder;
+  if (zeroCopyThreshold_ > 0 &&
+      outputBuffer_.frontSlice(&data, &len, &holder) &&
+      wantZeroCopy(std::min(len, limit))) {
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(data);
+    iov.iov_len = std::min(len, limit);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    ssize_t n = ::sendmsg(channel_->fd(), &msg, flags | MSG_ZEROCOPY);
+    if (n > 0) {
+      // 内核按成功的零拷贝发送依次编号, 完成通知给出序号区间
+      zeroCopyPending_.push_back(ZeroCopyBuffer{zeroCopyNextId_++, holder});
+      outputBuffer_.retrieve(static_cast<size_t>(n));
+      return n;
+    }
+    if (n < 0 && errno != ENOBUFS) {
+      *savedErrno = errno;
+      return n;
+    }
+    // ENOBUFS: 锁定的内存超过了optmem限制, 这一次退回普通拷贝
+  }
+  return outputBuffer_.writeFd(channel_->fd(), savedErrno, limit, flags);
+}
+
+bool TcpConnection::handleZeroCopyCompletions() {
+  bool copied = false;
+  bool notified =
+      drainZeroCopyCompletions(channel_->fd(), &zeroCopyPending_, &copied);
+  if (copied && zeroCopyThreshold_ > 0) {
+    // 内核仍然做了拷贝(例如回环地址), 零拷贝只剩额外开销
+    LOG_DEBUG << "TcpConnection::handleZeroCopyCompletions [" << name()
+              << "] kernel copied, disable zero copy";
+    zeroCopyThreshold_ = 0;
+  }
+  return notified;
+}
+
+bool TcpConnection::drainZeroCopyCompletions(
+    int fd, std::deque<ZeroCopyBuffer> *pending, bool *copied) {
+  bool notified = false;
+  while (true) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+      break; // EAGAIN: 错误队列已经读空
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+          !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      const struct sock_extended_err *ee =
+          reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+      if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      notified = true;
+      // [lo, hi]区间内的发送已经完成, 序号会回绕, 用无符号差值比较
+      uint32_t lo = ee->ee_info;
+      uint32_t span = ee->ee_data - lo;
+      pending->erase(std::remove_if(pending->begin(), pending->end(),
+                                    [lo, span](const ZeroCopyBuffer &buf) {
+                                      return buf.id - lo <= span;
+                                    }),
+                     pending->end());
+      if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        *copied = true;
+      }
+    }
+  }
+  return notified;
+}
+
+void TcpConnection::parkZeroCopyPending() {
+  if (zeroCopyPending_.empty()) {
+    return;
+  }
+  bool copied = false;
+  drainZeroCopyCompletions(channel_->fd(), &zeroCopyPending_, &copied);
+  if (zeroCopyPending_.empty()) {
+    return;
+  }
+  // 关闭socket之后就读不到完成通知了, 而内核可能还在发送这些内存,
+  // 复制一份描述符让socket在完成之前保持打开
+  auto linger = std::make_shared<ZeroCopyLinger>();
+  int fd = ::fcntl(channel_->fd(), F_DUPFD_CLOEXEC, 0);
+  if (fd < 0) {
+    // 描述符用尽(EMFILE)时改为持有连接本身, 连接析构之前socket一直打开
+    LOG_SYSERR << "TcpConnection::parkZeroCopyPending dup";
+    linger->owner = shared_from_this();
+    fd = channel_->fd();
+  }
+  // 与关闭socket时一样, 发完已经排队的数据后发送FIN
+  ::shutdown(fd, SHUT_WR);
+  linger->fd = fd;
+  linger->pending.swap(zeroCopyPending_);
+  linger->ticksLeft = kZeroCopyLingerTicks;
+  linger->aborted = false;
+  LOG_DEBUG << "TcpConnection::parkZeroCopyPending [" << name() << "] "
+            << linger->pending.size() << " zero copy sends in flight";
+  EventLoop *loop = loop_;
+  loop_->runAfter(kZeroCopyLingerInterval,
+                  [loop, linger]() { checkZeroCopyLinger(loop, linger); });
+}
+
+void TcpConnection::checkZeroCopyLinger(
+    EventLoop *loop, const std::shared_ptr<ZeroCopyLinger> &linger) {
+  if (linger->aborted) {
+    // RST中止时内核已经丢弃了发送队列, 多等一轮之后随linger一起释放数据
+    return;
+  }
+  bool copied = false;
+  drainZeroCopyCompletions(linger->fd, &linger->pending, &copied);
+  if (linger->pending.empty()) {
+    // 持有连接时socket随linger释放连接一起关闭
+    if (!linger->owner) {
+      ::close(linger->fd);
+    }
+    return;
+  }
+  if (--linger->ticksLeft <= 0) {
+    // 对端长时间不确认, 以RST中止连接让内核丢弃还没有发出的数据
+    LOG_WARN << "zero copy sends not completed, aborting connection";
+    struct linger opt = {1, 0};
+    ::setsockopt(linger->fd, SOL_SOCKET, SO_LINGER, &opt, sizeof opt);
+    if (linger->owner) {
+      linger->owner.reset();
+    } else {
+      ::close(linger->fd);
+    }
+    linger->fd = -1;
+    linger->aborted = true;
+  }
+  loop->runAfter(kZeroCopyLingerInterval,
+                 [loop, linger]() { checkZeroCopyLinger(loop, linger); });
+}
+
+void TcpConnection::clearFileSegments() {
+  if (fileChunk_ && fileChunk_->reading) {
+    // 读请求还在途, 第一个片段的文件由FileChunk在读完后关闭
+    fileChunk_->fd = fileSegments_.front().fd;
+    fileSegments_.front().fd = -1;
+  }
+  fileChunk_.reset();
+  for (const FileSegment &seg : fileSegments_) {
+    if (seg.fd >= 0) {
+      ::close(seg.fd);
+    }
+  }
+  fileSegments_.clear();
+  bufferedBeforeFiles_ = 0;
+  pendingFileBytes_ = 0;
+}
+
+void TcpConnection::updateOutputLoad() {
+  // 连接关闭之后不再计入所属loop的负载
+  size_t pending = state_ == kDisconnected
+                       ? 0
+                       : outputBuffer_.readableBytes() + pendingFileBytes_;
+  if (pending != reportedOutputBytes_) {
+    loop_->addOutstandingBytes(static_cast<int64_t>(pending) -
+                               static_cast<int64_t>(reportedOutputBytes_));
+    reportedOutputBytes_ = pending;
+  }
+}
+
+void TcpConnection::spliceToFile(int fd, size_t length,
+                                 const SpliceCompleteCallback &cb) {
+  int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dupfd < 0) {
+    LOG_SYSERR << "TcpConnection::spliceToFile dup fd = " << fd;
+    loop_->queueInLoop(std::bind(cb, shared_from_this(), false, 0));
+    return;
+  }
+  if (loop_->isInLoopThread()) {
+    spliceToFileInLoop(dupfd, length, cb);
+  } else {
+    loop_->runInLoop(std::bind(&TcpConnection::spliceToFileInLoop,
+                               shared_from_this(), dupfd, length, cb));
+  }
+}
+
+void TcpConnection::spliceToFileInLoop(int fd, size_t length,
+                                       const SpliceCompleteCallback &cb) {
+  loop_->assertInLoopThread();
+  if (state_ != kConnected || splice_) {
+    LOG_ERROR << "TcpConnection::spliceToFile [" << name()
+              << "] not connected or already splicing";
+    ::close(fd);
+    cb(shared_from_this(), false, 0);
+    return;
+  }
+  splice_.reset(new SpliceContext);
+  splice_->fileFd = fd;
+  splice_->remaining = length;
+  splice_->callback = cb;
+  if (loop_->supportsAsyncFileIo()) {
+    // 异步写入按显式偏移提交, 不能是管道等不支持定位的文件
+    splice_->fileOffset = ::lseek(fd, 0, SEEK_CUR);
+  }
+  if (splice_->fileOffset >= 0) {
+    size_t buffered = std::min(inputBuffer_.readableBytes(), length);
+    if (buffered > 0) {
+      auto data = std::make_shared<std::string>(inputBuffer_.peek(), buffered);
+      inputBuffer_.retrieve(buffered);
+      splice_->remaining -= buffered;
+      off_t offset = splice_->fileOffset;
+      splice_->fileOffset += static_cast<off_t>(buffered);
+      submitFileWrite(splice_, data, 0, offset);
     }
+    handleAsyncFileRead();
+    return;
+  }
+
+  // 先把已经读入输入缓冲区的数据写入文件
+  size_t buffered = std::min(inputBuffer_.readableBytes(), length);
+  while (buffered > 0) {
+    ssize_t n = ::write(fd, inputBuffer_.peek(), buffered);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_SYSERR << "TcpConnection::spliceToFile write";
+      finishSplice(false);
+      return;
+    }
+    inputBuffer_.retrieve(n);
+    buffered -= n;
+    splice_->remaining -= n;
+    splice_->written += n;
+  }
+  if (splice_->remaining == 0) {
+    finishSplice(true);
+    return;
+  }
+  if (tls_) {
+    // 密文不能直接搬到文件, 解密后再写; OpenSSL中可能已经有解密好的数据
+    handleTlsFileRead();
+    return;
+  }
+
+  if (::pipe2(splice_->pipeFds, O_NONBLOCK | O_CLOEXEC) < 0) {
+    LOG_SYSERR << "TcpConnection::spliceToFile pipe2";
+    finishSplice(false);
+    return;
+  }
+  ::fcntl(splice_->pipeFds[1], F_SETPIPE_SZ, kSplicePipeSize);
+  int pipeSize = ::fcntl(splice_->pipeFds[1], F_GETPIPE_SZ);
+  splice_->pipeSize = pipeSize > 0 ? static_cast<size_t>(pipeSize) : 65536;
+  LOG_DEBUG << "spliceToFile: " << length << " bytes, pipe size "
+            << splice_->pipeSize;
+
+  // 内核接收缓冲区中可能已经有数据, 不必等待下一次可读事件
+  handleSpliceRead();
+}
+
+void TcpConnection::handleSpliceRead() {
+  SpliceContext *ctx = splice_.get();
+  while (ctx->remaining > 0) {
+    size_t want = std::min(ctx->remaining, ctx->pipeSize);
+    ssize_t n = ::splice(channel_->fd(), NULL, ctx->pipeFds[1], NULL, want,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n == 0) {
+      LOG_ERROR << "TcpConnection::handleSpliceRead peer closed, "
+                << ctx->remaining << " bytes left";
+      finishSplice(false);
+      handleClose();
+      return;
+    }
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_SYSERR << "TcpConnection::handleSpliceRead socket -> pipe";
+      finishSplice(false);
+      handleError();
+      return;
+    }
+
+    // 管道中的数据全部搬到文件, 保证下一轮管道是空的
+    size_t inPipe = static_cast<size_t>(n);
+    while (inPipe > 0) {
+      ssize_t m = ::splice(ctx->pipeFds[0], NULL, ctx->fileFd, NULL, inPipe,
+                           SPLICE_F_MOVE);
+      if (m <= 0) {
+        if (m < 0 && errno == EINTR) {
+          continue;
+        }
+        LOG_SYSERR << "TcpConnection::handleSpliceRead pipe -> file";
+        finishSplice(false);
+        return;
+      }
+      inPipe -= m;
+      ctx->remaining -= m;
+      ctx->written += m;
+    }
+  }
+  if (ctx->remaining == 0) {
+    finishSplice(true);
+  }
+}
+
+void TcpConnection::handleTlsFileRead() {
+  SpliceContext *ctx = splice_.get();
+  char buf[kTlsRecordSize];
+  while (ctx->remaining > 0) {
+    int savedErrno = 0;
+    ssize_t n =
+        tls_->read(buf, std::min(ctx->remaining, sizeof buf), &savedErrno);
+    if (n == 0) {
+      LOG_ERROR << "TcpConnection::handleTlsFileRead peer closed, "
+                << ctx->remaining << " bytes left";
+      finishSplice(false);
+      handleClose();
+      return;
+    }
+    if (n < 0) {
+      if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+        break;
+      }
+      if (savedErrno == EINTR) {
+        continue;
+      }
+      errno = savedErrno;
+      LOG_SYSERR << "TcpConnection::handleTlsFileRead";
+      finishSplice(false);
+      handleError();
+      return;
+    }
+
+    const char *data = buf;
+    size_t left = static_cast<size_t>(n);
+    while (left > 0) {
+      ssize_t m = ::write(ctx->fileFd, data, left);
+      if (m < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        LOG_SYSERR << "TcpConnection::handleTlsFileRead write";
+        finishSplice(false);
+        return;
+      }
+      data += m;
+      left -= static_cast<size_t>(m);
+    }
+    ctx->remaining -= static_cast<size_t>(n);
+    ctx->written += static_cast<size_t>(n);
+  }
+  if (ctx->remaining == 0) {
+    finishSplice(true);
+  }
+}
+
+void TcpConnection::handleAsyncFileRead() {
+  std::shared_ptr<SpliceContext> ctx(splice_);
+  while (ctx->remaining > 0 && ctx->writesInFlight < kMaxFileWritesInFlight) {
+    auto data = std::make_shared<std::string>(
+        std::min(ctx->remaining, kFileWriteChunk), '\0');
+    int savedErrno = 0;
+    ssize_t n;
+    if (tls_) {
+      n = tls_->read(&(*data)[0], data->size(), &savedErrno);
+    } else {
+      n = ::read(channel_->fd(), &(*data)[0], data->size());
+      savedErrno = errno;
+    }
+    if (n == 0) {
+      LOG_ERROR << "TcpConnection::handleAsyncFileRead peer closed, "
+                << ctx->remaining << " bytes left";
+      finishSplice(false);
+      handleClose();
+      return;
+    }
+    if (n < 0) {
+      if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+        break;
+      }
+      if (savedErrno == EINTR) {
+        continue;
+      }
+      errno = savedErrno;
+      LOG_SYSERR << "TcpConnection::handleAsyncFileRead";
+      finishSplice(false);
+      handleError();
+      return;
+    }
+    data->resize(static_cast<size_t>(n));
+    ctx->remaining -= static_cast<size_t>(n);
+    off_t offset = ctx->fileOffset;
+    ctx->fileOffset += n;
+    submitFileWrite(ctx, data, 0, offset);
+  }
+  if (ctx->remaining == 0) {
+    if (ctx->writesInFlight == 0) {
+      finishSplice(true);
+    }
+  } else if (ctx->writesInFlight >= kMaxFileWritesInFlight) {
+    // 磁盘跟不上时数据留在内核接收缓冲区, 由TCP流控让对端放慢发送
+    stopReadInLoop(kPauseFileIo);
+  }
+}
+
+void TcpConnection::submitFileWrite(const std::shared_ptr<SpliceContext> &ctx,
+                                    const std::shared_ptr<std::string> &data,
+                                    size_t done, off_t offset) {
+  ++ctx->writesInFlight;
+  std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+  loop_->asyncWrite(ctx->fileFd, data->data() + done, data->size() - done,
+                    offset, [weakThis, ctx, data, done, offset](ssize_t n) {
+                      if (TcpConnectionPtr conn = weakThis.lock()) {
+                        conn->handleFileWritten(ctx, data, done, offset, n);
+                      }
+                    });
+}
+
+void TcpConnection::handleFileWritten(const std::shared_ptr<SpliceContext> &ctx,
+                                      const std::shared_ptr<std::string> &data,
+                                      size_t done, off_t offset, ssize_t n) {
+  --ctx->writesInFlight;
+  if (splice_ != ctx) {
+    // 接收已经失败结束, 剩余的写请求只需等它完成
+    return;
+  }
+  if (n <= 0) {
+    errno = n < 0 ? static_cast<int>(-n) : EIO;
+    LOG_SYSERR << "TcpConnection::handleFileWritten";
+    finishSplice(false);
+    return;
+  }
+  ctx->written += static_cast<size_t>(n);
+  if (done + static_cast<size_t>(n) < data->size()) {
+    submitFileWrite(ctx, data, done + static_cast<size_t>(n), offset + n);
+    return;
+  }
+  if (ctx->remaining == 0) {
+    if (ctx->writesInFlight == 0) {
+      finishSplice(true);
+    }
+    return;
+  }
+  if (readPauses_ & kPauseFileIo) {
+    startReadInLoop(kPauseFileIo);
+  }
+  // TLS连接已经解密的数据和边沿触发时错过的数据都不会再产生可读事件
+  if (channel_->isReading()) {
+    handleAsyncFileRead();
+  }
+}
+
+void TcpConnection::finishSplice(bool ok) {
+  std::shared_ptr<SpliceContext> ctx(std::move(splice_));
+  size_t written = ctx->written;
+  if (ok && ctx->fileOffset >= 0) {
+    // 异步写入使用显式偏移, 把文件的当前偏移移到末尾, 与同步写入一致
+    ::lseek(ctx->fileFd, ctx->fileOffset, SEEK_SET);
+  }
+  if (readPauses_ & kPauseFileIo) {
+    startReadInLoop(kPauseFileIo);
+  }
+  SpliceCompleteCallback cb;
+  cb.swap(ctx->callback);
+  // 先关闭管道和文件, 回调中可以安全地使用文件; 失败时仍在途的异步写请求
+  // 持有ctx, 文件在它们完成后关闭
+  ctx.reset();
+  LOG_DEBUG << "finishSplice: ok = " << ok << ", written " << written;
+
+  TcpConnectionPtr guardThis(shared_from_this());
+  cb(guardThis, ok, written);
+
+  // 输入缓冲区中剩余的数据属于后续的消息, 交还给messageCallback处理
+  if (ok && inputBuffer_.readableBytes() > 0) {
+    loop_->queueInLoop([guardThis]() {
+      if (guardThis->connected() && !guardThis->isSplicing() &&
+          guardThis->inputBuffer_.readableBytes() > 0) {
+        guardThis->messageCallback_(guardThis, &guardThis->inputBuffer_,
+                                    TimeStamp::now());
+      }
+    });
+  }
+  // 边沿触发时socket中剩余的数据不会再产生通知, TLS连接剩余的数据可能
+  // 已经解密在OpenSSL中, 主动读一次
+  if (ok && (edgeTriggered_ || tls_)) {
+    loop_->queueInLoop(std::bind(&TcpConnection::continueRead, guardThis));
   }
 }
 
@@ -84,10 +940,6 @@ void TcpConnection::sendInLoop(const FKString &message) {
 
 void TcpConnection::sendInLoop(const void *data, size_t len) {
   loop_->assertInLoopThread();
-  ssize_t nwrote = 0;
-  size_t remaining = len;
-  bool faultError = false;
-
   // 如果连接已经关闭，就不再发送数据
   if (state_ == kDisconnected) {
     LOG_ERROR << "disconnected, give up writing";
@@ -95,48 +947,196 @@ void TcpConnection::sendInLoop(const void *data, size_t len) {
   }
   LOG_DEBUG << "sendInLoop: data length = " << len;
 
-  // 如果输出缓冲区为空，尝试直接发送数据
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-    nwrote = ::write(channel_->fd(), data, len);
-    if (nwrote >= 0) {
-      remaining = len - nwrote;
-      LOG_DEBUG << "sendInLoop: wrote " << nwrote << " bytes, remaining "
-                << remaining << " bytes";
-      if (remaining == 0 && writeCompleteCallback_) {
-        loop_->queueInLoop(
-            std::bind(writeCompleteCallback_, shared_from_this()));
-      }
-    } else { // nwrote < 0
-      nwrote = 0;
-      if (errno != EWOULDBLOCK && errno != EAGAIN) {
-        LOG_ERROR << "TcpConnection::sendInLoop error: " << strerror(errno);
-        if (errno == EPIPE || errno == ECONNRESET) {
-          faultError = true;
-        }
-      }
+  bool idle = !channel_->isWriting();
+  bool faultError = false;
+  size_t nwrote = writeDirectly(static_cast<const char *>(data), len,
+                                &faultError);
+  size_t remaining = len - nwrote;
+  if (!faultError && remaining > 0) {
+    outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
+    queueOutput(remaining);
+    if (userspaceTls() && idle && coalesce_ == SocketProfile::kCoalesceNone) {
+      handleWrite();
     }
   }
+}
+
+void TcpConnection::sendStringInLoop(
+    const std::shared_ptr<std::string> &message) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_ERROR << "disconnected, give up writing";
+    return;
+  }
 
-  // 如果还有数据未发送完，添加到输出缓冲区，并开启写事件监听
+  // 零拷贝的数据不经过write, 整块挂到输出队列上由flushOutput发送
+  bool zeroCopy = wantZeroCopy(message->size());
+  bool idle = !channel_->isWriting();
+  bool faultError = false;
+  size_t nwrote = zeroCopy ? 0
+                            : writeDirectly(message->data(), message->size(),
+                                            &faultError);
+  size_t remaining = message->size() - nwrote;
   if (!faultError && remaining > 0) {
-    size_t oldLen = outputBuffer_.readableBytes();
-    LOG_DEBUG << "sendInLoop: append " << remaining
-              << " bytes to output buffer, oldLen = " << oldLen;
-    if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ &&
-        highWaterMarkCallback_) {
-      loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(),
-                                   oldLen + remaining));
+    const char *rest = message->data() + nwrote;
+    if (remaining < LINKED_BLOCK_SIZE && !zeroCopy) {
+      outputBuffer_.append(rest, remaining);
+    } else {
+      // 剩余部分较大时直接引用字符串本身, 不再拷贝
+      outputBuffer_.appendSlice(message, rest, remaining);
     }
-    outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
-    if (!channel_->isWriting()) {
-      LOG_DEBUG << "sendInLoop: enable writing";
-      channel_->enableWriting();
+    queueOutput(remaining);
+    if ((zeroCopy || userspaceTls()) && idle &&
+        coalesce_ == SocketProfile::kCoalesceNone) {
+      handleWrite();
+    }
+  }
+}
+
+void TcpConnection::sendBufferInLoop(const std::shared_ptr<Buffer> &message) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_ERROR << "disconnected, give up writing";
+    return;
+  }
+
+  size_t len = message->readableBytes();
+  bool zeroCopy = wantZeroCopy(len);
+  bool idle = !channel_->isWriting();
+  bool faultError = false;
+  size_t nwrote =
+      zeroCopy ? 0 : writeDirectly(message->peek(), len, &faultError);
+  size_t remaining = len - nwrote;
+  if (!faultError && remaining > 0) {
+    const char *rest = message->peek() + nwrote;
+    if (remaining < LINKED_BLOCK_SIZE && !zeroCopy) {
+      outputBuffer_.append(rest, remaining);
+    } else {
+      outputBuffer_.appendSlice(message, rest, remaining);
+    }
+    queueOutput(remaining);
+    if ((zeroCopy || userspaceTls()) && idle &&
+        coalesce_ == SocketProfile::kCoalesceNone) {
+      handleWrite();
+    }
+  }
+}
+
+void TcpConnection::sendPairInLoop(const std::shared_ptr<Buffer> &head,
+                                   const std::shared_ptr<std::string> &body) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_ERROR << "disconnected, give up writing";
+    return;
+  }
+
+  size_t headLen = head->readableBytes();
+  size_t bodyLen = body->size();
+  // 零拷贝的正文不经过writev, 头部和正文都挂到输出队列上由flushOutput发送
+  bool zeroCopy = wantZeroCopy(bodyLen);
+  bool idle = !channel_->isWriting();
+  bool faultError = false;
+  size_t nwrote = 0;
+  if (!zeroCopy) {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char *>(head->peek());
+    iov[0].iov_len = headLen;
+    iov[1].iov_base = const_cast<char *>(body->data());
+    iov[1].iov_len = bodyLen;
+    nwrote = writevDirectly(iov, bodyLen > 0 ? 2 : 1, headLen + bodyLen,
+                            &faultError);
+  }
+  if (faultError || nwrote == headLen + bodyLen) {
+    return;
+  }
+  size_t queued = 0;
+  if (nwrote < headLen) {
+    outputBuffer_.append(head->peek() + nwrote, headLen - nwrote);
+    queued += headLen - nwrote;
+    nwrote = headLen;
+  }
+  size_t remaining = headLen + bodyLen - nwrote;
+  if (remaining > 0) {
+    const char *rest = body->data() + (nwrote - headLen);
+    if (remaining < LINKED_BLOCK_SIZE && !zeroCopy) {
+      outputBuffer_.append(rest, remaining);
+    } else {
+      outputBuffer_.appendSlice(body, rest, remaining);
     }
-    // 立即尝试再次发送
+    queued += remaining;
+  }
+  queueOutput(queued);
+  if ((zeroCopy || userspaceTls()) && idle &&
+      coalesce_ == SocketProfile::kCoalesceNone) {
     handleWrite();
   }
 }
 
+size_t TcpConnection::writeDirectly(const char *data, size_t len,
+                                    bool *faultError) {
+  struct iovec iov;
+  iov.iov_base = const_cast<char *>(data);
+  iov.iov_len = len;
+  return writevDirectly(&iov, 1, len, faultError);
+}
+
+size_t TcpConnection::writevDirectly(const struct iovec *iov, int iovcnt,
+                                     size_t len, bool *faultError) {
+  // 只有在没有等待中的输出时才能直接写, 否则会打乱数据顺序;
+  // 合并输出时留到本轮末尾与后续数据一起写. 用户态加密时EAGAIN之后必须
+  // 用相同的数据重试, 先放进输出缓冲区再由handleWrite写出
+  if (coalesce_ != SocketProfile::kCoalesceNone || channel_->isWriting() ||
+      outputBuffer_.readableBytes() > 0 || !fileSegments_.empty() ||
+      userspaceTls()) {
+    return 0;
+  }
+  ssize_t nwrote = iovcnt == 1
+                       ? ::write(channel_->fd(), iov[0].iov_base, len)
+                       : ::writev(channel_->fd(), iov, iovcnt);
+  if (nwrote >= 0) {
+    bytesWritten_ += static_cast<uint64_t>(nwrote);
+    LOG_DEBUG << "writeDirectly: wrote " << nwrote << " bytes, remaining "
+              << len - nwrote << " bytes";
+    if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_) {
+      loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    return static_cast<size_t>(nwrote);
+  }
+  if (errno != EWOULDBLOCK && errno != EAGAIN) {
+    LOG_ERROR << "TcpConnection::sendInLoop error: " << strerror(errno);
+    if (errno == EPIPE || errno == ECONNRESET) {
+      *faultError = true;
+    }
+  }
+  return 0;
+}
+
+void TcpConnection::queueOutput(size_t len) {
+  size_t newLen = outputBuffer_.readableBytes();
+  size_t oldLen = newLen - len;
+  LOG_DEBUG << "queueOutput: append " << len
+            << " bytes to output buffer, oldLen = " << oldLen;
+  if (newLen >= highWaterMark_ && oldLen < highWaterMark_ &&
+      highWaterMarkCallback_) {
+    loop_->queueInLoop(
+        std::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+  }
+  // 剩余数据等待内核发送缓冲区可写(EPOLLOUT)时再用writev发送
+  if (!channel_->isWriting()) {
+    channel_->enableWriting();
+  }
+  if (coalesce_ != SocketProfile::kCoalesceNone) {
+    scheduleFlush();
+  }
+  if (outputHighWaterMark_ > 0 && !outputPaused_ &&
+      newLen >= effectiveHighWaterMark()) {
+    LOG_DEBUG << "queueOutput: " << newLen << " bytes pending, pause reading";
+    outputPaused_ = true;
+    updateReading();
+  }
+  updateOutputLoad();
+}
+
 void TcpConnection::shutdown() {
   if (state_ == kConnected) {
     setState(kDisconnecting);
@@ -146,7 +1146,11 @@ void TcpConnection::shutdown() {
 
 void TcpConnection::shutdownInLoop() {
   loop_->assertInLoopThread();
-  if (!channel_->isWriting()) {
+  // 等待读盘的文件片段关掉了写事件, 但还没有发完
+  if (!channel_->isWriting() && fileSegments_.empty()) {
+    if (tls_) {
+      tls_->shutdown();
+    }
     socket_->shutdownWrite();
   }
 }
@@ -170,9 +1174,30 @@ void TcpConnection::connectEstablished() {
   loop_->assertInLoopThread();
   assert(state_ == kConnecting);
   setState(kConnected);
+  loop_->addConnections(1);
   channel_->tie(shared_from_this());
-  channel_->enableReading(); // 开始关注读事件
+  if (readPauses_ == 0) {
+    channel_->enableReading(); // 开始关注读事件
+  }
+  if (tcpInfoInterval_ > 0) {
+    startTcpInfoTimer();
+  }
 
+  if (tls_) {
+    // 握手完成后才调用连接回调, 超时没有完成的连接直接关闭
+    std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+    handshakeTimer_ = loop_->runAfter(kHandshakeTimeout, [weakThis]() {
+      TcpConnectionPtr conn = weakThis.lock();
+      if (conn && !conn->tls_->established()) {
+        LOG_WARN << "TcpConnection [" << conn->name()
+                 << "] TLS handshake timeout";
+        conn->forceClose();
+      }
+    });
+    // 开启了TCP_DEFER_ACCEPT时ClientHello通常已经到达
+    handleHandshake();
+    return;
+  }
   connectionCallback_(shared_from_this());
 }
 
@@ -180,62 +1205,470 @@ void TcpConnection::connectDestroyed() {
   loop_->assertInLoopThread();
   if (state_ == kConnected) {
     setState(kDisconnected);
+    loop_->addConnections(-1);
+    updateOutputLoad();
+    stopTcpInfoTimer();
+    parkZeroCopyPending();
     channel_->disableAll(); // 停止所有事件的监听
-    connectionCallback_(shared_from_this());
+    if (handshakeDone()) {
+      connectionCallback_(shared_from_this());
+    }
   }
   channel_->remove(); // 从EventLoop中移除
 }
 
 void TcpConnection::handleRead(TimeStamp receiveTime) {
   loop_->assertInLoopThread();
+  if (!handshakeDone()) {
+    handleHandshake();
+    return;
+  }
+  if (splice_) {
+    if (splice_->fileOffset >= 0) {
+      handleAsyncFileRead();
+    } else if (tls_) {
+      handleTlsFileRead();
+    } else {
+      handleSpliceRead();
+    }
+    return;
+  }
+  // 按预算读到EAGAIN为止, 减少epoll_wait的次数; 未开启时每次事件只读一次
+  size_t total = 0;
+  bool drained = false;
+  ssize_t n = 0;
   int savedErrno = 0;
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-  if (n > 0) {
+  while (true) {
+    size_t writable = inputBuffer_.writableBytes();
+    // readFd最多读取Buffer的可写空间加上栈上的额外缓冲区
+    size_t maxRead = writable < BUFFER_LEN ? writable + BUFFER_LEN : writable;
+    n = tls_ ? readTls(&savedErrno)
+             : inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    if (n < 0 && savedErrno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      drained = n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK);
+      break;
+    }
+    total += static_cast<size_t>(n);
+    // TLS一次只读出一个记录, 读到EAGAIN才算读空
+    if (!tls_ && static_cast<size_t>(n) < maxRead) {
+      // 没有读满说明接收缓冲区已经空了, 不必再调用一次read等待EAGAIN
+      drained = true;
+      break;
+    }
+    if (total >= readBudget_) {
+      break;
+    }
+  }
+
+  if (total > 0) {
     messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
-  } else if (n == 0) {
-    handleClose();
-  } else {
+  }
+  if (n == 0) {
+    if (state_ == kConnected || state_ == kDisconnecting) {
+      handleClose();
+    }
+  } else if (n < 0 && !drained) {
     errno = savedErrno;
     LOG_ERROR << "TcpConnection::handleRead";
     handleError();
+  } else if (!drained && (edgeTriggered_ || (tls_ && tls_->hasPending()))) {
+    // 预算用完而数据还没读完, 边沿触发不会再通知, 放到下一轮继续读;
+    // 已经解密而没有读出的数据在OpenSSL中, socket上也不会再有可读事件
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::continueRead, shared_from_this()));
+  }
+}
+
+ssize_t TcpConnection::readTls(int *savedErrno) {
+  char buf[kTlsRecordSize];
+  ssize_t n = tls_->read(buf, sizeof buf, savedErrno);
+  if (n > 0) {
+    inputBuffer_.append(buf, static_cast<size_t>(n));
+  }
+  return n;
+}
+
+void TcpConnection::handleHandshake() {
+  TlsSession::HandshakeResult result = tls_->handshake();
+  if (result == TlsSession::kHandshakeWantWrite) {
+    if (!channel_->isWriting()) {
+      channel_->enableWriting();
+    }
+    return;
+  }
+  // 握手期间没有其它输出, 写事件只为握手打开
+  if (channel_->isWriting()) {
+    channel_->disableWriting();
+  }
+  if (result == TlsSession::kHandshakeWantRead) {
+    return;
+  }
+  if (result == TlsSession::kHandshakeError) {
+    handleClose();
+    return;
+  }
+  loop_->cancel(handshakeTimer_);
+  LOG_DEBUG << "TcpConnection::handleHandshake [" << name() << "] "
+            << tls_->version() << " " << tls_->cipher()
+            << (tls_->sessionReused() ? " resumed" : "")
+            << " kTLS send=" << tls_->ktlsSend()
+            << " recv=" << tls_->ktlsRecv();
+
+  TcpConnectionPtr guardThis(shared_from_this());
+  connectionCallback_(guardThis);
+  // 请求可能与握手的最后一个报文一起到达, 已经读进OpenSSL的数据不会再
+  // 产生可读事件
+  loop_->queueInLoop(std::bind(&TcpConnection::continueRead, guardThis));
+}
+
+bool TcpConnection::userspaceTls() const {
+  return tls_ && !tls_->ktlsSend();
+}
+
+bool TcpConnection::handshakeDone() const {
+  return !tls_ || tls_->established();
+}
+
+void TcpConnection::continueRead() {
+  if ((state_ == kConnected || state_ == kDisconnecting) &&
+      channel_->isReading()) {
+    handleRead(TimeStamp::now());
+  }
+}
+
+void TcpConnection::continueWrite() {
+  if (state_ != kDisconnected && channel_->isWriting()) {
+    handleWrite();
+  }
+}
+
+void TcpConnection::scheduleFlush() {
+  if (!flushQueued_) {
+    flushQueued_ = true;
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::flushCoalesced, shared_from_this()));
+  }
+}
+
+void TcpConnection::flushCoalesced() {
+  flushQueued_ = false;
+  continueWrite();
+}
+
+void TcpConnection::startRead(int reason) {
+  loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop,
+                             shared_from_this(), reason));
+}
+
+void TcpConnection::stopRead(int reason) {
+  loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop,
+                             shared_from_this(), reason));
+}
+
+void TcpConnection::startReadInLoop(int reason) {
+  loop_->assertInLoopThread();
+  readPauses_ &= ~reason;
+  updateReading();
+}
+
+void TcpConnection::stopReadInLoop(int reason) {
+  loop_->assertInLoopThread();
+  readPauses_ |= reason;
+  updateReading();
+}
+
+void TcpConnection::setOutputWatermarks(size_t highWaterMark,
+                                        size_t lowWaterMark) {
+  loop_->assertInLoopThread();
+  assert(lowWaterMark <= highWaterMark);
+  outputHighWaterMark_ = highWaterMark;
+  outputLowWaterMark_ = lowWaterMark;
+  if (outputPaused_ && (highWaterMark == 0 ||
+                        outputBuffer_.readableBytes() <= lowWaterMark)) {
+    outputPaused_ = false;
+    updateReading();
+  }
+}
+
+void TcpConnection::updateReading() {
+  if (state_ != kConnected && state_ != kDisconnecting) {
+    return;
+  }
+  bool want = readPauses_ == 0 && !outputPaused_;
+  if (want && !channel_->isReading()) {
+    channel_->enableReading();
+    // 边沿触发时暂停期间到达的数据已经错过了通知, 主动读一次
+    if (edgeTriggered_) {
+      loop_->queueInLoop(
+          std::bind(&TcpConnection::continueRead, shared_from_this()));
+    }
+  } else if (!want && channel_->isReading()) {
+    channel_->disableReading();
+  }
+}
+
+void TcpConnection::setBusyPoll(int usec) { socket_->setBusyPoll(usec); }
+
+bool TcpConnection::getPeerCredentials(struct ucred *cred) const {
+  return localAddr_.isUnix() && socket_->getPeerCredentials(cred);
+}
+
+void TcpConnection::setSocketProfile(const SocketProfile &profile) {
+  if (profile.sendBufferBytes > 0) {
+    socket_->setSendBuffer(profile.sendBufferBytes);
+  }
+  if (profile.recvBufferBytes > 0) {
+    socket_->setRecvBuffer(profile.recvBufferBytes);
+  }
+  if (localAddr_.isUnix()) {
+    // Unix域socket没有TCP层选项, 也不支持MSG_ZEROCOPY; 没有TCP_CORK时
+    // 合并输出仍然在用户态进行, 文件前面的数据改用MSG_MORE
+    coalesce_ = profile.coalesce == SocketProfile::kCoalesceCork
+                    ? SocketProfile::kCoalesceMsgMore
+                    : profile.coalesce;
+    return;
+  }
+  if (profile.notSentLowat > 0) {
+    socket_->setNotSentLowat(profile.notSentLowat);
+  }
+  if (!profile.congestion.empty()) {
+    socket_->setCongestion(profile.congestion);
+  }
+  if (profile.tcpNoDelay) {
+    socket_->setTcpNoDelay(true);
+  }
+  if (!profile.keepAlive) {
+    socket_->setKeepAlive(false);
+  }
+  coalesce_ = profile.coalesce;
+  if (profile.zeroCopyThreshold > 0) {
+    setZeroCopy(profile.zeroCopyThreshold);
+  }
+}
+
+void TcpConnection::startTls(const std::shared_ptr<TlsContext> &context) {
+  assert(state_ == kConnecting);
+  tls_.reset(new TlsSession(context, channel_->fd()));
+  // 内核不能对MSG_ZEROCOPY的数据做TLS加密
+  zeroCopyThreshold_ = 0;
+}
+
+void TcpConnection::setZeroCopy(size_t threshold) {
+  if (tls_) {
+    threshold = 0;
+  }
+  if (threshold > 0 && !socket_->setZeroCopy(true)) {
+    threshold = 0;
+  }
+  zeroCopyThreshold_ = threshold;
+}
+
+void TcpConnection::setTcpInfoSampling(double interval,
+                                       uint64_t slowThroughput) {
+  // Unix域socket没有TCP_INFO
+  tcpInfoInterval_ = interval > 0 && !localAddr_.isUnix() ? interval : 0;
+  slowThroughput_ = slowThroughput;
+  if (state_ == kConnected || state_ == kDisconnecting) {
+    loop_->assertInLoopThread();
+    if (tcpInfoTimerActive_) {
+      loop_->cancel(tcpInfoTimer_);
+      tcpInfoTimerActive_ = false;
+    }
+    if (tcpInfoInterval_ > 0) {
+      startTcpInfoTimer();
+    }
+  }
+}
+
+bool TcpConnection::sampleTcpInfo() {
+  loop_->assertInLoopThread();
+  struct tcp_info info;
+  int outq = 0;
+  if (!socket_->getTcpInfo(&info) ||
+      ::ioctl(channel_->fd(), SIOCOUTQ, &outq) < 0) {
+    LOG_SYSERR << "TcpConnection::sampleTcpInfo [" << name() << "]";
+    return false;
+  }
+  TimeStamp now = TimeStamp::now();
+  // bytesWritten_是写入的明文字节数, SIOCOUTQ按线上的字节计数; TLS连接上
+  // 两者不一致(记录头、MAC和握手消息), 差值可能为负或者比上一次小,
+  // 这样的采样不用来计算确认速率
+  uint64_t queued = static_cast<uint64_t>(outq);
+  uint64_t acked = bytesWritten_ > queued ? bytesWritten_ - queued : 0;
+  bool monotonic = acked >= tcpInfo_.bytesAcked;
+  if (!monotonic) {
+    acked = tcpInfo_.bytesAcked;
+  }
+  bool backlogged = hasPendingOutput();
+  int64_t us = now.microSecondsSinceEpoch() -
+               tcpInfo_.when.microSecondsSinceEpoch();
+  if (tcpInfo_.valid() && us > 0 && monotonic) {
+    uint64_t delta = acked - tcpInfo_.bytesAcked;
+    uint64_t elapsed = static_cast<uint64_t>(us);
+    // delta * 1e6在delta超过约18TB时才会溢出, 先除以时间再乘更安全
+    tcpInfo_.deliveryRate =
+        delta / elapsed * TimeStamp::kMicroSecondsPerSec +
+        delta % elapsed * TimeStamp::kMicroSecondsPerSec / elapsed;
+    tcpInfo_.deliveryRateValid = tcpInfo_.backlogged && backlogged;
+  } else {
+    tcpInfo_.deliveryRateValid = false;
+  }
+  tcpInfo_.when = now;
+  tcpInfo_.rttUs = info.tcpi_rtt;
+  tcpInfo_.rttVarUs = info.tcpi_rttvar;
+  tcpInfo_.cwnd = info.tcpi_snd_cwnd;
+  tcpInfo_.mss = info.tcpi_snd_mss;
+  tcpInfo_.unacked = info.tcpi_unacked;
+  tcpInfo_.retransmits = info.tcpi_retrans;
+  tcpInfo_.totalRetransmits = info.tcpi_total_retrans;
+  tcpInfo_.sendQueueBytes = static_cast<size_t>(outq);
+  tcpInfo_.bytesAcked = acked;
+  tcpInfo_.backlogged = backlogged;
+  return true;
+}
+
+size_t TcpConnection::sendBatchBytes() const {
+  if (!tcpInfo_.valid()) {
+    return kMaxSendfileChunk;
+  }
+  // 两倍BDP: 内核发完一个窗口等待确认时, 发送缓冲区里还有下一个窗口
+  return std::min(kMaxSendfileChunk,
+                  std::max(kMinSendBatch, 2 * tcpInfo_.bdpBytes()));
+}
+
+size_t TcpConnection::effectiveHighWaterMark() const {
+  if (!slowClient_ || outputHighWaterMark_ == 0) {
+    return outputHighWaterMark_;
+  }
+  return std::min(outputHighWaterMark_,
+                  std::max(outputLowWaterMark_, 4 * sendBatchBytes()));
+}
+
+void TcpConnection::startTcpInfoTimer() {
+  sampleTcpInfo();
+  // 定时器不持有连接, 连接关闭时在stopTcpInfoTimer中取消
+  std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+  tcpInfoTimer_ = loop_->runEvery(tcpInfoInterval_, [weakThis]() {
+    if (TcpConnectionPtr conn = weakThis.lock()) {
+      conn->onTcpInfoTimer();
+    }
+  });
+  tcpInfoTimerActive_ = true;
+}
+
+void TcpConnection::stopTcpInfoTimer() {
+  if (tcpInfoTimerActive_) {
+    loop_->cancel(tcpInfoTimer_);
+    tcpInfoTimerActive_ = false;
+  }
+  if (slowClient_) {
+    slowClient_ = false;
+    loop_->addSlowConnections(-1);
+  }
+}
+
+void TcpConnection::onTcpInfoTimer() {
+  if (state_ == kDisconnected || !sampleTcpInfo() || slowThroughput_ == 0) {
+    return;
+  }
+  bool slow;
+  if (tcpInfo_.deliveryRateValid) {
+    slow = tcpInfo_.deliveryRate < slowThroughput_;
+  } else if (!tcpInfo_.backlogged) {
+    slow = false; // 输出已经排空
+  } else {
+    return; // 刚开始积压, 等下一次采样
+  }
+  if (slow == slowClient_) {
+    return;
+  }
+  slowClient_ = slow;
+  loop_->addSlowConnections(slow ? 1 : -1);
+  LOG_DEBUG << "TcpConnection::onTcpInfoTimer [" << name() << "] "
+            << (slow ? "slow" : "recovered") << ", rtt = " << tcpInfo_.rttUs
+            << "us, cwnd = " << tcpInfo_.cwnd
+            << ", rate = " << tcpInfo_.deliveryRate
+            << ", retrans = " << tcpInfo_.totalRetransmits;
+  if (slow && outputHighWaterMark_ > 0 && !outputPaused_ &&
+      outputBuffer_.readableBytes() >= effectiveHighWaterMark()) {
+    outputPaused_ = true;
+    updateReading();
+  }
+  if (slowClientCallback_) {
+    slowClientCallback_(shared_from_this(), slow);
+  }
+}
+
+void TcpConnection::setEdgeTriggered(bool on, size_t readBudget) {
+  if (loop_->isInLoopThread()) {
+    setEdgeTriggeredInLoop(on, readBudget);
+  } else {
+    loop_->runInLoop(std::bind(&TcpConnection::setEdgeTriggeredInLoop,
+                               shared_from_this(), on, readBudget));
+  }
+}
+
+void TcpConnection::setEdgeTriggeredInLoop(bool on, size_t readBudget) {
+  loop_->assertInLoopThread();
+  readBudget_ = on ? readBudget : 0;
+  edgeTriggered_ = on && loop_->supportsEdgeTriggered();
+  channel_->setEdgeTriggered(edgeTriggered_);
+  if (edgeTriggered_ && state_ == kConnected && channel_->isReading()) {
+    // 切换之前到达的数据不会再产生边沿, 主动读一次
+    loop_->queueInLoop(
+        std::bind(&TcpConnection::continueRead, shared_from_this()));
   }
 }
 
 void TcpConnection::handleWrite() {
   loop_->assertInLoopThread();
+  if (!handshakeDone()) {
+    handleHandshake();
+    return;
+  }
   if (channel_->isWriting()) {
-    LOG_DEBUG << "handleWrite: try to write " << outputBuffer_.readableBytes()
-              << " bytes";
-    ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(),
-                        outputBuffer_.readableBytes());
-    if (n > 0) {
-      LOG_DEBUG << "handleWrite: wrote " << n << " bytes";
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0) {
-        LOG_DEBUG << "handleWrite: output buffer empty, disable writing";
-        channel_->disableWriting();
-        if (writeCompleteCallback_) {
-          loop_->queueInLoop(
-              std::bind(writeCompleteCallback_, shared_from_this()));
-        }
-        if (state_ == kDisconnecting) {
-          shutdownInLoop();
-        }
-      } else {
-        LOG_DEBUG << "handleWrite: still have " << outputBuffer_.readableBytes()
-                  << " bytes to write";
-        // 继续尝试写入
+    // 头部之后跟着文件时塞住socket, sendfile的数据接在头部后面组成满长度的
+    // 报文段, 本次写完后拔掉塞子立即发出剩余部分
+    bool cork = coalesce_ == SocketProfile::kCoalesceCork &&
+                outputBuffer_.readableBytes() > 0 && !fileSegments_.empty();
+    if (cork) {
+      socket_->setCork(true);
+    }
+    FlushResult result = flushOutput();
+    if (cork) {
+      socket_->setCork(false);
+    }
+    if (result == kFlushDone) {
+      LOG_DEBUG << "handleWrite: output drained, disable writing";
+      channel_->disableWriting();
+      if (writeCompleteCallback_) {
         loop_->queueInLoop(
-            std::bind(&TcpConnection::handleWrite, shared_from_this()));
+            std::bind(writeCompleteCallback_, shared_from_this()));
       }
-    } else {
-      if (errno != EWOULDBLOCK && errno != EAGAIN) {
-        LOG_ERROR << "TcpConnection::handleWrite error: " << strerror(errno);
-        if (errno == EPIPE || errno == ECONNRESET) {
-          handleClose();
-        }
+      if (state_ == kDisconnecting) {
+        shutdownInLoop();
       }
+    } else if (result == kFlushError) {
+      handleClose();
+    } else if (result == kFlushPending) {
+      // 读盘完成之前没有可写的数据, 关掉写事件避免空转, 读完后重新打开
+      channel_->disableWriting();
+    } else if (result == kFlushYield && edgeTriggered_) {
+      // 边沿触发时发送缓冲区仍然可写就不会再有通知, 放到下一轮继续发送
+      loop_->queueInLoop(
+          std::bind(&TcpConnection::continueWrite, shared_from_this()));
+    }
+    // 否则内核发送缓冲区已满, 等待下一次EPOLLOUT
+    if (outputPaused_ && state_ != kDisconnected &&
+        outputBuffer_.readableBytes() <= outputLowWaterMark_) {
+      LOG_DEBUG << "handleWrite: output below low watermark, resume reading";
+      outputPaused_ = false;
+      updateReading();
     }
+    updateOutputLoad();
   } else {
     LOG_ERROR << "Connection fd = " << channel_->fd()
               << " is down, no more writing";
@@ -244,18 +1677,32 @@ void TcpConnection::handleWrite() {
 
 void TcpConnection::handleClose() {
   loop_->assertInLoopThread();
-  LOG_INFO << "TcpConnection::handleClose fd = " << channel_->fd()
-           << " state = " << static_cast<int>(state_);
+  LOG_DEBUG << "TcpConnection::handleClose fd = " << channel_->fd()
+            << " state = " << static_cast<int>(state_);
   assert(state_ == kConnected || state_ == kDisconnecting);
   setState(kDisconnected);
+  loop_->addConnections(-1);
   channel_->disableAll();
+  clearFileSegments();
+  parkZeroCopyPending();
+  updateOutputLoad();
+  stopTcpInfoTimer();
+  if (splice_) {
+    finishSplice(false);
+  }
 
   TcpConnectionPtr guardThis(shared_from_this());
-  connectionCallback_(guardThis);
+  // 握手没有完成的TLS连接没有通知过使用者
+  if (handshakeDone()) {
+    connectionCallback_(guardThis);
+  }
   closeCallback_(guardThis);
 }
 
 void TcpConnection::handleError() {
+  // 错误队列中的零拷贝完成通知同样以POLLERR的形式报告
+  bool completions =
+      !zeroCopyPending_.empty() && handleZeroCopyCompletions();
   int optval;
   socklen_t optlen = sizeof optval;
   int err = 0;
@@ -265,7 +1712,10 @@ void TcpConnection::handleError() {
   } else {
     err = optval;
   }
-  LOG_ERROR << "TcpConnection::handleError name:" << name_
+  if (err == 0 && completions) {
+    return;
+  }
+  LOG_ERROR << "TcpConnection::handleError name:" << name()
             << " - SO_ERROR:" << err;
 }
 
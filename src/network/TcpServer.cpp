@@ -1,6 +1,7 @@
 #include "network/TcpServer.hpp"
 #include "network/TcpConnection.hpp"
 #include "utils/log/Logging.hpp"
+#include "utils/thread/CountDownLatch.hpp"
 
 #include <functional>
 #include <sstream>
@@ -18,28 +19,62 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop) {
   return loop;
 }
 
+// Unix域socket没有SO_REUSEPORT, 退回到单个监听socket
+static TcpServer::Option CheckOption(const InetAddress &listenAddr,
+                                     TcpServer::Option option) {
+  if (listenAddr.isUnix() && option != TcpServer::kNoReusePort) {
+    LOG_WARN << "TcpServer: " << listenAddr.toIpPort()
+             << " does not support SO_REUSEPORT, using a single acceptor";
+    return TcpServer::kNoReusePort;
+  }
+  return option;
+}
+
 TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr,
                      const std::string &nameArg, Option option)
     : loop_(CheckLoopNotNull(loop)), ipPort_(listenAddr.toIpPort()),
       name_(nameArg),
-      acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+      connNamePrefix_(std::make_shared<const std::string>(name_ + "-" +
+                                                          ipPort_ + "#")),
+      listenAddr_(listenAddr), option_(CheckOption(listenAddr, option)),
       threadPool_(new EventLoopThreadPool(loop, name_)), connectionCallback_(),
       messageCallback_(), writeCompleteCallback_(), threadInitCallback_(),
-      started_(0), nextConnId_(1), connections_() {
-  // 当有新用户连接时会执行TcpServer::newConnection回调
-  acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
-                                                std::placeholders::_1,
-                                                std::placeholders::_2));
+      started_(0), nextConnId_(1), edgeTriggered_(false),
+      readBudget_(TcpConnection::kDefaultReadBudget), busyPollUs_(0),
+      socketBusyPoll_(false), tcpInfoInterval_(0), slowThroughput_(0),
+      connections_() {
+  if (option_ != kReusePortPerLoop) {
+    acceptor_.reset(new Acceptor(loop, listenAddr, option_ == kReusePort));
+    // 当有新用户连接时会执行TcpServer::newConnection回调
+    acceptor_->setNewConnectionCallback(
+        std::bind(&TcpServer::newConnection, this, std::placeholders::_1,
+                  std::placeholders::_2));
+  }
 }
 
 TcpServer::~TcpServer() {
-  for (auto &item : connections_) {
-    TcpConnectionPtr conn(item.second);
-    item.second.reset();
+  // 每个接收器的Channel属于各自的IO线程, 在对应线程中析构并等待完成,
+  // 保证析构之后不会再有新连接回调进来
+  if (!loopAcceptors_.empty()) {
+    thread::CountDownLatch latch(static_cast<int>(loopAcceptors_.size()));
+    for (auto &acceptor : loopAcceptors_) {
+      Acceptor *acc = acceptor.release();
+      acc->getLoop()->runInLoop([acc, &latch]() {
+        delete acc;
+        latch.countDown();
+      });
+    }
+    latch.wait();
+    loopAcceptors_.clear();
+  }
+
+  std::lock_guard<std::mutex> lock(connectionsMutex_);
+  connections_.forEach([](const TcpConnectionPtr &conn) {
     // 销毁连接
     conn->getLoop()->runInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
-  }
+  });
+  connections_.clear();
 }
 
 // 设置底层subloop的个数
@@ -52,37 +87,59 @@ void TcpServer::start() {
   if (started_.exchange(1) == 0) // 防止一个TcpServer对象被start多次
   {
     threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
-    loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+    if (busyPollUs_ > 0) {
+      loop_->setBusyPoll(busyPollUs_);
+      for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+        ioLoop->setBusyPoll(busyPollUs_);
+      }
+    }
+    if (option_ == kReusePortPerLoop) {
+      // 每个IO线程绑定一个同端口的监听socket, 在自己的线程中监听和accept
+      for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+        Acceptor *acceptor = new Acceptor(ioLoop, listenAddr_, true);
+        acceptor->setSocketProfile(socketProfile_);
+        acceptor->setNewConnectionCallback(
+            std::bind(&TcpServer::newConnectionInLoop, this, ioLoop,
+                      std::placeholders::_1, std::placeholders::_2));
+        loopAcceptors_.emplace_back(acceptor);
+        ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+      }
+    } else {
+      acceptor_->setSocketProfile(socketProfile_);
+      loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+    }
   }
 }
 
 // 有一个新的客户端连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
   // 轮询算法，选择一个subLoop，来管理channel
-  EventLoop *ioLoop = threadPool_->getNextLoop();
-  std::string connName =
-      name_ + "-" + ipPort_ + "#" + std::to_string(nextConnId_);
-  ++nextConnId_;
-
-  std::stringstream ss;
-  ss << "TcpServer::newConnection [" << name_ << "] - new connection ["
-     << connName << "] from " << peerAddr.toIpPort();
-  LOG_INFO << ss.str();
-
-  // 通过sockfd获取其绑定的本机的ip地址和端口信息
-  sockaddr_in local;
+  newConnectionInLoop(threadPool_->getNextLoop(), sockfd, peerAddr);
+}
+
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, int sockfd,
+                                    const InetAddress &peerAddr) {
+  // 通过sockfd获取其绑定的本机地址, 可能是IPv4、IPv6或Unix域地址
+  sockaddr_storage local;
   ::bzero(&local, sizeof local);
   socklen_t addrlen = sizeof local;
   if (::getsockname(sockfd, reinterpret_cast<sockaddr *>(&local), &addrlen) <
       0) {
     LOG_ERROR << "sockets::getLocalAddr";
   }
-  InetAddress localAddr(local);
+  InetAddress localAddr(reinterpret_cast<const sockaddr *>(&local), addrlen);
 
   // 根据连接成功的sockfd，创建TcpConnection连接对象
-  TcpConnectionPtr conn(
-      new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
-  connections_[connName] = conn;
+  // 连接名字只在打印日志时才会拼接
+  TcpConnectionPtr conn(new TcpConnection(ioLoop, connNamePrefix_,
+                                          nextConnId_++, sockfd, localAddr,
+                                          peerAddr));
+  LOG_DEBUG << "TcpServer::newConnection [" << name_ << "] - new connection ["
+            << conn->name() << "] from " << peerAddr.toIpPort();
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    conn->setId(connections_.insert(conn));
+  }
   // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify
   // channel调用回调
   conn->setConnectionCallback(connectionCallback_);
@@ -92,22 +149,46 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
   // 设置了如何关闭连接的回调
   conn->setCloseCallback(
       std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+  if (edgeTriggered_) {
+    // 在connectEstablished注册Channel之前切换, 避免多一次epoll_ctl
+    conn->setEdgeTriggered(true, readBudget_);
+  }
+  if (socketBusyPoll_ && busyPollUs_ > 0) {
+    conn->setBusyPoll(busyPollUs_);
+  }
+  // 连接还没有交给ioLoop, 可以在当前线程设置
+  if (tlsContext_) {
+    conn->startTls(tlsContext_);
+  }
+  conn->setSocketProfile(socketProfile_);
+  if (tcpInfoInterval_ > 0) {
+    conn->setTcpInfoSampling(tcpInfoInterval_, slowThroughput_);
+    conn->setSlowClientCallback(slowClientCallback_);
+  }
 
   // 直接调用TcpConnection::connectEstablished
+  // kReusePortPerLoop时当前就在ioLoop线程中, 会立即执行
   ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
-  loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+  if (option_ == kReusePortPerLoop) {
+    // 连接表有锁保护, 直接在连接所在的IO线程中移除
+    removeConnectionInLoop(conn);
+  } else {
+    loop_->runInLoop(
+        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+  }
 }
 
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn) {
-  std::stringstream ss;
-  ss << "TcpServer::removeConnectionInLoop [" << name_ << "] - connection "
-     << conn->name();
-  LOG_INFO << ss.str();
+  LOG_DEBUG << "TcpServer::removeConnectionInLoop [" << name_
+            << "] - connection " << conn->name();
 
-  connections_.erase(conn->name());
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    connections_.erase(conn->id());
+  }
   EventLoop *ioLoop = conn->getLoop();
   ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
 }
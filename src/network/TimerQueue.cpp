@@ -1,16 +1,16 @@
 #include "network/TimerQueue.hpp"
 #include <functional>
+#include <string.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
 #include "network/EventLoop.hpp"
-#include "network/Timer.hpp"
-#include "network/TimerId.hpp"
 #include "utils/log/Logging.hpp"
 
 namespace flkeeper {
 namespace network {
 
+namespace {
 // 创建定时器文件描述符
 int createTimerfd() {
   int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
@@ -46,23 +46,10 @@ void readTimerfd(int timerfd, TimeStamp now) {
               << " bytes instead of 8";
   }
 }
-
-// 重置定时器的超时时间
-void resetTimerfd(int timerfd, TimeStamp expiration) {
-  struct itimerspec newValue;
-  struct itimerspec oldValue;
-  memset(&newValue, 0, sizeof newValue);
-  memset(&oldValue, 0, sizeof oldValue);
-  newValue.it_value = howMuchTimeFromNow(expiration);
-  int ret = ::timerfd_settime(timerfd, 0, &newValue, &oldValue);
-  if (ret) {
-    LOG_SYSERR << "timerfd_settime()";
-  }
-}
+} // namespace
 
 TimerQueue::TimerQueue(EventLoop *loop)
-    : loop_(loop), timerfd_(createTimerfd()), timerfdChannel_(loop, timerfd_),
-      timers_(), callingExpiredTimers_(false) {
+    : loop_(loop), timerfd_(createTimerfd()), timerfdChannel_(loop, timerfd_) {
   timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
   timerfdChannel_.enableReading();
 }
@@ -71,134 +58,26 @@ TimerQueue::~TimerQueue() {
   timerfdChannel_.disableAll();
   timerfdChannel_.remove();
   ::close(timerfd_);
-  // 不需要删除timer，因为它们是智能指针管理的
-  for (const Entry &timer : timers_) {
-    delete timer.second;
-  }
-}
-
-TimerId TimerQueue::addTimer(TimerCallback cb, TimeStamp when,
-                             double interval) {
-  Timer *timer = new Timer(std::move(cb), when, interval);
-  loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
-  return TimerId(timer, timer->sequence());
-}
-
-void TimerQueue::cancel(TimerId timerId) {
-  loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
-}
-
-void TimerQueue::addTimerInLoop(Timer *timer) {
-  loop_->assertInLoopThread();
-  bool earliestChanged = insert(timer);
-
-  if (earliestChanged) {
-    resetTimerfd(timerfd_, timer->expiration());
-  }
-}
-
-void TimerQueue::cancelInLoop(TimerId timerId) {
-  loop_->assertInLoopThread();
-  assert(timers_.size() == activeTimers_.size());
-  ActiveTimer timer(timerId.timer_, timerId.sequence_);
-  ActiveTimerSet::iterator it = activeTimers_.find(timer);
-  if (it != activeTimers_.end()) {
-    size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
-    assert(n == 1);
-    (void)n;
-    delete it->first;
-    activeTimers_.erase(it);
-  } else if (callingExpiredTimers_) {
-    cancelingTimers_.insert(timer);
-  }
-  assert(timers_.size() == activeTimers_.size());
 }
 
 void TimerQueue::handleRead() {
   loop_->assertInLoopThread();
   TimeStamp now(TimeStamp::now());
   readTimerfd(timerfd_, now);
-
-  std::vector<Entry> expired = getExpired(now);
-
-  callingExpiredTimers_ = true;
-  cancelingTimers_.clear();
-  // 安全的调用用户回调
-  for (const Entry &it : expired) {
-    it.second->run();
-  }
-  callingExpiredTimers_ = false;
-
-  reset(expired, now);
-}
-
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(TimeStamp now) {
-  assert(timers_.size() == activeTimers_.size());
-  std::vector<Entry> expired;
-  Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
-  TimerList::iterator end = timers_.lower_bound(sentry);
-  assert(end == timers_.end() || now < end->first);
-  std::copy(timers_.begin(), end, back_inserter(expired));
-  timers_.erase(timers_.begin(), end);
-
-  for (const Entry &it : expired) {
-    ActiveTimer timer(it.second, it.second->sequence());
-    size_t n = activeTimers_.erase(timer);
-    assert(n == 1);
-    (void)n;
-  }
-
-  assert(timers_.size() == activeTimers_.size());
-  return expired;
+  handleExpired(now);
 }
 
-void TimerQueue::reset(const std::vector<Entry> &expired, TimeStamp now) {
-  TimeStamp nextExpire;
-
-  for (const Entry &it : expired) {
-    ActiveTimer timer(it.second, it.second->sequence());
-    if (it.second->repeat() &&
-        cancelingTimers_.find(timer) == cancelingTimers_.end()) {
-      it.second->restart(now);
-      insert(it.second);
-    } else {
-      delete it.second;
-    }
-  }
-
-  if (!timers_.empty()) {
-    nextExpire = timers_.begin()->second->expiration();
-  }
-
-  if (nextExpire.microSecondsSinceEpoch() > 0) { // 检查时间戳是否有效
-    resetTimerfd(timerfd_, nextExpire);
-  }
-}
-
-bool TimerQueue::insert(Timer *timer) {
-  loop_->assertInLoopThread();
-  assert(timers_.size() == activeTimers_.size());
-  bool earliestChanged = false;
-  TimeStamp when = timer->expiration();
-  TimerList::iterator it = timers_.begin();
-  if (it == timers_.end() || when < it->first) {
-    earliestChanged = true;
-  }
-  {
-    std::pair<TimerList::iterator, bool> result =
-        timers_.insert(Entry(when, timer));
-    assert(result.second);
-    (void)result;
-  }
-  {
-    std::pair<ActiveTimerSet::iterator, bool> result =
-        activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
-    assert(result.second);
-    (void)result;
+// 重置定时器的超时时间
+void TimerQueue::resetTimerfd(TimeStamp expiration) {
+  struct itimerspec newValue;
+  struct itimerspec oldValue;
+  memset(&newValue, 0, sizeof newValue);
+  memset(&oldValue, 0, sizeof oldValue);
+  newValue.it_value = howMuchTimeFromNow(expiration);
+  int ret = ::timerfd_settime(timerfd_, 0, &newValue, &oldValue);
+  if (ret) {
+    LOG_SYSERR << "timerfd_settime()";
   }
-
-  assert(timers_.size() == activeTimers_.size());
-  return earliestChanged;
 }
 
 } // namespace network
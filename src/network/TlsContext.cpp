@@ -0,0 +1,176 @@
+#include "network/TlsContext.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <string.h>
+
+namespace flkeeper {
+namespace network {
+
+namespace {
+const unsigned char kSessionIdContext[] = "flkeeper";
+
+// SSL_CTX上保存TlsContext指针的ex_data下标
+int contextIndex() {
+  static int index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+  return index;
+}
+} // namespace
+
+std::string TlsContext::errorString() {
+  std::string result;
+  unsigned long err;
+  while ((err = ERR_get_error()) != 0) {
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof buf);
+    if (!result.empty()) {
+      result += "; ";
+    }
+    result += buf;
+  }
+  return result;
+}
+
+TlsContext::TlsContext()
+    : ctx_(SSL_CTX_new(TLS_server_method())), ktls_(false) {
+  if (ctx_ == NULL) {
+    LOG_FATAL << "TlsContext SSL_CTX_new: " << errorString();
+  }
+  SSL_CTX_set_ex_data(ctx_, contextIndex(), this);
+  SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+  // 对端不发close_notify直接关闭TCP连接时按正常的EOF处理, HTTP客户端
+  // 普遍如此
+  SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF |
+                                SSL_OP_NO_RENEGOTIATION |
+                                SSL_OP_CIPHER_SERVER_PREFERENCE);
+  // 输出缓冲区中的数据在EAGAIN之后可能从不同的地址重试, 也允许一次只写出
+  // 一部分记录; 空闲连接释放OpenSSL的读写缓冲区
+  SSL_CTX_set_mode(ctx_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                             SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                             SSL_MODE_RELEASE_BUFFERS);
+  SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx_, kSessionIdContext,
+                                 sizeof kSessionIdContext - 1);
+  setKtls(true);
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx_); }
+
+bool TlsContext::useCertificate(const std::string &certChainFile,
+                                const std::string &keyFile) {
+  if (SSL_CTX_use_certificate_chain_file(ctx_, certChainFile.c_str()) != 1 ||
+      SSL_CTX_use_PrivateKey_file(ctx_, keyFile.c_str(), SSL_FILETYPE_PEM) !=
+          1 ||
+      SSL_CTX_check_private_key(ctx_) != 1) {
+    LOG_ERROR << "TlsContext::useCertificate " << certChainFile << ", "
+              << keyFile << ": " << errorString();
+    return false;
+  }
+  return true;
+}
+
+void TlsContext::setKtls(bool on) {
+#ifdef SSL_OP_ENABLE_KTLS
+  if (on) {
+    SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+  } else {
+    SSL_CTX_clear_options(ctx_, SSL_OP_ENABLE_KTLS);
+  }
+  ktls_ = on;
+#else
+  if (on) {
+    LOG_WARN << "TlsContext: OpenSSL is built without kTLS support";
+  }
+  ktls_ = false;
+#endif
+}
+
+void TlsContext::setSessionCache(long size, long timeoutSeconds) {
+  SSL_CTX_sess_set_cache_size(ctx_, size);
+  SSL_CTX_set_timeout(ctx_, timeoutSeconds);
+}
+
+bool TlsContext::addTicketKey(const std::string &key) {
+  if (key.size() != kTicketKeyLength) {
+    LOG_ERROR << "TlsContext::addTicketKey expects " << kTicketKeyLength
+              << " bytes, got " << key.size();
+    return false;
+  }
+  TicketKey ticketKey;
+  memcpy(ticketKey.name, key.data(), sizeof ticketKey.name);
+  memcpy(ticketKey.hmacKey, key.data() + 16, sizeof ticketKey.hmacKey);
+  memcpy(ticketKey.aesKey, key.data() + 48, sizeof ticketKey.aesKey);
+  addTicketKey(ticketKey);
+  return true;
+}
+
+void TlsContext::rotateTicketKey() {
+  TicketKey key;
+  if (RAND_bytes(reinterpret_cast<unsigned char *>(&key), sizeof key) != 1) {
+    LOG_ERROR << "TlsContext::rotateTicketKey RAND_bytes: " << errorString();
+    return;
+  }
+  addTicketKey(key);
+}
+
+void TlsContext::addTicketKey(const TicketKey &key) {
+  std::lock_guard<std::mutex> lock(ticketMutex_);
+  if (ticketKeys_.empty()) {
+    // 第一个密钥到来之前使用OpenSSL自动生成的密钥
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, &TlsContext::ticketKeyCallback);
+  }
+  ticketKeys_.push_front(key);
+  if (ticketKeys_.size() > kMaxTicketKeys) {
+    ticketKeys_.pop_back();
+  }
+}
+
+int TlsContext::ticketKeyCallback(SSL *ssl, unsigned char *name,
+                                  unsigned char *iv,
+                                  EVP_CIPHER_CTX *cipherCtx,
+                                  EVP_MAC_CTX *macCtx, int enc) {
+  TlsContext *self = static_cast<TlsContext *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), contextIndex()));
+  std::lock_guard<std::mutex> lock(self->ticketMutex_);
+  const TicketKey *key = NULL;
+  bool current = true;
+  if (enc) {
+    key = &self->ticketKeys_.front();
+    memcpy(name, key->name, sizeof key->name);
+    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+      return -1;
+    }
+  } else {
+    for (const TicketKey &candidate : self->ticketKeys_) {
+      if (memcmp(name, candidate.name, sizeof candidate.name) == 0) {
+        key = &candidate;
+        break;
+      }
+      current = false;
+    }
+    if (key == NULL) {
+      return 0; // 密钥已经轮换出去, 做完整握手
+    }
+  }
+
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(
+          OSSL_MAC_PARAM_KEY, const_cast<unsigned char *>(key->hmacKey),
+          sizeof key->hmacKey),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                       const_cast<char *>("sha256"), 0),
+      OSSL_PARAM_construct_end()};
+  if (EVP_MAC_CTX_set_params(macCtx, params) != 1 ||
+      EVP_CipherInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, key->aesKey, iv,
+                        enc) != 1) {
+    return -1;
+  }
+  // 用旧密钥解开的票据请求OpenSSL用当前密钥重新签发
+  return current ? 1 : 2;
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -0,0 +1,126 @@
+#include "network/TlsSession.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <openssl/err.h>
+#include <unistd.h>
+
+namespace flkeeper {
+namespace network {
+
+TlsSession::TlsSession(const std::shared_ptr<TlsContext> &context, int sockfd)
+    : context_(context), ssl_(SSL_new(context->get())), established_(false),
+      ktlsSend_(false), ktlsRecv_(false), fileBegin_(0), fileEnd_(0) {
+  if (ssl_ == NULL) {
+    LOG_FATAL << "TlsSession SSL_new: " << TlsContext::errorString();
+  }
+  // 使用socket BIO, 握手完成后OpenSSL才能在这个fd上开启kTLS
+  SSL_set_fd(ssl_, sockfd);
+  SSL_set_accept_state(ssl_);
+}
+
+TlsSession::~TlsSession() { SSL_free(ssl_); }
+
+TlsSession::HandshakeResult TlsSession::handshake() {
+  ERR_clear_error();
+  int ret = SSL_do_handshake(ssl_);
+  if (ret == 1) {
+    established_ = true;
+#ifndef OPENSSL_NO_KTLS
+    ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    ktlsRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+    return kHandshakeDone;
+  }
+  int err = SSL_get_error(ssl_, ret);
+  if (err == SSL_ERROR_WANT_READ) {
+    return kHandshakeWantRead;
+  }
+  if (err == SSL_ERROR_WANT_WRITE) {
+    return kHandshakeWantWrite;
+  }
+  if (err == SSL_ERROR_SYSCALL && errno != 0) {
+    LOG_SYSERR << "TlsSession::handshake";
+  } else {
+    // 对端在握手中途断开时错误队列为空
+    LOG_ERROR << "TlsSession::handshake failed: "
+              << TlsContext::errorString();
+  }
+  return kHandshakeError;
+}
+
+ssize_t TlsSession::read(char *buf, size_t len, int *savedErrno) {
+  ERR_clear_error();
+  size_t n = 0;
+  int ret = SSL_read_ex(ssl_, buf, len, &n);
+  if (ret == 1) {
+    return static_cast<ssize_t>(n);
+  }
+  if (SSL_get_error(ssl_, ret) == SSL_ERROR_ZERO_RETURN) {
+    return 0;
+  }
+  return failed(ret, "read", savedErrno);
+}
+
+ssize_t TlsSession::write(const char *data, size_t len, int *savedErrno) {
+  ERR_clear_error();
+  size_t n = 0;
+  int ret = SSL_write_ex(ssl_, data, len, &n);
+  if (ret == 1) {
+    return static_cast<ssize_t>(n);
+  }
+  return failed(ret, "write", savedErrno);
+}
+
+ssize_t TlsSession::sendFile(int fd, off_t *offset, size_t count,
+                             int *savedErrno) {
+  if (fileBegin_ == fileEnd_) {
+    if (!fileBuffer_) {
+      fileBuffer_.reset(new char[kFileChunk]);
+    }
+    ssize_t n = ::pread(fd, fileBuffer_.get(), std::min(count, kFileChunk),
+                        *offset);
+    if (n <= 0) {
+      *savedErrno = errno;
+      return n;
+    }
+    fileBegin_ = 0;
+    fileEnd_ = static_cast<size_t>(n);
+  }
+  ssize_t n = write(fileBuffer_.get() + fileBegin_, fileEnd_ - fileBegin_,
+                    savedErrno);
+  if (n > 0) {
+    fileBegin_ += static_cast<size_t>(n);
+    *offset += n;
+  }
+  return n;
+}
+
+void TlsSession::shutdown() {
+  if (established_) {
+    ERR_clear_error();
+    SSL_shutdown(ssl_);
+  }
+}
+
+ssize_t TlsSession::failed(int ret, const char *what, int *savedErrno) {
+  switch (SSL_get_error(ssl_, ret)) {
+  case SSL_ERROR_WANT_READ:
+  case SSL_ERROR_WANT_WRITE:
+    *savedErrno = EAGAIN;
+    break;
+  case SSL_ERROR_SYSCALL:
+    *savedErrno = errno != 0 ? errno : ECONNRESET;
+    break;
+  default:
+    LOG_ERROR << "TlsSession::" << what << " "
+              << TlsContext::errorString();
+    *savedErrno = EPROTO;
+    break;
+  }
+  return -1;
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -2,10 +2,21 @@
 #include "utils/date/TimeStamp.hpp"
 #include "utils/log/Logging.hpp"
 #include <algorithm>
-#include <cstring>
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
 
 namespace flkeeper::network {
 
+namespace {
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  return (c | 0x20) - 'a' + 10;
+}
+} // namespace
+
 bool HttpContext::processRequestLine(const char *begin, const char *end) {
   bool succeed = false;
   const char *start = begin;
@@ -38,67 +49,180 @@ bool HttpContext::processRequestLine(const char *begin, const char *end) {
 }
 
 bool HttpContext::processHeaders(Buffer *buf) {
-  bool ok = true;
-  bool hasMore = true;
-  while (hasMore) {
-    const char *crlf = buf->findCRLF();
-    if (crlf) {
-      const char *colon = std::find(buf->peek(), crlf, ':');
-      if (colon != crlf) {
-        request_.addHeader(buf->peek(), colon, crlf);
+  const char *end = HttpParser::findHeaderEnd(buf->peek(), buf->beginWrite(),
+                                              &headerScanned_);
+  if (end == NULL) {
+    // 头部还没有收完
+    return buf->readableBytes() <= kMaxHeaderBytes;
+  }
+  // end之前的两个字节是结尾空行的CRLF
+  if (static_cast<size_t>(end - buf->peek()) > kMaxHeaderBytes ||
+      !request_.setHeaders(buf->peek(), end - 2)) {
+    LOG_ERROR << "HttpContext::processHeaders malformed header block";
+    return false;
+  }
+  buf->retrieveUntil(end);
+  headerScanned_ = 0;
 
-        // 检查是否有 Content-Length 头
-        std::string field(buf->peek(), colon);
-        if (strcasecmp(field.c_str(), "Content-Length") == 0) {
-          ++colon; // 跳过冒号
-          while (colon < crlf && isspace(*colon)) {
-            ++colon; // 跳过空白字符
-          }
-          contentLength_ = static_cast<size_t>(atoi(colon));
-          LOG_INFO << "Content-Length: " << contentLength_;
-        } else if (strcasecmp(field.c_str(), "Transfer-Encoding") == 0) {
-          ++colon;
-          while (colon < crlf && isspace(*colon)) {
-            ++colon;
-          }
-          std::string encoding(colon, crlf);
-          if (strcasecmp(encoding.c_str(), "chunked") == 0) {
-            isChunked_ = true;
-            LOG_INFO << "Transfer-Encoding: chunked";
-          }
-        }
-        buf->retrieveUntil(crlf + 2);
-      } else {
-        // 空行，头部解析完成
-        buf->retrieveUntil(crlf + 2);
-        state_ = kExpectBody;
-        hasMore = false;
+  FKString length = request_.header(HttpParser::kContentLength);
+  // 多个Content-Length只允许值完全相同, 否则前后两端可能按不同的长度
+  // 划分请求(请求走私)
+  for (size_t i = 0; i < request_.headerCount(); ++i) {
+    if (request_.headerId(i) != HttpParser::kContentLength) {
+      continue;
+    }
+    FKString value = request_.headerValue(i);
+    if (value.size() != length.size() ||
+        memcmp(value.data(), length.data(), length.size()) != 0) {
+      LOG_ERROR << "conflicting Content-Length: " << value.as_string()
+                << " and " << length.as_string();
+      return false;
+    }
+  }
+  if (!length.empty()) {
+    size_t value = 0;
+    for (int i = 0; i < length.size(); ++i) {
+      char c = length[i];
+      if (c < '0' || c > '9' || value > (SIZE_MAX - 9) / 10) {
+        LOG_ERROR << "invalid Content-Length: " << length.as_string();
+        return false;
       }
-    } else {
-      hasMore = false;
+      value = value * 10 + (c - '0');
+    }
+    contentLength_ = value;
+    LOG_INFO << "Content-Length: " << contentLength_;
+  }
+  if (request_.hasHeader(HttpParser::kTransferEncoding)) {
+    // 只支持chunked; 同时带有Content-Length的请求可能被前后两端按不同的
+    // 长度解析(请求走私), 一并拒绝
+    if (!HttpParser::equalsIgnoreCase(
+            request_.header(HttpParser::kTransferEncoding), "chunked") ||
+        request_.hasHeader(HttpParser::kContentLength)) {
+      LOG_ERROR << "unsupported Transfer-Encoding: "
+                << request_.header(HttpParser::kTransferEncoding).as_string();
+      return false;
     }
+    isChunked_ = true;
+    LOG_INFO << "Transfer-Encoding: chunked";
   }
-  return ok;
+  state_ = kExpectBody;
+  return true;
 }
 
 bool HttpContext::processBody(Buffer *buf) {
   if (isChunked_) {
-    // TODO: 处理浏览器的chunked传输方式
+    return processChunkedBody(buf);
+  }
+  size_t readable = buf->readableBytes();
+  LOG_DEBUG << "processBody readable: " << readable;
+  size_t toRead = std::min(readable, remainingLength());
+  if (toRead > 0) {
+    if (!deliverBody(buf->peek(), toRead)) {
+      return false;
+    }
+    bodyReceived_ += toRead;
+    buf->retrieve(toRead);
+  }
+  LOG_DEBUG << "bodyReceived_: " << bodyReceived_
+            << ", contentLength_: " << contentLength_;
+  if (bodyReceived_ >= contentLength_) {
+    state_ = kGotAll;
+  }
+  return true;
+}
 
-    return false;
-  } else {
-    size_t readable = buf->readableBytes();
-    LOG_DEBUG << "processBody readable: " << readable;
-    size_t toRead = std::min(readable, remainingLength());
-    if (toRead > 0) {
-      request_.appendToBody(buf->peek(), toRead);
+bool HttpContext::processChunkedBody(Buffer *buf) {
+  while (state_ == kExpectBody) {
+    if (chunkState_ == kChunkSize) {
+      // chunk-size [BWS ";" chunk-ext] CRLF, 扩展直接忽略
+      const char *crlf = buf->findCRLF();
+      if (crlf == NULL) {
+        // 这一行还没有收完
+        return buf->readableBytes() <= kMaxChunkLine;
+      }
+      const char *p = buf->peek();
+      size_t size = 0;
+      int digits = 0;
+      for (; p < crlf && isxdigit(static_cast<unsigned char>(*p)); ++p) {
+        if (size > (SIZE_MAX >> 4)) {
+          LOG_ERROR << "chunk size overflow";
+          return false;
+        }
+        size = (size << 4) | static_cast<size_t>(hexValue(*p));
+        ++digits;
+      }
+      while (p < crlf && (*p == ' ' || *p == '\t')) {
+        ++p;
+      }
+      if (digits == 0 || (p != crlf && *p != ';')) {
+        LOG_ERROR << "invalid chunk size line";
+        return false;
+      }
+      buf->retrieveUntil(crlf + 2);
+      chunkRemaining_ = size;
+      chunkState_ = size == 0 ? kChunkTrailers : kChunkData;
+    } else if (chunkState_ == kChunkData) {
+      // 块的数据到达多少交付多少, 不等待整块
+      size_t toRead = std::min(buf->readableBytes(), chunkRemaining_);
+      if (toRead == 0) {
+        return true;
+      }
+      if (!deliverBody(buf->peek(), toRead)) {
+        return false;
+      }
       bodyReceived_ += toRead;
+      chunkRemaining_ -= toRead;
       buf->retrieve(toRead);
+      if (chunkRemaining_ == 0) {
+        chunkState_ = kChunkDataEnd;
+      }
+    } else if (chunkState_ == kChunkDataEnd) {
+      if (buf->readableBytes() < 2) {
+        return true;
+      }
+      if (buf->peek()[0] != '\r' || buf->peek()[1] != '\n') {
+        LOG_ERROR << "missing CRLF after chunk data";
+        return false;
+      }
+      buf->retrieve(2);
+      chunkState_ = kChunkSize;
+    } else {
+      // 结尾的trailer字段逐行跳过, 直到空行
+      const char *crlf = buf->findCRLF();
+      if (crlf == NULL) {
+        return trailerBytes_ + buf->readableBytes() <= kMaxHeaderBytes;
+      }
+      if (crlf == buf->peek()) {
+        buf->retrieve(2);
+        state_ = kGotAll;
+        LOG_DEBUG << "chunked body complete: " << bodyReceived_ << " bytes";
+      } else {
+        trailerBytes_ += crlf + 2 - buf->peek();
+        if (trailerBytes_ > kMaxHeaderBytes ||
+            std::find(buf->peek(), crlf, ':') == crlf) {
+          LOG_ERROR << "invalid chunked trailer";
+          return false;
+        }
+        buf->retrieveUntil(crlf + 2);
+      }
+    }
+  }
+  return true;
+}
+
+bool HttpContext::deliverBody(const char *data, size_t len) {
+  if (bodySink_) {
+    // 数据直接从输入缓冲区交给接收器, 不经过HttpRequest
+    if (!bodySink_->onBodyChunk(data, len)) {
+      // 之后到达的请求体都丢弃
+      bodyRejected_ = true;
+      state_ = kGotAll;
+      return false;
     }
-    LOG_DEBUG << "bodyReceived_: " << bodyReceived_
-              << ", contentLength_: " << contentLength_;
-    return bodyReceived_ >= contentLength_;
+  } else {
+    request_.appendToBody(data, len);
   }
+  return true;
 }
 
 // return false for error, true for success (got all or need more data)
@@ -115,7 +239,10 @@ HttpContext::ParseResult HttpContext::parseRequest(Buffer *buf,
     if (state_ == kExpectRequestLine) {
       // 处于kExpectRequestLine状态,首先查找请求行的结束符(CRLF)
       const char *crlf = buf->findCRLF();
-      if (crlf) {
+      if (crlf == NULL && buf->readableBytes() > kMaxRequestLine) {
+        result = kError;
+        hasMore = false;
+      } else if (crlf) {
         // 解析找到的请求行
         ok = processRequestLine(buf->peek(), crlf);
         if (ok) {
@@ -139,14 +266,14 @@ HttpContext::ParseResult HttpContext::parseRequest(Buffer *buf,
             result = kGotRequest;
             hasMore = false;
           } else {
-            // 有请求体，继续处理
-            result = kHeadersComplete;
-            if (buf->readableBytes() > 0) {
-              // 如果缓冲区还有数据，继续处理body
-              continue;
-            }
+            // 有请求体, 先返回让调用者决定如何接收请求体,
+            // 再次调用parseRequest时才会继续处理body
+            result = kGotHeaders;
             hasMore = false;
           }
+        } else {
+          // 头部还没有收完, 等待更多数据
+          hasMore = false;
         }
       } else {
         result = kError;
@@ -154,14 +281,22 @@ HttpContext::ParseResult HttpContext::parseRequest(Buffer *buf,
       }
     } else if (state_ == kExpectBody) {
       // 处理请求体
-      if (processBody(buf)) {
-        state_ = kGotAll;
+      if (!processBody(buf)) {
+        result = bodyRejected_ ? kBodyRejected : kError;
+      } else if (state_ == kGotAll) {
         result = kGotRequest;
-      } else if (bodyReceived_ < contentLength_) {
+      } else {
         // 还需要更多数据
         result = kHeadersComplete;
       }
       hasMore = false;
+    } else {
+      // kGotAll: 当前请求还没有重置, 数据留给下一个请求; 请求体被拒绝时
+      // 剩余的请求体直接丢弃
+      if (bodyRejected_) {
+        buf->retrieveAll();
+      }
+      hasMore = false;
     }
   }
 
@@ -0,0 +1,279 @@
+#include "network/http/HttpParser.hpp"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLK_HTTP_PARSER_X86
+#endif
+
+namespace flkeeper::network {
+
+namespace {
+
+// 字段名允许的字符, 即RFC 7230中的tchar
+struct TokenTable {
+  bool value[256];
+  constexpr TokenTable() : value() {
+    const char extra[] = "!#$%&'*+-.^_`|~";
+    for (int c = '0'; c <= '9'; ++c) {
+      value[c] = true;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+      value[c] = true;
+      value[c - 'a' + 'A'] = true;
+    }
+    for (size_t i = 0; i + 1 < sizeof extra; ++i) {
+      value[static_cast<unsigned char>(extra[i])] = true;
+    }
+  }
+};
+constexpr TokenTable kTokenChars;
+
+struct KnownHeader {
+  const char *name;
+  size_t length;
+};
+
+template <size_t N> constexpr KnownHeader known(const char (&name)[N]) {
+  return KnownHeader{name, N - 1};
+}
+
+// 下标与HttpParser::HeaderId一一对应
+const KnownHeader kKnownHeaders[HttpParser::kNumHeaderIds] = {
+    known(""),
+    known("Host"),
+    known("Connection"),
+    known("Content-Length"),
+    known("Content-Type"),
+    known("Transfer-Encoding"),
+    known("Expect"),
+    known("Range"),
+    known("Accept"),
+    known("X-Session-ID"),
+    known("X-File-Name"),
+    known("X-Requested-With"),
+};
+
+inline char toLower(char c) { return c >= 'A' && c <= 'Z' ? c + 32 : c; }
+
+// 字段值中不允许的字符: 除水平制表符以外的控制字符和DEL, 值结尾的CR也在
+// 其中, 所以找到的第一个这样的字符就是值的结尾
+inline bool isValueEnd(char c) {
+  unsigned char uc = static_cast<unsigned char>(c);
+  return (uc < 0x20 && uc != '\t') || uc == 0x7f;
+}
+
+const char *findNameEndScalar(const char *p, const char *end) {
+  while (p < end && kTokenChars.value[static_cast<unsigned char>(*p)]) {
+    ++p;
+  }
+  return p;
+}
+
+const char *findValueEndScalar(const char *p, const char *end) {
+  while (p < end && !isValueEnd(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+#ifdef FLK_HTTP_PARSER_X86
+
+enum SimdLevel { kScalar, kSse42, kAvx2 };
+
+SimdLevel detectSimdLevel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return kAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return kSse42;
+  }
+  return kScalar;
+}
+
+const SimdLevel kSimdLevel = detectSimdLevel();
+
+// pcmpestri的字符区间: 每两个字节是一个闭区间, 落在任一区间中的字符命中
+// 非token字符: 控制字符和空格、'"'、'('和')'、','、'/'、':'到'@'、
+// '['到']'、'{'到0xff (其中'|'和'~'是token字符, 由标量代码补充判断)
+alignas(16) const char kNameRanges[16] = {
+    '\x00', ' ', '"', '"', '(', ')', ',', ',',
+    '/',    '/', ':', '@', '[', ']', '{', '\xff'};
+// 字段值的结尾: 除'\t'以外的控制字符和DEL
+alignas(16) const char kValueRanges[16] = {'\x00', '\x08', '\x0a', '\x1f',
+                                           '\x7f', '\x7f'};
+
+__attribute__((target("sse4.2"))) const char *
+findNameEndSse42(const char *p, const char *end) {
+  const __m128i ranges =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(kNameRanges));
+  while (end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int index = _mm_cmpestri(ranges, 16, bytes, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                 _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16) {
+      p += index;
+      // '|'和'~'落在'{'到0xff的区间里, 继续向后查找
+      if (*p != '|' && *p != '~') {
+        return p;
+      }
+      ++p;
+      continue;
+    }
+    p += 16;
+  }
+  return findNameEndScalar(p, end);
+}
+
+__attribute__((target("sse4.2"))) const char *
+findValueEndSse42(const char *p, const char *end) {
+  const __m128i ranges =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(kValueRanges));
+  while (end - p >= 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int index = _mm_cmpestri(ranges, 6, bytes, 16,
+                             _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                 _SIDD_LEAST_SIGNIFICANT);
+    if (index != 16) {
+      return p + index;
+    }
+    p += 16;
+  }
+  return findValueEndScalar(p, end);
+}
+
+// 字段值通常比字段名长得多(Cookie, User-Agent等), 用32字节的比较查找结尾
+__attribute__((target("avx2"))) const char *
+findValueEndAvx2(const char *p, const char *end) {
+  const __m256i control = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  while (end - p >= 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    // 无符号比较bytes <= 0x1f
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, control), bytes);
+    hit = _mm256_andnot_si256(_mm256_cmpeq_epi8(bytes, tab), hit);
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(bytes, del));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 32;
+  }
+  return findValueEndSse42(p, end);
+}
+
+#endif // FLK_HTTP_PARSER_X86
+
+const char *findNameEnd(const char *p, const char *end) {
+#ifdef FLK_HTTP_PARSER_X86
+  if (kSimdLevel >= kSse42) {
+    return findNameEndSse42(p, end);
+  }
+#endif
+  return findNameEndScalar(p, end);
+}
+
+const char *findValueEnd(const char *p, const char *end) {
+#ifdef FLK_HTTP_PARSER_X86
+  if (kSimdLevel == kAvx2) {
+    return findValueEndAvx2(p, end);
+  }
+  if (kSimdLevel == kSse42) {
+    return findValueEndSse42(p, end);
+  }
+#endif
+  return findValueEndScalar(p, end);
+}
+
+} // namespace
+
+const char *HttpParser::findHeaderEnd(const char *begin, const char *end,
+                                      size_t *scanned) {
+  const char *p = begin + *scanned;
+  while (p < end) {
+    // glibc的memchr本身就是向量化的, 这里只需要逐个检查换行
+    const char *lf = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (lf == NULL) {
+      break;
+    }
+    // 空行: 头部块开头的"\r\n"(没有头部), 或者上一行的"\r\n"之后紧跟"\r\n"
+    if (lf > begin && lf[-1] == '\r' &&
+        (lf - 1 == begin ||
+         (lf - 3 >= begin && lf[-2] == '\n' && lf[-3] == '\r'))) {
+      return lf + 1;
+    }
+    p = lf + 1;
+  }
+  *scanned = end - begin;
+  return NULL;
+}
+
+bool HttpParser::parseHeaders(const char *begin, const char *end,
+                              std::vector<Header> *headers) {
+  const char *p = begin;
+  while (p < end) {
+    if (headers->size() >= kMaxHeaders) {
+      return false;
+    }
+    // 字段名不能为空且必须紧跟冒号, 折行(行首是空白)也在这里被拒绝
+    const char *nameEnd = findNameEnd(p, end);
+    if (nameEnd == p || nameEnd == end || *nameEnd != ':') {
+      return false;
+    }
+    const char *value = nameEnd + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+      ++value;
+    }
+    const char *valueEnd = findValueEnd(value, end);
+    if (end - valueEnd < 2 || valueEnd[0] != '\r' || valueEnd[1] != '\n') {
+      return false;
+    }
+    const char *next = valueEnd + 2;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+      --valueEnd;
+    }
+
+    Header header;
+    header.nameOffset = static_cast<uint32_t>(p - begin);
+    header.nameLength = static_cast<uint32_t>(nameEnd - p);
+    header.valueOffset = static_cast<uint32_t>(value - begin);
+    header.valueLength = static_cast<uint32_t>(valueEnd - value);
+    header.id = headerId(p, nameEnd - p);
+    headers->push_back(header);
+    p = next;
+  }
+  return true;
+}
+
+HttpParser::HeaderId HttpParser::headerId(const char *name, size_t len) {
+  for (int id = kOtherHeader + 1; id < kNumHeaderIds; ++id) {
+    const KnownHeader &header = kKnownHeaders[id];
+    if (equalsIgnoreCase(name, len, header.name, header.length)) {
+      return static_cast<HeaderId>(id);
+    }
+  }
+  return kOtherHeader;
+}
+
+const char *HttpParser::headerName(HeaderId id) {
+  return kKnownHeaders[id].name;
+}
+
+bool HttpParser::equalsIgnoreCase(const char *a, size_t alen, const char *b,
+                                  size_t blen) {
+  if (alen != blen) {
+    return false;
+  }
+  for (size_t i = 0; i < alen; ++i) {
+    if (toLower(a[i]) != toLower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace flkeeper::network
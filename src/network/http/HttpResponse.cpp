@@ -0,0 +1,110 @@
+#include "network/http/HttpResponse.hpp"
+#include "network/http/HttpParser.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace flkeeper {
+namespace network {
+
+namespace {
+
+// 每个loop线程缓存一份格式化好的Date字段, 每秒最多格式化一次
+const size_t kDateLength =
+    sizeof("Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n") - 1;
+__thread time_t t_lastDateSecond = -1;
+__thread char t_dateField[kDateLength + 1];
+
+const char *dateField() {
+  time_t now = ::time(NULL);
+  if (now != t_lastDateSecond) {
+    t_lastDateSecond = now;
+    struct tm tm_time;
+    ::gmtime_r(&now, &tm_time);
+    ::strftime(t_dateField, sizeof t_dateField,
+               "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm_time);
+  }
+  return t_dateField;
+}
+
+inline void appendLiteral(Buffer *output, const char *text) {
+  output->append(text, strlen(text));
+}
+
+} // namespace
+
+void HttpResponse::addHeader(const std::string &key,
+                             const std::string &value) {
+  for (auto &header : headers_) {
+    if (HttpParser::equalsIgnoreCase(header.first.data(), header.first.size(),
+                                     key.data(), key.size())) {
+      header.second = value;
+      return;
+    }
+  }
+  headers_.emplace_back(key, value);
+}
+
+const std::string *HttpResponse::findHeader(const char *key) const {
+  size_t len = strlen(key);
+  for (const auto &header : headers_) {
+    if (HttpParser::equalsIgnoreCase(header.first.data(), header.first.size(),
+                                     key, len)) {
+      return &header.second;
+    }
+  }
+  return NULL;
+}
+
+size_t HttpResponse::headersSizeHint() const {
+  // 状态行、Connection、Date、分帧字段和结尾的空行
+  size_t size = 64 + statusMessage_.size() + kDateLength + 64;
+  for (const auto &header : headers_) {
+    size += header.first.size() + header.second.size() + 4;
+  }
+  return size;
+}
+
+void HttpResponse::appendHeadersToBuffer(Buffer *output) const {
+  output->checkWritableSpace(headersSizeHint());
+
+  char buf[64];
+  int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
+  output->append(buf, n);
+  output->append(statusMessage_);
+  if (closeConnection_) {
+    appendLiteral(output, "\r\nConnection: close\r\n");
+  } else {
+    appendLiteral(output, "\r\nConnection: Keep-Alive\r\n");
+  }
+  output->append(dateField(), kDateLength);
+
+  bool hasLength = false;
+  for (const auto &header : headers_) {
+    bool isLength = HttpParser::equalsIgnoreCase(
+        header.first.data(), header.first.size(), "Content-Length", 14);
+    // 其它分帧方式下Content-Length没有意义, 留着会让客户端按它截断正文
+    if (isLength && framing_ != kFramingLength) {
+      continue;
+    }
+    hasLength = hasLength || isLength;
+    output->append(header.first);
+    output->append(": ", 2);
+    output->append(header.second);
+    output->append("\r\n", 2);
+  }
+
+  if (framing_ == kFramingChunked) {
+    appendLiteral(output, "Transfer-Encoding: chunked\r\n");
+  } else if (framing_ == kFramingLength && !hasLength) {
+    // 长连接上客户端依靠Content-Length确定响应的边界
+    n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n",
+                 hasFileBody() ? fileLength_ : body_.size());
+    output->append(buf, n);
+  }
+  output->append("\r\n", 2);
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -0,0 +1,136 @@
+#include "network/http/HttpResponseWriter.hpp"
+#include "network/TcpConnection.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+
+namespace flkeeper::network {
+
+namespace {
+// 一个数据块之前的分隔最长为"\r\n" + 16位十六进制长度 + "\r\n"
+const size_t kChunkHeadSize = 32;
+} // namespace
+
+void HttpResponseWriter::send(const TcpConnectionPtr &conn,
+                              HttpResponse &response) {
+  Buffer head(response.headersSizeHint());
+  response.appendHeadersToBuffer(&head);
+  conn->send(std::move(head), response.takeBody());
+  if (response.hasFileBody()) {
+    conn->sendFile(response.fileFd(), response.fileOffset(),
+                   response.fileLength());
+  }
+  // 保持连接时不关闭, 下一个请求继续在这个连接上处理
+  if (response.closeConnection()) {
+    conn->shutdown();
+  }
+}
+
+HttpResponseWriter::HttpResponseWriter(const TcpConnectionPtr &conn,
+                                       HttpRequest::Version version)
+    : conn_(conn), http10_(version == HttpRequest::kHttp10),
+      framing_(HttpResponse::kFramingChunked), close_(false), started_(false),
+      finished_(false), wroteChunk_(false) {}
+
+HttpResponseWriter::~HttpResponseWriter() {
+  if (started_ && !finished_) {
+    if (TcpConnectionPtr conn = conn_.lock()) {
+      LOG_WARN << "response to " << conn->name()
+               << " not finished, closing connection";
+      conn->forceClose();
+    }
+  }
+}
+
+void HttpResponseWriter::begin(HttpResponse &response) {
+  assert(!started_);
+  started_ = true;
+  if (response.findHeader("Content-Length") != NULL) {
+    framing_ = HttpResponse::kFramingLength;
+  } else if (http10_) {
+    // HTTP/1.0的客户端不认识chunked, 只能以关闭连接结束正文
+    framing_ = HttpResponse::kFramingClose;
+    response.setCloseConnection(true);
+  } else {
+    framing_ = HttpResponse::kFramingChunked;
+  }
+  response.setFraming(framing_);
+  close_ = response.closeConnection();
+
+  TcpConnectionPtr conn = conn_.lock();
+  if (!conn) {
+    return;
+  }
+  Buffer head(response.headersSizeHint() + kChunkHeadSize);
+  response.appendHeadersToBuffer(&head);
+  std::string body = response.takeBody();
+  if (chunked() && !body.empty()) {
+    appendChunkHead(&head, body.size());
+  }
+  conn->send(std::move(head), std::move(body));
+}
+
+void HttpResponseWriter::write(const char *data, size_t len) {
+  assert(started_);
+  if (len == 0 || finished_) {
+    return;
+  }
+  TcpConnectionPtr conn = conn_.lock();
+  if (!conn) {
+    return;
+  }
+  // 调用者的数据在返回后可能失效, 连同分隔一起拷贝一次
+  Buffer output(len + kChunkHeadSize);
+  if (chunked()) {
+    appendChunkHead(&output, len);
+  }
+  output.append(data, len);
+  conn->send(std::move(output));
+}
+
+void HttpResponseWriter::write(std::string &&data) {
+  assert(started_);
+  if (data.empty() || finished_) {
+    return;
+  }
+  TcpConnectionPtr conn = conn_.lock();
+  if (!conn) {
+    return;
+  }
+  Buffer head(kChunkHeadSize);
+  if (chunked()) {
+    appendChunkHead(&head, data.size());
+  }
+  conn->send(std::move(head), std::move(data));
+}
+
+void HttpResponseWriter::finish() {
+  assert(started_);
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  TcpConnectionPtr conn = conn_.lock();
+  if (!conn) {
+    return;
+  }
+  if (chunked()) {
+    conn->send(wroteChunk_ ? "\r\n0\r\n\r\n" : "0\r\n\r\n");
+  }
+  if (close_) {
+    conn->shutdown();
+  }
+}
+
+void HttpResponseWriter::appendChunkHead(Buffer *output, size_t len) {
+  // 上一块数据结尾的CRLF推迟到这里, 与长度行一起发送, 数据块本身就可以
+  // 原样作为独立的iovec
+  char buf[kChunkHeadSize];
+  int n = snprintf(buf, sizeof buf, "%s%zx\r\n", wroteChunk_ ? "\r\n" : "",
+                   len);
+  output->append(buf, n);
+  wroteChunk_ = true;
+}
+
+} // namespace flkeeper::network
@@ -1,7 +1,10 @@
 #include "network/http/HttpContext.hpp"
+#include "network/http/HttpResponseWriter.hpp"
 #include "network/http/HttpServer.hpp"
 #include "utils/log/Logging.hpp"
 #include "network/TcpConnection.hpp"
+#include "network/EventLoop.hpp"
+#include "network/TimerId.hpp"
 
 namespace flkeeper {
 namespace network {
@@ -15,21 +18,94 @@ bool defaultHttpCallback(const TcpConnectionPtr &, const HttpRequest &,
 }
 
 HttpServer::HttpServer(EventLoop *loop, const InetAddress &listenAddr,
-                       const std::string &name)
-    : server_(loop, listenAddr, name),
-      httpCallback_(defaultHttpCallback) {
+                       const std::string &name, TcpServer::Option option)
+    : server_(loop, listenAddr, name, option),
+      httpCallback_(defaultHttpCallback),
+      idleTimeout_(kDefaultIdleTimeout),
+      maxRequestsPerConnection_(kDefaultMaxRequestsPerConnection),
+      maxPipelinedRequests_(kDefaultMaxPipelinedRequests),
+      outputHighWaterMark_(kDefaultOutputHighWaterMark),
+      outputLowWaterMark_(kDefaultOutputLowWaterMark) {
   server_.setConnectionCallback(
       std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
   server_.setMessageCallback(
       std::bind(&HttpServer::onMessage, this, std::placeholders::_1,
                 std::placeholders::_2, std::placeholders::_3));
+  server_.setWriteCompleteCallback(
+      std::bind(&HttpServer::onWriteComplete, this, std::placeholders::_1));
 }
 
 void HttpServer::onConnection(const TcpConnectionPtr &conn) {
   if (conn->connected()) {
     auto context = std::make_shared<HttpContext>();
+    context->touch(TimeStamp::now());
+    // 异步请求结束时在回调返回之后再处理后续请求, 保证它的响应先发出
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    EventLoop *loop = conn->getLoop();
+    context->setResumeCallback([this, weakConn, loop]() {
+      loop->queueInLoop([this, weakConn]() { resumeRequests(weakConn); });
+    });
     conn->setContext(context);
+    conn->setOutputWatermarks(outputHighWaterMark_, outputLowWaterMark_);
+    if (idleTimeout_ > 0) {
+      std::weak_ptr<TcpConnection> weakConn(conn);
+      conn->getLoop()->runAfter(idleTimeout_,
+                                [this, weakConn]() { checkIdle(weakConn); });
+    }
+  } else if (auto context =
+                 std::static_pointer_cast<HttpContext>(conn->getContext())) {
+    // 请求体还没有收完连接就断开了
+    if (context->bodySink() && !context->gotAll()) {
+      context->bodySink()->onAbort();
+    }
+  }
+  if (connectionCallback_) {
+    connectionCallback_(conn);
+  }
+}
+
+void HttpServer::checkIdle(const std::weak_ptr<TcpConnection> &weakConn) {
+  TcpConnectionPtr conn = weakConn.lock();
+  if (!conn || !conn->connected()) {
+    return;
+  }
+  auto context = std::static_pointer_cast<HttpContext>(conn->getContext());
+  if (!context) {
+    return;
+  }
+
+  TimeStamp now = TimeStamp::now();
+  double delay = idleTimeout_;
+  if (context->state() != HttpContext::kExpectRequestLine ||
+      conn->hasPendingOutput() || conn->isSplicing()) {
+    // 请求还在处理或响应还在发送, 从现在开始重新计时
+    context->touch(now);
+  } else {
+    double idle = timeDiff(now, context->lastActive());
+    if (idle >= idleTimeout_) {
+      LOG_INFO << "connection " << conn->name() << " idle for " << idle
+               << "s, closing";
+      conn->forceClose();
+      return;
+    }
+    delay = idleTimeout_ - idle;
+  }
+  conn->getLoop()->runAfter(delay,
+                            [this, weakConn]() { checkIdle(weakConn); });
+}
+
+void HttpServer::startRequest(HttpContext *context) {
+  const HttpRequest &req = context->request();
+  FKString connection = req.header(HttpParser::kConnection);
+  bool close = HttpParser::equalsIgnoreCase(connection, "close") ||
+               (req.getVersion() == HttpRequest::kHttp10 &&
+                !HttpParser::equalsIgnoreCase(connection, "keep-alive"));
+  // 达到单连接请求数上限时, 这个请求的响应就是连接上的最后一个响应
+  if (maxRequestsPerConnection_ > 0 &&
+      context->requestCount() + 1 >= maxRequestsPerConnection_) {
+    close = true;
   }
+  context->startRequest(close);
 }
 
 void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf,
@@ -40,73 +116,144 @@ void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf,
     LOG_INFO << "context is null";
     return;
   }
+  context->touch(receiveTime);
+  processRequests(conn, context.get(), buf, receiveTime);
+  LOG_DEBUG << "onMessage end";
+}
+
+void HttpServer::processRequests(const TcpConnectionPtr &conn,
+                                 HttpContext *context, Buffer *buf,
+                                 TimeStamp receiveTime) {
+  do {
+    if (!conn->connected()) {
+      // 已经决定关闭连接(最后一个响应已经发出), 之后的请求不再处理
+      buf->retrieveAll();
+      return;
+    }
+    if (context->state() == HttpContext::kExpectRequestLine &&
+        maxPipelinedRequests_ > 0 &&
+        context->pipelinedResponses() >= maxPipelinedRequests_) {
+      // 客户端发得比读得快, 等已经生成的响应写出去之后再继续
+      LOG_DEBUG << "connection " << conn->name() << " has "
+                << context->pipelinedResponses()
+                << " pipelined responses pending, pause reading";
+      if (!context->readPaused()) {
+        context->setReadPaused(true);
+        conn->stopRead(TcpConnection::kPauseProtocol);
+      }
+      return;
+    }
+  } while (processRequest(conn, context, buf, receiveTime) &&
+           buf->readableBytes() > 0);
+
+  if (context->asyncPending() && context->gotAll() &&
+      buf->readableBytes() > kMaxPendingInput && !context->readPaused()) {
+    // 异步请求还没有结束, 后续请求只能留在缓冲区里, 不再继续读取
+    context->setReadPaused(true);
+    conn->stopRead(TcpConnection::kPauseProtocol);
+  }
+}
 
+bool HttpServer::processRequest(const TcpConnectionPtr &conn,
+                                HttpContext *context, Buffer *buf,
+                                TimeStamp receiveTime) {
   HttpContext::ParseResult result = context->parseRequest(buf, receiveTime);
+  if (context->headersComplete() && !context->requestStarted()) {
+    startRequest(context);
+  }
+  if (result == HttpContext::kGotHeaders) {
+    // 请求体还未处理, 先给回调一个接管请求体的机会
+    if (headersCallback_ && headersCallback_(conn, context->request())) {
+      LOG_INFO << "request body taken over by headers callback";
+      context->markAsync();
+      return false;
+    }
+    if (bodySinkCallback_) {
+      context->setBodySink(bodySinkCallback_(conn, context->request()));
+    }
+    result = context->parseRequest(buf, receiveTime);
+  }
   LOG_INFO << "result = " << result;
   if (result == HttpContext::kError) { // 解析出错
-    conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
+    conn->send("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n"
+               "Content-Length: 0\r\n\r\n");
     conn->shutdown();
-    return;
+    return false;
   }
 
-  if (result == HttpContext::kHeadersComplete) { // 头部解析完成
-    // 头部解析完成之后接下来要上传的是主体数据,body
-    // 如果是大文件上传，在这里就可以开始处理了
-    if (context->expectBody()) {
-      HttpRequest &req = context->request(); // 改为非const引用
-      // 检查是否是文件上传请求: 请求路径是/upload,且请求方法是POST
-      if (req.path() == "/upload" && req.method() == HttpRequest::kPost) {
-        // 检查body数据大小
-        size_t bufSize = req.body().size();
-        // LOG_INFO << "bufSize = " << bufSize;
-
-        // ! 优化大文件的上传, 这里暂时设置超过1MB的为大文件
-        if (bufSize >= 1024 * 1024) { // 如果数据超过1MB
-          // LOG_INFO << "Buffer size exceeds 1MB, processing chunk";
-          HttpResponse response(false); // 不关闭连接
-          bool syncProcessed = httpCallback_(conn, req, &response);
-          if (!syncProcessed) {
-            // 异步处理，不重置 context
-            LOG_INFO << "Async upload chunk processing";
-            return;
-          } else {
-            LOG_INFO << "Sync upload chunk processed";
-          }
-        }
-
-      }
+  if (result == HttpContext::kBodyRejected) {
+    // 剩余的请求体无法跳过, 响应之后关闭连接
+    HttpResponse response(true);
+    if (context->bodySink()->onBodyEnd(conn, context->request(), &response)) {
+      response.setCloseConnection(true);
+      sendResponse(conn, response);
     }
   } else if (result == HttpContext::kGotRequest) { // 整个请求解析完成
-    bool syncProcessed = onRequest(conn, context->request());
-    if (syncProcessed) {
+    if (onRequest(conn, context)) {
       LOG_INFO << "context->reset()";
       context->reset();
+      if (conn->hasPendingOutput()) {
+        context->addPipelinedResponse();
+      }
+      return true;
     }
+    context->markAsync();
   } else {
     LOG_INFO << "need more data";
   }
-  LOG_DEBUG << "onMessage end";
+  return false;
+}
+
+void HttpServer::resumeRequests(const std::weak_ptr<TcpConnection> &weakConn) {
+  TcpConnectionPtr conn = weakConn.lock();
+  if (!conn) {
+    return;
+  }
+  auto context = std::static_pointer_cast<HttpContext>(conn->getContext());
+  if (!context) {
+    return;
+  }
+  Buffer *buf = conn->inputBuffer();
+  if (!context->asyncPending() && buf->readableBytes() > 0 &&
+      context->state() == HttpContext::kExpectRequestLine) {
+    processRequests(conn, context.get(), buf, TimeStamp::now());
+  }
+  // 流水线积压仍然超限, 或者异步请求期间缓冲区仍然过大时保持暂停
+  bool hold = (maxPipelinedRequests_ > 0 &&
+               context->pipelinedResponses() >= maxPipelinedRequests_) ||
+              (context->asyncPending() &&
+               buf->readableBytes() > kMaxPendingInput);
+  if (context->readPaused() && !hold && conn->connected()) {
+    context->setReadPaused(false);
+    conn->startRead(TcpConnection::kPauseProtocol);
+  }
+}
+
+void HttpServer::onWriteComplete(const TcpConnectionPtr &conn) {
+  auto context = std::static_pointer_cast<HttpContext>(conn->getContext());
+  if (!context) {
+    return;
+  }
+  context->clearPipelinedResponses();
+  if (context->readPaused()) {
+    resumeRequests(conn);
+  }
 }
 
-bool HttpServer::onRequest(const TcpConnectionPtr &conn, HttpRequest &req) {
+bool HttpServer::onRequest(const TcpConnectionPtr &conn,
+                           HttpContext *context) {
   // LOG_DEBUG << "onRequest start";
-  const std::string &connection = req.getHeader("Connection");
-  bool close =
-      connection == "close" ||
-      (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
-  HttpResponse response(close);
+  HttpResponse response(context->closeAfterResponse());
 
-  // 调用用户的回调函数处理请求
-  bool syncProcessed = httpCallback_(conn, req, &response);
+  // 调用用户的回调函数处理请求, 请求体流式接收时由接收器生成响应
+  bool syncProcessed =
+      context->bodySink()
+          ? context->bodySink()->onBodyEnd(conn, context->request(), &response)
+          : httpCallback_(conn, context->request(), &response);
 
   // 如果是同步处理完成，或者不是异步响应，直接发送响应
   if (syncProcessed) {
-    Buffer buf;
-    response.appendToBuffer(&buf);
-    conn->send(&buf);
-    if (response.closeConnection()) {
-      conn->shutdown();
-    }
+    sendResponse(conn, response);
     LOG_INFO << "Sync request completed";
   } else {
     LOG_INFO << "Async request, waiting for response";
@@ -115,5 +262,10 @@ bool HttpServer::onRequest(const TcpConnectionPtr &conn, HttpRequest &req) {
   return syncProcessed;
 }
 
+void HttpServer::sendResponse(const TcpConnectionPtr &conn,
+                              HttpResponse &response) {
+  HttpResponseWriter::send(conn, response);
+}
+
 } // namespace network
 } // namespace flkeeper
@@ -1,6 +1,8 @@
 #include "network/Poller.hpp"
 #include "network/poller/EPollPoller.hpp"
+#include "network/poller/IoUringPoller.hpp"
 #include "network/poller/PollPoller.hpp"
+#include "utils/log/Logging.hpp"
 
 #include <stdlib.h>
 
@@ -10,6 +12,15 @@ namespace network {
 Poller* Poller::newDefaultPoller(EventLoop* loop) {
     if (::getenv("MYMUDUO_USE_POLL")) {
         return new PollPoller(loop);
+    } else if (::getenv("MYMUDUO_USE_IOURING")) {
+        IoUringPoller* poller = new IoUringPoller(loop);
+        if (poller->valid()) {
+            return poller;
+        }
+        // 内核不支持或io_uring被禁用时退回epoll
+        LOG_WARN << "io_uring is not available, fall back to epoll";
+        delete poller;
+        return new EPollPoller(loop);
     } else {
         return new EPollPoller(loop); // 默认使用epoll
     }
@@ -69,11 +69,17 @@ void EPollPoller::fillActiveChannels(int numEvents,
     Channel *channel = static_cast<Channel *>(events_[i].data.ptr);
 #ifndef NDEBUG
     int fd = channel->fd();
-    ChannelMap::const_iterator it = channels_.find(fd);
-    assert(it != channels_.end());
-    assert(it->second == channel);
+    assert(channels_.find(fd) == channel);
 #endif
-    channel->set_revents(events_[i].events);
+    int revents = static_cast<int>(events_[i].events);
+    if (channel->isEdgeTriggered()) {
+      // 边沿触发时注册了全部读写事件, 只分发当前关注的事件
+      revents &= channel->events() | EPOLLERR | EPOLLHUP;
+      if (revents == 0) {
+        continue;
+      }
+    }
+    channel->set_revents(revents);
     activeChannels->push_back(channel);
   }
 }
@@ -88,11 +94,10 @@ void EPollPoller::updateChannel(Channel *channel) {
     // 新的channel或已删除的channel
     int fd = channel->fd();
     if (index == kNew) {
-      assert(channels_.find(fd) == channels_.end());
-      channels_[fd] = channel;
+      assert(channels_.find(fd) == nullptr);
+      channels_.add(fd, channel);
     } else { // index == kDeleted
-      assert(channels_.find(fd) != channels_.end());
-      assert(channels_[fd] == channel);
+      assert(channels_.find(fd) == channel);
     }
 
     channel->set_index(kAdded);
@@ -101,15 +106,15 @@ void EPollPoller::updateChannel(Channel *channel) {
     // 更新已存在的channel
     int fd = channel->fd();
     (void)fd;
-    assert(channels_.find(fd) != channels_.end());
-    assert(channels_[fd] == channel);
+    assert(channels_.find(fd) == channel);
     assert(index == kAdded);
     if (channel->isNoneEvent()) {
       update(EPOLL_CTL_DEL, channel);
       channel->set_index(kDeleted);
-    } else {
+    } else if (eventsToPoll(channel) != channel->polledEvents()) {
       update(EPOLL_CTL_MOD, channel);
     }
+    // 内核中注册的事件没有变化(例如边沿触发时开关写事件), 不需要epoll_ctl
   }
 }
 
@@ -117,8 +122,7 @@ void EPollPoller::removeChannel(Channel *channel) {
   Poller::assertInLoopThread();
   int fd = channel->fd();
   LOG_TRACE << "fd = " << fd;
-  assert(channels_.find(fd) != channels_.end());
-  assert(channels_[fd] == channel);
+  assert(channels_.find(fd) == channel);
   assert(channel->isNoneEvent());
   int index = channel->index();
   assert(index == kAdded || index == kDeleted);
@@ -132,10 +136,19 @@ void EPollPoller::removeChannel(Channel *channel) {
   channel->set_index(kNew);
 }
 
+int EPollPoller::eventsToPoll(const Channel *channel) {
+  if (channel->isEdgeTriggered() && !channel->isNoneEvent()) {
+    return static_cast<int>(EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLET);
+  }
+  return channel->events();
+}
+
 void EPollPoller::update(int operation, Channel *channel) {
   struct epoll_event event;
   memset(&event, 0, sizeof event);
-  event.events = channel->events();
+  int events = eventsToPoll(channel);
+  channel->set_polledEvents(operation == EPOLL_CTL_DEL ? 0 : events);
+  event.events = events;
   event.data.ptr = channel;
   int fd = channel->fd();
   LOG_TRACE << "epoll_ctl op = " << operationToString(operation)
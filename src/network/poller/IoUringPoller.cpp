@@ -0,0 +1,373 @@
+#include "network/poller/IoUringPoller.hpp"
+#include "network/Channel.hpp"
+#include "network/EventLoop.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace flkeeper;
+using namespace flkeeper::network;
+
+namespace {
+const int kNew = -1;  // channel未添加到poller中
+const int kAdded = 1; // channel已添加到poller中
+
+// user_data的最高两位区分完成事件的种类
+const uint64_t kIgnoreKind = 0; // POLL_REMOVE等不需要处理的完成事件
+const uint64_t kPollKind = 1;   // socket可读/可写
+const uint64_t kFileKind = 2;   // 文件读写
+const uint32_t kGenerationMask = 0x3fffffff;
+
+uint64_t encodePoll(int fd, uint32_t generation) {
+  return (kPollKind << 62) | (static_cast<uint64_t>(generation) << 32) |
+         static_cast<uint32_t>(fd);
+}
+
+int ioUringSetup(unsigned entries, struct io_uring_params *p) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags, const void *arg, size_t argsz) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, arg, argsz));
+}
+} // namespace
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop), ringFd_(-1), sqRing_(MAP_FAILED), sqRingSize_(0),
+      cqRing_(MAP_FAILED), cqRingSize_(0), sqes_(nullptr), sqesSize_(0),
+      sqHead_(nullptr), sqTail_(nullptr), sqMask_(nullptr), sqArray_(nullptr),
+      sqEntries_(0), cqHead_(nullptr), cqTail_(nullptr), cqMask_(nullptr),
+      cqes_(nullptr), sqeTail_(0), toSubmit_(0), generation_(0) {
+  if (!setupRing()) {
+    LOG_SYSERR << "IoUringPoller::IoUringPoller";
+    if (ringFd_ >= 0) {
+      ::close(ringFd_);
+      ringFd_ = -1;
+    }
+  }
+}
+
+IoUringPoller::~IoUringPoller() {
+  if (sqes_) {
+    ::munmap(sqes_, sqesSize_);
+  }
+  if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  if (sqRing_ != MAP_FAILED) {
+    ::munmap(sqRing_, sqRingSize_);
+  }
+  if (ringFd_ >= 0) {
+    ::close(ringFd_);
+  }
+}
+
+bool IoUringPoller::setupRing() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof params);
+  ringFd_ = ioUringSetup(kRingEntries, &params);
+  if (ringFd_ < 0) {
+    return false;
+  }
+  // 依赖IORING_ENTER_EXT_ARG实现带超时的等待, 依赖NODROP保证完成事件不丢失
+  if (!(params.features & IORING_FEAT_EXT_ARG) ||
+      !(params.features & IORING_FEAT_NODROP)) {
+    errno = ENOSYS;
+    return false;
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+
+  sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    return false;
+  }
+  if (singleMmap) {
+    cqRing_ = sqRing_;
+  } else {
+    cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      return false;
+    }
+  }
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sqMask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sqEntries_ = params.sq_entries;
+  sqeTail_ = *sqTail_;
+
+  char *cq = static_cast<char *>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cqMask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  LOG_INFO << "IoUringPoller sq entries " << params.sq_entries
+           << ", cq entries " << params.cq_entries;
+  return true;
+}
+
+struct io_uring_sqe *IoUringPoller::getSqe() {
+  unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  if (sqeTail_ - head >= sqEntries_) {
+    // 提交队列已满, 先把已有的sqe交给内核
+    enter(toSubmit_, 0, 0);
+    head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_) {
+      LOG_ERROR << "IoUringPoller submission queue is full";
+      return nullptr;
+    }
+  }
+  unsigned index = sqeTail_ & *sqMask_;
+  struct io_uring_sqe *sqe = &sqes_[index];
+  memset(sqe, 0, sizeof *sqe);
+  sqArray_[index] = index;
+  ++sqeTail_;
+  ++toSubmit_;
+  return sqe;
+}
+
+int IoUringPoller::enter(unsigned toSubmit, unsigned minComplete,
+                         int timeoutMs) {
+  if (toSubmit == 0 && minComplete == 0) {
+    return 0;
+  }
+  __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+  unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int ret = 0;
+  if (minComplete > 0 && timeoutMs >= 0) {
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    ret = ioUringEnter(ringFd_, toSubmit, minComplete,
+                       flags | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+  } else {
+    ret = ioUringEnter(ringFd_, toSubmit, minComplete, flags, nullptr,
+                       _NSIG / 8);
+  }
+  // 内核取走的sqe会推进sq head, 剩余的留到下一次提交
+  toSubmit_ = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  return ret;
+}
+
+TimeStamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+  LOG_TRACE << "fd total count " << pollStates_.size();
+  rearmPending();
+
+  unsigned head = *cqHead_;
+  unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  // 已经有完成事件时不再阻塞等待
+  unsigned minComplete = head == tail ? 1 : 0;
+  int ret = enter(toSubmit_, minComplete, timeoutMs);
+  int savedErrno = errno;
+  TimeStamp now(TimeStamp::now());
+  if (ret < 0 && savedErrno != ETIME && savedErrno != EINTR &&
+      savedErrno != EBUSY) {
+    errno = savedErrno;
+    LOG_SYSERR << "IoUringPoller::poll()";
+  }
+
+  head = *cqHead_;
+  tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  int numEvents = 0;
+  while (head != tail) {
+    handleCompletion(&cqes_[head & *cqMask_], activeChannels);
+    ++head;
+    ++numEvents;
+  }
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  if (numEvents > 0) {
+    LOG_TRACE << numEvents << " completions happened";
+  }
+  return now;
+}
+
+void IoUringPoller::handleCompletion(const struct io_uring_cqe *cqe,
+                                     ChannelList *activeChannels) {
+  uint64_t data = cqe->user_data;
+  uint64_t kind = data >> 62;
+  if (kind == kPollKind) {
+    int fd = static_cast<int>(data & 0xffffffff);
+    uint32_t generation = static_cast<uint32_t>(data >> 32) & kGenerationMask;
+    auto it = pollStates_.find(fd);
+    // channel已经移除, 或者这是被取消/替换掉的旧poll
+    if (it == pollStates_.end() || it->second.armedEvents == 0 ||
+        it->second.generation != generation) {
+      return;
+    }
+    PollState &state = it->second;
+    state.armedEvents = 0;
+    rearmList_.push_back(fd);
+    if (cqe->res == -ECANCELED) {
+      return;
+    }
+    int revents = cqe->res >= 0 ? cqe->res : POLLERR;
+    state.channel->set_revents(revents);
+    activeChannels->push_back(state.channel);
+  } else if (kind == kFileKind) {
+    uint32_t slot = static_cast<uint32_t>(data & 0xffffffff);
+    assert(slot < fileOps_.size());
+    FileIoCallback cb;
+    cb.swap(fileOps_[slot]);
+    freeFileSlots_.push_back(slot);
+    // 放入loop的待处理队列, 在本轮事件处理之后执行
+    ownerLoop()->queueInLoop(std::bind(std::move(cb),
+                                       static_cast<ssize_t>(cqe->res)));
+  }
+}
+
+void IoUringPoller::arm(int fd, PollState *state) {
+  uint32_t events = static_cast<uint32_t>(state->channel->events());
+  if (events == 0) {
+    return;
+  }
+  struct io_uring_sqe *sqe = getSqe();
+  if (!sqe) {
+    // 提交队列满了, 下一次poll时再试
+    rearmList_.push_back(fd);
+    return;
+  }
+  uint32_t generation = ++generation_ & kGenerationMask;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->user_data = encodePoll(fd, generation);
+  state->armedEvents = events;
+  state->generation = generation;
+}
+
+void IoUringPoller::cancel(PollState *state, int fd) {
+  if (state->armedEvents == 0) {
+    return;
+  }
+  struct io_uring_sqe *sqe = getSqe();
+  if (sqe) {
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encodePoll(fd, state->generation);
+    sqe->user_data = kIgnoreKind << 62;
+  }
+  // 即使取消请求没能提交, 旧poll的完成事件也会因为armedEvents为0被忽略
+  state->armedEvents = 0;
+}
+
+void IoUringPoller::rearmPending() {
+  if (rearmList_.empty()) {
+    return;
+  }
+  std::vector<int> fds;
+  fds.swap(rearmList_);
+  for (int fd : fds) {
+    auto it = pollStates_.find(fd);
+    if (it != pollStates_.end() && it->second.armedEvents == 0) {
+      arm(fd, &it->second);
+    }
+  }
+}
+
+void IoUringPoller::updateChannel(Channel *channel) {
+  Poller::assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd << " events = " << channel->events()
+            << " index = " << channel->index();
+  if (channel->index() == kNew) {
+    assert(channels_.find(fd) == nullptr);
+    channels_.add(fd, channel);
+    pollStates_[fd] = PollState{channel, 0, 0};
+    channel->set_index(kAdded);
+  }
+  assert(channels_.find(fd) == channel);
+
+  PollState &state = pollStates_[fd];
+  if (state.armedEvents == static_cast<uint32_t>(channel->events())) {
+    return;
+  }
+  cancel(&state, fd);
+  arm(fd, &state);
+}
+
+void IoUringPoller::removeChannel(Channel *channel) {
+  Poller::assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd;
+  assert(channels_.find(fd) == channel);
+  assert(channel->isNoneEvent());
+  auto it = pollStates_.find(fd);
+  if (it != pollStates_.end()) {
+    cancel(&it->second, fd);
+    pollStates_.erase(it);
+  }
+  channels_.erase(fd);
+  channel->set_index(kNew);
+}
+
+bool IoUringPoller::submitFileIo(uint8_t opcode, int fd, void *buf,
+                                 size_t len, off_t offset,
+                                 const FileIoCallback &cb) {
+  Poller::assertInLoopThread();
+  struct io_uring_sqe *sqe = getSqe();
+  if (!sqe) {
+    return false;
+  }
+  uint32_t slot;
+  if (freeFileSlots_.empty()) {
+    slot = static_cast<uint32_t>(fileOps_.size());
+    fileOps_.push_back(cb);
+  } else {
+    slot = freeFileSlots_.back();
+    freeFileSlots_.pop_back();
+    fileOps_[slot] = cb;
+  }
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = static_cast<uint32_t>(len);
+  // offset为-1时内核使用文件的当前位置
+  sqe->off = static_cast<uint64_t>(offset);
+  sqe->user_data = (kFileKind << 62) | slot;
+  return true;
+}
+
+bool IoUringPoller::submitFileRead(int fd, void *buf, size_t len, off_t offset,
+                                   const FileIoCallback &cb) {
+  return submitFileIo(IORING_OP_READ, fd, buf, len, offset, cb);
+}
+
+bool IoUringPoller::submitFileWrite(int fd, const void *buf, size_t len,
+                                    off_t offset, const FileIoCallback &cb) {
+  return submitFileIo(IORING_OP_WRITE, fd, const_cast<void *>(buf), len,
+                      offset, cb);
+}
@@ -36,9 +36,8 @@ void PollPoller::fillActiveChannels(int numEvents,
        pfd != pollfds_.end() && numEvents > 0; ++pfd) {
     if (pfd->revents > 0) {
       --numEvents;
-      ChannelMap::const_iterator ch = channels_.find(pfd->fd);
-      assert(ch != channels_.end());
-      Channel *channel = ch->second;
+      Channel *channel = channels_.find(pfd->fd);
+      assert(channel);
       assert(channel->fd() == pfd->fd);
       channel->set_revents(pfd->revents);
       activeChannels->push_back(channel);
@@ -51,7 +50,7 @@ void PollPoller::updateChannel(Channel *channel) {
   LOG_TRACE << "fd = " << channel->fd() << " events = " << channel->events();
   if (channel->index() < 0) {
     // 新的Channel
-    assert(channels_.find(channel->fd()) == channels_.end());
+    assert(channels_.find(channel->fd()) == nullptr);
     struct pollfd pfd;
     pfd.fd = channel->fd();
     pfd.events = static_cast<short>(channel->events());
@@ -59,11 +58,10 @@ void PollPoller::updateChannel(Channel *channel) {
     pollfds_.push_back(pfd);
     int idx = static_cast<int>(pollfds_.size()) - 1;
     channel->set_index(idx);
-    channels_[pfd.fd] = channel;
+    channels_.add(pfd.fd, channel);
   } else {
     // 更新已有的Channel
-    assert(channels_.find(channel->fd()) != channels_.end());
-    assert(channels_[channel->fd()] == channel);
+    assert(channels_.find(channel->fd()) == channel);
     int idx = channel->index();
     assert(0 <= idx && idx < static_cast<int>(pollfds_.size()));
     struct pollfd &pfd = pollfds_[idx];
@@ -81,15 +79,16 @@ void PollPoller::updateChannel(Channel *channel) {
 void PollPoller::removeChannel(Channel *channel) {
   Poller::assertInLoopThread();
   LOG_TRACE << "fd = " << channel->fd();
-  assert(channels_.find(channel->fd()) != channels_.end());
-  assert(channels_[channel->fd()] == channel);
+  assert(channels_.find(channel->fd()) == channel);
   assert(channel->isNoneEvent());
   int idx = channel->index();
   assert(0 <= idx && idx < static_cast<int>(pollfds_.size()));
   const struct pollfd &pfd = pollfds_[idx];
   (void)pfd;
   assert(pfd.fd == -channel->fd() - 1 && pfd.events == channel->events());
-  assert(channels_.erase(channel->fd()) == 1);
+  size_t n = channels_.erase(channel->fd());
+  (void)n;
+  assert(n == 1);
   if (implicit_cast<size_t>(idx) == pollfds_.size() - 1) {
     pollfds_.pop_back();
   } else {
@@ -98,7 +97,7 @@ void PollPoller::removeChannel(Channel *channel) {
     if (channelAtEnd < 0) {
       channelAtEnd = -channelAtEnd - 1;
     }
-    channels_[channelAtEnd]->set_index(idx);
+    channels_.find(channelAtEnd)->set_index(idx);
     pollfds_.pop_back();
   }
 }
@@ -0,0 +1,19 @@
+#include "network/TimerQueue.hpp"
+#include "network/timer/TimingWheel.hpp"
+#include "network/timer/TreeTimerQueue.hpp"
+
+#include <stdlib.h>
+
+namespace flkeeper {
+namespace network {
+
+TimerQueue* TimerQueue::newDefaultTimerQueue(EventLoop* loop) {
+    if (::getenv("MYMUDUO_USE_TIMING_WHEEL")) {
+        return new TimingWheel(loop);
+    } else {
+        return new TreeTimerQueue(loop); // 默认使用std::set
+    }
+}
+
+} // namespace network
+} // namespace flkeeper
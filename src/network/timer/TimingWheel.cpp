@@ -0,0 +1,314 @@
+#include "network/timer/TimingWheel.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <string.h>
+
+#include "network/EventLoop.hpp"
+#include "network/Timer.hpp"
+#include "utils/log/Logging.hpp"
+
+namespace flkeeper {
+namespace network {
+
+namespace {
+const uint64_t kNoTick = UINT64_MAX;
+
+// 从第from位开始循环查找下一个置位的位, 返回与from的距离, 没有时返回-1
+int nextSetBit(const uint64_t *words, int nbits, int from) {
+  int nwords = nbits / 64;
+  int word = from / 64;
+  int bit = from % 64;
+  // from所在的字中高于from的部分
+  uint64_t w = words[word] & (~0ULL << bit);
+  if (w) {
+    return __builtin_ctzll(w) - bit;
+  }
+  // 之后的各个字, 最后回到from所在字中低于from的部分
+  for (int i = 1; i <= nwords; ++i) {
+    int idx = (word + i) % nwords;
+    w = words[idx];
+    if (i == nwords) {
+      w &= bit == 0 ? 0 : (~0ULL >> (64 - bit));
+    }
+    if (w) {
+      int pos = idx * 64 + __builtin_ctzll(w);
+      return (pos - from + nbits) % nbits;
+    }
+  }
+  return -1;
+}
+} // namespace
+
+TimingWheel::TimingWheel(EventLoop *loop)
+    : TimerQueue(loop), baseUs_(TimeStamp::now().microSecondsSinceEpoch()),
+      currentTick_(0), armedTick_(kNoTick), size_(0), handling_(false) {
+  memset(slots_, 0, sizeof slots_);
+  memset(occupied_, 0, sizeof occupied_);
+}
+
+TimingWheel::~TimingWheel() = default;
+
+TimerId TimingWheel::addTimer(TimerCallback cb, TimeStamp when,
+                              double interval) {
+  if (loop_->isInLoopThread()) {
+    Timer *timer = allocTimer(std::move(cb), when, interval);
+    addTimerInLoop(timer);
+    return TimerId(timer, timer->sequence());
+  }
+  // 空闲链表只在loop线程中访问, 其它线程新建一个定时器交给时间轮接管
+  Timer *timer = new Timer(std::move(cb), when, interval);
+  TimerId timerId(timer, timer->sequence());
+  loop_->runInLoop([this, timer]() {
+    nodes_.emplace_back(timer);
+    addTimerInLoop(timer);
+  });
+  return timerId;
+}
+
+void TimingWheel::cancel(TimerId timerId) {
+  if (loop_->isInLoopThread()) {
+    cancelInLoop(timerId);
+  } else {
+    loop_->runInLoop(std::bind(&TimingWheel::cancelInLoop, this, timerId));
+  }
+}
+
+Timer *TimingWheel::allocTimer(TimerCallback cb, TimeStamp when,
+                               DFLK_FP interval) {
+  Timer *timer;
+  if (freeList_.empty()) {
+    nodes_.emplace_back(new Timer);
+    timer = nodes_.back().get();
+  } else {
+    timer = freeList_.back();
+    freeList_.pop_back();
+  }
+  timer->reset(std::move(cb), when, interval);
+  return timer;
+}
+
+void TimingWheel::freeTimer(Timer *timer) {
+  timer->clear();
+  timer->wheelState_ = kFree;
+  freeList_.push_back(timer);
+}
+
+void TimingWheel::addTimerInLoop(Timer *timer) {
+  loop_->assertInLoopThread();
+  if (size_ == 0 && !handling_) {
+    // 时间轮为空时直接把刻度推进到当前时间, 避免长时间空闲后逐槽追赶
+    int64_t us = TimeStamp::now().microSecondsSinceEpoch() - baseUs_;
+    if (us > 0) {
+      currentTick_ = std::max(currentTick_, static_cast<uint64_t>(us / kTickUs));
+    }
+  }
+  timer->wheelState_ = kPending;
+  insert(timer);
+  // 处理到期定时器期间新增的定时器在处理结束后统一设置timerfd
+  uint64_t tick = std::max(tickOf(timer->expiration()), currentTick_);
+  if (!handling_ && tick < armedTick_) {
+    rearm(tick);
+  }
+}
+
+void TimingWheel::cancelInLoop(TimerId timerId) {
+  loop_->assertInLoopThread();
+  Timer *timer = timerOf(timerId);
+  // 定时器对象不会被释放, 序列号不一致说明已经到期或被复用
+  if (!timer || timer->sequence() != sequenceOf(timerId)) {
+    return;
+  }
+  if (timer->wheelState_ == kPending) {
+    unlink(timer);
+    freeTimer(timer);
+  } else if (timer->wheelState_ == kRunning) {
+    timer->wheelState_ = kCanceled;
+  }
+}
+
+uint64_t TimingWheel::tickOf(TimeStamp when) const {
+  int64_t us = when.microSecondsSinceEpoch() - baseUs_;
+  if (us <= 0) {
+    return 0;
+  }
+  // 向上取整, 定时器不会提前触发
+  return static_cast<uint64_t>((us + kTickUs - 1) / kTickUs);
+}
+
+TimeStamp TimingWheel::timeOfTick(uint64_t tick) const {
+  return TimeStamp(baseUs_ + static_cast<int64_t>(tick) * kTickUs);
+}
+
+void TimingWheel::insert(Timer *timer) {
+  uint64_t expire = std::max(tickOf(timer->expiration()), currentTick_);
+  uint64_t delta = expire - currentTick_;
+  int slot;
+  if (delta < static_cast<uint64_t>(kRootSize)) {
+    slot = static_cast<int>(expire & (kRootSize - 1));
+  } else {
+    int level = 1;
+    while (level < kNumLevels &&
+           delta >= (1ULL << (kRootBits + level * kLevelBits))) {
+      ++level;
+    }
+    uint64_t range = 1ULL << (kRootBits + kNumLevels * kLevelBits);
+    if (delta >= range) {
+      // 超出时间轮范围, 先放在最远的位置, 级联时会按真实到期时间重新放置
+      expire = currentTick_ + range - 1;
+    }
+    int shift = kRootBits + (level - 1) * kLevelBits;
+    slot = kRootSize + (level - 1) * kLevelSize +
+           static_cast<int>((expire >> shift) & (kLevelSize - 1));
+  }
+  link(timer, slot);
+}
+
+void TimingWheel::link(Timer *timer, int slot) {
+  timer->prev_ = nullptr;
+  timer->next_ = slots_[slot];
+  if (timer->next_) {
+    timer->next_->prev_ = timer;
+  }
+  slots_[slot] = timer;
+  timer->wheelSlot_ = slot;
+  occupied_[slot / 64] |= 1ULL << (slot % 64);
+  ++size_;
+}
+
+void TimingWheel::unlink(Timer *timer) {
+  int slot = timer->wheelSlot_;
+  assert(slot >= 0);
+  if (timer->prev_) {
+    timer->prev_->next_ = timer->next_;
+  } else {
+    slots_[slot] = timer->next_;
+  }
+  if (timer->next_) {
+    timer->next_->prev_ = timer->prev_;
+  }
+  if (!slots_[slot]) {
+    occupied_[slot / 64] &= ~(1ULL << (slot % 64));
+  }
+  timer->prev_ = timer->next_ = nullptr;
+  timer->wheelSlot_ = -1;
+  --size_;
+}
+
+void TimingWheel::cascade() {
+  // 第0层转完一圈, 把上一层当前槽位的定时器下放; 上一层也转完一圈时继续向上
+  for (int level = 1; level <= kNumLevels; ++level) {
+    int shift = kRootBits + (level - 1) * kLevelBits;
+    int index = static_cast<int>((currentTick_ >> shift) & (kLevelSize - 1));
+    int slot = kRootSize + (level - 1) * kLevelSize + index;
+    Timer *timer = slots_[slot];
+    while (timer) {
+      Timer *next = timer->next_;
+      unlink(timer);
+      insert(timer);
+      timer = next;
+    }
+    if (index != 0) {
+      break;
+    }
+  }
+}
+
+void TimingWheel::advance(uint64_t nowTick) {
+  while (currentTick_ <= nowTick) {
+    int index = static_cast<int>(currentTick_ & (kRootSize - 1));
+    if (index == 0) {
+      cascade();
+    }
+    if (size_ == 0) {
+      currentTick_ = nowTick + 1;
+      break;
+    }
+    if (!(occupied_[0] | occupied_[1] | occupied_[2] | occupied_[3])) {
+      // 第0层为空, 直接跳到下一次级联
+      uint64_t nextCascade = (currentTick_ | (kRootSize - 1)) + 1;
+      currentTick_ = std::min(nextCascade, nowTick + 1);
+      continue;
+    }
+    Timer *timer = slots_[index];
+    while (timer) {
+      Timer *next = timer->next_;
+      unlink(timer);
+      timer->wheelState_ = kRunning;
+      expired_.push_back(timer);
+      timer = next;
+    }
+    ++currentTick_;
+  }
+}
+
+uint64_t TimingWheel::nextWakeupTick() const {
+  if (size_ == 0) {
+    return kNoTick;
+  }
+  uint64_t best = kNoTick;
+  // 第0层的槽位就是到期刻度
+  int index = static_cast<int>(currentTick_ & (kRootSize - 1));
+  int offset = nextSetBit(occupied_, kRootSize, index);
+  if (offset >= 0) {
+    best = currentTick_ + static_cast<uint64_t>(offset);
+  }
+  // 更高层只知道槽位, 在该槽位级联的时刻唤醒
+  for (int level = 1; level <= kNumLevels; ++level) {
+    int shift = kRootBits + (level - 1) * kLevelBits;
+    int cur = static_cast<int>((currentTick_ >> shift) & (kLevelSize - 1));
+    uint64_t word = occupied_[(kRootSize + (level - 1) * kLevelSize) / 64];
+    if (!word) {
+      continue;
+    }
+    uint64_t base = currentTick_ >> shift << shift;
+    uint64_t steps =
+        static_cast<uint64_t>(nextSetBit(&word, kLevelSize, cur));
+    // currentTick_正好在级联点上时当前槽位还没有级联, 否则要等转完一圈
+    if (steps == 0 && base != currentTick_) {
+      steps = kLevelSize;
+    }
+    best = std::min(best, base + (steps << shift));
+  }
+  return best;
+}
+
+void TimingWheel::rearm(uint64_t tick) {
+  if (tick == kNoTick || tick == armedTick_) {
+    return;
+  }
+  armedTick_ = tick;
+  resetTimerfd(timeOfTick(tick));
+}
+
+void TimingWheel::handleExpired(TimeStamp now) {
+  armedTick_ = kNoTick;
+  int64_t us = now.microSecondsSinceEpoch() - baseUs_;
+  uint64_t nowTick = us > 0 ? static_cast<uint64_t>(us / kTickUs) : 0;
+  advance(nowTick);
+
+  handling_ = true;
+  // 回调中可能取消本轮尚未执行的定时器
+  for (Timer *timer : expired_) {
+    if (timer->wheelState_ == kRunning) {
+      timer->run();
+    }
+  }
+  handling_ = false;
+
+  for (Timer *timer : expired_) {
+    if (timer->wheelState_ == kRunning && timer->repeat()) {
+      timer->restart(now);
+      timer->wheelState_ = kPending;
+      insert(timer);
+    } else {
+      freeTimer(timer);
+    }
+  }
+  expired_.clear();
+
+  rearm(nextWakeupTick());
+}
+
+} // namespace network
+} // namespace flkeeper
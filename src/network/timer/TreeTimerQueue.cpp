@@ -0,0 +1,146 @@
+#include "network/timer/TreeTimerQueue.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <iterator>
+#include <stdint.h>
+
+#include "network/EventLoop.hpp"
+#include "network/Timer.hpp"
+#include "network/TimerId.hpp"
+#include "utils/log/Logging.hpp"
+
+namespace flkeeper {
+namespace network {
+
+TreeTimerQueue::TreeTimerQueue(EventLoop *loop)
+    : TimerQueue(loop), timers_(), callingExpiredTimers_(false) {}
+
+TreeTimerQueue::~TreeTimerQueue() {
+  for (const Entry &timer : timers_) {
+    delete timer.second;
+  }
+}
+
+TimerId TreeTimerQueue::addTimer(TimerCallback cb, TimeStamp when,
+                                 double interval) {
+  Timer *timer = new Timer(std::move(cb), when, interval);
+  loop_->runInLoop(std::bind(&TreeTimerQueue::addTimerInLoop, this, timer));
+  return TimerId(timer, timer->sequence());
+}
+
+void TreeTimerQueue::cancel(TimerId timerId) {
+  loop_->runInLoop(std::bind(&TreeTimerQueue::cancelInLoop, this, timerId));
+}
+
+void TreeTimerQueue::addTimerInLoop(Timer *timer) {
+  loop_->assertInLoopThread();
+  bool earliestChanged = insert(timer);
+
+  if (earliestChanged) {
+    resetTimerfd(timer->expiration());
+  }
+}
+
+void TreeTimerQueue::cancelInLoop(TimerId timerId) {
+  loop_->assertInLoopThread();
+  assert(timers_.size() == activeTimers_.size());
+  ActiveTimer timer(timerOf(timerId), sequenceOf(timerId));
+  ActiveTimerSet::iterator it = activeTimers_.find(timer);
+  if (it != activeTimers_.end()) {
+    size_t n = timers_.erase(Entry(it->first->expiration(), it->first));
+    assert(n == 1);
+    (void)n;
+    delete it->first;
+    activeTimers_.erase(it);
+  } else if (callingExpiredTimers_) {
+    cancelingTimers_.insert(timer);
+  }
+  assert(timers_.size() == activeTimers_.size());
+}
+
+void TreeTimerQueue::handleExpired(TimeStamp now) {
+  std::vector<Entry> expired = getExpired(now);
+
+  callingExpiredTimers_ = true;
+  cancelingTimers_.clear();
+  // 安全的调用用户回调
+  for (const Entry &it : expired) {
+    it.second->run();
+  }
+  callingExpiredTimers_ = false;
+
+  reset(expired, now);
+}
+
+std::vector<TreeTimerQueue::Entry> TreeTimerQueue::getExpired(TimeStamp now) {
+  assert(timers_.size() == activeTimers_.size());
+  std::vector<Entry> expired;
+  Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
+  TimerList::iterator end = timers_.lower_bound(sentry);
+  assert(end == timers_.end() || now < end->first);
+  std::copy(timers_.begin(), end, back_inserter(expired));
+  timers_.erase(timers_.begin(), end);
+
+  for (const Entry &it : expired) {
+    ActiveTimer timer(it.second, it.second->sequence());
+    size_t n = activeTimers_.erase(timer);
+    assert(n == 1);
+    (void)n;
+  }
+
+  assert(timers_.size() == activeTimers_.size());
+  return expired;
+}
+
+void TreeTimerQueue::reset(const std::vector<Entry> &expired, TimeStamp now) {
+  TimeStamp nextExpire;
+
+  for (const Entry &it : expired) {
+    ActiveTimer timer(it.second, it.second->sequence());
+    if (it.second->repeat() &&
+        cancelingTimers_.find(timer) == cancelingTimers_.end()) {
+      it.second->restart(now);
+      insert(it.second);
+    } else {
+      delete it.second;
+    }
+  }
+
+  if (!timers_.empty()) {
+    nextExpire = timers_.begin()->second->expiration();
+  }
+
+  if (nextExpire.microSecondsSinceEpoch() > 0) { // 检查时间戳是否有效
+    resetTimerfd(nextExpire);
+  }
+}
+
+bool TreeTimerQueue::insert(Timer *timer) {
+  loop_->assertInLoopThread();
+  assert(timers_.size() == activeTimers_.size());
+  bool earliestChanged = false;
+  TimeStamp when = timer->expiration();
+  TimerList::iterator it = timers_.begin();
+  if (it == timers_.end() || when < it->first) {
+    earliestChanged = true;
+  }
+  {
+    std::pair<TimerList::iterator, bool> result =
+        timers_.insert(Entry(when, timer));
+    assert(result.second);
+    (void)result;
+  }
+  {
+    std::pair<ActiveTimerSet::iterator, bool> result =
+        activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    assert(result.second);
+    (void)result;
+  }
+
+  assert(timers_.size() == activeTimers_.size());
+  return earliestChanged;
+}
+
+} // namespace network
+} // namespace flkeeper
@@ -43,7 +43,7 @@ TimeStamp TimeStamp::now() {
   struct timeval tv;
   gettimeofday(&tv, nullptr);
   DFLK_INT64 seconds = tv.tv_sec;
-  return TimeStamp(seconds & kMicroSecondsPerSec + tv.tv_usec);
+  return TimeStamp(seconds * kMicroSecondsPerSec + tv.tv_usec);
 }
 
 void TimeStamp::add(DFLK_FP sec) {
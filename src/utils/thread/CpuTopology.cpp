@@ -0,0 +1,162 @@
+#include "utils/thread/CpuTopology.hpp"
+#include "utils/FileUtil.hpp"
+#include "utils/log/Logging.hpp"
+
+#include <errno.h>
+#include <map>
+#include <pthread.h>
+#include <sched.h>
+#include <set>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+
+namespace flkeeper::thread {
+
+namespace {
+const char *kSysCpuDir = "/sys/devices/system/cpu/cpu";
+const char *kSysNodeDir = "/sys/devices/system/node/";
+
+// 读取sysfs中的小文件, 失败时返回空串
+std::string readSysFile(const std::string &path) {
+  ReadSmallFile file(path);
+  std::string content;
+  // readToString会写入全部输出参数
+  DFLK_INT64 fileSize, modifyTime, createTime;
+  if (file.readToString(4096, &content, &fileSize, &modifyTime, &createTime) !=
+      0) {
+    content.clear();
+  }
+  return content;
+}
+
+// 解析"0-3,8-11"格式的CPU(或节点)列表
+std::vector<int> parseList(const std::string &list) {
+  std::vector<int> result;
+  const char *p = list.c_str();
+  while (*p) {
+    char *end;
+    long first = ::strtol(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = ::strtol(p + 1, &end, 10);
+      p = end;
+    }
+    for (long i = first; i <= last; ++i) {
+      result.push_back(static_cast<int>(i));
+    }
+    if (*p == ',') {
+      ++p;
+    } else {
+      break;
+    }
+  }
+  return result;
+}
+
+// 读取topology下的整数属性, 不存在时返回defaultValue
+int readTopologyId(int cpu, const char *name, int defaultValue) {
+  std::string content = readSysFile(std::string(kSysCpuDir) +
+                                    std::to_string(cpu) + "/topology/" + name);
+  return content.empty() ? defaultValue : ::atoi(content.c_str());
+}
+} // namespace
+
+const CpuTopology &CpuTopology::instance() {
+  static CpuTopology topology;
+  return topology;
+}
+
+CpuTopology::CpuTopology() : numCores_(0) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (::sched_getaffinity(0, sizeof set, &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus_.push_back(cpu);
+      }
+    }
+  }
+  if (cpus_.empty()) {
+    long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < (n > 0 ? n : 1); ++cpu) {
+      cpus_.push_back(static_cast<int>(cpu));
+    }
+  }
+
+  // 每个CPU所在的NUMA节点, 没有NUMA信息时都归到节点0
+  std::map<int, int> nodeOfCpu;
+  for (int node : parseList(readSysFile(std::string(kSysNodeDir) + "online"))) {
+    std::string path = std::string(kSysNodeDir) + "node" +
+                       std::to_string(node) + "/cpulist";
+    for (int cpu : parseList(readSysFile(path))) {
+      nodeOfCpu[cpu] = node;
+    }
+  }
+
+  // 按节点分组, 同一物理核的第一个超线程排在其余超线程之前
+  std::map<int, std::pair<std::vector<int>, std::vector<int>>> byNode;
+  std::set<std::pair<int, int>> cores;
+  for (int cpu : cpus_) {
+    auto it = nodeOfCpu.find(cpu);
+    int node = it == nodeOfCpu.end() ? 0 : it->second;
+    std::pair<int, int> core(readTopologyId(cpu, "physical_package_id", 0),
+                             readTopologyId(cpu, "core_id", cpu));
+    if (cores.insert(core).second) {
+      byNode[node].first.push_back(cpu);
+    } else {
+      byNode[node].second.push_back(cpu);
+    }
+  }
+  numCores_ = static_cast<int>(cores.size());
+
+  for (const auto &item : byNode) {
+    std::vector<int> cpus(item.second.first);
+    cpus.insert(cpus.end(), item.second.second.begin(),
+                item.second.second.end());
+    nodes_.push_back(cpus);
+  }
+
+  // 先在各节点之间轮流放到物理核上, 物理核用完后再轮流使用超线程
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0;; ++i) {
+      bool placed = false;
+      for (const auto &item : byNode) {
+        const std::vector<int> &cpus =
+            pass == 0 ? item.second.first : item.second.second;
+        if (i < cpus.size()) {
+          placement_.push_back(cpus[i]);
+          placed = true;
+        }
+      }
+      if (!placed) {
+        break;
+      }
+    }
+  }
+
+  LOG_INFO << "CpuTopology: " << numCpus() << " cpus, " << numCores_
+           << " cores, " << numNodes() << " nodes";
+}
+
+bool CpuTopology::pinThread(pthread_t thread, const std::vector<int> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  int err = ::pthread_setaffinity_np(thread, sizeof set, &set);
+  if (err != 0) {
+    errno = err;
+    LOG_SYSERR << "CpuTopology::pinThread";
+    return false;
+  }
+  return true;
+}
+
+} // namespace flkeeper::thread
@@ -1,4 +1,5 @@
 #include "utils/thread/Thread.hpp"
+#include "utils/thread/CpuTopology.hpp"
 #include "utils/thread/CurrentThread.hpp"
 #include "utils/FKException.hpp"
 #include "utils/log/Logging.hpp"
@@ -22,15 +23,18 @@ struct ThreadData
     typedef Thread::ThreadFunc ThreadFunc;
     ThreadFunc func_;        // 线程函数
     std::string name_;           // 线程名称
+    std::vector<int> cpus_;      // 绑定的CPU
     pid_t* tid_;           // 线程ID指针
     CountDownLatch* latch_; // 用于确保线程安全启动的门闩
 
     ThreadData(ThreadFunc func,
               const std::string& name,
+              const std::vector<int>& cpus,
               pid_t* tid,
               CountDownLatch* latch)
         : func_(std::move(func)),
           name_(name),
+          cpus_(cpus),
           tid_(tid),
           latch_(latch)
     { }
@@ -48,6 +52,10 @@ struct ThreadData
 
         setName(name_.empty() ? "flkeeperThread" : name_.c_str());
         ::prctl(PR_SET_NAME, name());
+        if (!cpus_.empty())
+        {
+            CpuTopology::pinCurrentThread(cpus_);
+        }
 
         try
         {
@@ -130,7 +138,7 @@ void Thread::start()
     started_ = true;
 
     // 创建线程数据
-    ThreadData* data = new ThreadData(func_, name_, &tid_, &latch_);
+    ThreadData* data = new ThreadData(func_, name_, cpus_, &tid_, &latch_);
 
     // 创建线程
     if (pthread_create(&pthreadId_, NULL, &startThread, data))
@@ -147,6 +155,15 @@ void Thread::start()
     }
 }
 
+void Thread::setCpuAffinity(const std::vector<int>& cpus)
+{
+    cpus_ = cpus;
+    if (started_ && !joined_ && !cpus_.empty())
+    {
+        CpuTopology::pinThread(pthreadId_, cpus_);
+    }
+}
+
 void Thread::join()
 {
     assert(started_);
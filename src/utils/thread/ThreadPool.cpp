@@ -1,5 +1,9 @@
 #include "utils/thread/ThreadPool.hpp"
 #include "utils/FKException.hpp"
+#include "utils/thread/CpuTopology.hpp"
+#include "utils/thread/CurrentThread.hpp"
+
+#include <algorithm>
 
 namespace flkeeper {
 
@@ -7,7 +11,8 @@ namespace thread {
 
 ThreadPool::ThreadPool(const string &name)
     : name_(name), mutex_(), notEmpty_(mutex_), notFull_(mutex_),
-      running_(false), maxQueueSize_(0), threadSize_(0) {}
+      running_(false), maxQueueSize_(0), threadSize_(0), retiring_(0),
+      pinThreads_(false), spawned_(0) {}
 
 ThreadPool::~ThreadPool() {
   if(running_) {
@@ -19,21 +24,16 @@ void ThreadPool::start(int numThreads) {
   assert(!running_);
   running_ = true;
 
+  if(numThreads == kAutoThreads) {
+    numThreads = CpuTopology::instance().recommendedWorkerThreads();
+  }
   threadSize_ = numThreads;
 
   // 创建线程
+  PMutexLockGuard lock(mutex_);
   threads_.reserve(threadSize_);
   for(int i=0;i<threadSize_;++i) {
-    char id[32];
-    snprintf(id, sizeof(id), "%d", i+1);
-    threads_.emplace_back(
-        new Thread(std::bind(&ThreadPool::runInThread, this), name_ + id));
-    threads_[i]->start();
-  }
-
-  // 单线程模式，启动一个线程执行任务
-  if(threadSize_ == 0 && !threads_.empty()) {
-    threads_[0]->start();
+    spawnThread();
   }
 }
 
@@ -48,6 +48,82 @@ void ThreadPool::stop() {
   for(auto &thr : threads_) {
     thr->join();
   }
+  threads_.clear();
+  retired_.clear();
+  retiring_ = 0;
+}
+
+void ThreadPool::resize(int numThreads) {
+  if(numThreads == kAutoThreads) {
+    numThreads = CpuTopology::instance().recommendedWorkerThreads();
+  }
+  assert(numThreads >= 0);
+
+  PMutexLockGuard lock(mutex_);
+  if(!running_) {
+    threadSize_ = numThreads;
+    return;
+  }
+  reapRetired();
+
+  int delta = numThreads - threadSize_;
+  if(delta > 0) {
+    // 优先撤销还没有退出的线程, 不够时再创建新线程
+    int kept = std::min(delta, retiring_);
+    retiring_ -= kept;
+    for(int i=kept;i<delta;++i) {
+      spawnThread();
+    }
+  } else if(delta < 0) {
+    retiring_ -= delta;
+    notEmpty_.notifyAll();
+  }
+  threadSize_ = numThreads;
+}
+
+void ThreadPool::setCpuAffinity(bool on) {
+  PMutexLockGuard lock(mutex_);
+  pinThreads_ = on;
+  // 已经退出的线程不再绑定; 与spawnThread一样按在threads_中的位置选择节点
+  reapRetired();
+  const CpuTopology &topology = CpuTopology::instance();
+  for(size_t i=0;i<threads_.size();++i) {
+    threads_[i]->setCpuAffinity(on ? topology.nodeCpusForThread(static_cast<int>(i))
+                                   : topology.cpus());
+  }
+}
+
+int ThreadPool::numThreads() const {
+  PMutexLockGuard lock(mutex_);
+  return threadSize_;
+}
+
+void ThreadPool::spawnThread() {
+  char id[32];
+  snprintf(id, sizeof(id), "%d", ++spawned_);
+  std::unique_ptr<Thread> thr(
+      new Thread(std::bind(&ThreadPool::runInThread, this), name_ + id));
+  if(pinThreads_) {
+    thr->setCpuAffinity(CpuTopology::instance().nodeCpusForThread(
+        static_cast<int>(threads_.size())));
+  }
+  thr->start();
+  threads_.push_back(std::move(thr));
+}
+
+void ThreadPool::reapRetired() {
+  // 退出的线程在登记之后不再访问线程池, 持锁join不会死锁
+  for(pid_t tid : retired_) {
+    auto it = std::find_if(threads_.begin(), threads_.end(),
+                           [tid](const std::unique_ptr<Thread> &thr) {
+                             return thr->tid() == tid;
+                           });
+    if(it != threads_.end()) {
+      (*it)->join();
+      threads_.erase(it);
+    }
+  }
+  retired_.clear();
 }
 
 size_t ThreadPool::queeuSize() const {
@@ -56,29 +132,40 @@ size_t ThreadPool::queeuSize() const {
 }
 
 void ThreadPool::run(Task task) {
-  if(threads_.empty()) {
-    task();
-  } else {
+  {
     PMutexLockGuard lock(mutex_);
-    while(isFull() && running_) {
-      notFull_.wait();
-    }
+    if(threadSize_ > 0) {
+      while(isFull() && running_) {
+        notFull_.wait();
+      }
 
-    if(!running_) return;
-    assert(!isFull());
+      if(!running_) return;
+      assert(!isFull());
 
-    queue_.push_back(std::move(task));
-    notEmpty_.notifyOne();
+      queue_.push_back(std::move(task));
+      notEmpty_.notifyOne();
+      return;
+    }
   }
+  // 没有工作线程时在调用线程中直接执行
+  task();
 }
 
-ThreadPool::Task ThreadPool::take() {
+ThreadPool::Task ThreadPool::take(bool *retire) {
   PMutexLockGuard lock(mutex_);
   // 等待任务队列非空
-  while(queue_.empty() && running_) {
+  while(queue_.empty() && running_ && retiring_ == 0) {
     notEmpty_.wait();
   }
 
+  // 缩减线程数时, 如果已经没有剩下的线程, 先把队列中的任务执行完再退出
+  if(retiring_ > 0 && (queue_.empty() || threadSize_ > 0)) {
+    --retiring_;
+    retired_.push_back(tid());
+    *retire = true;
+    return Task();
+  }
+
   Task task;
   if(!queue_.empty()) {
     task = queue_.front();
@@ -94,28 +181,17 @@ void ThreadPool::runInThread()
 {
     try
     {
-        if (threadSize_ == 0)
+        while (running_)
         {
-            // 单线程模式
-            while (running_)
+            bool retire = false;
+            Task task(take(&retire));
+            if (retire)
             {
-                Task task(take());
-                if (task)
-                {
-                    task();
-                }
+                break;
             }
-        }
-        else
-        {
-            // 多线程模式
-            while (running_)
+            if (task)
             {
-                Task task(take());
-                if (task)
-                {
-                    task();
-                }
+                task();
             }
         }
     }